@@ -0,0 +1,776 @@
+#include "AllocationTracker.h"
+#include "CpuDispatch.h"
+#include "GroupNode.h"
+#include "ImageNode.h"
+#include "MemoryBudget.h"
+#include "NodeGraph.h"
+#include "ProcessingNodes.h"
+#include <benchmark/benchmark.h>
+#include <QApplication>
+#include <sys/resource.h>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+// Usage:
+//   NodeBenchmarks --benchmark_out=results.json --benchmark_out_format=json
+// Each result carries MP/s, allocations per iteration and peak RSS; the JSON
+// context records the commit so runs can be diffed across revisions.
+
+namespace {
+
+std::atomic<size_t> g_heapAllocations{0};
+
+struct Resolution {
+    const char* label;
+    int width;
+    int height;
+};
+
+const Resolution kResolutions[] = {
+    {"1MP", 1000, 1000},
+    {"12MP", 4000, 3000},
+    {"50MP", 8192, 6144}
+};
+
+const std::vector<int64_t> kResolutionArgs = {0, 1, 2};
+const std::vector<int64_t> kChannelArgs = {1, 3, 4};
+
+// Feeds a fixed image into the node under test
+class MatSourceNode : public Node {
+public:
+    explicit MatSourceNode(const cv::Mat& image) {
+        m_outputData.push_back(std::make_shared<cv::Mat>(image));
+    }
+
+    void process() override {}
+    std::string name() const override { return "Benchmark Source"; }
+    const std::vector<Port>& getPorts() const override {
+        static const std::vector<Port> ports = {
+            {0, "Output", PortType::Output, DataType::Image}
+        };
+        return ports;
+    }
+};
+
+// Generating 50 MP of noise is slow, so keep the last input around
+const cv::Mat& benchmarkInput(int resolution, int channels, int seed = 0) {
+    static cv::Mat cached;
+    static int cachedKey = -1;
+    int key = (resolution * 8 + channels) * 4 + seed;
+    if (key != cachedKey) {
+        const Resolution& res = kResolutions[resolution];
+        cached.release();
+        cached.create(res.height, res.width, CV_8UC(channels));
+        cv::RNG rng(0x5eed + seed);
+        rng.fill(cached, cv::RNG::UNIFORM, 0, 256);
+        cachedKey = key;
+    }
+    return cached;
+}
+
+struct Counters {
+    size_t heapAllocations;
+    AllocationTracker::Snapshot mats;
+};
+
+Counters readCounters() {
+    return {g_heapAllocations.load(std::memory_order_relaxed), AllocationTracker::instance().snapshot()};
+}
+
+double peakRssMegabytes() {
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss / 1024.0; // ru_maxrss is in KiB on Linux
+}
+
+void reportCounters(benchmark::State& state, double megapixels, const Counters& before) {
+    Counters after = readCounters();
+    const double iterations = static_cast<double>(state.iterations());
+    state.counters["MP/s"] = benchmark::Counter(megapixels * iterations, benchmark::Counter::kIsRate);
+    state.counters["allocs/iter"] = iterations > 0
+        ? (after.heapAllocations - before.heapAllocations + after.mats.allocations - before.mats.allocations) / iterations
+        : 0.0;
+    state.counters["matMB/iter"] = iterations > 0
+        ? (after.mats.bytesAllocated - before.mats.bytesAllocated) / iterations / (1024.0 * 1024.0)
+        : 0.0;
+    state.counters["peakRSS_MB"] = peakRssMegabytes();
+}
+
+std::string imageLabel(int resolution, int channels) {
+    return std::string(kResolutions[resolution].label) + " " + std::to_string(channels) + "ch";
+}
+
+// Runs a single-input node against one generated image.
+// Arguments: resolution index, channel count, then node-specific modes.
+template <typename NodeT, typename Configure>
+void runFilterNode(benchmark::State& state, Configure configure) {
+    const int resolution = static_cast<int>(state.range(0));
+    const int channels = static_cast<int>(state.range(1));
+    const cv::Mat& input = benchmarkInput(resolution, channels);
+
+    MatSourceNode source(input);
+    NodeT node;
+    node.addInputConnection(&source, 0, 0);
+    state.SetLabel(imageLabel(resolution, channels) + " " + configure(node, state));
+
+    Counters before = readCounters();
+    for (auto _ : state) {
+        node.process();
+    }
+    reportCounters(state, input.total() / 1e6, before);
+}
+
+} // namespace
+
+void* operator new(std::size_t size) {
+    g_heapAllocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+    std::free(p);
+}
+
+static void BM_BrightnessContrast(benchmark::State& state) {
+    runFilterNode<BrightnessContrastNode>(state, [](BrightnessContrastNode& node, benchmark::State&) {
+        node.setBrightness(20);
+        node.setContrast(1.2f);
+        return std::string("b=20 c=1.2");
+    });
+}
+BENCHMARK(BM_BrightnessContrast)
+    ->ArgsProduct({kResolutionArgs, kChannelArgs})
+    ->Unit(benchmark::kMillisecond)->UseRealTime();
+
+static void BM_Blur(benchmark::State& state) {
+    runFilterNode<BlurNode>(state, [](BlurNode& node, benchmark::State& s) {
+        node.setRadius(static_cast<int>(s.range(2)));
+        return "radius=" + std::to_string(s.range(2));
+    });
+}
+BENCHMARK(BM_Blur)
+    ->ArgsProduct({kResolutionArgs, kChannelArgs, {5, 15}})
+    ->Unit(benchmark::kMillisecond)->UseRealTime();
+
+static void BM_Threshold(benchmark::State& state) {
+    static const char* modes[] = {"t=127", "Otsu", "Triangle", "AdaptiveMean r=15", "Sauvola r=15"};
+    runFilterNode<ThresholdNode>(state, [](ThresholdNode& node, benchmark::State& s) {
+        node.setThreshold(127);
+        node.setMode(static_cast<int>(s.range(2)));
+        return std::string(modes[s.range(2)]);
+    });
+}
+BENCHMARK(BM_Threshold)
+    ->ArgsProduct({kResolutionArgs, kChannelArgs, {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10}})
+    ->Unit(benchmark::kMillisecond)->UseRealTime();
+
+static void BM_EdgeDetection(benchmark::State& state) {
+    runFilterNode<EdgeDetectionNode>(state, [](EdgeDetectionNode& node, benchmark::State& s) {
+        node.setMethod(static_cast<int>(s.range(2)));
+        return std::string(s.range(2) == 0 ? "Sobel" : "Canny");
+    });
+}
+BENCHMARK(BM_EdgeDetection)
+    ->ArgsProduct({kResolutionArgs, kChannelArgs, {0, 1}})
+    ->Unit(benchmark::kMillisecond)->UseRealTime();
+
+// sRGB input converted to each other space; Linear is 16-bit
+static void BM_ColorSpace(benchmark::State& state) {
+    runFilterNode<ColorSpaceNode>(state, [](ColorSpaceNode& node, benchmark::State& s) {
+        node.setSpace(static_cast<int>(s.range(2)));
+        return std::string("to ") + colorSpaceName(node.space());
+    });
+}
+BENCHMARK(BM_ColorSpace)
+    ->ArgsProduct({kResolutionArgs, kChannelArgs, {1, 2, 3, 4}})
+    ->Unit(benchmark::kMillisecond)->UseRealTime();
+
+static void BM_ChannelSplitter(benchmark::State& state) {
+    runFilterNode<ColorChannelSplitterNode>(state, [](ColorChannelSplitterNode& node, benchmark::State& s) {
+        node.setOutputGrayscale(s.range(2) != 0);
+        return std::string(s.range(2) != 0 ? "grayscale" : "tinted");
+    });
+}
+BENCHMARK(BM_ChannelSplitter)
+    ->ArgsProduct({kResolutionArgs, kChannelArgs, {0, 1}})
+    ->Unit(benchmark::kMillisecond)->UseRealTime();
+
+static void BM_ConvolutionFilter(benchmark::State& state) {
+    static const char* presets[] = {"Identity", "Sharpen", "Edge", "Emboss", "BoxBlur"};
+    runFilterNode<ConvolutionFilterNode>(state, [](ConvolutionFilterNode& node, benchmark::State& s) {
+        node.setKernelSize(static_cast<int>(s.range(3)));
+        node.setPreset(static_cast<int>(s.range(2)));
+        return std::string(presets[s.range(2)]) + " " + std::to_string(s.range(3)) + "x" + std::to_string(s.range(3));
+    });
+}
+BENCHMARK(BM_ConvolutionFilter)
+    ->ArgsProduct({kResolutionArgs, kChannelArgs, {0, 1, 2, 3, 4}, {3, 5}})
+    ->Unit(benchmark::kMillisecond)->UseRealTime();
+
+// Masks are single channel; time per pixel should stay flat as the radius grows
+static void BM_Morphology(benchmark::State& state) {
+    static const char* shapes[] = {"rect", "hline", "vline", "ellipse"};
+    runFilterNode<MorphologyNode>(state, [](MorphologyNode& node, benchmark::State& s) {
+        node.setOperation(MorphologyNode::Open);
+        node.setShape(static_cast<int>(s.range(2)));
+        node.setRadius(static_cast<int>(s.range(3)));
+        return std::string("open ") + shapes[s.range(2)] + " radius=" + std::to_string(s.range(3));
+    });
+}
+BENCHMARK(BM_Morphology)
+    ->ArgsProduct({kResolutionArgs, {1}, {0, 1}, {1, 7, 50}})
+    ->Unit(benchmark::kMillisecond)->UseRealTime();
+
+static void BM_Median(benchmark::State& state) {
+    runFilterNode<MedianNode>(state, [](MedianNode& node, benchmark::State& s) {
+        node.setRadius(static_cast<int>(s.range(2)));
+        return "radius=" + std::to_string(s.range(2));
+    });
+}
+BENCHMARK(BM_Median)
+    ->ArgsProduct({kResolutionArgs, {1, 3}, {1, 5, 20}})
+    ->Unit(benchmark::kMillisecond)->UseRealTime();
+
+// Every statistic comes from a single histogram pass
+static void BM_Statistics(benchmark::State& state) {
+    runFilterNode<StatisticsNode>(state, [](StatisticsNode& node, benchmark::State& s) {
+        node.setChannel(static_cast<int>(s.range(2)));
+        return std::string(s.range(2) == StatisticsNode::Luma ? "luma" : "all channels");
+    });
+}
+BENCHMARK(BM_Statistics)
+    ->ArgsProduct({kResolutionArgs, kChannelArgs, {StatisticsNode::Luma, StatisticsNode::AllChannels}})
+    ->Unit(benchmark::kMillisecond)->UseRealTime();
+
+// Later iterations reuse the warp's remap tables
+static void BM_Warp(benchmark::State& state) {
+    static const char* kinds[] = {"rotate", "perspective"};
+    static const char* filters[] = {"nearest", "bilinear", "bicubic"};
+    runFilterNode<WarpNode>(state, [](WarpNode& node, benchmark::State& s) {
+        node.setAngle(15.0f);
+        node.setTilt(0.0f, s.range(2) != 0 ? 5e-5f : 0.0f);
+        node.setInterpolation(static_cast<int>(s.range(3)));
+        return std::string(kinds[s.range(2)]) + " " + filters[s.range(3)];
+    });
+}
+BENCHMARK(BM_Warp)
+    ->ArgsProduct({kResolutionArgs, {3, 4}, {0, 1}, {1, 2}})
+    ->Unit(benchmark::kMillisecond)->UseRealTime();
+
+static void BM_Resize(benchmark::State& state) {
+    runFilterNode<ResizeNode>(state, [](ResizeNode& node, benchmark::State& s) {
+        node.setScale(s.range(2) / 100.0f);
+        return "scale=" + std::to_string(s.range(2)) + "%";
+    });
+}
+BENCHMARK(BM_Resize)
+    ->ArgsProduct({kResolutionArgs, {3}, {25, 150}})
+    ->Unit(benchmark::kMillisecond)->UseRealTime();
+
+static void BM_Blend(benchmark::State& state) {
+    static const char* modes[] = {"Normal", "Multiply", "Screen", "Overlay", "Difference", "Add",
+                                  "Subtract", "Darken", "Lighten", "SoftLight", "HardLight"};
+    const int resolution = static_cast<int>(state.range(0));
+    const int channels = static_cast<int>(state.range(1));
+    const int mode = static_cast<int>(state.range(2));
+
+    // Both inputs share the cached image; blending with itself costs the same
+    const cv::Mat& input = benchmarkInput(resolution, channels);
+    MatSourceNode base(input);
+    MatSourceNode layer(input);
+    BlendNode node;
+    node.addInputConnection(&base, 0, 0);
+    node.addInputConnection(&layer, 0, 1);
+    node.setBlendMode(mode);
+    node.setOpacity(0.5f);
+    state.SetLabel(imageLabel(resolution, channels) + " " + modes[mode]);
+
+    Counters before = readCounters();
+    for (auto _ : state) {
+        node.process();
+    }
+    reportCounters(state, input.total() / 1e6, before);
+}
+BENCHMARK(BM_Blend)
+    ->ArgsProduct({kResolutionArgs, kChannelArgs, {0, 1, 2, 3, 4}})
+    ->Unit(benchmark::kMillisecond)->UseRealTime();
+
+// Layer stacks of 2, 5 and 10 inputs on 3-channel images, alternating modes, every other layer masked
+static void BM_Composite(benchmark::State& state) {
+    const int resolution = static_cast<int>(state.range(0));
+    const int layerCount = static_cast<int>(state.range(1));
+    const cv::Mat& input = benchmarkInput(resolution, 3);
+    cv::Mat mask;
+    cv::extractChannel(input, mask, 0);
+
+    MatSourceNode image(input);
+    MatSourceNode maskSource(mask);
+    CompositeNode node;
+    node.setLayerCount(layerCount);
+    const BlendMode modes[] = {BlendMode::Normal, BlendMode::Multiply, BlendMode::Screen, BlendMode::Overlay};
+    for (int i = 0; i < layerCount; ++i) {
+        node.addInputConnection(&image, 0, 1 + 2 * i);
+        if (i > 0) {
+            node.setLayerMode(i, modes[i % 4]);
+            node.setLayerOpacity(i, 0.5f);
+            if (i % 2 == 0) {
+                node.addInputConnection(&maskSource, 0, 2 + 2 * i);
+            }
+        }
+    }
+    state.SetLabel(imageLabel(resolution, 3) + " " + std::to_string(layerCount) + " layers");
+
+    Counters before = readCounters();
+    for (auto _ : state) {
+        node.process();
+    }
+    reportCounters(state, input.total() / 1e6, before);
+}
+BENCHMARK(BM_Composite)
+    ->ArgsProduct({kResolutionArgs, {2, 5, 10}})
+    ->Unit(benchmark::kMillisecond)->UseRealTime();
+
+// The noise generator has a fixed 512x512 output and no input
+static void BM_NoiseGeneration(benchmark::State& state) {
+    static const char* types[] = {"Perlin", "Simplex", "Worley"};
+    NoiseGenerationNode node;
+    node.setNoiseType(static_cast<NoiseGenerationNode::NoiseType>(state.range(0)));
+    node.setOctaves(static_cast<int>(state.range(1)));
+    node.setUseAsDisplacement(state.range(2) != 0);
+    state.SetLabel(std::string(types[state.range(0)]) + " octaves=" + std::to_string(state.range(1)) +
+                   (state.range(2) ? " displacement" : ""));
+
+    Counters before = readCounters();
+    for (auto _ : state) {
+        node.process();
+    }
+    reportCounters(state, 512 * 512 / 1e6, before);
+}
+BENCHMARK(BM_NoiseGeneration)
+    ->ArgsProduct({{0, 1, 2}, {1, 4}, {0, 1}})
+    ->Unit(benchmark::kMillisecond)->UseRealTime();
+
+// End-to-end passes through NodeGraph::processGraph on 3-channel input.
+// Nodes are added in dependency order since the graph runs them in insertion order.
+enum class GraphKind { Enhance, EdgeMask, Composite, Redundant, Chains };
+
+static void buildGraph(NodeGraph& graph, GraphKind kind, const cv::Mat& input) {
+    auto* source = new MatSourceNode(input);
+    auto* output = new ImageOutputNode();
+    graph.addNode(source);
+
+    switch (kind) {
+        case GraphKind::Enhance: {
+            auto* adjust = new BrightnessContrastNode();
+            auto* blur = new BlurNode();
+            auto* sharpen = new ConvolutionFilterNode();
+            graph.addNode(adjust);
+            graph.addNode(blur);
+            graph.addNode(sharpen);
+            graph.addNode(output);
+            adjust->setContrast(1.1f);
+            sharpen->setPreset(1);
+            graph.connectNodes(source, 0, adjust, 0);
+            graph.connectNodes(adjust, 1, blur, 0);
+            graph.connectNodes(blur, 1, sharpen, 0);
+            graph.connectNodes(sharpen, 1, output, 0);
+            break;
+        }
+        case GraphKind::EdgeMask: {
+            auto* blur = new BlurNode();
+            auto* edges = new EdgeDetectionNode();
+            auto* threshold = new ThresholdNode();
+            graph.addNode(blur);
+            graph.addNode(edges);
+            graph.addNode(threshold);
+            graph.addNode(output);
+            graph.connectNodes(source, 0, blur, 0);
+            graph.connectNodes(blur, 1, edges, 0);
+            graph.connectNodes(edges, 1, threshold, 0);
+            graph.connectNodes(threshold, 1, output, 0);
+            break;
+        }
+        case GraphKind::Composite: {
+            auto* blur = new BlurNode();
+            auto* splitter = new ColorChannelSplitterNode();
+            auto* blend = new BlendNode();
+            graph.addNode(blur);
+            graph.addNode(splitter);
+            graph.addNode(blend);
+            graph.addNode(output);
+            blend->setBlendMode(3); // Overlay
+            graph.connectNodes(source, 0, blur, 0);
+            graph.connectNodes(source, 0, splitter, 0);
+            graph.connectNodes(source, 0, blend, 0);
+            graph.connectNodes(blur, 1, blend, 1);
+            graph.connectNodes(blend, 2, output, 0);
+            break;
+        }
+        case GraphKind::Redundant: {
+            // Duplicated blur branch plus a dangling generator, as found in copy-pasted graphs
+            auto* blurA = new BlurNode();
+            auto* blurB = new BlurNode();
+            auto* blend = new BlendNode();
+            auto* noise = new NoiseGenerationNode();
+            graph.addNode(blurA);
+            graph.addNode(blurB);
+            graph.addNode(blend);
+            graph.addNode(noise);
+            graph.addNode(output);
+            graph.connectNodes(source, 0, blurA, 0);
+            graph.connectNodes(source, 0, blurB, 0);
+            graph.connectNodes(blurA, 1, blend, 0);
+            graph.connectNodes(blurB, 1, blend, 1);
+            graph.connectNodes(blend, 2, output, 0);
+            break;
+        }
+        case GraphKind::Chains: {
+            // Blur -> Blur -> BoxBlur -> Sharpen -> Adjust -> Adjust, each pair fusable
+            std::vector<Node*> chain = {
+                new BlurNode(), new BlurNode(), new ConvolutionFilterNode(),
+                new ConvolutionFilterNode(), new BrightnessContrastNode(), new BrightnessContrastNode()
+            };
+            static_cast<ConvolutionFilterNode*>(chain[2])->setPreset(4);
+            static_cast<ConvolutionFilterNode*>(chain[3])->setPreset(1);
+            static_cast<BrightnessContrastNode*>(chain[4])->setContrast(0.8f);
+            static_cast<BrightnessContrastNode*>(chain[4])->setBrightness(10);
+            static_cast<BrightnessContrastNode*>(chain[5])->setContrast(1.2f);
+            Node* previous = source;
+            int previousPort = 0;
+            for (Node* node : chain) {
+                graph.addNode(node);
+                graph.connectNodes(previous, previousPort, node, 0);
+                previous = node;
+                previousPort = 1;
+            }
+            graph.addNode(output);
+            graph.connectNodes(previous, previousPort, output, 0);
+            break;
+        }
+    }
+}
+
+static void BM_Graph(benchmark::State& state) {
+    static const char* kinds[] = {"Enhance", "EdgeMask", "Composite", "Redundant", "Chains"};
+    const int resolution = static_cast<int>(state.range(0));
+    const GraphKind kind = static_cast<GraphKind>(state.range(1));
+    const cv::Mat& input = benchmarkInput(resolution, 3);
+
+    NodeGraph graph;
+    buildGraph(graph, kind, input);
+    state.SetLabel(imageLabel(resolution, 3) + " " + kinds[state.range(1)]);
+
+    Counters before = readCounters();
+    for (auto _ : state) {
+        graph.processGraph();
+    }
+    reportCounters(state, input.total() / 1e6, before);
+}
+BENCHMARK(BM_Graph)
+    ->ArgsProduct({kResolutionArgs, {0, 1, 2, 3, 4}})
+    ->Unit(benchmark::kMillisecond)->UseRealTime();
+
+// Thumbnail workload: 64 frames of 256x256 through Adjust -> Blur -> Sharpen -> Threshold.
+// Batch size 0 runs one processGraph() per frame for comparison.
+static void BM_Batch(benchmark::State& state) {
+    const size_t batchSize = static_cast<size_t>(state.range(0));
+    const int frameCount = 64;
+    ImageBatch frames(frameCount);
+    cv::RNG rng(0x5eed);
+    for (auto& frame : frames) {
+        frame.create(256, 256, CV_8UC3);
+        rng.fill(frame, cv::RNG::UNIFORM, 0, 256);
+    }
+
+    NodeGraph graph;
+    auto* source = new MatSourceNode(frames[0]);
+    auto* adjust = new BrightnessContrastNode();
+    auto* blur = new BlurNode();
+    auto* sharpen = new ConvolutionFilterNode();
+    auto* threshold = new ThresholdNode();
+    auto* output = new ImageOutputNode();
+    for (Node* node : std::initializer_list<Node*>{source, adjust, blur, sharpen, threshold, output}) {
+        graph.addNode(node);
+    }
+    adjust->setContrast(1.1f);
+    sharpen->setPreset(1);
+    graph.connectNodes(source, 0, adjust, 0);
+    graph.connectNodes(adjust, 1, blur, 0);
+    graph.connectNodes(blur, 1, sharpen, 0);
+    graph.connectNodes(sharpen, 1, threshold, 0);
+    graph.connectNodes(threshold, 1, output, 0);
+    state.SetLabel(batchSize == 0 ? "per-frame passes" : "batch " + std::to_string(batchSize));
+
+    Counters before = readCounters();
+    for (auto _ : state) {
+        if (batchSize == 0) {
+            for (const auto& frame : frames) {
+                source->setOutputImage(0, frame);
+                graph.processGraph();
+            }
+        } else {
+            graph.setBatchSize(batchSize);
+            benchmark::DoNotOptimize(graph.processBatch(source, frames, threshold));
+        }
+    }
+    reportCounters(state, frameCount * frames[0].total() / 1e6, before);
+    state.counters["images/s"] = benchmark::Counter(frameCount * static_cast<double>(state.iterations()),
+                                                    benchmark::Counter::kIsRate);
+}
+BENCHMARK(BM_Batch)
+    ->Arg(0)->Arg(1)->Arg(8)->Arg(32)
+    ->Unit(benchmark::kMillisecond)->UseRealTime();
+
+// 16 threshold levels after an expensive blur. Arg 0 recomputes the whole graph
+// per level; arg 1 sweeps the Threshold parameter, re-running only the threshold.
+static void BM_Sweep(benchmark::State& state) {
+    const bool sweep = state.range(0) != 0;
+    const cv::Mat& input = benchmarkInput(0, 3);
+
+    NodeGraph graph;
+    graph.setResultCache(nullptr);
+    auto* source = new MatSourceNode(input);
+    auto* blur = new BlurNode();
+    auto* threshold = new ThresholdNode();
+    auto* output = new ImageOutputNode();
+    for (Node* node : std::initializer_list<Node*>{source, blur, threshold, output}) {
+        graph.addNode(node);
+    }
+    blur->setRadius(31);
+    graph.connectNodes(source, 0, blur, 0);
+    graph.connectNodes(blur, 1, threshold, 0);
+    graph.connectNodes(threshold, 1, output, 0);
+    std::vector<double> levels;
+    for (int i = 0; i < 16; ++i) {
+        levels.push_back(16.0 * i);
+    }
+    state.SetLabel(sweep ? "sweep" : "full passes");
+
+    Counters before = readCounters();
+    for (auto _ : state) {
+        if (sweep) {
+            graph.processGraph();
+            benchmark::DoNotOptimize(graph.sweep(threshold, "Threshold", levels, threshold));
+        } else {
+            for (double level : levels) {
+                threshold->setThreshold(static_cast<int>(level));
+                graph.processGraph();
+            }
+        }
+    }
+    reportCounters(state, levels.size() * input.total() / 1e6, before);
+}
+BENCHMARK(BM_Sweep)
+    ->Arg(0)->Arg(1)
+    ->Unit(benchmark::kMillisecond)->UseRealTime();
+
+// Building and running 32 copies of Blur -> Blur -> Adjust -> Threshold on
+// 256x256 input. Arg 0 adds the copies node by node; arg 1 instances a group
+// planned once.
+static void BM_GroupInstances(benchmark::State& state) {
+    const bool grouped = state.range(0) != 0;
+    const int copies = 32;
+    cv::Mat input(256, 256, CV_8UC3);
+    cv::RNG(0x5eed).fill(input, cv::RNG::UNIFORM, 0, 256);
+
+    auto definition = std::make_shared<GroupDefinition>("Benchmark Motif");
+    const int first = definition->addMember("Blur");
+    const int second = definition->addMember("Blur");
+    const int adjust = definition->addMember("Brightness/Contrast", [](Node& node) {
+        node.setParameter("Contrast", 1.2);
+    });
+    const int threshold = definition->addMember("Threshold");
+    definition->connect(GroupDefinition::kGroupInput, definition->addInput("Input"), first, 0);
+    definition->connect(first, 1, second, 0);
+    definition->connect(second, 1, adjust, 0);
+    definition->connect(adjust, 1, threshold, 0);
+    definition->addOutput("Output", threshold, 1);
+    state.SetLabel(grouped ? "group instances" : "flat copies");
+
+    Counters before = readCounters();
+    for (auto _ : state) {
+        NodeGraph graph;
+        graph.setResultCache(nullptr);
+        auto* source = new MatSourceNode(input);
+        graph.addNode(source);
+        for (int copy = 0; copy < copies; ++copy) {
+            auto* output = new ImageOutputNode();
+            if (grouped) {
+                auto* group = new GroupNode(definition);
+                graph.addNode(group);
+                graph.addNode(output);
+                graph.connectNodes(source, 0, group, 0);
+                graph.connectNodes(group, 1, output, 0);
+            } else {
+                auto* adjustNode = new BrightnessContrastNode();
+                std::vector<Node*> chain = {new BlurNode(), new BlurNode(), adjustNode, new ThresholdNode()};
+                adjustNode->setContrast(1.2f);
+                Node* previous = source;
+                int previousPort = 0;
+                for (Node* node : chain) {
+                    graph.addNode(node);
+                    graph.connectNodes(previous, previousPort, node, 0);
+                    previous = node;
+                    previousPort = 1;
+                }
+                graph.addNode(output);
+                graph.connectNodes(previous, previousPort, output, 0);
+            }
+        }
+        graph.processGraph();
+    }
+    reportCounters(state, copies * input.total() / 1e6, before);
+}
+BENCHMARK(BM_GroupInstances)
+    ->Arg(0)->Arg(1)
+    ->Unit(benchmark::kMillisecond)->UseRealTime();
+
+// The unfused Chains graph on 12 MP input under a memory budget in MB; arg 0
+// is unbounded. Intermediates over the budget spill to scratch files and are
+// paged back in by the next pass.
+static void BM_MemoryBudget(benchmark::State& state) {
+    const uint64_t budgetMb = static_cast<uint64_t>(state.range(0));
+    const cv::Mat& input = benchmarkInput(1, 3);
+
+    NodeGraph graph;
+    graph.setResultCache(nullptr);
+    GraphOptimizer::Options options;
+    options.fuseLinearChains = false;
+    graph.setOptimizerOptions(options);
+    auto budget = budgetMb > 0 ? std::make_shared<MemoryBudget>(budgetMb << 20) : nullptr;
+    graph.setMemoryBudget(budget);
+    buildGraph(graph, GraphKind::Chains, input);
+    state.SetLabel(budgetMb > 0 ? std::to_string(budgetMb) + " MB budget" : "unbounded");
+
+    Counters before = readCounters();
+    for (auto _ : state) {
+        graph.processGraph();
+    }
+    reportCounters(state, input.total() / 1e6, before);
+    state.counters["residentMB"] = budget ? budget->residentBytes() / (1024.0 * 1024.0) : 0.0;
+    state.counters["spilledMB"] = budget ? budget->spilledBytes() / (1024.0 * 1024.0) : 0.0;
+}
+BENCHMARK(BM_MemoryBudget)
+    ->Arg(0)->Arg(256)->Arg(64)
+    ->Unit(benchmark::kMillisecond)->UseRealTime();
+
+// A 64x64 brush dab on the source of the unfused Chains graph at 12 MP,
+// then a pass; arg 1 recomputes only the damaged region, arg 0 the frame
+static void BM_DirtyRect(benchmark::State& state) {
+    const bool tracking = state.range(0) != 0;
+    const cv::Mat& input = benchmarkInput(1, 3);
+
+    NodeGraph graph;
+    graph.setResultCache(nullptr);
+    GraphOptimizer::Options options;
+    options.fuseLinearChains = false;
+    graph.setOptimizerOptions(options);
+    graph.setDamageTracking(tracking);
+    buildGraph(graph, GraphKind::Chains, input);
+    graph.processGraph();
+    Node* source = graph.getNodes().front();
+    const cv::Mat dab(64, 64, CV_8UC3, cv::Scalar(40, 160, 220));
+    state.SetLabel(tracking ? "damaged region" : "full frame");
+
+    Counters before = readCounters();
+    int step = 0;
+    for (auto _ : state) {
+        const cv::Point at((step * 97) % (input.cols - dab.cols), (step * 53) % (input.rows - dab.rows));
+        source->patchOutput(0, cv::Rect(at, dab.size()), dab);
+        graph.processPending();
+        ++step;
+    }
+    reportCounters(state, input.total() / 1e6, before);
+}
+BENCHMARK(BM_DirtyRect)
+    ->Arg(0)->Arg(1)
+    ->Unit(benchmark::kMillisecond)->UseRealTime();
+
+// Each dispatched kernel through its node at every instruction-set level, on
+// 12 MP 3-channel input; levels this CPU lacks are skipped
+static void BM_Kernels(benchmark::State& state) {
+    static const char* kernelNames[] = {"Overlay", "LUT", "Noise", "Convolution 5x5", "Split"};
+    const CpuLevel level = static_cast<CpuLevel>(state.range(0));
+    const int kernel = static_cast<int>(state.range(1));
+    if (level > detectedCpuLevel()) {
+        state.SkipWithError("instruction set not supported by this CPU");
+        return;
+    }
+    const cv::Mat& input = benchmarkInput(1, 3);
+    MatSourceNode source(input);
+    std::unique_ptr<Node> node;
+    switch (kernel) {
+        case 0: {
+            auto blend = std::make_unique<BlendNode>();
+            blend->setBlendMode(static_cast<int>(BlendMode::Overlay));
+            blend->addInputConnection(&source, 0, 1);
+            node = std::move(blend);
+            break;
+        }
+        case 1: {
+            auto adjust = std::make_unique<BrightnessContrastNode>();
+            adjust->setContrast(1.2f);
+            node = std::move(adjust);
+            break;
+        }
+        case 2:
+            node = std::make_unique<NoiseGenerationNode>();
+            break;
+        case 3: {
+            auto convolution = std::make_unique<ConvolutionFilterNode>();
+            convolution->setKernelSize(5);
+            convolution->setPreset(4);
+            node = std::move(convolution);
+            break;
+        }
+        default: {
+            auto splitter = std::make_unique<ColorChannelSplitterNode>();
+            splitter->setOutputGrayscale(true);
+            node = std::move(splitter);
+            break;
+        }
+    }
+    if (kernel != 2) {
+        node->addInputConnection(&source, 0, 0);
+    }
+    state.SetLabel(std::string(cpuLevelName(level)) + " " + kernelNames[kernel]);
+
+    const CpuLevel previous = activeCpuLevel();
+    setCpuLevel(level);
+    Counters before = readCounters();
+    for (auto _ : state) {
+        node->process();
+    }
+    reportCounters(state, (kernel == 2 ? 512 * 512 : input.total()) / 1e6, before);
+    setCpuLevel(previous);
+}
+BENCHMARK(BM_Kernels)
+    ->ArgsProduct({{0, 1, 2, 3}, {0, 1, 2, 3, 4}})
+    ->Unit(benchmark::kMillisecond)->UseRealTime();
+
+int main(int argc, char** argv) {
+    // NodeGraph is a QGraphicsScene and needs an application object, but no display
+    qputenv("QT_QPA_PLATFORM", "offscreen");
+    QApplication app(argc, argv);
+    AllocationTracker::instance().install();
+
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv)) {
+        return 1;
+    }
+    benchmark::AddCustomContext("git_commit", NBIP_GIT_COMMIT);
+    benchmark::AddCustomContext("opencv_version", CV_VERSION);
+    benchmark::AddCustomContext("opencv_threads", std::to_string(cv::getNumThreads()));
+    benchmark::AddCustomContext("cpu_level", cpuLevelName(activeCpuLevel()));
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
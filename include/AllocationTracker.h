@@ -0,0 +1,44 @@
+#ifndef ALLOCATIONTRACKER_H
+#define ALLOCATIONTRACKER_H
+
+#include <opencv2/core.hpp>
+#include <atomic>
+#include <cstddef>
+
+// Counts cv::Mat buffer allocations made through OpenCV's default allocator.
+// Install once at startup; all counters are process-wide.
+class AllocationTracker : public cv::MatAllocator {
+public:
+    struct Snapshot {
+        size_t allocations = 0;
+        size_t bytesAllocated = 0;
+        size_t bytesInUse = 0;
+        size_t peakBytesInUse = 0;
+    };
+
+    static AllocationTracker& instance();
+
+    void install();
+    bool isInstalled() const { return m_installed; }
+    Snapshot snapshot() const;
+    void resetPeak();
+
+    cv::UMatData* allocate(int dims, const int* sizes, int type, void* data, size_t* step,
+                           cv::AccessFlag flags, cv::UMatUsageFlags usageFlags) const override;
+    bool allocate(cv::UMatData* data, cv::AccessFlag accessFlags, cv::UMatUsageFlags usageFlags) const override;
+    void deallocate(cv::UMatData* data) const override;
+
+private:
+    AllocationTracker();
+    AllocationTracker(const AllocationTracker&) = delete;
+    AllocationTracker& operator=(const AllocationTracker&) = delete;
+
+    const cv::MatAllocator* m_base;
+    bool m_installed = false;
+    mutable std::atomic<size_t> m_allocations{0};
+    mutable std::atomic<size_t> m_bytesAllocated{0};
+    mutable std::atomic<size_t> m_bytesInUse{0};
+    mutable std::atomic<size_t> m_peakBytesInUse{0};
+};
+
+#endif // ALLOCATIONTRACKER_H
@@ -0,0 +1,24 @@
+#ifndef BINARIZE_H
+#define BINARIZE_H
+
+#include <opencv2/core.hpp>
+
+// Threshold selection and local thresholding for 8-bit single-channel images.
+// Outputs are 0 or 255.
+
+// 256-bin histogram, counted in parallel row bands
+void grayHistogram(const cv::Mat& gray, int histogram[256]);
+
+// Global thresholds picked from a histogram; pixels above them are foreground
+int otsuThreshold(const int histogram[256]);
+int triangleThreshold(const int histogram[256]);
+
+enum class AdaptiveMethod { Mean, Sauvola };
+
+// Compares each pixel with a threshold from the (2 * radius + 1) square around
+// it, clipped to the image. Mean uses mean - parameter; Sauvola uses
+// mean * (1 + parameter * (stddev / 128 - 1)). Window sums come from integral
+// images, so the cost per pixel does not depend on the radius.
+void adaptiveThreshold(const cv::Mat& gray, cv::Mat& output, int radius, AdaptiveMethod method, double parameter);
+
+#endif // BINARIZE_H
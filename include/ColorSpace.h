@@ -0,0 +1,38 @@
+#ifndef COLORSPACE_H
+#define COLORSPACE_H
+
+#include <opencv2/core.hpp>
+
+// Encoding of an image's color channels. Images load as gamma-encoded sRGB in
+// BGR order. Linear is linear-light BGR, 16-bit when converted from 8-bit so
+// dark tones keep their precision. HSV, Lab and YCbCr use OpenCV's 8-bit
+// layouts: H in 0-180, a and b offset by 128, channels in Y, Cr, Cb order.
+enum class ColorSpace {
+    SRGB,
+    Linear,
+    HSV,
+    Lab,
+    YCbCr,
+    // Not recorded: the space of the producing node's first image input
+    Inherit = 7
+};
+
+const int kColorSpaceCount = 5;
+const char* colorSpaceName(ColorSpace space);
+
+// Factor taking full scale in one depth to full scale in another: 255 for
+// 8-bit, 65535 for 16-bit and 1 for float
+double rangeScale(int fromDepth, int toDepth);
+
+// Converts the color channels from one space to another, keeping a fourth
+// channel as alpha. Spaces other than sRGB and Linear are reached through
+// 8-bit sRGB. Converting to the input's own space shares the input buffer.
+void convertColorSpace(const cv::Mat& input, cv::Mat& output, ColorSpace from, ColorSpace to);
+
+// Single-channel luminance of an image in the given space: L, V or Y where
+// the space has one, sRGB luma otherwise. Linear images, single-channel ones
+// included, are re-encoded to 8-bit sRGB first; any other single-channel
+// image is shared as it is.
+void lumaOf(const cv::Mat& image, ColorSpace space, cv::Mat& luma);
+
+#endif // COLORSPACE_H
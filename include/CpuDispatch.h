@@ -0,0 +1,19 @@
+#ifndef CPUDISPATCH_H
+#define CPUDISPATCH_H
+
+// Instruction sets the hot kernels are built for, lowest first
+enum class CpuLevel { Baseline, SSE4, AVX2, AVX512 };
+
+// Highest level both this CPU and this build support, probed once with CPUID
+CpuLevel detectedCpuLevel();
+
+// Level kernels() dispatches to: the detected one unless NBIP_CPU_LEVEL
+// (baseline, sse4, avx2 or avx512) or setCpuLevel() asks for a lower one
+CpuLevel activeCpuLevel();
+// Requests above the detected level are capped; returns the level now active
+CpuLevel setCpuLevel(CpuLevel level);
+
+const char* cpuLevelName(CpuLevel level);
+bool parseCpuLevel(const char* name, CpuLevel& level);
+
+#endif // CPUDISPATCH_H
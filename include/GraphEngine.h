@@ -0,0 +1,110 @@
+#ifndef GRAPHENGINE_H
+#define GRAPHENGINE_H
+
+#include "GraphOptimizer.h"
+#include "MemoryBudget.h"
+#include "NodeProfiler.h"
+#include "ResultCache.h"
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// Evaluates nodes without going through Qt signals. Nodes flag themselves
+// dirty and report through a plain callback; each pass re-runs only dirty
+// nodes and whatever depends on them. Structure changes (adding, removing,
+// connecting) happen on the owning thread; invalidation may come from any.
+class GraphEngine {
+public:
+    // Fired on every invalidation; the owner decides when to call run()
+    using InvalidationCallback = std::function<void()>;
+    // Fired once per finished pass with the nodes whose outputs changed
+    using PassCallback = std::function<void(const std::vector<Node*>& updated)>;
+
+    GraphEngine();
+    ~GraphEngine();
+
+    void addNode(Node* node);
+    void removeNode(Node* node);
+    const std::vector<Node*>& nodes() const { return m_nodes; }
+
+    void setInvalidationCallback(InvalidationCallback callback) { m_onInvalidated = std::move(callback); }
+    void setPassCallback(PassCallback callback) { m_onPassFinished = std::move(callback); }
+
+    // Brings every output up to date. A call made while a pass is running
+    // returns false at once and the running pass goes around again instead.
+    bool run();
+    bool isRunning() const { return m_running.load(std::memory_order_acquire); }
+    // Makes the next run() recompute every node
+    void invalidateAll();
+
+    // See NodeGraph::processBatch
+    std::vector<ImageBatch> processBatch(Node* source, const ImageBatch& frames, Node* target);
+    void setBatchSize(size_t frames) { m_batchSize = std::max<size_t>(1, frames); }
+    size_t batchSize() const { return m_batchSize; }
+
+    // See NodeGraph::sweep
+    std::vector<std::vector<cv::Mat>> sweep(Node* node, const std::string& parameter, const std::vector<double>& values,
+                                            Node* target);
+
+    void setOptimizerOptions(const GraphOptimizer::Options& options) { m_optimizer.setOptions(options); }
+    const ExecutionPlan& lastPlan() const { return m_lastPlan; }
+
+    NodeProfiler& profiler() { return m_profiler; }
+    const NodeProfiler& profiler() const { return m_profiler; }
+
+    void setResultCache(std::shared_ptr<ResultCache> cache) { m_resultCache = std::move(cache); }
+    const std::shared_ptr<ResultCache>& resultCache() const { return m_resultCache; }
+    void setCacheThresholdMs(double milliseconds) { m_cacheThresholdMs = milliseconds; }
+
+    // Shared by every engine when NBIP_MEMORY_BUDGET_MB is set; null means unbounded
+    void setMemoryBudget(std::shared_ptr<MemoryBudget> budget);
+    const std::shared_ptr<MemoryBudget>& memoryBudget() const { return m_memoryBudget; }
+
+    // After Node::patchOutput(), nodes with a damageMargin() recompute only
+    // the rect the patch reaches, in place; on by default
+    void setDamageTracking(bool enabled) { m_damageTracking = enabled; }
+    bool damageTracking() const { return m_damageTracking; }
+
+private:
+    // Damaged rect per output slot of the nodes updated in place this pass
+    using DamageMap = std::unordered_map<Node*, std::vector<cv::Rect>>;
+
+    void runPass();
+    bool inputsChanged(const Node* node, const std::unordered_set<Node*>& changed) const;
+    bool execute(const PlanStep& step);
+    // Recomputes the damaged region of node's outputs in place; false when
+    // the node has to run over the whole frame instead
+    bool runDamaged(Node* node, DamageMap& damage, const std::unordered_set<Node*>& changed);
+    // Tells every consumer of updated's buffers that they changed in place
+    void discardInputCaches(const Node* updated);
+    // How many of buffer's references this engine's nodes hold
+    int engineReferences(const cv::UMatData* buffer) const;
+    bool restoreOutputs(Node* node);
+    void updateContentKeys();
+
+    std::vector<Node*> m_nodes;
+    NodeProfiler m_profiler;
+    GraphOptimizer m_optimizer;
+    ExecutionPlan m_lastPlan;
+    // Nodes skipped by a pass although their inputs changed (pruned or fused away)
+    std::unordered_set<Node*> m_stale;
+    // Kept alive by the optimizer during a sweep although no sink may observe them
+    std::unordered_set<Node*> m_observed;
+    std::shared_ptr<ResultCache> m_resultCache;
+    std::shared_ptr<MemoryBudget> m_memoryBudget;
+    double m_cacheThresholdMs = 20.0;
+    size_t m_batchSize = 16;
+    bool m_damageTracking = true;
+
+    InvalidationCallback m_onInvalidated;
+    PassCallback m_onPassFinished;
+    std::atomic<bool> m_running{false};
+    std::atomic<bool> m_rerunRequested{false};
+};
+
+#endif // GRAPHENGINE_H
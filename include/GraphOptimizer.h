@@ -0,0 +1,95 @@
+#ifndef GRAPHOPTIMIZER_H
+#define GRAPHOPTIMIZER_H
+
+#include "Node.h"
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+// A chain of same-family linear operators collapsed into one operation
+struct FusedChain {
+    enum class Kind { Gaussian, Convolution, Affine, Geometric, ColorSpace };
+
+    Kind kind = Kind::Gaussian;
+    std::vector<Node*> nodes;   // Head first; the tail receives the output
+    double sigma = 0.0;         // Gaussian
+    cv::Mat kernel;             // Convolution, CV_32F
+    double alpha = 1.0;         // Affine: alpha * x + beta
+    double beta = 0.0;
+    ColorSpace space = ColorSpace::SRGB;  // ColorSpace: the last member's target
+    // Geometric chains compose their members' transforms when the input size
+    // is known, so they carry nothing else
+    std::string signature;      // Identifies the rewrite for verification
+
+    // inputSpace is what a color-space chain converts from
+    cv::Mat apply(const cv::Mat& input, ColorSpace inputSpace = ColorSpace::SRGB) const;
+};
+
+struct PlanStep {
+    Node* node = nullptr;
+    Node* aliasOf = nullptr;               // When set, copy this node's outputs instead of running
+    std::shared_ptr<FusedChain> fused;     // When set, run the chain ending at node in one pass
+};
+
+struct ExecutionPlan {
+    std::vector<PlanStep> steps;    // Dependencies first
+    std::vector<Node*> pruned;      // Nodes whose outputs nothing observes
+    std::vector<Node*> absorbed;    // Chain members folded into a fused step
+    int mergedCount = 0;
+    int fusedCount = 0;
+};
+
+// Rewrites a node list into an execution plan before a pass runs:
+// - nodes with identical type, parameters and inputs are computed once
+// - nodes that cannot reach a sink (an output or a visible preview) are skipped
+// - chains of blurs, convolutions or brightness/contrast nodes run as one operation
+// - chains of geometric transforms run as one resample
+// - chains of color-space conversions run as one conversion, or none when
+//   they return to the input's space
+class GraphOptimizer {
+public:
+    struct Options {
+        bool eliminateCommonSubexpressions = true;
+        bool pruneDeadNodes = true;
+        bool fuseLinearChains = true;
+        // Each fused chain is checked against the unfused nodes once per
+        // input type, size and color space; rewrites outside tolerance are
+        // disabled for good. Differences are in 8-bit levels, scaled to the
+        // image's depth
+        bool verifyRewrites = true;
+        double maxAbsDifference = 8.0;
+        double meanAbsDifference = 1.0;
+    };
+
+    GraphOptimizer() = default;
+    explicit GraphOptimizer(const Options& options) : m_options(options) {}
+
+    void setOptions(const Options& options) { m_options = options; }
+    const Options& options() const { return m_options; }
+
+    // Observed nodes are kept and keep their own outputs, like sinks
+    ExecutionPlan optimize(const std::vector<Node*>& nodes, const std::unordered_set<Node*>& observed = {}) const;
+
+    // Executes a fused step, verifying the rewrite the first time it sees an
+    // input of that form. Safe to call from several threads.
+    void runFused(const FusedChain& chain) const;
+    // Rewrites that failed verification; plans built later leave them out
+    bool isRejected(const FusedChain& chain) const;
+
+    // Dependencies-first ordering; nodes on a cycle keep their list order at the end
+    static std::vector<Node*> topologicalOrder(const std::vector<Node*>& nodes);
+
+private:
+    void fuseChains(const std::vector<Node*>& order, const std::vector<Node*>& liveOrder,
+                    const std::set<Node*>& pinned, std::vector<std::shared_ptr<FusedChain>>& chains) const;
+
+    Options m_options;
+    mutable std::mutex m_verifyMutex;
+    mutable std::set<std::string> m_verified;   // Signature plus input form
+    mutable std::set<std::string> m_rejected;   // Signature
+};
+
+#endif // GRAPHOPTIMIZER_H
@@ -0,0 +1,125 @@
+#ifndef GROUPNODE_H
+#define GROUPNODE_H
+
+#include "GraphOptimizer.h"
+#include "Node.h"
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// A reusable subgraph. Members are created through NodeFactory by type name
+// and wired by index; the group's ports are its exposed inputs followed by
+// its exposed outputs. The first instance freezes the definition and compiles
+// it once into an execution plan over member indices that every instance
+// shares, so instancing costs only the member nodes themselves.
+class GroupDefinition {
+public:
+    // Source member for links from the group's inputs; the source port is the input's index
+    static const int kGroupInput = -1;
+
+    explicit GroupDefinition(const std::string& name) : m_name(name) {}
+
+    const std::string& name() const { return m_name; }
+    const std::vector<Port>& ports() const { return m_ports; }
+    int inputCount() const { return m_inputCount; }
+    std::vector<std::string> memberTypes() const;
+
+    // configure runs on each instance's member before its first pass.
+    // Edits after the first instance is created are ignored and return -1.
+    int addMember(const std::string& type, std::function<void(Node&)> configure = nullptr);
+    bool connect(int sourceMember, int sourcePort, int destMember, int destPort);
+    int addInput(const std::string& name, DataType type = DataType::Image);
+    int addOutput(const std::string& name, int member, int port, DataType type = DataType::Image);
+
+    // Builds a definition from nodes in a graph: links between them are kept,
+    // links from other nodes become inputs (one per distinct source, listed in
+    // inputSources) and ports other nodes read become outputs. Members keep
+    // their parameter values and whatever Node::captureState() returns.
+    static std::shared_ptr<GroupDefinition> capture(const std::string& name, const std::vector<Node*>& nodes,
+                                                    const std::vector<Node*>& graphNodes,
+                                                    std::vector<std::pair<Node*, int>>* inputSources = nullptr);
+
+    struct Output {
+        int member;
+        int port;
+    };
+    const std::vector<Output>& outputs() const { return m_outputs; }
+
+private:
+    friend class GroupNode;
+
+    struct Member {
+        std::string type;
+        std::function<void(Node&)> configure;
+    };
+    struct Link {
+        int sourceMember;
+        int sourcePort;
+        int destMember;
+        int destPort;
+    };
+    // Plan steps by index into the nodes createNodes() returns
+    struct Step {
+        int node;
+        int aliasOf = -1;
+        std::shared_ptr<const FusedChain> fused;   // Member list left empty
+        std::vector<int> chain;
+    };
+    struct Compiled {
+        std::vector<Step> steps;
+        bool sink = false;
+    };
+
+    // The input proxy first, then one node per member (null when its type is unknown)
+    std::vector<std::unique_ptr<Node>> createNodes() const;
+    const Compiled& compiled() const;
+
+    std::string m_name;
+    std::vector<Member> m_members;
+    std::vector<Link> m_links;
+    std::vector<Output> m_outputs;
+    std::vector<Port> m_ports;
+    int m_inputCount = 0;
+
+    mutable std::once_flag m_compileOnce;
+    mutable std::atomic<bool> m_frozen{false};
+    mutable Compiled m_compiled;
+    // Shared by all instances so each fused chain is verified once
+    GraphOptimizer m_optimizer;
+};
+
+// One instance of a group definition. The engine schedules it as a single
+// node and caches its outputs like any other; inside, members re-run only
+// when the group's inputs reach them or their own parameters changed.
+class GroupNode : public Node {
+public:
+    explicit GroupNode(std::shared_ptr<const GroupDefinition> definition);
+    ~GroupNode() override = default;
+
+    void process() override;
+    std::string name() const override { return m_definition->name(); }
+    const std::vector<Port>& getPorts() const override { return m_definition->ports(); }
+    std::string parameterKey() const override;
+    // Built from the members' cache keys, so sources inside count what they read
+    std::string cacheKey() const override;
+    bool isSink() const override { return m_definition->compiled().sink; }
+    // Includes what the members hold
+    std::vector<cv::Mat> retainedImages() const override;
+    void discardInputCaches() override;
+
+    const GroupDefinition& definition() const { return *m_definition; }
+
+private:
+    std::shared_ptr<const GroupDefinition> m_definition;
+    std::vector<std::unique_ptr<Node>> m_nodes;
+    std::vector<PlanStep> m_steps;
+};
+
+// Makes the definition available from NodeFactory under its name. False when
+// the name is taken or a member's type is not registered yet.
+bool registerGroup(std::shared_ptr<const GroupDefinition> definition);
+
+#endif // GROUPNODE_H
@@ -0,0 +1,37 @@
+#ifndef IMAGEINFO_H
+#define IMAGEINFO_H
+
+#include "ColorSpace.h"
+#include <opencv2/core.hpp>
+#include <cstdint>
+
+// Alpha state and color space carried next to each output image. Only 8-bit
+// BGRA images can be transparent or premultiplied; everything else is opaque
+// and straight.
+struct ImageInfo {
+    bool opaque = true;          // Alpha is 255 everywhere, so alpha work can be skipped
+    bool premultiplied = false;  // Color channels are already scaled by alpha
+    // Only nodes that change the encoding record a space
+    ColorSpace space = ColorSpace::Inherit;
+
+    // What can be known from the Mat alone: four channels may hold transparency
+    static ImageInfo describe(const cv::Mat& image);
+    bool hasAlpha() const { return !opaque; }
+
+    uint32_t flags() const {
+        return (opaque ? 1u : 0u) | (premultiplied ? 2u : 0u) | (static_cast<uint32_t>(space) << 2);
+    }
+    static ImageInfo fromFlags(uint32_t flags) {
+        return {(flags & 1u) != 0, (flags & 2u) != 0, static_cast<ColorSpace>((flags >> 2) & 7u)};
+    }
+};
+
+// Alpha conversions for 8-bit BGRA; other images are copied by reference
+void premultiplyAlpha(const cv::Mat& straight, cv::Mat& premultiplied);
+void unpremultiplyAlpha(const cv::Mat& premultiplied, cv::Mat& straight);
+// True when a BGRA image has any alpha below 255
+bool hasTransparency(const cv::Mat& image);
+// The image in straight or premultiplied form, converting only when needed
+cv::Mat imageAs(const cv::Mat& image, const ImageInfo& info, bool premultiplied);
+
+#endif // IMAGEINFO_H
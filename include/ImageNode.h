@@ -12,14 +12,22 @@ public:
     
     void process() override;
     std::string name() const override { return "Image Input"; }
-    std::vector<Port> getPorts() const override;
+    const std::vector<Port>& getPorts() const override;
+    std::string parameterKey() const override { return m_imagePath + (m_loadAlpha ? "|alpha" : ""); }
+    std::string cacheKey() const override;
+    std::function<void(Node&)> captureState() const override;
     
     void setImagePath(const std::string& path);
     cv::Mat getImage() const;
     
+    // Keep the file's alpha channel (IMREAD_UNCHANGED). Images whose alpha is
+    // fully opaque are still loaded as 3-channel BGR.
+    void setLoadAlpha(bool loadAlpha);
+    bool loadsAlpha() const { return m_loadAlpha; }
+    
 private:
     std::string m_imagePath;
-    cv::Mat m_image;
+    bool m_loadAlpha = false;
 };
 
 class ImageOutputNode : public Node {
@@ -29,11 +37,17 @@ public:
     
     void process() override;
     std::string name() const override { return "Image Output"; }
-    std::vector<Port> getPorts() const override;
+    const std::vector<Port>& getPorts() const override;
+    bool isSink() const override { return true; }
+    std::function<void(Node&)> captureState() const override;
     
     void setOutputPath(const std::string& path);
     cv::Mat getOutputImage() const;
+    std::vector<cv::Mat> retainedImages() const override { return {m_outputImage}; }
     
+protected:
+    cv::Mat previewSource() const override { return m_outputImage; }
+
 private:
     std::string m_outputPath;
     cv::Mat m_outputImage;
@@ -0,0 +1,28 @@
+#ifndef IMAGESTATISTICS_H
+#define IMAGESTATISTICS_H
+
+#include <opencv2/core.hpp>
+#include <array>
+#include <cstdint>
+
+// Which values of an image a histogram counts
+enum class StatisticsChannel { Luma = -1, AllChannels = -2 };
+
+struct Histogram256 {
+    std::array<uint64_t, 256> counts{};
+    uint64_t total = 0;
+
+    double min() const;
+    double max() const;
+    double mean() const;
+    double standardDeviation() const;
+    // Smallest level with at least fraction of the values at or below it
+    double percentile(double fraction) const;
+};
+
+// One parallel pass over an 8-bit image: each thread counts its rows into a
+// private table and the tables are summed at the end. channel is a channel
+// index or a StatisticsChannel; luma uses BT.601 weights.
+void accumulateHistogram(const cv::Mat& image, int channel, Histogram256& histogram);
+
+#endif // IMAGESTATISTICS_H
@@ -0,0 +1,40 @@
+#ifndef KERNELS_H
+#define KERNELS_H
+
+#include "CpuDispatch.h"
+#include <cstdint>
+
+struct NoiseRowParameters {
+    int type;           // NoiseGenerationNode::NoiseType
+    float scale;
+    int octaves;
+    float persistence;
+};
+
+// Row kernels behind the hottest node loops. All variants come from one
+// source, KernelsImpl.inl, compiled once per instruction set.
+struct KernelTable {
+    CpuLevel level;
+    // Overlay of src over dst in place at opacity; dst is 0-1, src 0-255
+    void (*overlayRow)(float* dst, const uint8_t* src, int count, float opacity);
+    // Maps every channel through table, except that 4-channel alpha is copied
+    void (*lutRow)(const uint8_t* src, uint8_t* dst, int width, int channels, const uint8_t* table);
+    // Unnormalized octave sum of the noise node's pattern for pixels 0..width-1 of row y
+    void (*noiseRow)(float* dst, int width, int y, const NoiseRowParameters& parameters);
+    // Correlation with a ksize x ksize kernel; rows are the ksize input rows
+    // around the output row, each padded by ksize / 2 pixels on both sides
+    void (*convolveRow)(const uint8_t* const* rows, uint8_t* dst, int width, int channels,
+                        const float* kernel, int ksize);
+    // Deinterleaves 1 to 4 channels into planes
+    void (*splitRow)(const uint8_t* src, uint8_t* const* planes, int width, int channels);
+    // Writes a 3-channel row that keeps src's channel in slot and is zero elsewhere
+    void (*isolateRow)(const uint8_t* src, uint8_t* dst, int width, int channels, int channel, int slot);
+};
+
+// Kernels for activeCpuLevel()
+const KernelTable& kernels();
+// Kernels for one level, for comparing variants; levels this build or CPU
+// lacks fall back to the detected level
+const KernelTable& kernelsFor(CpuLevel level);
+
+#endif // KERNELS_H
@@ -9,6 +9,8 @@
 #include <QToolBar>
 #include <QAction>
 #include <QMenu>
+#include <QSlider>
+#include <QComboBox>
 
 class MainWindow : public QMainWindow {
     Q_OBJECT
@@ -30,6 +32,8 @@ private:
     void createToolBars();
     void createDockWidgets();
     void setupNodeFactory();
+    QSlider* createParameterSlider(int minimum, int maximum, int value);
+    QComboBox* createBlendModeCombo();
     
     NodeGraph* m_graph;
     QGraphicsView* m_view;
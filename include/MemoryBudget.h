@@ -0,0 +1,90 @@
+#ifndef MEMORYBUDGET_H
+#define MEMORYBUDGET_H
+
+#include "types.h"
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class Node;
+
+// Process-wide limit on the image buffers nodes hold between passes.
+// Engines report each node's buffers after it runs. When the unique bytes
+// held by all nodes exceed the limit, the least recently used outputs move
+// into unlinked scratch files mapped with mmap: the kernel writes them back
+// and drops them from memory, and pages them in again when something reads
+// them. Buffers shared with another holder are left alone, since moving one
+// reference would free nothing.
+class MemoryBudget {
+public:
+    struct NodeUsage {
+        NodeID node = 0;
+        std::string name;
+        uint64_t residentBytes = 0;   // Heap buffers first held by this node
+        uint64_t spilledBytes = 0;    // Buffers living in scratch files
+    };
+
+    explicit MemoryBudget(uint64_t maxBytes, const std::string& scratchDirectory = std::string());
+
+    // NBIP_MEMORY_BUDGET_MB enables the budget and NBIP_SCRATCH_DIR picks the
+    // spill directory (the system temp directory by default). Every call
+    // returns the same instance, so all engines share one limit.
+    static std::shared_ptr<MemoryBudget> fromEnvironment();
+
+    uint64_t maxBytes() const { return m_maxBytes; }
+    const std::string& scratchDirectory() const { return m_scratchDirectory; }
+
+    // A pass is about to read node's outputs
+    void touch(Node* node);
+    // Records node's buffers after it ran. Over the limit, it spills outputs
+    // of owner's nodes, least recently used first, until owner has freed its
+    // share of the excess: the excess times owner's part of the resident
+    // bytes. node itself goes last, so a single oversized node still ends up
+    // on disk. The copies and write-back run without holding the lock.
+    void update(Node* node, const void* owner);
+    void forget(Node* node);
+    void forgetOwner(const void* owner);
+
+    uint64_t residentBytes() const;
+    uint64_t spilledBytes() const;
+    // One entry per node, largest resident first. Buffers shared between
+    // nodes count once, for the node that reported them first.
+    std::vector<NodeUsage> report() const;
+    bool writeReport(const std::string& path) const;
+
+    // A copy of image in a scratch file mapping, or an empty Mat on failure
+    cv::Mat spill(const cv::Mat& image) const;
+    static bool isSpilled(const cv::Mat& image);
+
+private:
+    struct Buffer {
+        const void* key = nullptr;
+        uint64_t bytes = 0;
+        bool spilled = false;
+    };
+    struct Entry {
+        const void* owner = nullptr;
+        NodeID node = 0;
+        std::string name;
+        uint64_t order = 0;      // First report, for attributing shared buffers
+        uint64_t lastUse = 0;
+        std::vector<Buffer> buffers;
+    };
+
+    // Caller holds m_mutex
+    void totals(uint64_t& resident, uint64_t& spilled) const;
+    static std::vector<Buffer> buffersOf(const Node* node);
+    uint64_t spillOutputs(Node* node) const;
+
+    uint64_t m_maxBytes;
+    std::string m_scratchDirectory;
+    mutable std::mutex m_mutex;
+    std::unordered_map<Node*, Entry> m_entries;
+    uint64_t m_clock = 0;
+    uint64_t m_nextOrder = 0;
+};
+
+#endif // MEMORYBUDGET_H
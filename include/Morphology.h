@@ -0,0 +1,19 @@
+#ifndef MORPHOLOGY_H
+#define MORPHOLOGY_H
+
+#include <opencv2/core.hpp>
+
+// Min (erode) or max (dilate) over a window x window.height rectangle, which
+// covers lines too. 8-bit images use van Herk/Gil-Werman, a fixed three
+// comparisons per pixel and pass whatever the window size. Pixels outside the
+// image never win, as with OpenCV's default morphology border.
+void minMaxFilter(const cv::Mat& src, cv::Mat& dst, cv::Size window, bool maximum);
+
+// Median over a (2 * radius + 1) square with replicated borders, at any
+// depth. 8-bit images use column histograms (Perreault and Hebert), so the
+// cost per pixel does not grow with the radius; 16-bit images slide a
+// two-level histogram along each row, linear in the radius, as do 8-bit
+// images past a radius of 127.
+void medianFilter(const cv::Mat& src, cv::Mat& dst, int radius);
+
+#endif // MORPHOLOGY_H
@@ -1,13 +1,20 @@
 #ifndef NODE_H
 #define NODE_H
 
+#include "ImageInfo.h"
 #include "types.h"
+#include <QElapsedTimer>
 #include <QGraphicsItem>
+#include <QImage>
 #include <QObject>
 #include <QPainter>
 #include <QRectF>
 #include <QStyleOptionGraphicsItem>
 #include <QWidget>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <string>
 
 class Node : public QObject, public QGraphicsItem {
     Q_OBJECT
@@ -21,29 +28,204 @@ public:
 
     virtual void process() = 0;
     virtual std::string name() const = 0;
-    virtual std::vector<Port> getPorts() const = 0;
+    virtual const std::vector<Port>& getPorts() const = 0;
+    // getPorts() followed by one input per parameter; port indices refer to this list
+    const std::vector<Port>& ports() const;
+
+    // A value a Scalar, Integer or Boolean connection can drive. Parameters go
+    // through the node's own setters, so clamping and invalidation still apply.
+    struct Parameter {
+        std::string name;
+        DataType type;
+        std::function<double()> get;
+        std::function<void(double)> set;
+    };
+    const std::vector<Parameter>& parameters() const { return m_parameters; }
+    // Input port driving the named parameter, -1 when there is none
+    int parameterPort(const std::string& name) const;
+    double parameter(const std::string& name) const;
+    bool setParameter(const std::string& name, double value);
+    // State outside the registered parameters, such as file paths, as a
+    // function that applies it to a fresh node of the same type. Groups copy
+    // their members through it; null when the parameters are everything.
+    virtual std::function<void(Node&)> captureState() const { return nullptr; }
+    // Copies connected parameter inputs into the parameters without marking
+    // the node dirty; the engine calls it right before the node runs
+    void applyParameterInputs();
+    // Whether port drives a parameter and its value is the one last applied,
+    // so a change upstream of it alone needs no re-run
+    bool isParameterInputApplied(int portIndex) const;
+
+    // Runs the node over a batch of frames: inputs[port][frame] produce
+    // outputs[slot][frame], all in straight alpha. The default calls process()
+    // once per frame; nodes override it to build shared state such as kernels
+    // once per batch.
+    virtual void processBatch(const std::vector<ImageBatch>& inputs, std::vector<ImageBatch>& outputs);
+
+    // How far a change at one input pixel can reach in the outputs, so the
+    // engine can recompute only the damaged part of a frame: 0 for pointwise
+    // nodes, the kernel radius for filters, -1 when any input pixel can
+    // affect any output pixel
+    virtual int damageMargin() const { return -1; }
+    // Drops state keyed by input buffer addresses; called when an input
+    // buffer was updated in place
+    virtual void discardInputCaches() {}
+
+    // Overwrites rect of an output without re-running the node, e.g. a brush
+    // stroke on a source; the next pass recomputes only what the edit reaches.
+    // pixels must match the output's type and alpha form.
+    bool patchOutput(int slot, const cv::Rect& rect, const cv::Mat& pixels);
+    // Bounding rect per output slot of the patches made since the last call;
+    // empty when there were none
+    std::vector<cv::Rect> takePatches();
+    // The outputs hold patches process() would not reproduce
+    bool isPatched() const { return m_patched; }
+    void clearPatched() { m_patched = false; }
+
+    // Index of the port whose connector contains pos (item coordinates), or -1
+    int portAt(const QPointF& pos) const;
+
+    // Every parameter that affects the outputs; nodes with equal type, key and
+    // inputs are merged by the optimizer. Empty means never merge.
+    virtual std::string parameterKey() const { return std::string(); }
+    // Sinks have effects outside the graph and anchor dead-node pruning
+    virtual bool isSink() const { return false; }
+    // Identifies the outputs across sessions for the result cache; sources
+    // override it to include what they read. Empty means never cache.
+    virtual std::string cacheKey() const { return parameterKey(); }
+    // Shares the other node's output buffers instead of recomputing them
+    void copyOutputsFrom(const Node* other);
+    // Used by the executor when a rewritten plan computes this node's output
+    void setOutputImage(int slot, const cv::Mat& image);
+    std::vector<cv::Mat> outputImages() const;
+    void setOutputImages(const std::vector<cv::Mat>& images);
+    // Every image the node keeps between passes, for memory accounting
+    virtual std::vector<cv::Mat> retainedImages() const { return outputImages(); }
+
+    // Content hash of this node's inputs and parameters, 0 when unknown
+    uint64_t contentKey() const { return m_contentKey; }
+    void setContentKey(uint64_t key) { m_contentKey = key; }
+    // Content key the current outputs were produced for
+    uint64_t resultKey() const { return m_resultKey; }
+    void setResultKey(uint64_t key) { m_resultKey = key; }
 
     void addInputConnection(Node* sourceNode, int sourcePort, int destPort);
     void removeInputConnection(int port);
     std::vector<std::pair<Node*, int>> getInputConnections() const;
 
     void setOutputData(int portIndex, std::shared_ptr<void> data);
+    std::shared_ptr<void> getOutputData(int portIndex) const;
     std::shared_ptr<void> getInputData(int portIndex) const;
+    // m_outputData index of an output port, -1 for inputs
+    int outputSlot(int portIndex) const;
+
+    // Alpha state and color space of an output image. Record it after writing
+    // the image; until then, and after the image is replaced,
+    // ImageInfo::describe() in sRGB applies. Recording resolves an Inherit
+    // space to the first image input's, once, so lookups never walk upstream.
+    ImageInfo outputInfo(int slot) const;
+    void setOutputInfo(int slot, const ImageInfo& info);
+    // Records ImageInfo::describe() for outputs the last run left unrecorded
+    void recordOutputInfo();
+    ImageInfo inputInfo(int portIndex) const;
+    // Input image in straight or premultiplied alpha; empty when unconnected
+    cv::Mat readInput(int portIndex, bool premultiplied = false) const;
+    // Value on a numeric input, or fallback when it is unconnected or empty
+    double inputScalar(int portIndex, double fallback) const;
+    void setOutputScalar(int slot, double value);
 
     NodeID id() const { return m_id; }
 
-signals:
-    void dataUpdated();
+    // Parameters or connections changed since the engine last ran this node
+    bool isDirty() const { return m_dirty.load(std::memory_order_acquire); }
+    void markDirty() { m_dirty.store(true, std::memory_order_release); }
+    bool takeDirty() { return m_dirty.exchange(false, std::memory_order_acq_rel); }
+    // Called by invalidate(), possibly from a worker thread
+    void setInvalidationCallback(std::function<void()> callback) { m_onInvalidated = std::move(callback); }
+
+    void setTimingBadge(double milliseconds, double heat);
+    void clearTimingBadge();
+
+    // Inline thumbnail of the node's output, rendered off the GUI thread
+    void setPreviewEnabled(bool enabled);
+    bool isPreviewEnabled() const { return m_previewEnabled; }
+    void requestPreview();
+
+    // Expensive nodes can ask the UI to apply slider edits on release only
+    void setUpdateOnRelease(bool onRelease) { m_updateOnRelease = onRelease; }
+    bool updatesOnRelease() const { return m_updateOnRelease; }
 
 protected:
-    void mousePressEvent(QGraphicsSceneMouseEvent* event) override;
-    void mouseMoveEvent(QGraphicsSceneMouseEvent* event) override;
-    void mouseReleaseEvent(QGraphicsSceneMouseEvent* event) override;
+    // Call when getPorts() changes for this instance
+    void invalidateLayout();
+
+    // Registers a parameter; its port follows getPorts() in registration order
+    void addParameter(const std::string& name, DataType type, std::function<double()> get,
+                      std::function<void(double)> set);
+    void clearParameters();
+
+    // Setters call this instead of process(); marks the node dirty and lets the
+    // engine coalesce re-evaluation so only the latest values are computed
+    void invalidate();
+
+    // Image shown in the preview; defaults to the first image output
+    virtual cv::Mat previewSource() const;
+
+    static std::string makeParameterKey(std::initializer_list<double> values);
 
     NodeID m_id;
     std::vector<std::pair<Node*, int>> m_inputConnections;
     std::vector<std::shared_ptr<void>> m_outputData;
-    QPointF m_oldPos;
+    double m_lastRunMs = -1.0;  // Negative when no timing is shown
+    double m_heat = 0.0;        // 0 = fastest, 1 = slowest node of the pass
+    bool m_updateOnRelease = false;
+    uint64_t m_contentKey = 0;
+    uint64_t m_resultKey = 0;
+
+private:
+    // Geometry and labels derived from getPorts(), built on first use
+    struct Layout {
+        std::vector<Port> ports;
+        QRectF bounds;
+        QString title;
+        std::vector<QString> portLabels;
+        std::vector<QRectF> portHitRects;
+        std::vector<int> outputSlots;   // Port index -> m_outputData index, -1 for inputs
+    };
+    const Layout& layout() const;
+
+    ImageInfo previewInfo() const;
+    // Recorded space of the first connected image input, sRGB when there is none
+    ColorSpace inputSpace() const;
+    bool isOnScreen() const;
+    void updatePreview(bool visible);
+    void applyPreview(const QImage& image);
+
+    mutable std::unique_ptr<Layout> m_layout;
+    std::atomic<bool> m_dirty{true};
+    std::function<void()> m_onInvalidated;
+    // Info is tied to the buffer it was recorded for
+    struct OutputInfo {
+        const uchar* data = nullptr;
+        ImageInfo info;
+    };
+    std::vector<OutputInfo> m_outputInfo;
+    std::vector<Parameter> m_parameters;
+    std::vector<double> m_appliedInputs;  // Per parameter, NaN until a connection drives it
+    bool m_applyingParameters = false;
+    // Stands in for the connections while the default processBatch() runs
+    std::vector<std::shared_ptr<void>> m_batchInputs;
+    std::vector<cv::Rect> m_patches;
+    bool m_patched = false;
+
+    bool m_previewEnabled = false;
+    bool m_previewStale = false;      // Output changed since the last thumbnail
+    bool m_previewInFlight = false;   // A worker is downsampling
+    bool m_previewScheduled = false;  // A delayed update is queued
+    QElapsedTimer m_previewClock;
+    QImage m_preview;
+
+    friend class PreviewTask;
 };
 
 #endif // NODE_H
\ No newline at end of file
@@ -2,58 +2,91 @@
 #define NODEFACTORY_H
 
 #include "Node.h"
-#include <memory>
-#include <string>
+#include <atomic>
 #include <functional>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Plugins are shared libraries exporting this entry point; bump the version
+// whenever Node or NodeFactory change in a binary-incompatible way
+#define NBIP_PLUGIN_ENTRY "nbip_register_nodes"
+#define NBIP_PLUGIN_ABI_VERSION 1
 
 class NodeFactory {
 public:
-    using CreatorFunc = std::function<Node*()>;
-    
-    static NodeFactory& instance() {
-        static NodeFactory instance;
-        return instance;
-    }
-    
-    void registerNodeType(const std::string& name, CreatorFunc creator) {
-        m_creators[name] = creator;
-    }
-    
-    Node* createNode(const std::string& name) {
-        auto it = m_creators.find(name);
-        if (it != m_creators.end()) {
-            return it->second();
-        }
-        return nullptr;
-    }
-    
-    std::vector<std::string> getAvailableNodes() const {
-        std::vector<std::string> names;
-        for (const auto& pair : m_creators) {
-            names.push_back(pair.first);
-        }
-        return names;
-    }
-    
+    using CreatorFunc = std::function<std::unique_ptr<Node>()>;
+
+    static NodeFactory& instance();
+
+    // Writers copy the registry and publish the copy, so createNode() and
+    // getAvailableNodes() never lock and are safe from any thread. A name that
+    // is already registered is refused with a warning, except for the types a
+    // plugin's manifest announced, which its library fills in when loaded.
+    bool registerNodeType(const std::string& name, CreatorFunc creator);
+    std::unique_ptr<Node> createNode(const std::string& name);
+    // Sorted; the reference stays valid for the lifetime of the program
+    const std::vector<std::string>& getAvailableNodes() const;
+
+    // Reads the "<library>.nodes" manifests in a directory. Each one names the
+    // node types its library provides, and the library is only opened the
+    // first time one of them is created. Returns the number of types announced.
+    int loadPlugins(const std::string& directory);
+    // Same for every directory in NBIP_PLUGIN_PATH (colon separated)
+    int loadPluginsFromEnvironment();
+
 private:
-    NodeFactory() = default;
+    struct Plugin {
+        std::string libraryPath;
+        std::once_flag loadOnce;
+        bool loaded = false;
+    };
+    struct Entry {
+        CreatorFunc creator;               // Empty until a lazy plugin is loaded
+        std::shared_ptr<Plugin> plugin;
+    };
+    struct Registry {
+        std::map<std::string, Entry> entries;
+        std::vector<std::string> names;
+    };
+
+    NodeFactory();
     ~NodeFactory() = default;
     NodeFactory(const NodeFactory&) = delete;
     NodeFactory& operator=(const NodeFactory&) = delete;
-    
-    std::map<std::string, CreatorFunc> m_creators;
+
+    const Registry& registry() const { return *m_registry.load(std::memory_order_acquire); }
+    // Caller holds m_writeMutex
+    void publish(std::unique_ptr<Registry> next);
+    bool loadLibrary(Plugin& plugin);
+
+    std::atomic<const Registry*> m_registry{nullptr};
+    std::mutex m_writeMutex;
+    // Every published snapshot is kept since readers may still hold one
+    std::vector<std::unique_ptr<Registry>> m_snapshots;
 };
 
 template<typename T>
 class NodeRegistrar {
 public:
     NodeRegistrar(const std::string& name) {
-        NodeFactory::instance().registerNodeType(name, []() { return new T(); });
+        NodeFactory::instance().registerNodeType(name, []() { return std::unique_ptr<Node>(new T()); });
     }
 };
 
 #define REGISTER_NODE(type) \
     static NodeRegistrar<type> registrar_##type(#type)
 
-#endif // NODEFACTORY_H
\ No newline at end of file
+// Defines the plugin entry point; registerTypes is called with the factory
+#define NBIP_DECLARE_PLUGIN(registerTypes) \
+    extern "C" __attribute__((visibility("default"))) bool nbip_register_nodes(NodeFactory* factory, int abiVersion) { \
+        if (abiVersion != NBIP_PLUGIN_ABI_VERSION) { \
+            return false; \
+        } \
+        registerTypes(*factory); \
+        return true; \
+    }
+
+#endif // NODEFACTORY_H
@@ -1,11 +1,14 @@
 #ifndef NODEGRAPH_H
 #define NODEGRAPH_H
 
+#include "GraphEngine.h"
 #include "Node.h"
 #include <QGraphicsScene>
 #include <QGraphicsSceneMouseEvent>
 #include <QObject>
 #include <QPointF>
+#include <atomic>
+#include <memory>
 #include <vector>
 
 class NodeGraph : public QGraphicsScene {
@@ -18,9 +21,61 @@ public:
     void removeNode(Node* node);
     void connectNodes(Node* sourceNode, int sourcePort, Node* destNode, int destPort);
     void disconnectNodes(Node* destNode, int destPort);
+    // Recomputes every node
     void processGraph();
+    // Recomputes what changed since the last pass
+    void processPending();
 
-    std::vector<Node*> getNodes() const { return m_nodes; }
+    // Coalesces requests into at most one pass per display frame
+    void scheduleProcessing();
+
+    // Carries same-sized frames through the nodes between source and target,
+    // batchSize() frames per dispatch. The frames replace source's output and
+    // the result is target's outputs as [slot][frame]; for a sink, the frames
+    // arriving at its inputs. Other nodes contribute their current outputs.
+    std::vector<ImageBatch> processBatch(Node* source, const ImageBatch& frames, Node* target) {
+        return m_engine.processBatch(source, frames, target);
+    }
+    void setBatchSize(size_t frames) { m_engine.setBatchSize(frames); }
+    size_t batchSize() const { return m_engine.batchSize(); }
+
+    // Runs the graph once per value of node's named parameter and returns
+    // target's outputs for each (for a sink, its inputs). Only node and its
+    // dependents re-run between values. The parameter is restored afterwards;
+    // a parameter driven by a connection cannot be swept and gives no results.
+    std::vector<std::vector<cv::Mat>> sweep(Node* node, const std::string& parameter, const std::vector<double>& values,
+                                            Node* target) {
+        return m_engine.sweep(node, parameter, values, target);
+    }
+
+    // Replaces nodes with one instance of a new group definition built from
+    // them (see GroupDefinition::capture), registered in NodeFactory under
+    // name so further instances can be added. Returns the instance, or null
+    // without changing the graph when name is taken or a node's type is not
+    // one NodeFactory can create.
+    Node* groupNodes(const std::vector<Node*>& nodes, const std::string& name);
+
+    std::vector<Node*> getNodes() const { return m_engine.nodes(); }
+    GraphEngine& engine() { return m_engine; }
+
+    // Merging and pruning applied before each pass
+    void setOptimizerOptions(const GraphOptimizer::Options& options) { m_engine.setOptimizerOptions(options); }
+    const ExecutionPlan& lastPlan() const { return m_engine.lastPlan(); }
+
+    // Per-node timings of recent passes, shown as badges on the nodes
+    void setProfilingEnabled(bool enabled);
+    bool isProfilingEnabled() const { return m_engine.profiler().isEnabled(); }
+    const NodeProfiler& profiler() const { return m_engine.profiler(); }
+    bool exportTrace(const std::string& path) const { return m_engine.profiler().exportChromeTrace(path); }
+
+    // Reuses outputs whose content key is unchanged and persists slow ones to
+    // disk. Enabled from NBIP_CACHE_DIR by default; null disables it.
+    void setResultCache(std::shared_ptr<ResultCache> cache) { m_engine.setResultCache(std::move(cache)); }
+    void setMemoryBudget(std::shared_ptr<MemoryBudget> budget) { m_engine.setMemoryBudget(std::move(budget)); }
+    void setDamageTracking(bool enabled) { m_engine.setDamageTracking(enabled); }
+    const std::shared_ptr<ResultCache>& resultCache() const { return m_engine.resultCache(); }
+    // Only nodes slower than this are written, cheap ones recompute faster than they load
+    void setCacheThresholdMs(double milliseconds) { m_engine.setCacheThresholdMs(milliseconds); }
 
 signals:
     void nodeAdded(Node* node);
@@ -35,10 +90,15 @@ protected:
     void mouseReleaseEvent(QGraphicsSceneMouseEvent* event) override;
 
 private:
-    std::vector<Node*> m_nodes;
+    Node* nodeAt(const QPointF& scenePos) const;
+    void updateTimingBadges();
+    void passFinished(const std::vector<Node*>& updated);
+
+    GraphEngine m_engine;
     QGraphicsLineItem* m_tempConnection = nullptr;
     Node* m_connectionStartNode = nullptr;
     int m_connectionStartPort = -1;
+    std::atomic<bool> m_flushScheduled{false};
 };
 
 #endif // NODEGRAPH_H
\ No newline at end of file
@@ -0,0 +1,69 @@
+#ifndef NODEPROFILER_H
+#define NODEPROFILER_H
+
+#include "types.h"
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <string>
+#include <vector>
+
+class Node;
+
+struct ImageDims {
+    int port = -1;
+    int width = 0;
+    int height = 0;
+    int channels = 0;
+};
+
+struct NodeTiming {
+    NodeID nodeId = 0;
+    std::string nodeName;
+    int64_t startNs = 0;      // Offset from the start of the pass
+    int64_t wallNs = 0;
+    int64_t cpuNs = 0;        // Process CPU time, so OpenCV worker threads are included
+    size_t bytesAllocated = 0;
+    std::vector<ImageDims> inputs;
+    std::vector<ImageDims> outputs;
+};
+
+struct PassProfile {
+    uint64_t passIndex = 0;
+    int64_t startNs = 0;      // Steady clock timestamp
+    int64_t wallNs = 0;
+    std::vector<NodeTiming> nodes;
+};
+
+// Records per-node execution statistics for each processGraph() pass
+class NodeProfiler {
+public:
+    explicit NodeProfiler(size_t maxPasses = 64);
+
+    void setEnabled(bool enabled);
+    bool isEnabled() const { return m_enabled; }
+
+    void beginPass();
+    void runNode(Node* node);
+    // Records work done on behalf of node, e.g. a fused chain ending at it
+    void runNode(Node* node, const std::function<void()>& work);
+    void endPass();
+
+    const std::deque<PassProfile>& passes() const { return m_passes; }
+    const PassProfile* lastPass() const;
+    const NodeTiming* lastTiming(NodeID id) const;
+    void clear();
+
+    // Writes the retained passes in Chrome trace-event format (chrome://tracing, Perfetto)
+    bool exportChromeTrace(const std::string& path) const;
+
+private:
+    size_t m_maxPasses;
+    bool m_enabled = false;
+    bool m_inPass = false;
+    uint64_t m_nextPassIndex = 0;
+    PassProfile m_current;
+    std::deque<PassProfile> m_passes;
+};
+
+#endif // NODEPROFILER_H
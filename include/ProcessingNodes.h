@@ -2,23 +2,51 @@
 #define PROCESSINGNODES_H
 
 #include "Node.h"
+#include "Resample.h"
 #include <opencv2/opencv.hpp>
 
+// Shared by BlendNode and CompositeNode; the first five match BlendNode's old modes
+enum class BlendMode { Normal, Multiply, Screen, Overlay, Difference, Add, Subtract, Darken, Lighten, SoftLight, HardLight };
+
+// An input converted to a target color space, size and 8-bit type, reused
+// while the input buffer, spaces, size and type stay the same. The held header
+// keeps the buffer alive, so an unchanged data pointer means an unchanged input.
+struct PreparedInput {
+    cv::Mat source;
+    cv::Size size;
+    int type = -1;
+    ColorSpace from = ColorSpace::Inherit;
+    ColorSpace to = ColorSpace::Inherit;
+    cv::Mat prepared;
+
+    const cv::Mat& prepare(const cv::Mat& input, cv::Size targetSize, int targetType,
+                           ColorSpace fromSpace = ColorSpace::SRGB, ColorSpace toSpace = ColorSpace::SRGB);
+};
+
 class BrightnessContrastNode : public Node {
 public:
     BrightnessContrastNode();
     ~BrightnessContrastNode() override = default;
     
     void process() override;
+    void processBatch(const std::vector<ImageBatch>& inputs, std::vector<ImageBatch>& outputs) override;
     std::string name() const override { return "Brightness/Contrast"; }
-    std::vector<Port> getPorts() const override;
+    const std::vector<Port>& getPorts() const override;
+    std::string parameterKey() const override;
+    int damageMargin() const override { return 0; }
     
     void setBrightness(int value);
     void setContrast(float value);
+    int brightness() const { return m_brightness; }
+    float contrast() const { return m_contrast; }
     
 private:
     int m_brightness;
     float m_contrast;
+    
+    // 8-bit output level for each input level
+    cv::Mat lookupTable() const;
+    void adjust(const cv::Mat& lut, const cv::Mat& input, cv::Mat& output) const;
 };
 
 class BlurNode : public Node {
@@ -27,10 +55,18 @@ public:
     ~BlurNode() override = default;
     
     void process() override;
+    void processBatch(const std::vector<ImageBatch>& inputs, std::vector<ImageBatch>& outputs) override;
     std::string name() const override { return "Blur"; }
-    std::vector<Port> getPorts() const override;
+    const std::vector<Port>& getPorts() const override;
+    std::string parameterKey() const override;
+    int damageMargin() const override { return kernelSize() / 2; }
     
     void setRadius(int radius);
+    int radius() const { return m_radius; }
+    // GaussianBlur needs an odd aperture; even radii round up
+    int kernelSize() const { return m_radius | 1; }
+    // The sigma OpenCV derives from kernelSize()
+    double sigma() const { return 0.3 * ((kernelSize() - 1) * 0.5 - 1) + 0.8; }
     
 private:
     int m_radius;
@@ -38,17 +74,41 @@ private:
 
 class ThresholdNode : public Node {
 public:
+    // Fixed uses threshold(); Otsu and Triangle pick one from the histogram;
+    // the adaptive modes compare each pixel with its radius() neighbourhood
+    enum Mode { Fixed, Otsu, Triangle, AdaptiveMean, Sauvola };
+    
     ThresholdNode();
     ~ThresholdNode() override = default;
     
     void process() override;
+    void processBatch(const std::vector<ImageBatch>& inputs, std::vector<ImageBatch>& outputs) override;
     std::string name() const override { return "Threshold"; }
-    std::vector<Port> getPorts() const override;
+    const std::vector<Port>& getPorts() const override;
+    std::string parameterKey() const override;
+    int damageMargin() const override;
     
     void setThreshold(int value);
+    void setMode(int mode);
+    void setRadius(int radius);
+    // Subtracted from the local mean in AdaptiveMean mode
+    void setOffset(int offset);
+    // Sauvola's k; larger values need more local contrast to stay foreground
+    void setSauvolaK(float k);
+    int threshold() const { return m_threshold; }
+    int mode() const { return m_mode; }
+    int radius() const { return m_radius; }
+    int offset() const { return m_offset; }
+    float sauvolaK() const { return m_sauvolaK; }
     
 private:
     int m_threshold;
+    int m_mode;
+    int m_radius;
+    int m_offset;
+    float m_sauvolaK;
+    
+    void binarize(const cv::Mat& gray, cv::Mat& output) const;
 };
 
 class EdgeDetectionNode : public Node {
@@ -58,7 +118,10 @@ public:
     
     void process() override;
     std::string name() const override { return "Edge Detection"; }
-    std::vector<Port> getPorts() const override;
+    const std::vector<Port>& getPorts() const override;
+    std::string parameterKey() const override;
+    // Canny's hysteresis can follow an edge across the whole frame
+    int damageMargin() const override { return m_method == 0 ? 1 : -1; }
     
     void setMethod(int method); // 0 = Sobel, 1 = Canny
     
@@ -73,7 +136,10 @@ public:
     
     void process() override;
     std::string name() const override { return "Blend"; }
-    std::vector<Port> getPorts() const override;
+    const std::vector<Port>& getPorts() const override;
+    std::string parameterKey() const override;
+    int damageMargin() const override { return 0; }
+    void discardInputCaches() override;
     
     void setBlendMode(int mode);
     void setOpacity(float opacity);
@@ -81,69 +147,347 @@ public:
 private:
     int m_blendMode;
     float m_opacity;
+    PreparedInput m_base;
+    PreparedInput m_layer;
 };
 
-#endif // PROCESSINGNODES_H
-// Add these class declarations to ProcessingNodes.h
+// Stacks any number of layers bottom-up in one pass over the rows. Layer 0 is
+// the base and sets the output size and channels; every other layer has its
+// own blend mode, opacity and optional single-channel mask.
+class CompositeNode : public Node {
+public:
+    CompositeNode();
+    ~CompositeNode() override = default;
+    
+    void process() override;
+    std::string name() const override { return "Composite"; }
+    const std::vector<Port>& getPorts() const override { return m_ports; }
+    std::string parameterKey() const override;
+    int damageMargin() const override { return 0; }
+    void discardInputCaches() override;
+    // The layer count; modes and opacities are parameters
+    std::function<void(Node&)> captureState() const override;
+    
+    // Port 0 is the output; layer i uses ports 1 + 2i (image) and 2 + 2i (mask).
+    // Layer 0 is the base: its mask and opacity apply but its mode stays Normal.
+    void setLayerCount(int count);
+    int layerCount() const { return static_cast<int>(m_layers.size()); }
+    void setLayerMode(int layer, BlendMode mode);
+    void setLayerOpacity(int layer, float opacity);
+    BlendMode layerMode(int layer) const { return m_layers[layer].mode; }
+    float layerOpacity(int layer) const { return m_layers[layer].opacity; }
+    
+private:
+    struct Layer {
+        BlendMode mode = BlendMode::Normal;
+        float opacity = 1.0f;
+        PreparedInput image;
+        PreparedInput mask;
+    };
+    
+    void rebuildPorts();
+    
+    std::vector<Layer> m_layers;
+    std::vector<Port> m_ports;
+};
 
 class ColorChannelSplitterNode : public Node {
-    public:
-        ColorChannelSplitterNode();
-        ~ColorChannelSplitterNode() override = default;
-        
-        void process() override;
-        std::string name() const override { return "Channel Splitter"; }
-        std::vector<Port> getPorts() const override;
-        
-        void setOutputGrayscale(bool grayscale);
-        
-    private:
-        bool m_outputGrayscale;
-    };
+public:
+    ColorChannelSplitterNode();
+    ~ColorChannelSplitterNode() override = default;
     
-    class NoiseGenerationNode : public Node {
-    public:
-        enum NoiseType { Perlin, Simplex, Worley };
-        
-        NoiseGenerationNode();
-        ~NoiseGenerationNode() override = default;
-        
-        void process() override;
-        std::string name() const override { return "Noise Generator"; }
-        std::vector<Port> getPorts() const override;
-        
-        void setNoiseType(NoiseType type);
-        void setScale(float scale);
-        void setOctaves(int octaves);
-        void setPersistence(float persistence);
-        void setUseAsDisplacement(bool useAsDisplacement);
-        
-    private:
-        NoiseType m_type;
-        float m_scale;
-        int m_octaves;
-        float m_persistence;
-        bool m_useAsDisplacement;
-        
-        float perlinNoise(float x, float y, float z = 0.0f);
-    };
+    void process() override;
+    std::string name() const override { return "Channel Splitter"; }
+    const std::vector<Port>& getPorts() const override;
+    std::string parameterKey() const override;
+    int damageMargin() const override { return 0; }
+    std::vector<cv::Mat> retainedImages() const override;
+    
+    void setOutputGrayscale(bool grayscale);
+    
+private:
+    bool m_outputGrayscale;
+    cv::Mat m_opaqueAlpha;
+};
+
+// Converts to another color space. The input's space is tracked through the
+// graph, so only the target is chosen; adjacent conversions fuse into one,
+// and converting back to the space an image is already in costs nothing.
+class ColorSpaceNode : public Node {
+public:
+    ColorSpaceNode();
+    ~ColorSpaceNode() override = default;
+    
+    void process() override;
+    std::string name() const override { return "Color Space"; }
+    const std::vector<Port>& getPorts() const override;
+    std::string parameterKey() const override;
+    
+    void setSpace(int space);
+    ColorSpace space() const { return m_space; }
+    
+private:
+    ColorSpace m_space;
+};
+
+class NoiseGenerationNode : public Node {
+public:
+    enum NoiseType { Perlin, Simplex, Worley };
+    
+    NoiseGenerationNode();
+    ~NoiseGenerationNode() override = default;
+    
+    void process() override;
+    std::string name() const override { return "Noise Generator"; }
+    const std::vector<Port>& getPorts() const override;
+    std::string parameterKey() const override;
+    
+    void setNoiseType(NoiseType type);
+    void setScale(float scale);
+    void setOctaves(int octaves);
+    void setPersistence(float persistence);
+    void setUseAsDisplacement(bool useAsDisplacement);
+    
+private:
+    NoiseType m_type;
+    float m_scale;
+    int m_octaves;
+    float m_persistence;
+    bool m_useAsDisplacement;
+};
+
+class ConvolutionFilterNode : public Node {
+public:
+    ConvolutionFilterNode();
+    ~ConvolutionFilterNode() override = default;
+    
+    void process() override;
+    void processBatch(const std::vector<ImageBatch>& inputs, std::vector<ImageBatch>& outputs) override;
+    std::string name() const override { return "Convolution Filter"; }
+    const std::vector<Port>& getPorts() const override;
+    std::string parameterKey() const override;
+    int damageMargin() const override { return m_kernelSize / 2; }
+    std::function<void(Node&)> captureState() const override;
+    
+    void setKernelSize(int size);
+    void setKernelValue(int row, int col, float value);
+    void setPreset(int preset);
+    cv::Mat kernelMatrix() const;
+    
+private:
+    int m_kernelSize;
+    std::vector<std::vector<float>> m_kernel;
+    
+    static void applyKernel(const cv::Mat& kernel, const cv::Mat& input, cv::Mat& output);
+};
+
+// Mask cleanup. Rectangles and lines run in constant time per pixel whatever
+// the radius; ellipses go through OpenCV and cost grows with their area.
+class MorphologyNode : public Node {
+public:
+    enum Operation { Erode, Dilate, Open, Close, Gradient };
+    enum Shape { Rectangle, HorizontalLine, VerticalLine, Ellipse };
+    
+    MorphologyNode();
+    ~MorphologyNode() override = default;
+    
+    void process() override;
+    std::string name() const override { return "Morphology"; }
+    const std::vector<Port>& getPorts() const override;
+    std::string parameterKey() const override;
+    int damageMargin() const override;
+    
+    void setOperation(int operation);
+    void setShape(int shape);
+    void setRadius(int radius);
+    int operation() const { return m_operation; }
+    int shape() const { return m_shape; }
+    int radius() const { return m_radius; }
+    
+private:
+    int m_operation;
+    int m_shape;
+    int m_radius;
     
-    class ConvolutionFilterNode : public Node {
-    public:
-        ConvolutionFilterNode();
-        ~ConvolutionFilterNode() override = default;
-        
-        void process() override;
-        std::string name() const override { return "Convolution Filter"; }
-        std::vector<Port> getPorts() const override;
-        
-        void setKernelSize(int size);
-        void setKernelValue(int row, int col, float value);
-        void setPreset(int preset);
-        
-    private:
-        int m_kernelSize;
-        std::vector<std::vector<float>> m_kernel;
-        
-        void applyKernel(const cv::Mat& input, cv::Mat& output);
-    };
\ No newline at end of file
+    void minMax(const cv::Mat& input, cv::Mat& output, bool maximum) const;
+};
+
+class MedianNode : public Node {
+public:
+    MedianNode();
+    ~MedianNode() override = default;
+    
+    void process() override;
+    std::string name() const override { return "Median"; }
+    const std::vector<Port>& getPorts() const override;
+    std::string parameterKey() const override;
+    int damageMargin() const override { return m_radius; }
+    
+    void setRadius(int radius);
+    int radius() const { return m_radius; }
+    
+private:
+    int m_radius;
+};
+
+// A node whose output is its input resampled through one projective
+// transform. Chains of these run as a single resample of the first input.
+class GeometricNode : public Node {
+public:
+    ~GeometricNode() override = default;
+    
+    void process() override;
+    const std::vector<Port>& getPorts() const override;
+    std::vector<cv::Mat> retainedImages() const override;
+    
+    // Input pixel coordinates to output pixel coordinates
+    virtual cv::Matx33d transform(cv::Size inputSize) const = 0;
+    virtual cv::Size outputSize(cv::Size inputSize) const = 0;
+    // Whether fusing a later transform after this one matches running them
+    // apart: every pixel moves to another pixel centre and none is dropped
+    virtual bool isLossless(cv::Size inputSize) const;
+    
+    void setInterpolation(int interpolation); // 0 = nearest, 1 = linear, 2 = cubic
+    Interpolation interpolation() const { return m_interpolation; }
+    
+protected:
+    GeometricNode();
+    
+    Interpolation m_interpolation;
+    
+private:
+    RemapTable m_remapTable;
+};
+
+class ResizeNode : public GeometricNode {
+public:
+    ResizeNode();
+    ~ResizeNode() override = default;
+    
+    std::string name() const override { return "Resize"; }
+    std::string parameterKey() const override;
+    cv::Matx33d transform(cv::Size inputSize) const override;
+    cv::Size outputSize(cv::Size inputSize) const override;
+    
+    // Used when no explicit size is set
+    void setScale(float scale);
+    // A zero dimension follows the other one's aspect ratio; both zero uses the scale
+    void setSize(int width, int height);
+    float scale() const { return m_scale; }
+    
+private:
+    float m_scale;
+    int m_width;
+    int m_height;
+};
+
+// Rotation, scale and perspective tilt about the image centre, then a translation
+class WarpNode : public GeometricNode {
+public:
+    WarpNode();
+    ~WarpNode() override = default;
+    
+    std::string name() const override { return "Warp"; }
+    std::string parameterKey() const override;
+    cv::Matx33d transform(cv::Size inputSize) const override;
+    cv::Size outputSize(cv::Size inputSize) const override { return inputSize; }
+    
+    void setAngle(float degrees);
+    void setScale(float scale);
+    void setTranslation(float x, float y);
+    // Projective terms per pixel from the centre; zero keeps the warp affine
+    void setTilt(float x, float y);
+    float angle() const { return m_angle; }
+    float scale() const { return m_scale; }
+    
+private:
+    float m_angle;
+    float m_scale;
+    float m_translateX;
+    float m_translateY;
+    float m_tiltX;
+    float m_tiltY;
+};
+
+// Output is a view into the input's buffer; nothing is copied
+class CropNode : public GeometricNode {
+public:
+    CropNode();
+    ~CropNode() override = default;
+    
+    void process() override;
+    std::string name() const override { return "Crop"; }
+    std::string parameterKey() const override;
+    cv::Matx33d transform(cv::Size inputSize) const override;
+    cv::Size outputSize(cv::Size inputSize) const override;
+    bool isLossless(cv::Size) const override { return false; }
+    
+    void setRect(int x, int y, int width, int height);
+    const cv::Rect& rect() const { return m_rect; }
+    // The crop rectangle clipped to the input
+    cv::Rect clippedRect(cv::Size inputSize) const;
+    
+private:
+    cv::Rect m_rect;
+};
+
+// Moves each pixel by a displacement map: red (or the only channel) shifts
+// horizontally, green vertically, with mid-grey meaning no shift
+class DisplacementNode : public Node {
+public:
+    DisplacementNode();
+    ~DisplacementNode() override = default;
+    
+    void process() override;
+    std::string name() const override { return "Displace"; }
+    const std::vector<Port>& getPorts() const override;
+    std::string parameterKey() const override;
+    std::vector<cv::Mat> retainedImages() const override;
+    void discardInputCaches() override { m_mapSource.release(); }
+    
+    void setStrength(float pixels);
+    void setInterpolation(int interpolation);
+    float strength() const { return m_strength; }
+    
+private:
+    float m_strength;
+    Interpolation m_interpolation;
+    // Tables are rebuilt only when the map, image size or parameters change
+    cv::Mat m_mapSource;
+    cv::Size m_tableSize;
+    float m_tableStrength = 0.0f;
+    Interpolation m_tableInterpolation = Interpolation::Linear;
+    RemapTable m_remapTable;
+};
+
+// Histogram and summary statistics from one pass over the image. The scalar
+// outputs can drive other nodes' parameters; Levels Gain and Levels Offset
+// stretch the percentile range to 0-255 as Brightness/Contrast's contrast and
+// brightness.
+class StatisticsNode : public Node {
+public:
+    // Luma, all channels together, or one of B, G, R, A
+    enum Channel { Luma, AllChannels, Blue, Green, Red, Alpha };
+    
+    StatisticsNode();
+    ~StatisticsNode() override = default;
+    
+    void process() override;
+    std::string name() const override { return "Statistics"; }
+    const std::vector<Port>& getPorts() const override;
+    std::string parameterKey() const override;
+    
+    void setChannel(int channel);
+    // Percentiles in percent, for the Low and High outputs
+    void setPercentiles(float low, float high);
+    int channel() const { return m_channel; }
+    float lowPercentile() const { return m_lowPercentile; }
+    float highPercentile() const { return m_highPercentile; }
+    
+private:
+    int m_channel;
+    float m_lowPercentile;
+    float m_highPercentile;
+};
+
+#endif // PROCESSINGNODES_H
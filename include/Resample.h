@@ -0,0 +1,42 @@
+#ifndef RESAMPLE_H
+#define RESAMPLE_H
+
+#include <opencv2/core.hpp>
+#include <vector>
+
+// Transforms map input pixel coordinates to output pixel coordinates, with
+// integer coordinates at pixel centres, as OpenCV's warps use them
+enum class Interpolation { Nearest, Linear, Cubic };
+
+int cvInterpolation(Interpolation interpolation);
+
+// Fixed-point remap tables for one transform, rebuilt only when the transform,
+// sizes or interpolation change. OpenCV's remap runs its vectorized
+// fixed-point kernels on these tables, and a perspective warp no longer
+// divides per pixel on every pass.
+class RemapTable {
+public:
+    // False when the output is too large to be worth holding tables for
+    bool prepare(const cv::Matx33d& transform, cv::Size inputSize, cv::Size outputSize, Interpolation interpolation);
+    void apply(const cv::Mat& input, cv::Mat& output, int border = cv::BORDER_CONSTANT) const;
+    // Tables from absolute source coordinates (CV_32FC2) the caller built
+    void assign(const cv::Mat& coordinates, Interpolation interpolation);
+    void clear();
+    std::vector<cv::Mat> buffers() const { return {m_map1, m_map2}; }
+
+private:
+    cv::Matx33d m_transform;
+    cv::Size m_inputSize;
+    cv::Size m_outputSize;
+    Interpolation m_interpolation = Interpolation::Linear;
+    cv::Mat m_map1;
+    cv::Mat m_map2;
+};
+
+// Resamples input through transform into an image of the given size. Integer
+// translations come back as views of input where they fit inside it, and
+// plain scales go through cv::resize. Pixels from outside the input are zero.
+void resample(const cv::Mat& input, cv::Mat& output, const cv::Matx33d& transform, cv::Size size,
+              Interpolation interpolation, RemapTable* table = nullptr);
+
+#endif // RESAMPLE_H
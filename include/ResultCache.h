@@ -0,0 +1,47 @@
+#ifndef RESULTCACHE_H
+#define RESULTCACHE_H
+
+#include <opencv2/core.hpp>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Content-addressed on-disk store of node outputs.
+// Keys hash the node type, its parameters and the keys of everything upstream,
+// salted with GraphEngine's algorithm version and the active kernel level, so
+// equal keys mean equal outputs across sessions, processes and builds. Entries are
+// raw Mat data written to a temporary file and renamed into place, which makes
+// the directory safe to share between concurrent processes on one machine.
+// Reads refresh an entry's timestamp; eviction removes the least recently used
+// entries once the directory exceeds its size budget.
+class ResultCache {
+public:
+    explicit ResultCache(const std::string& directory, uint64_t maxBytes = 2ull << 30);
+
+    // NBIP_CACHE_DIR enables the cache, NBIP_CACHE_MAX_MB bounds it
+    static std::shared_ptr<ResultCache> fromEnvironment();
+
+    const std::string& directory() const { return m_directory; }
+    uint64_t maxBytes() const { return m_maxBytes; }
+
+    // flags holds one caller-defined word per image (ImageInfo::flags())
+    bool load(uint64_t key, std::vector<cv::Mat>& images, std::vector<uint32_t>* flags = nullptr);
+    bool store(uint64_t key, const std::vector<cv::Mat>& images, const std::vector<uint32_t>* flags = nullptr);
+    void evict();
+
+    static uint64_t hash(const void* data, size_t size, uint64_t seed = 0xcbf29ce484222325ull);
+    static uint64_t hash(const std::string& text) { return hash(text.data(), text.size()); }
+    static uint64_t combine(uint64_t seed, uint64_t value);
+
+private:
+    std::string pathFor(uint64_t key) const;
+
+    std::string m_directory;
+    uint64_t m_maxBytes;
+    std::mutex m_mutex;
+    uint64_t m_bytesSinceEviction = 0;
+};
+
+#endif // RESULTCACHE_H
@@ -18,6 +18,12 @@ enum class DataType {
     Integer
 };
 
+// Scalar, Boolean and Integer values travel as 1x1 CV_64F Mats, so the
+// engine, caches and aliases handle them like any other output
+inline bool isNumeric(DataType type) {
+    return type != DataType::Image;
+}
+
 struct Port {
     int id;
     std::string name;
@@ -28,5 +34,6 @@ struct Port {
 
 using NodeID = int;
 using Connection = std::pair<NodeID, int>; // node ID and port index
+using ImageBatch = std::vector<cv::Mat>;    // One image per frame
 
 #endif // TYPES_H
\ No newline at end of file
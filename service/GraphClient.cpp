@@ -0,0 +1,121 @@
+#include "GraphClient.h"
+#include <cerrno>
+#include <cstring>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace GraphProtocol;
+
+GraphClient::~GraphClient() {
+    close();
+}
+
+bool GraphClient::connect(const std::string& socketPath) {
+    close();
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    if (socketPath.size() >= sizeof(address.sun_path)) {
+        return fail("Socket path too long: " + socketPath);
+    }
+    std::strncpy(address.sun_path, socketPath.c_str(), sizeof(address.sun_path) - 1);
+
+    m_socket = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (m_socket < 0) {
+        return fail(std::string("socket: ") + std::strerror(errno));
+    }
+    if (::connect(m_socket, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0) {
+        const std::string error = std::string("Cannot connect to ") + socketPath + ": " + std::strerror(errno);
+        close();
+        return fail(error);
+    }
+    return true;
+}
+
+void GraphClient::close() {
+    if (m_socket >= 0) {
+        ::close(m_socket);
+        m_socket = -1;
+    }
+}
+
+bool GraphClient::fail(const std::string& error) {
+    m_lastError = error;
+    return false;
+}
+
+bool GraphClient::listGraphs(std::vector<GraphInfo>& graphs) {
+    if (!isConnected()) {
+        return fail("Not connected");
+    }
+    std::vector<uint8_t> payload;
+    int fd = -1;
+    if (!sendMessage(m_socket, encodeListRequest()) || !receiveMessage(m_socket, payload, fd)) {
+        close();
+        return fail("Connection lost");
+    }
+    if (fd >= 0) {
+        ::close(fd);
+    }
+
+    std::vector<GraphSummary> summaries;
+    if (!decodeListResponse(payload, summaries)) {
+        close();
+        return fail("Malformed response");
+    }
+    graphs.clear();
+    for (const auto& summary : summaries) {
+        graphs.push_back({summary.name, static_cast<int>(summary.inputs), static_cast<int>(summary.outputs)});
+    }
+    return true;
+}
+
+bool GraphClient::run(const std::string& graph, const std::vector<cv::Mat>& inputs, std::vector<cv::Mat>& outputs,
+                      const std::vector<ParameterOverride>& overrides) {
+    m_lastBatchSize = 0;
+    if (!isConnected()) {
+        return fail("Not connected");
+    }
+    RunRequest request;
+    request.id = m_nextId++;
+    request.graph = graph;
+    request.overrides = overrides;
+    SharedBuffer buffer;
+    if (!packImages(inputs, buffer, request.inputs)) {
+        return fail("Cannot allocate shared memory");
+    }
+    if (!sendMessage(m_socket, encodeRunRequest(request), buffer.fd())) {
+        close();
+        return fail("Connection lost");
+    }
+    // The service maps its own copy of the descriptor
+    buffer.reset();
+
+    std::vector<uint8_t> payload;
+    int fd = -1;
+    if (!receiveMessage(m_socket, payload, fd)) {
+        close();
+        return fail("Connection lost");
+    }
+    SharedBuffer result;
+    const bool mapped = fd >= 0 && result.map(fd);
+    RunResponse response;
+    if (!decodeRunResponse(payload, response) || response.id != request.id) {
+        close();
+        return fail("Malformed response");
+    }
+    if (!response.ok) {
+        return fail(response.error);
+    }
+    std::vector<cv::Mat> views;
+    if (!response.outputs.empty() && (!mapped || !viewImages(result, response.outputs, views))) {
+        return fail("Invalid output buffer");
+    }
+    // Copies, so the mapping can go away with this call
+    outputs.clear();
+    for (const cv::Mat& view : views) {
+        outputs.push_back(view.clone());
+    }
+    m_lastBatchSize = static_cast<int>(response.batchSize);
+    return true;
+}
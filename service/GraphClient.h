@@ -0,0 +1,47 @@
+#ifndef GRAPHCLIENT_H
+#define GRAPHCLIENT_H
+
+#include "GraphProtocol.h"
+#include <opencv2/core.hpp>
+#include <string>
+#include <vector>
+
+// Talks to a GraphService over its socket. One request is in flight per
+// client; use one client per thread for concurrency.
+class GraphClient {
+public:
+    struct GraphInfo {
+        std::string name;
+        int inputs = 0;
+        int outputs = 0;
+    };
+
+    GraphClient() = default;
+    ~GraphClient();
+    GraphClient(const GraphClient&) = delete;
+    GraphClient& operator=(const GraphClient&) = delete;
+
+    bool connect(const std::string& socketPath);
+    void close();
+    bool isConnected() const { return m_socket >= 0; }
+
+    bool listGraphs(std::vector<GraphInfo>& graphs);
+    // Inputs bind to the graph's request inputs in file order; outputs come
+    // back in the order the graph file lists them. Images are straight alpha.
+    bool run(const std::string& graph, const std::vector<cv::Mat>& inputs, std::vector<cv::Mat>& outputs,
+             const std::vector<GraphProtocol::ParameterOverride>& overrides = {});
+
+    const std::string& lastError() const { return m_lastError; }
+    // Requests that shared the service's last pass for this client
+    int lastBatchSize() const { return m_lastBatchSize; }
+
+private:
+    bool fail(const std::string& error);
+
+    int m_socket = -1;
+    uint64_t m_nextId = 1;
+    std::string m_lastError;
+    int m_lastBatchSize = 0;
+};
+
+#endif // GRAPHCLIENT_H
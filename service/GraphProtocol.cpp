@@ -0,0 +1,502 @@
+#include "GraphProtocol.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <sys/syscall.h>
+#else
+#include <atomic>
+#include <string>
+#endif
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+#ifndef MSG_CMSG_CLOEXEC
+#define MSG_CMSG_CLOEXEC 0
+#endif
+
+namespace GraphProtocol {
+
+namespace {
+
+const size_t kAlignment = 64;
+
+size_t alignUp(size_t value) {
+    return (value + kAlignment - 1) & ~(kAlignment - 1);
+}
+
+int createAnonymousFile() {
+#if defined(__linux__) && defined(SYS_memfd_create)
+    const int fd = static_cast<int>(syscall(SYS_memfd_create, "nbip-graph", 1u /* MFD_CLOEXEC */ | 2u /* MFD_ALLOW_SEALING */));
+    if (fd >= 0) {
+        return fd;
+    }
+#endif
+#if !defined(__linux__)
+    static std::atomic<unsigned> counter{0};
+    const std::string name = "/nbip-" + std::to_string(getpid()) + "-" + std::to_string(counter++);
+    const int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd >= 0) {
+        shm_unlink(name.c_str());
+    }
+    return fd;
+#else
+    return -1;
+#endif
+}
+
+#if defined(F_ADD_SEALS) && defined(F_GET_SEALS)
+const int kSizeSeals = F_SEAL_SHRINK | F_SEAL_GROW;
+#endif
+
+bool sealSize(int fd) {
+#if defined(F_ADD_SEALS) && defined(F_GET_SEALS)
+    return fcntl(fd, F_ADD_SEALS, kSizeSeals) == 0;
+#else
+    (void)fd;
+    return false;
+#endif
+}
+
+bool isSizeSealed(int fd) {
+#if defined(F_ADD_SEALS) && defined(F_GET_SEALS)
+    const int seals = fcntl(fd, F_GET_SEALS);
+    return seals >= 0 && (seals & kSizeSeals) == kSizeSeals;
+#else
+    (void)fd;
+    return false;
+#endif
+}
+
+class Writer {
+public:
+    template<typename T>
+    void put(const T& value) {
+        const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&value);
+        m_data.insert(m_data.end(), bytes, bytes + sizeof(T));
+    }
+    void putString(const std::string& value) {
+        put(static_cast<uint32_t>(value.size()));
+        m_data.insert(m_data.end(), value.begin(), value.end());
+    }
+    void putImages(const std::vector<ImageDescriptor>& images) {
+        put(static_cast<uint32_t>(images.size()));
+        for (const auto& image : images) {
+            put(image.rows);
+            put(image.cols);
+            put(image.type);
+            put(image.offset);
+            put(image.step);
+        }
+    }
+    std::vector<uint8_t> take() { return std::move(m_data); }
+
+private:
+    std::vector<uint8_t> m_data;
+};
+
+// Every read is bounds-checked; a failed read leaves the reader failed
+class Reader {
+public:
+    explicit Reader(const std::vector<uint8_t>& data) : m_data(data) {}
+
+    template<typename T>
+    bool get(T& value) {
+        if (!m_ok || m_data.size() - m_position < sizeof(T)) {
+            return m_ok = false;
+        }
+        std::memcpy(&value, m_data.data() + m_position, sizeof(T));
+        m_position += sizeof(T);
+        return true;
+    }
+    bool getString(std::string& value) {
+        uint32_t size = 0;
+        if (!get(size) || m_data.size() - m_position < size) {
+            return m_ok = false;
+        }
+        value.assign(reinterpret_cast<const char*>(m_data.data() + m_position), size);
+        m_position += size;
+        return true;
+    }
+    bool getCount(uint32_t& count, size_t minimumItemSize) {
+        if (!get(count) || (m_data.size() - m_position) / minimumItemSize < count) {
+            return m_ok = false;
+        }
+        return true;
+    }
+    bool getImages(std::vector<ImageDescriptor>& images) {
+        uint32_t count = 0;
+        if (!getCount(count, 28)) {
+            return false;
+        }
+        images.resize(count);
+        for (auto& image : images) {
+            get(image.rows);
+            get(image.cols);
+            get(image.type);
+            get(image.offset);
+            get(image.step);
+        }
+        return m_ok;
+    }
+    bool header(MessageType expected) {
+        uint32_t magic = 0;
+        uint16_t version = 0;
+        uint16_t type = 0;
+        return get(magic) && get(version) && get(type) && magic == kMagic && version == kVersion &&
+               type == static_cast<uint16_t>(expected);
+    }
+    bool finished() const { return m_ok && m_position == m_data.size(); }
+
+private:
+    const std::vector<uint8_t>& m_data;
+    size_t m_position = 0;
+    bool m_ok = true;
+};
+
+Writer startMessage(MessageType type) {
+    Writer writer;
+    writer.put(kMagic);
+    writer.put(kVersion);
+    writer.put(static_cast<uint16_t>(type));
+    return writer;
+}
+
+bool sendAll(int socket, const uint8_t* data, size_t size) {
+    while (size > 0) {
+        const ssize_t sent = send(socket, data, size, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR) {
+            continue;
+        }
+        if (sent <= 0) {
+            return false;
+        }
+        data += sent;
+        size -= static_cast<size_t>(sent);
+    }
+    return true;
+}
+
+bool receiveAll(int socket, uint8_t* data, size_t size) {
+    while (size > 0) {
+        const ssize_t received = recv(socket, data, size, 0);
+        if (received < 0 && errno == EINTR) {
+            continue;
+        }
+        if (received <= 0) {
+            return false;
+        }
+        data += received;
+        size -= static_cast<size_t>(received);
+    }
+    return true;
+}
+
+} // namespace
+
+SharedBuffer::~SharedBuffer() {
+    reset();
+}
+
+SharedBuffer::SharedBuffer(SharedBuffer&& other) noexcept
+    : m_fd(other.m_fd), m_data(other.m_data), m_size(other.m_size), m_sealed(other.m_sealed) {
+    other.m_fd = -1;
+    other.m_data = nullptr;
+    other.m_size = 0;
+    other.m_sealed = false;
+}
+
+SharedBuffer& SharedBuffer::operator=(SharedBuffer&& other) noexcept {
+    if (this != &other) {
+        reset();
+        std::swap(m_fd, other.m_fd);
+        std::swap(m_data, other.m_data);
+        std::swap(m_size, other.m_size);
+        std::swap(m_sealed, other.m_sealed);
+    }
+    return *this;
+}
+
+bool SharedBuffer::create(size_t size) {
+    reset();
+    const int fd = createAnonymousFile();
+    if (fd < 0) {
+        return false;
+    }
+    if (ftruncate(fd, static_cast<off_t>(std::max<size_t>(size, 1))) != 0) {
+        close(fd);
+        return false;
+    }
+    // Fails where the system has no seals; map() then reports the buffer unsealed
+    sealSize(fd);
+    return map(fd);
+}
+
+bool SharedBuffer::map(int fd) {
+    reset();
+    struct stat info;
+    if (fd < 0 || fstat(fd, &info) != 0 || info.st_size <= 0) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        return false;
+    }
+    void* data = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (data == MAP_FAILED) {
+        close(fd);
+        return false;
+    }
+    m_fd = fd;
+    m_data = static_cast<uint8_t*>(data);
+    m_size = static_cast<size_t>(info.st_size);
+    m_sealed = isSizeSealed(fd);
+    return true;
+}
+
+void SharedBuffer::reset() {
+    if (m_data) {
+        munmap(m_data, m_size);
+    }
+    if (m_fd >= 0) {
+        close(m_fd);
+    }
+    m_fd = -1;
+    m_data = nullptr;
+    m_size = 0;
+    m_sealed = false;
+}
+
+bool sizeSealingSupported() {
+#if defined(__linux__) && defined(F_ADD_SEALS) && defined(F_GET_SEALS)
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool packImages(const std::vector<cv::Mat>& images, SharedBuffer& buffer, std::vector<ImageDescriptor>& descriptors) {
+    descriptors.clear();
+    size_t total = 0;
+    for (const cv::Mat& image : images) {
+        ImageDescriptor descriptor;
+        descriptor.rows = image.rows;
+        descriptor.cols = image.cols;
+        descriptor.type = image.type();
+        descriptor.offset = total;
+        descriptor.step = alignUp(image.cols * image.elemSize());
+        total = alignUp(total + descriptor.step * image.rows);
+        descriptors.push_back(descriptor);
+    }
+    if (!buffer.create(total)) {
+        return false;
+    }
+    for (size_t i = 0; i < images.size(); ++i) {
+        const ImageDescriptor& descriptor = descriptors[i];
+        cv::Mat view(descriptor.rows, descriptor.cols, descriptor.type, buffer.data() + descriptor.offset,
+                     static_cast<size_t>(descriptor.step));
+        images[i].copyTo(view);
+    }
+    return true;
+}
+
+bool viewImages(const SharedBuffer& buffer, const std::vector<ImageDescriptor>& descriptors,
+                std::vector<cv::Mat>& images) {
+    images.clear();
+    for (const ImageDescriptor& descriptor : descriptors) {
+        if (descriptor.rows <= 0 || descriptor.cols <= 0 || descriptor.type != CV_MAT_TYPE(descriptor.type)) {
+            return false;
+        }
+        const uint64_t rowBytes = static_cast<uint64_t>(descriptor.cols) * CV_ELEM_SIZE(descriptor.type);
+        if (descriptor.step < rowBytes || descriptor.offset > buffer.size() ||
+            (buffer.size() - descriptor.offset) / descriptor.step < static_cast<uint64_t>(descriptor.rows) - 1 ||
+            buffer.size() - descriptor.offset - descriptor.step * (descriptor.rows - 1) < rowBytes) {
+            return false;
+        }
+        images.emplace_back(descriptor.rows, descriptor.cols, descriptor.type, buffer.data() + descriptor.offset,
+                            static_cast<size_t>(descriptor.step));
+    }
+    return true;
+}
+
+bool sendMessage(int socket, const std::vector<uint8_t>& payload, int fd) {
+    const uint32_t size = static_cast<uint32_t>(payload.size());
+    iovec part;
+    part.iov_base = const_cast<uint32_t*>(&size);
+    part.iov_len = sizeof(size);
+
+    // The descriptor rides on the length prefix
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))] = {};
+    msghdr message = {};
+    message.msg_iov = &part;
+    message.msg_iovlen = 1;
+    if (fd >= 0) {
+        message.msg_control = control;
+        message.msg_controllen = sizeof(control);
+        cmsghdr* header = CMSG_FIRSTHDR(&message);
+        header->cmsg_level = SOL_SOCKET;
+        header->cmsg_type = SCM_RIGHTS;
+        header->cmsg_len = CMSG_LEN(sizeof(int));
+        std::memcpy(CMSG_DATA(header), &fd, sizeof(int));
+    }
+    ssize_t sent;
+    do {
+        sent = sendmsg(socket, &message, MSG_NOSIGNAL);
+    } while (sent < 0 && errno == EINTR);
+    if (sent <= 0) {
+        return false;
+    }
+    const uint8_t* prefix = reinterpret_cast<const uint8_t*>(&size);
+    return sendAll(socket, prefix + sent, sizeof(size) - static_cast<size_t>(sent)) &&
+           sendAll(socket, payload.data(), payload.size());
+}
+
+bool receiveMessage(int socket, std::vector<uint8_t>& payload, int& fd) {
+    fd = -1;
+    uint32_t size = 0;
+    iovec part;
+    part.iov_base = &size;
+    part.iov_len = sizeof(size);
+
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))] = {};
+    msghdr message = {};
+    message.msg_iov = &part;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+    ssize_t received;
+    do {
+        received = recvmsg(socket, &message, MSG_CMSG_CLOEXEC);
+    } while (received < 0 && errno == EINTR);
+    if (received <= 0) {
+        return false;
+    }
+    for (cmsghdr* header = CMSG_FIRSTHDR(&message); header; header = CMSG_NXTHDR(&message, header)) {
+        if (header->cmsg_level == SOL_SOCKET && header->cmsg_type == SCM_RIGHTS) {
+            std::memcpy(&fd, CMSG_DATA(header), sizeof(int));
+        }
+    }
+
+    uint8_t* prefix = reinterpret_cast<uint8_t*>(&size);
+    if (!receiveAll(socket, prefix + received, sizeof(size) - static_cast<size_t>(received)) || size > kMaxPayload) {
+        if (fd >= 0) {
+            close(fd);
+            fd = -1;
+        }
+        return false;
+    }
+    payload.resize(size);
+    if (!receiveAll(socket, payload.data(), size)) {
+        if (fd >= 0) {
+            close(fd);
+            fd = -1;
+        }
+        return false;
+    }
+    return true;
+}
+
+std::vector<uint8_t> encodeListRequest() {
+    return startMessage(MessageType::ListRequest).take();
+}
+
+std::vector<uint8_t> encodeListResponse(const std::vector<GraphSummary>& graphs) {
+    Writer writer = startMessage(MessageType::ListResponse);
+    writer.put(static_cast<uint32_t>(graphs.size()));
+    for (const auto& graph : graphs) {
+        writer.putString(graph.name);
+        writer.put(graph.inputs);
+        writer.put(graph.outputs);
+    }
+    return writer.take();
+}
+
+std::vector<uint8_t> encodeRunRequest(const RunRequest& request) {
+    Writer writer = startMessage(MessageType::RunRequest);
+    writer.put(request.id);
+    writer.putString(request.graph);
+    writer.put(static_cast<uint32_t>(request.overrides.size()));
+    for (const auto& parameter : request.overrides) {
+        writer.putString(parameter.node);
+        writer.putString(parameter.parameter);
+        writer.put(parameter.value);
+    }
+    writer.putImages(request.inputs);
+    return writer.take();
+}
+
+std::vector<uint8_t> encodeRunResponse(const RunResponse& response) {
+    Writer writer = startMessage(MessageType::RunResponse);
+    writer.put(response.id);
+    writer.put(static_cast<uint8_t>(response.ok ? 1 : 0));
+    writer.putString(response.error);
+    writer.put(response.batchSize);
+    writer.putImages(response.outputs);
+    return writer.take();
+}
+
+bool messageType(const std::vector<uint8_t>& payload, MessageType& type) {
+    Reader reader(payload);
+    uint32_t magic = 0;
+    uint16_t version = 0;
+    uint16_t value = 0;
+    if (!reader.get(magic) || !reader.get(version) || !reader.get(value) || magic != kMagic || version != kVersion ||
+        value < static_cast<uint16_t>(MessageType::ListRequest) || value > static_cast<uint16_t>(MessageType::RunResponse)) {
+        return false;
+    }
+    type = static_cast<MessageType>(value);
+    return true;
+}
+
+bool decodeListResponse(const std::vector<uint8_t>& payload, std::vector<GraphSummary>& graphs) {
+    Reader reader(payload);
+    uint32_t count = 0;
+    if (!reader.header(MessageType::ListResponse) || !reader.getCount(count, 12)) {
+        return false;
+    }
+    graphs.resize(count);
+    for (auto& graph : graphs) {
+        reader.getString(graph.name);
+        reader.get(graph.inputs);
+        reader.get(graph.outputs);
+    }
+    return reader.finished();
+}
+
+bool decodeRunRequest(const std::vector<uint8_t>& payload, RunRequest& request) {
+    Reader reader(payload);
+    uint32_t count = 0;
+    if (!reader.header(MessageType::RunRequest) || !reader.get(request.id) || !reader.getString(request.graph) ||
+        !reader.getCount(count, 16)) {
+        return false;
+    }
+    request.overrides.resize(count);
+    for (auto& parameter : request.overrides) {
+        reader.getString(parameter.node);
+        reader.getString(parameter.parameter);
+        reader.get(parameter.value);
+    }
+    reader.getImages(request.inputs);
+    return reader.finished();
+}
+
+bool decodeRunResponse(const std::vector<uint8_t>& payload, RunResponse& response) {
+    Reader reader(payload);
+    uint8_t ok = 0;
+    if (!reader.header(MessageType::RunResponse) || !reader.get(response.id) || !reader.get(ok)) {
+        return false;
+    }
+    response.ok = ok != 0;
+    reader.getString(response.error);
+    reader.get(response.batchSize);
+    reader.getImages(response.outputs);
+    return reader.finished();
+}
+
+} // namespace GraphProtocol
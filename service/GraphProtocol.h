@@ -0,0 +1,121 @@
+#ifndef GRAPHPROTOCOL_H
+#define GRAPHPROTOCOL_H
+
+#include <opencv2/core.hpp>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Wire format between GraphService and GraphClient over a Unix domain socket.
+// Each message is a uint32 payload length followed by the payload, and may
+// carry one file descriptor (SCM_RIGHTS): an anonymous shared memory buffer
+// holding the message's images, so pixels never go through the socket.
+// Both ends are on one host, so integers are in host byte order.
+namespace GraphProtocol {
+
+const uint32_t kMagic = 0x5347424e; // "NBGS"
+const uint16_t kVersion = 1;
+const uint32_t kMaxPayload = 16u << 20;
+
+enum class MessageType : uint16_t {
+    ListRequest = 1,
+    ListResponse,
+    RunRequest,
+    RunResponse
+};
+
+// An image inside a shared buffer
+struct ImageDescriptor {
+    int32_t rows = 0;
+    int32_t cols = 0;
+    int32_t type = 0;
+    uint64_t offset = 0;
+    uint64_t step = 0;
+};
+
+struct ParameterOverride {
+    std::string node;       // Node id from the graph file
+    std::string parameter;  // Registered parameter name
+    double value = 0.0;
+};
+
+struct RunRequest {
+    uint64_t id = 0;
+    std::string graph;
+    std::vector<ParameterOverride> overrides;
+    std::vector<ImageDescriptor> inputs;    // In the attached buffer, straight alpha
+};
+
+struct RunResponse {
+    uint64_t id = 0;
+    bool ok = false;
+    std::string error;
+    uint32_t batchSize = 0;                 // Requests that shared the pass
+    std::vector<ImageDescriptor> outputs;   // In the attached buffer, straight alpha
+};
+
+struct GraphSummary {
+    std::string name;
+    uint32_t inputs = 0;
+    uint32_t outputs = 0;
+};
+
+// Anonymous shared memory, unlinked from the start: it lives as long as
+// some process holds its descriptor or a mapping
+class SharedBuffer {
+public:
+    SharedBuffer() = default;
+    ~SharedBuffer();
+    SharedBuffer(SharedBuffer&& other) noexcept;
+    SharedBuffer& operator=(SharedBuffer&& other) noexcept;
+    SharedBuffer(const SharedBuffer&) = delete;
+    SharedBuffer& operator=(const SharedBuffer&) = delete;
+
+    bool create(size_t size);
+    // Takes ownership of fd and maps all of it
+    bool map(int fd);
+    void reset();
+
+    int fd() const { return m_fd; }
+    uint8_t* data() const { return m_data; }
+    size_t size() const { return m_size; }
+    // The file can no longer shrink or grow, so whoever sent it cannot
+    // truncate it under this mapping and fault the reader. create() seals
+    // its buffers where sizeSealingSupported().
+    bool sealed() const { return m_sealed; }
+
+private:
+    int m_fd = -1;
+    uint8_t* m_data = nullptr;
+    size_t m_size = 0;
+    bool m_sealed = false;
+};
+
+// Linux memfd seals; elsewhere no buffer is ever sealed
+bool sizeSealingSupported();
+
+// Copies images into a new buffer, each row-aligned at 64 bytes
+bool packImages(const std::vector<cv::Mat>& images, SharedBuffer& buffer, std::vector<ImageDescriptor>& descriptors);
+// Mat headers over the buffer's memory, valid while it stays mapped; false
+// when a descriptor reaches outside the buffer
+bool viewImages(const SharedBuffer& buffer, const std::vector<ImageDescriptor>& descriptors,
+                std::vector<cv::Mat>& images);
+
+// Whole messages; fd is -1 when none is attached. A received fd belongs to the caller.
+bool sendMessage(int socket, const std::vector<uint8_t>& payload, int fd = -1);
+bool receiveMessage(int socket, std::vector<uint8_t>& payload, int& fd);
+
+std::vector<uint8_t> encodeListRequest();
+std::vector<uint8_t> encodeListResponse(const std::vector<GraphSummary>& graphs);
+std::vector<uint8_t> encodeRunRequest(const RunRequest& request);
+std::vector<uint8_t> encodeRunResponse(const RunResponse& response);
+
+// Type of a payload with a valid header, or false
+bool messageType(const std::vector<uint8_t>& payload, MessageType& type);
+bool decodeListResponse(const std::vector<uint8_t>& payload, std::vector<GraphSummary>& graphs);
+bool decodeRunRequest(const std::vector<uint8_t>& payload, RunRequest& request);
+bool decodeRunResponse(const std::vector<uint8_t>& payload, RunResponse& response);
+
+} // namespace GraphProtocol
+
+#endif // GRAPHPROTOCOL_H
@@ -0,0 +1,533 @@
+#include "GraphService.h"
+#include "ImageNode.h"
+#include "NodeFactory.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace GraphProtocol;
+
+namespace {
+
+// Blocking calls wake up this often to notice stop()
+const int kPollIntervalMs = 200;
+
+bool sameOverrides(const std::vector<ParameterOverride>& a, const std::vector<ParameterOverride>& b) {
+    if (a.size() != b.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < a.size(); ++i) {
+        if (a[i].node != b[i].node || a[i].parameter != b[i].parameter || a[i].value != b[i].value) {
+            return false;
+        }
+    }
+    return true;
+}
+
+cv::Mat imageOf(const std::shared_ptr<void>& data) {
+    return data ? *std::static_pointer_cast<cv::Mat>(data) : cv::Mat();
+}
+
+} // namespace
+
+RequestInputNode::RequestInputNode() {
+    m_outputData.push_back(std::make_shared<cv::Mat>());
+}
+
+const std::vector<Port>& RequestInputNode::getPorts() const {
+    static const std::vector<Port> ports = {
+        {0, "Output", PortType::Output, DataType::Image}
+    };
+    return ports;
+}
+
+void RequestInputNode::setImage(const cv::Mat& image) {
+    // A fresh buffer each time: earlier outputs may still share the last one
+    ImageInfo info;
+    cv::Mat copy;
+    if (image.channels() == 4 && !hasTransparency(image)) {
+        cv::cvtColor(image, copy, cv::COLOR_BGRA2BGR);
+    } else {
+        copy = image.clone();
+        info = ImageInfo::describe(copy);
+    }
+    *std::static_pointer_cast<cv::Mat>(m_outputData[0]) = copy;
+    setOutputInfo(0, info);
+    invalidate();
+}
+
+bool ServiceGraph::load(const std::string& path, std::string& error) {
+    cv::FileStorage file;
+    try {
+        file.open(path, cv::FileStorage::READ);
+    } catch (const cv::Exception& exception) {
+        error = path + ": " + exception.what();
+        return false;
+    }
+    if (!file.isOpened()) {
+        error = "Cannot read " + path;
+        return false;
+    }
+    m_name = std::filesystem::path(path).stem().string();
+    const std::filesystem::path directory = std::filesystem::path(path).parent_path();
+
+    for (const cv::FileNode& entry : file["nodes"]) {
+        const std::string id = entry["id"].string();
+        const std::string type = entry["type"].string();
+        if (id.empty() || m_ids.count(id)) {
+            error = path + ": missing or duplicate node id '" + id + "'";
+            return false;
+        }
+        std::unique_ptr<Node> node;
+        if (type == "Request Input") {
+            auto input = std::make_unique<RequestInputNode>();
+            m_inputs.push_back(input.get());
+            node = std::move(input);
+        } else {
+            node = NodeFactory::instance().createNode(type);
+        }
+        if (!node) {
+            error = path + ": unknown node type '" + type + "'";
+            return false;
+        }
+        if (auto* image = dynamic_cast<ImageInputNode*>(node.get())) {
+            std::filesystem::path imagePath = entry["path"].string();
+            if (imagePath.is_relative()) {
+                imagePath = directory / imagePath;
+            }
+            image->setLoadAlpha(static_cast<int>(entry["alpha"]) != 0);
+            image->setImagePath(imagePath.string());
+        }
+        for (const cv::FileNode& parameter : entry["parameters"]) {
+            const std::string name = parameter["name"].string();
+            if (!node->setParameter(name, static_cast<double>(parameter["value"]))) {
+                error = path + ": node '" + id + "' has no parameter '" + name + "'";
+                return false;
+            }
+        }
+        m_ids[id] = node.get();
+        m_engine.addNode(node.get());
+        m_nodes.push_back(std::move(node));
+    }
+
+    for (const cv::FileNode& entry : file["connections"]) {
+        Node* from = findNode(entry["from"].string());
+        Node* to = findNode(entry["to"].string());
+        const int port = static_cast<int>(entry["port"]);
+        const int input = static_cast<int>(entry["input"]);
+        if (!from || !to || from->outputSlot(port) < 0 || input < 0 ||
+            input >= static_cast<int>(to->ports().size()) || to->ports()[input].type != PortType::Input) {
+            error = path + ": invalid connection from '" + entry["from"].string() + "' to '" + entry["to"].string() + "'";
+            return false;
+        }
+        to->addInputConnection(from, port, input);
+    }
+
+    for (const cv::FileNode& entry : file["outputs"]) {
+        Output output;
+        output.node = findNode(entry["node"].string());
+        output.port = static_cast<int>(entry["port"]);
+        if (!output.node || output.node->outputSlot(output.port) < 0) {
+            error = path + ": invalid output '" + entry["node"].string() + "'";
+            return false;
+        }
+        // A sink per output keeps its producer from being pruned
+        auto sink = std::make_unique<ImageOutputNode>();
+        sink->addInputConnection(output.node, output.port, 0);
+        m_engine.addNode(sink.get());
+        m_nodes.push_back(std::move(sink));
+        m_outputs.push_back(output);
+    }
+    if (m_outputs.empty()) {
+        error = path + ": no outputs";
+        return false;
+    }
+    m_batchTarget = m_outputs.front().node;
+    for (const Output& output : m_outputs) {
+        if (output.node != m_batchTarget) {
+            m_batchTarget = nullptr;
+        }
+    }
+
+    // Decode file inputs and size every buffer before the first request
+    m_engine.run();
+    return true;
+}
+
+Node* ServiceGraph::findNode(const std::string& id) const {
+    auto found = m_ids.find(id);
+    return found != m_ids.end() ? found->second : nullptr;
+}
+
+bool ServiceGraph::applyOverrides(const std::vector<ParameterOverride>& overrides, std::string& error) {
+    std::map<std::pair<Node*, std::string>, double> wanted;
+    for (const auto& parameter : overrides) {
+        Node* node = findNode(parameter.node);
+        if (!node) {
+            error = "Unknown node '" + parameter.node + "'";
+            return false;
+        }
+        const auto& parameters = node->parameters();
+        if (std::none_of(parameters.begin(), parameters.end(),
+                         [&parameter](const Node::Parameter& p) { return p.name == parameter.parameter; })) {
+            error = "Node '" + parameter.node + "' has no parameter '" + parameter.parameter + "'";
+            return false;
+        }
+        const auto key = std::make_pair(node, parameter.parameter);
+        m_defaults.emplace(key, node->parameter(parameter.parameter));
+        wanted[key] = parameter.value;
+    }
+    for (const auto& entry : m_defaults) {
+        wanted.emplace(entry.first, entry.second);
+    }
+
+    // Only a value that differs from the last one set invalidates the node
+    for (const auto& entry : wanted) {
+        auto current = m_current.find(entry.first);
+        if (current == m_current.end() || current->second != entry.second) {
+            entry.first.first->setParameter(entry.first.second, entry.second);
+            m_current[entry.first] = entry.second;
+        }
+    }
+    return true;
+}
+
+bool ServiceGraph::run(const std::vector<cv::Mat>& inputs, std::vector<cv::Mat>& outputs, std::string& error) {
+    if (inputs.size() != m_inputs.size()) {
+        error = "Graph '" + m_name + "' takes " + std::to_string(m_inputs.size()) + " inputs, got " +
+                std::to_string(inputs.size());
+        return false;
+    }
+    for (size_t i = 0; i < inputs.size(); ++i) {
+        m_inputs[i]->setImage(inputs[i]);
+    }
+    m_engine.run();
+
+    outputs.clear();
+    for (const Output& output : m_outputs) {
+        const int slot = output.node->outputSlot(output.port);
+        outputs.push_back(imageAs(imageOf(output.node->getOutputData(output.port)), output.node->outputInfo(slot), false));
+    }
+    return true;
+}
+
+bool ServiceGraph::canBatch(const std::vector<cv::Mat>& inputs) const {
+    return m_batchTarget && m_inputs.size() == 1 && inputs.size() == 1;
+}
+
+bool ServiceGraph::runBatch(const std::vector<cv::Mat>& frames, std::vector<std::vector<cv::Mat>>& outputs,
+                            std::string& error) {
+    outputs.assign(frames.size(), {});
+    if (frames.empty() || !run({frames[0]}, outputs[0], error)) {
+        return false;
+    }
+    if (frames.size() == 1) {
+        return true;
+    }
+    // Everything not fed by the request input keeps the outputs of the pass above
+    const ImageBatch rest(frames.begin() + 1, frames.end());
+    const std::vector<ImageBatch> results = m_engine.processBatch(m_inputs[0], rest, m_batchTarget);
+    for (size_t frame = 1; frame < frames.size(); ++frame) {
+        for (const Output& output : m_outputs) {
+            const int slot = m_batchTarget->outputSlot(output.port);
+            if (slot < 0 || slot >= static_cast<int>(results.size()) || results[slot].size() != rest.size()) {
+                error = "Batch produced no output for port " + std::to_string(output.port);
+                return false;
+            }
+            outputs[frame].push_back(results[slot][frame - 1]);
+        }
+    }
+    return true;
+}
+
+GraphService::Connection::~Connection() {
+    if (socket >= 0) {
+        ::close(socket);
+    }
+}
+
+GraphService::~GraphService() {
+    stop();
+    if (m_acceptor.joinable()) {
+        m_acceptor.join();
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_connectionsMutex);
+        for (auto& connection : m_connections) {
+            if (connection->reader.joinable()) {
+                connection->reader.join();
+            }
+        }
+        m_connections.clear();
+    }
+    if (m_listenSocket >= 0) {
+        ::close(m_listenSocket);
+        unlink(m_options.socketPath.c_str());
+    }
+}
+
+bool GraphService::loadGraphs(std::string& error) {
+    std::error_code code;
+    std::vector<std::filesystem::path> files;
+    for (const auto& item : std::filesystem::directory_iterator(m_options.graphDirectory, code)) {
+        const std::string extension = item.path().extension().string();
+        if (extension == ".yml" || extension == ".yaml" || extension == ".json") {
+            files.push_back(item.path());
+        }
+    }
+    if (code) {
+        error = "Cannot list " + m_options.graphDirectory + ": " + code.message();
+        return false;
+    }
+    std::sort(files.begin(), files.end());
+    for (const auto& file : files) {
+        auto graph = std::make_unique<ServiceGraph>();
+        if (!graph->load(file.string(), error)) {
+            return false;
+        }
+        const std::string name = graph->name();
+        m_graphs[name] = std::move(graph);
+    }
+    if (m_graphs.empty()) {
+        error = "No graphs in " + m_options.graphDirectory;
+        return false;
+    }
+    return true;
+}
+
+bool GraphService::listen(std::string& error) {
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    if (m_options.socketPath.size() >= sizeof(address.sun_path)) {
+        error = "Socket path too long: " + m_options.socketPath;
+        return false;
+    }
+    std::strncpy(address.sun_path, m_options.socketPath.c_str(), sizeof(address.sun_path) - 1);
+
+    m_listenSocket = socket(AF_UNIX, SOCK_STREAM, 0);
+    // A socket file left by an earlier run would make bind() fail
+    unlink(m_options.socketPath.c_str());
+    if (m_listenSocket < 0 || bind(m_listenSocket, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0 ||
+        ::listen(m_listenSocket, 64) != 0) {
+        error = "Cannot listen on " + m_options.socketPath + ": " + std::strerror(errno);
+        return false;
+    }
+    m_acceptor = std::thread(&GraphService::acceptConnections, this);
+    return true;
+}
+
+void GraphService::acceptConnections() {
+    while (!m_stop.load(std::memory_order_acquire)) {
+        pollfd waiting = {m_listenSocket, POLLIN, 0};
+        if (poll(&waiting, 1, kPollIntervalMs) <= 0) {
+            continue;
+        }
+        const int socket = accept(m_listenSocket, nullptr, nullptr);
+        if (socket < 0) {
+            continue;
+        }
+        auto connection = std::make_shared<Connection>();
+        connection->socket = socket;
+        m_openConnections.fetch_add(1, std::memory_order_relaxed);
+
+        std::lock_guard<std::mutex> lock(m_connectionsMutex);
+        // Reap connections whose readers have returned
+        for (auto it = m_connections.begin(); it != m_connections.end();) {
+            if ((*it)->finished.load(std::memory_order_acquire)) {
+                (*it)->reader.join();
+                it = m_connections.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        connection->reader = std::thread(&GraphService::readRequests, this, connection);
+        m_connections.push_back(connection);
+    }
+}
+
+void GraphService::readRequests(std::shared_ptr<Connection> connection) {
+    while (!m_stop.load(std::memory_order_acquire)) {
+        pollfd waiting = {connection->socket, POLLIN, 0};
+        const int ready = poll(&waiting, 1, kPollIntervalMs);
+        if (ready == 0 || (ready < 0 && errno == EINTR)) {
+            continue;
+        }
+        std::vector<uint8_t> payload;
+        int fd = -1;
+        MessageType type;
+        if (ready < 0 || !receiveMessage(connection->socket, payload, fd) || !messageType(payload, type)) {
+            if (fd >= 0) {
+                ::close(fd);
+            }
+            break;
+        }
+
+        if (type == MessageType::ListRequest) {
+            if (fd >= 0) {
+                ::close(fd);
+            }
+            // The graph set is fixed once serving starts
+            std::vector<GraphSummary> graphs;
+            for (const auto& entry : m_graphs) {
+                graphs.push_back({entry.first, static_cast<uint32_t>(entry.second->inputCount()),
+                                  static_cast<uint32_t>(entry.second->outputCount())});
+            }
+            std::lock_guard<std::mutex> lock(connection->writeMutex);
+            if (!sendMessage(connection->socket, encodeListResponse(graphs))) {
+                break;
+            }
+            continue;
+        }
+
+        Pending pending;
+        pending.connection = connection;
+        pending.buffer = std::make_shared<SharedBuffer>();
+        pending.arrived = std::chrono::steady_clock::now();
+        if (type != MessageType::RunRequest || !decodeRunRequest(payload, pending.request)) {
+            if (fd >= 0) {
+                ::close(fd);
+            }
+            break;
+        }
+        const bool mapped = fd >= 0 && pending.buffer->map(fd);
+        // A client that can still resize its buffer could truncate it while
+        // the request waits and crash the service with SIGBUS
+        if (mapped && !pending.buffer->sealed() && sizeSealingSupported()) {
+            respond(pending, {}, "Input buffer is not sealed against resizing", 0);
+            continue;
+        }
+        if (!pending.request.inputs.empty() && (!mapped || !viewImages(*pending.buffer, pending.request.inputs, pending.inputs))) {
+            respond(pending, {}, "Invalid input buffer", 0);
+            continue;
+        }
+        if (mapped && !pending.buffer->sealed()) {
+            // No seals on this system: keep a private copy and let the mapping go
+            for (cv::Mat& input : pending.inputs) {
+                input = input.clone();
+            }
+            pending.buffer->reset();
+        }
+        {
+            std::lock_guard<std::mutex> lock(m_queueMutex);
+            m_queue.push_back(std::move(pending));
+        }
+        m_queueChanged.notify_one();
+    }
+    m_openConnections.fetch_sub(1, std::memory_order_relaxed);
+    connection->finished.store(true, std::memory_order_release);
+}
+
+bool GraphService::compatible(const Pending& first, const Pending& other) const {
+    if (other.request.graph != first.request.graph || other.inputs.size() != first.inputs.size() ||
+        !sameOverrides(other.request.overrides, first.request.overrides)) {
+        return false;
+    }
+    for (size_t i = 0; i < first.inputs.size(); ++i) {
+        if (other.inputs[i].size() != first.inputs[i].size() || other.inputs[i].type() != first.inputs[i].type()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool GraphService::takeBatch(std::vector<Pending>& batch) {
+    std::unique_lock<std::mutex> lock(m_queueMutex);
+    if (!m_queueChanged.wait_for(lock, std::chrono::milliseconds(kPollIntervalMs), [this]() { return !m_queue.empty(); })) {
+        return false;
+    }
+    batch.clear();
+    batch.push_back(std::move(m_queue.front()));
+    m_queue.pop_front();
+
+    auto graph = m_graphs.find(batch[0].request.graph);
+    if (graph == m_graphs.end() || !graph->second->canBatch(batch[0].inputs) || m_options.maxBatch <= 1) {
+        return true;
+    }
+
+    auto collect = [this, &batch]() {
+        for (auto it = m_queue.begin(); it != m_queue.end() && batch.size() < m_options.maxBatch;) {
+            if (compatible(batch[0], *it)) {
+                batch.push_back(std::move(*it));
+                it = m_queue.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    };
+    collect();
+    // With a single client nobody else can join, so the window is skipped
+    const auto deadline = batch[0].arrived + std::chrono::microseconds(static_cast<int64_t>(m_options.batchWindowMs * 1000.0));
+    while (batch.size() < m_options.maxBatch && m_openConnections.load(std::memory_order_relaxed) > 1) {
+        const bool timedOut = m_queueChanged.wait_until(lock, deadline) == std::cv_status::timeout;
+        collect();
+        if (timedOut) {
+            break;
+        }
+    }
+    return true;
+}
+
+void GraphService::serve() {
+    std::vector<Pending> batch;
+    while (!m_stop.load(std::memory_order_acquire)) {
+        if (takeBatch(batch)) {
+            execute(batch);
+            batch.clear();
+        }
+    }
+}
+
+void GraphService::execute(std::vector<Pending>& batch) {
+    const Pending& first = batch[0];
+    auto found = m_graphs.find(first.request.graph);
+    std::string error;
+    if (found == m_graphs.end()) {
+        error = "Unknown graph '" + first.request.graph + "'";
+    } else if (!found->second->applyOverrides(first.request.overrides, error)) {
+        // Rejected as a whole; nothing was changed
+    } else if (batch.size() == 1) {
+        std::vector<cv::Mat> outputs;
+        if (found->second->run(first.inputs, outputs, error)) {
+            respond(first, outputs, std::string(), 1);
+            return;
+        }
+    } else {
+        std::vector<cv::Mat> frames;
+        for (const Pending& pending : batch) {
+            frames.push_back(pending.inputs[0]);
+        }
+        std::vector<std::vector<cv::Mat>> outputs;
+        if (found->second->runBatch(frames, outputs, error)) {
+            for (size_t i = 0; i < batch.size(); ++i) {
+                respond(batch[i], outputs[i], std::string(), batch.size());
+            }
+            return;
+        }
+    }
+    for (const Pending& pending : batch) {
+        respond(pending, {}, error, batch.size());
+    }
+}
+
+void GraphService::respond(const Pending& pending, const std::vector<cv::Mat>& outputs, const std::string& error,
+                           size_t batchSize) {
+    RunResponse response;
+    response.id = pending.request.id;
+    response.ok = error.empty();
+    response.error = error;
+    response.batchSize = static_cast<uint32_t>(batchSize);
+    SharedBuffer buffer;
+    if (response.ok && !packImages(outputs, buffer, response.outputs)) {
+        response.ok = false;
+        response.error = "Cannot allocate shared memory";
+    }
+
+    std::lock_guard<std::mutex> lock(pending.connection->writeMutex);
+    // A client that went away is noticed by its reader
+    sendMessage(pending.connection->socket, encodeRunResponse(response), buffer.fd());
+}
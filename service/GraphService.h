@@ -0,0 +1,149 @@
+#ifndef GRAPHSERVICE_H
+#define GRAPHSERVICE_H
+
+#include "GraphEngine.h"
+#include "GraphProtocol.h"
+#include "Node.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Source node fed by the service with each request's image
+class RequestInputNode : public Node {
+public:
+    RequestInputNode();
+    ~RequestInputNode() override = default;
+
+    // The output is set by setImage(); nothing is computed
+    void process() override {}
+    std::string name() const override { return "Request Input"; }
+    const std::vector<Port>& getPorts() const override;
+    // parameterKey() stays empty: two request inputs are never merged, and
+    // nothing downstream is cached across requests
+
+    // Copies image (straight alpha) into the output and marks the node dirty
+    void setImage(const cv::Mat& image);
+};
+
+// A graph file loaded once and kept warm between requests. Files are
+// cv::FileStorage YAML or JSON:
+//   nodes:       [{id, type, path, alpha, parameters: [{name, value}]}]
+//   connections: [{from, port, to, input}]
+//   outputs:     [{node, port}]
+// "path" and "alpha" apply to Image Input nodes; relative paths are resolved
+// against the graph file. Nodes of type "Request Input" receive the request's
+// images in the order they are listed.
+class ServiceGraph {
+public:
+    bool load(const std::string& path, std::string& error);
+
+    const std::string& name() const { return m_name; }
+    size_t inputCount() const { return m_inputs.size(); }
+    size_t outputCount() const { return m_outputs.size(); }
+
+    // Sets each listed parameter, and puts back the file's value for
+    // parameters an earlier request overrode but this one does not
+    bool applyOverrides(const std::vector<GraphProtocol::ParameterOverride>& overrides, std::string& error);
+    // Runs one request: outputs receive the graph's outputs in straight alpha
+    bool run(const std::vector<cv::Mat>& inputs, std::vector<cv::Mat>& outputs, std::string& error);
+    // Whether requests with these inputs can share one batched pass
+    bool canBatch(const std::vector<cv::Mat>& inputs) const;
+    // Runs the first frame as a normal pass and the rest through
+    // GraphEngine::processBatch; outputs[frame][output]
+    bool runBatch(const std::vector<cv::Mat>& frames, std::vector<std::vector<cv::Mat>>& outputs, std::string& error);
+
+private:
+    struct Output {
+        Node* node = nullptr;
+        int port = 0;
+    };
+
+    Node* findNode(const std::string& id) const;
+
+    // Declared first, so it goes after the nodes it points to
+    GraphEngine m_engine;
+    std::vector<std::unique_ptr<Node>> m_nodes;
+    std::map<std::string, Node*> m_ids;
+    std::vector<RequestInputNode*> m_inputs;
+    std::vector<Output> m_outputs;
+    // Every output comes from this node, or null; batching needs one target
+    Node* m_batchTarget = nullptr;
+    // Values from the file and the values last set, per overridden parameter
+    std::map<std::pair<Node*, std::string>, double> m_defaults;
+    std::map<std::pair<Node*, std::string>, double> m_current;
+    std::string m_name;
+};
+
+// Serves the graphs in a directory over a Unix domain socket. Connections
+// are read on their own threads; every graph pass runs on the thread that
+// calls serve(), where queued requests for the same graph, parameters and
+// input size are combined into one batch.
+class GraphService {
+public:
+    struct Options {
+        std::string socketPath = "/tmp/nbip-graph.sock";
+        std::string graphDirectory = "graphs";
+        // How long the first request of a batch waits for others to join
+        double batchWindowMs = 2.0;
+        size_t maxBatch = 16;
+    };
+
+    explicit GraphService(const Options& options) : m_options(options) {}
+    ~GraphService();
+
+    bool loadGraphs(std::string& error);
+    bool listen(std::string& error);
+    // Returns after stop()
+    void serve();
+    // Safe from any thread or a signal handler
+    void stop() { m_stop.store(true, std::memory_order_release); }
+
+private:
+    // Closed when the last queued request holding it is answered
+    struct Connection {
+        ~Connection();
+
+        int socket = -1;
+        std::thread reader;
+        std::mutex writeMutex;
+        std::atomic<bool> finished{false};
+    };
+    struct Pending {
+        std::shared_ptr<Connection> connection;
+        GraphProtocol::RunRequest request;
+        // Keeps the request's images mapped until the response is sent
+        std::shared_ptr<GraphProtocol::SharedBuffer> buffer;
+        std::vector<cv::Mat> inputs;
+        std::chrono::steady_clock::time_point arrived;
+    };
+
+    void acceptConnections();
+    void readRequests(std::shared_ptr<Connection> connection);
+    bool takeBatch(std::vector<Pending>& batch);
+    bool compatible(const Pending& first, const Pending& other) const;
+    void execute(std::vector<Pending>& batch);
+    void respond(const Pending& pending, const std::vector<cv::Mat>& outputs, const std::string& error,
+                 size_t batchSize);
+
+    Options m_options;
+    std::map<std::string, std::unique_ptr<ServiceGraph>> m_graphs;
+    int m_listenSocket = -1;
+    std::thread m_acceptor;
+    std::mutex m_connectionsMutex;
+    std::vector<std::shared_ptr<Connection>> m_connections;
+    std::atomic<int> m_openConnections{0};
+
+    std::mutex m_queueMutex;
+    std::condition_variable m_queueChanged;
+    std::deque<Pending> m_queue;
+    std::atomic<bool> m_stop{false};
+};
+
+#endif // GRAPHSERVICE_H
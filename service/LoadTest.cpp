@@ -0,0 +1,167 @@
+#include "GraphClient.h"
+#include <opencv2/imgcodecs.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Drives a running GraphService from several connections at once and
+// reports throughput, latency percentiles and how well requests batched
+
+namespace {
+
+struct ClientResult {
+    std::vector<double> latenciesMs;
+    long long batchTotal = 0;
+    int failures = 0;
+    std::string lastError;
+};
+
+double percentile(const std::vector<double>& sorted, double fraction) {
+    if (sorted.empty()) {
+        return 0.0;
+    }
+    const size_t index = std::min(sorted.size() - 1, static_cast<size_t>(fraction * (sorted.size() - 1) + 0.5));
+    return sorted[index];
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    std::string socketPath = "/tmp/nbip-graph.sock";
+    std::string graph;
+    std::string inputPath;
+    int width = 1920;
+    int height = 1080;
+    int clients = 4;
+    int requests = 100;
+    int warmup = 5;
+    for (int i = 1; i < argc; ++i) {
+        const std::string argument = argv[i];
+        if (argument == "--socket" && i + 1 < argc) {
+            socketPath = argv[++i];
+        } else if (argument == "--graph" && i + 1 < argc) {
+            graph = argv[++i];
+        } else if (argument == "--input" && i + 1 < argc) {
+            inputPath = argv[++i];
+        } else if (argument == "--size" && i + 1 < argc && std::sscanf(argv[i + 1], "%dx%d", &width, &height) == 2) {
+            ++i;
+        } else if (argument == "--clients" && i + 1 < argc) {
+            clients = std::max(1, std::atoi(argv[++i]));
+        } else if (argument == "--requests" && i + 1 < argc) {
+            requests = std::max(1, std::atoi(argv[++i]));
+        } else if (argument == "--warmup" && i + 1 < argc) {
+            warmup = std::max(0, std::atoi(argv[++i]));
+        } else {
+            std::fprintf(stderr,
+                         "usage: %s --graph NAME [--socket PATH] [--input FILE | --size WxH] [--clients N]"
+                         " [--requests N per client] [--warmup N per client]\n",
+                         argv[0]);
+            return 2;
+        }
+    }
+
+    cv::Mat image;
+    if (!inputPath.empty()) {
+        image = cv::imread(inputPath, cv::IMREAD_COLOR);
+        if (image.empty()) {
+            std::fprintf(stderr, "Cannot read %s\n", inputPath.c_str());
+            return 1;
+        }
+    } else {
+        image.create(height, width, CV_8UC3);
+        cv::randu(image, 0, 256);
+    }
+
+    GraphClient probe;
+    std::vector<GraphClient::GraphInfo> graphs;
+    if (!probe.connect(socketPath) || !probe.listGraphs(graphs)) {
+        std::fprintf(stderr, "%s\n", probe.lastError().c_str());
+        return 1;
+    }
+    probe.close();
+    if (graph.empty() && !graphs.empty()) {
+        graph = graphs.front().name;
+    }
+    auto info = std::find_if(graphs.begin(), graphs.end(), [&graph](const GraphClient::GraphInfo& g) { return g.name == graph; });
+    if (info == graphs.end()) {
+        std::fprintf(stderr, "The service has no graph '%s'\n", graph.c_str());
+        return 1;
+    }
+    const std::vector<cv::Mat> inputs(static_cast<size_t>(info->inputs), image);
+
+    // Clients connect and warm up first, then start together
+    std::vector<ClientResult> results(static_cast<size_t>(clients));
+    std::atomic<int> ready{0};
+    std::atomic<bool> go{false};
+    std::vector<std::thread> threads;
+    for (int c = 0; c < clients; ++c) {
+        threads.emplace_back([&, c]() {
+            ClientResult& result = results[static_cast<size_t>(c)];
+            GraphClient client;
+            std::vector<cv::Mat> outputs;
+            if (!client.connect(socketPath)) {
+                result.failures = requests;
+                result.lastError = client.lastError();
+            }
+            for (int i = 0; i < warmup && client.isConnected(); ++i) {
+                client.run(graph, inputs, outputs);
+            }
+            ready.fetch_add(1);
+            while (!go.load()) {
+                std::this_thread::yield();
+            }
+            for (int i = 0; i < requests && client.isConnected(); ++i) {
+                const auto start = std::chrono::steady_clock::now();
+                const bool ok = client.run(graph, inputs, outputs);
+                const auto end = std::chrono::steady_clock::now();
+                if (!ok) {
+                    ++result.failures;
+                    result.lastError = client.lastError();
+                    continue;
+                }
+                result.latenciesMs.push_back(std::chrono::duration<double, std::milli>(end - start).count());
+                result.batchTotal += client.lastBatchSize();
+            }
+        });
+    }
+    while (ready.load() < clients) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    const auto start = std::chrono::steady_clock::now();
+    go.store(true);
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::vector<double> latencies;
+    long long batchTotal = 0;
+    int failures = 0;
+    std::string lastError;
+    for (const auto& result : results) {
+        latencies.insert(latencies.end(), result.latenciesMs.begin(), result.latenciesMs.end());
+        batchTotal += result.batchTotal;
+        failures += result.failures;
+        if (!result.lastError.empty()) {
+            lastError = result.lastError;
+        }
+    }
+    std::sort(latencies.begin(), latencies.end());
+    const double completed = static_cast<double>(latencies.size());
+    const double megapixels = image.total() * inputs.size() / 1e6;
+
+    std::printf("graph %s, %dx%d, %d clients x %d requests\n", graph.c_str(), image.cols, image.rows, clients, requests);
+    std::printf("throughput: %.1f req/s, %.1f MP/s\n", completed / seconds, completed * megapixels / seconds);
+    std::printf("latency ms: p50 %.2f  p90 %.2f  p99 %.2f  max %.2f\n", percentile(latencies, 0.50),
+                percentile(latencies, 0.90), percentile(latencies, 0.99), latencies.empty() ? 0.0 : latencies.back());
+    std::printf("average batch: %.2f\n", completed > 0 ? batchTotal / completed : 0.0);
+    if (failures > 0) {
+        std::printf("failures: %d (%s)\n", failures, lastError.c_str());
+    }
+    return failures == 0 ? 0 : 1;
+}
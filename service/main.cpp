@@ -0,0 +1,64 @@
+#include "GraphService.h"
+#include "NodeFactory.h"
+#include <QApplication>
+#include <algorithm>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+namespace {
+
+GraphService* runningService = nullptr;
+
+void handleSignal(int) {
+    if (runningService) {
+        runningService->stop();
+    }
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    // Nodes are graphics items and need an application object, but no display
+    qputenv("QT_QPA_PLATFORM", "offscreen");
+    QApplication app(argc, argv);
+
+    GraphService::Options options;
+    for (int i = 1; i < argc; ++i) {
+        const std::string argument = argv[i];
+        if (argument == "--socket" && i + 1 < argc) {
+            options.socketPath = argv[++i];
+        } else if (argument == "--graphs" && i + 1 < argc) {
+            options.graphDirectory = argv[++i];
+        } else if (argument == "--batch-window-ms" && i + 1 < argc) {
+            options.batchWindowMs = std::max(0.0, std::atof(argv[++i]));
+        } else if (argument == "--max-batch" && i + 1 < argc) {
+            options.maxBatch = static_cast<size_t>(std::max(1, std::atoi(argv[++i])));
+        } else if (argument == "--threads" && i + 1 < argc) {
+            cv::setNumThreads(std::atoi(argv[++i]));
+        } else {
+            std::fprintf(stderr,
+                         "usage: %s [--socket PATH] [--graphs DIR] [--batch-window-ms MS] [--max-batch N] [--threads N]\n",
+                         argv[0]);
+            return 2;
+        }
+    }
+
+    NodeFactory::instance().loadPluginsFromEnvironment();
+    GraphService service(options);
+    std::string error;
+    if (!service.loadGraphs(error) || !service.listen(error)) {
+        std::fprintf(stderr, "%s\n", error.c_str());
+        return 1;
+    }
+
+    runningService = &service;
+    std::signal(SIGINT, handleSignal);
+    std::signal(SIGTERM, handleSignal);
+    std::printf("Serving %s on %s\n", options.graphDirectory.c_str(), options.socketPath.c_str());
+    std::fflush(stdout);
+    service.serve();
+    runningService = nullptr;
+    return 0;
+}
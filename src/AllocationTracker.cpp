@@ -0,0 +1,61 @@
+#include "AllocationTracker.h"
+
+AllocationTracker& AllocationTracker::instance() {
+    static AllocationTracker tracker;
+    return tracker;
+}
+
+AllocationTracker::AllocationTracker() : m_base(cv::Mat::getStdAllocator()) {}
+
+void AllocationTracker::install() {
+    if (!m_installed) {
+        cv::Mat::setDefaultAllocator(this);
+        m_installed = true;
+    }
+}
+
+AllocationTracker::Snapshot AllocationTracker::snapshot() const {
+    Snapshot s;
+    s.allocations = m_allocations.load(std::memory_order_relaxed);
+    s.bytesAllocated = m_bytesAllocated.load(std::memory_order_relaxed);
+    s.bytesInUse = m_bytesInUse.load(std::memory_order_relaxed);
+    s.peakBytesInUse = m_peakBytesInUse.load(std::memory_order_relaxed);
+    return s;
+}
+
+void AllocationTracker::resetPeak() {
+    m_peakBytesInUse.store(m_bytesInUse.load(std::memory_order_relaxed), std::memory_order_relaxed);
+}
+
+cv::UMatData* AllocationTracker::allocate(int dims, const int* sizes, int type, void* data, size_t* step,
+                                          cv::AccessFlag flags, cv::UMatUsageFlags usageFlags) const {
+    cv::UMatData* u = m_base->allocate(dims, sizes, type, data, step, flags, usageFlags);
+    if (!u) {
+        return u;
+    }
+    // Route the matching deallocate() back through us
+    u->currAllocator = this;
+    if (!data) {
+        m_allocations.fetch_add(1, std::memory_order_relaxed);
+        m_bytesAllocated.fetch_add(u->size, std::memory_order_relaxed);
+        size_t inUse = m_bytesInUse.fetch_add(u->size, std::memory_order_relaxed) + u->size;
+        size_t peak = m_peakBytesInUse.load(std::memory_order_relaxed);
+        while (inUse > peak && !m_peakBytesInUse.compare_exchange_weak(peak, inUse, std::memory_order_relaxed)) {
+        }
+    }
+    return u;
+}
+
+bool AllocationTracker::allocate(cv::UMatData* data, cv::AccessFlag accessFlags, cv::UMatUsageFlags usageFlags) const {
+    return m_base->allocate(data, accessFlags, usageFlags);
+}
+
+void AllocationTracker::deallocate(cv::UMatData* data) const {
+    if (!data) {
+        return;
+    }
+    if (!(data->flags & cv::UMatData::USER_ALLOCATED)) {
+        m_bytesInUse.fetch_sub(data->size, std::memory_order_relaxed);
+    }
+    m_base->deallocate(data);
+}
@@ -0,0 +1,156 @@
+#include "Binarize.h"
+#include <opencv2/imgproc.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <mutex>
+
+// Rows per adaptive band; each band also integrates a radius-row apron on both sides
+static const int kAdaptiveBandRows = 128;
+
+void grayHistogram(const cv::Mat& gray, int histogram[256]) {
+    std::fill(histogram, histogram + 256, 0);
+    std::mutex mutex;
+    const int bands = std::max(1, std::min(gray.rows, cv::getNumThreads() * 4));
+    cv::parallel_for_(cv::Range(0, bands), [&](const cv::Range& range) {
+        // Four interleaved tables so consecutive equal pixels do not serialize
+        // on one counter
+        int local[4][256] = {};
+        const int y0 = range.start * gray.rows / bands;
+        const int y1 = range.end * gray.rows / bands;
+        for (int y = y0; y < y1; ++y) {
+            const uchar* row = gray.ptr<uchar>(y);
+            int x = 0;
+            for (; x + 4 <= gray.cols; x += 4) {
+                ++local[0][row[x]];
+                ++local[1][row[x + 1]];
+                ++local[2][row[x + 2]];
+                ++local[3][row[x + 3]];
+            }
+            for (; x < gray.cols; ++x) {
+                ++local[0][row[x]];
+            }
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        for (int i = 0; i < 256; ++i) {
+            histogram[i] += local[0][i] + local[1][i] + local[2][i] + local[3][i];
+        }
+    });
+}
+
+int otsuThreshold(const int histogram[256]) {
+    double total = 0.0, weightedTotal = 0.0;
+    for (int i = 0; i < 256; ++i) {
+        total += histogram[i];
+        weightedTotal += static_cast<double>(i) * histogram[i];
+    }
+    double background = 0.0, weightedBackground = 0.0, bestVariance = -1.0;
+    int best = 0;
+    for (int t = 0; t < 256; ++t) {
+        background += histogram[t];
+        weightedBackground += static_cast<double>(t) * histogram[t];
+        const double foreground = total - background;
+        if (background == 0.0 || foreground == 0.0) {
+            continue;
+        }
+        const double meanDifference = weightedBackground / background - (weightedTotal - weightedBackground) / foreground;
+        const double variance = background * foreground * meanDifference * meanDifference;
+        if (variance > bestVariance) {
+            bestVariance = variance;
+            best = t;
+        }
+    }
+    return best;
+}
+
+// Zack's triangle method: the bin farthest from the line joining the peak to
+// the far end of the longer tail, computed as OpenCV does
+int triangleThreshold(const int histogram[256]) {
+    int left = 0, right = 255;
+    while (left < 255 && histogram[left] == 0) {
+        ++left;
+    }
+    while (right > 0 && histogram[right] == 0) {
+        --right;
+    }
+    // Step one bin into the empty space so the line starts at zero height
+    left = std::max(left - 1, 0);
+    right = std::min(right + 1, 255);
+
+    int peak = 0;
+    for (int i = 0; i < 256; ++i) {
+        if (histogram[i] > histogram[peak]) {
+            peak = i;
+        }
+    }
+    // Work on the longer tail as if it were on the left
+    const bool flip = peak - left < right - peak;
+    auto count = [&](int i) { return histogram[flip ? 255 - i : i]; };
+    if (flip) {
+        left = 255 - right;
+        peak = 255 - peak;
+    }
+
+    int threshold = left;
+    double bestDistance = 0.0;
+    const double height = count(peak);
+    for (int i = left + 1; i <= peak; ++i) {
+        // Distance to the line up to a constant factor and offset
+        const double distance = height * i + static_cast<double>(left - peak) * count(i);
+        if (distance > bestDistance) {
+            bestDistance = distance;
+            threshold = i;
+        }
+    }
+    --threshold;
+    return flip ? 255 - threshold : threshold;
+}
+
+void adaptiveThreshold(const cv::Mat& gray, cv::Mat& output, int radius, AdaptiveMethod method, double parameter) {
+    cv::Mat result(gray.size(), CV_8UC1);
+    const int bands = (gray.rows + kAdaptiveBandRows - 1) / kAdaptiveBandRows;
+    cv::parallel_for_(cv::Range(0, bands), [&](const cv::Range& range) {
+        // Per-band integrals stay cache-sized and in range for 64-bit sums
+        cv::Mat sum, squares;
+        for (int band = range.start; band < range.end; ++band) {
+            const int y0 = band * kAdaptiveBandRows;
+            const int y1 = std::min(y0 + kAdaptiveBandRows, gray.rows);
+            const int top = std::max(y0 - radius, 0);
+            const int bottom = std::min(y1 + radius, gray.rows);
+            const cv::Mat rows = gray.rowRange(top, bottom);
+            if (method == AdaptiveMethod::Sauvola) {
+                cv::integral(rows, sum, squares, CV_64F, CV_64F);
+            } else {
+                cv::integral(rows, sum, CV_64F);
+            }
+
+            for (int y = y0; y < y1; ++y) {
+                const int wy0 = std::max(y - radius, 0) - top;
+                const int wy1 = std::min(y + radius + 1, gray.rows) - top;
+                const double* sumTop = sum.ptr<double>(wy0);
+                const double* sumBottom = sum.ptr<double>(wy1);
+                const double* squaresTop = method == AdaptiveMethod::Sauvola ? squares.ptr<double>(wy0) : nullptr;
+                const double* squaresBottom = method == AdaptiveMethod::Sauvola ? squares.ptr<double>(wy1) : nullptr;
+                const uchar* in = gray.ptr<uchar>(y);
+                uchar* out = result.ptr<uchar>(y);
+                for (int x = 0; x < gray.cols; ++x) {
+                    const int x0 = std::max(x - radius, 0);
+                    const int x1 = std::min(x + radius + 1, gray.cols);
+                    const double count = static_cast<double>(wy1 - wy0) * (x1 - x0);
+                    const double mean = (sumBottom[x1] - sumBottom[x0] - sumTop[x1] + sumTop[x0]) / count;
+                    double threshold;
+                    if (squaresTop) {
+                        const double meanSquare =
+                            (squaresBottom[x1] - squaresBottom[x0] - squaresTop[x1] + squaresTop[x0]) / count;
+                        const double deviation = std::sqrt(std::max(meanSquare - mean * mean, 0.0));
+                        threshold = mean * (1.0 + parameter * (deviation / 128.0 - 1.0));
+                    } else {
+                        threshold = mean - parameter;
+                    }
+                    out[x] = in[x] > threshold ? 255 : 0;
+                }
+            }
+        }
+    });
+    output = result;
+}
@@ -0,0 +1,185 @@
+#include "ColorSpace.h"
+#include <opencv2/imgproc.hpp>
+#include <cmath>
+#include <vector>
+
+double rangeScale(int fromDepth, int toDepth) {
+    auto white = [](int depth) { return depth == CV_8U ? 255.0 : (depth == CV_16U ? 65535.0 : 1.0); };
+    return white(toDepth) / white(fromDepth);
+}
+
+namespace {
+
+double srgbToLinear(double encoded) {
+    return encoded <= 0.04045 ? encoded / 12.92 : std::pow((encoded + 0.055) / 1.055, 2.4);
+}
+
+double linearToSrgb(double linear) {
+    return linear <= 0.0031308 ? linear * 12.92 : 1.055 * std::pow(linear, 1.0 / 2.4) - 0.055;
+}
+
+// 8-bit sRGB to 16-bit linear, applied with cv::LUT
+const cv::Mat& decodeTable() {
+    static const cv::Mat table = []() {
+        cv::Mat lut(1, 256, CV_16U);
+        for (int i = 0; i < 256; ++i) {
+            lut.at<ushort>(i) = cv::saturate_cast<ushort>(srgbToLinear(i / 255.0) * 65535.0);
+        }
+        return lut;
+    }();
+    return table;
+}
+
+// Linear to 8-bit sRGB, indexed by the 16-bit value
+const uchar* encodeTable16() {
+    static const std::vector<uchar> table = []() {
+        std::vector<uchar> lut(65536);
+        for (int i = 0; i < 65536; ++i) {
+            lut[i] = cv::saturate_cast<uchar>(linearToSrgb(i / 65535.0) * 255.0);
+        }
+        return lut;
+    }();
+    return table.data();
+}
+
+const cv::Mat& encodeTable8() {
+    static const cv::Mat table = []() {
+        cv::Mat lut(1, 256, CV_8U);
+        for (int i = 0; i < 256; ++i) {
+            lut.at<uchar>(i) = cv::saturate_cast<uchar>(linearToSrgb(i / 255.0) * 255.0);
+        }
+        return lut;
+    }();
+    return table;
+}
+
+void decode(const cv::Mat& srgb, cv::Mat& linear) {
+    cv::Mat encoded = srgb;
+    if (srgb.depth() != CV_8U) {
+        srgb.convertTo(encoded, CV_8U, rangeScale(srgb.depth(), CV_8U));
+    }
+    cv::LUT(encoded, decodeTable(), linear);
+}
+
+// 8-bit and 16-bit input go through a table; float input (0-1) is scaled to
+// 16-bit first
+void encode(const cv::Mat& linear, cv::Mat& srgb) {
+    if (linear.depth() == CV_8U) {
+        cv::LUT(linear, encodeTable8(), srgb);
+        return;
+    }
+    cv::Mat wide = linear;
+    if (linear.depth() != CV_16U) {
+        linear.convertTo(wide, CV_16U, rangeScale(linear.depth(), CV_16U));
+    }
+    srgb.create(wide.size(), CV_MAKETYPE(CV_8U, wide.channels()));
+    const uchar* table = encodeTable16();
+    const int width = wide.cols * wide.channels();
+    cv::parallel_for_(cv::Range(0, wide.rows), [&](const cv::Range& range) {
+        for (int y = range.start; y < range.end; ++y) {
+            const ushort* in = wide.ptr<ushort>(y);
+            uchar* out = srgb.ptr<uchar>(y);
+            for (int x = 0; x < width; ++x) {
+                out[x] = table[in[x]];
+            }
+        }
+    });
+}
+
+// 8-bit, three-channel BGR, as cvtColor's 8-bit paths expect
+cv::Mat toBgr8(const cv::Mat& srgb) {
+    cv::Mat bgr = srgb;
+    if (bgr.depth() != CV_8U) {
+        bgr.convertTo(bgr, CV_8U, rangeScale(bgr.depth(), CV_8U));
+    }
+    if (bgr.channels() == 1) {
+        cv::cvtColor(bgr, bgr, cv::COLOR_GRAY2BGR);
+    }
+    return bgr;
+}
+
+} // namespace
+
+const char* colorSpaceName(ColorSpace space) {
+    switch (space) {
+        case ColorSpace::SRGB: return "sRGB";
+        case ColorSpace::Linear: return "Linear";
+        case ColorSpace::HSV: return "HSV";
+        case ColorSpace::Lab: return "Lab";
+        case ColorSpace::YCbCr: return "YCbCr";
+        default: return "Inherit";
+    }
+}
+
+void convertColorSpace(const cv::Mat& input, cv::Mat& output, ColorSpace from, ColorSpace to) {
+    if (from == to || input.empty()) {
+        output = input;
+        return;
+    }
+    cv::Mat color = input;
+    cv::Mat alpha;
+    if (input.channels() == 4) {
+        cv::cvtColor(input, color, cv::COLOR_BGRA2BGR);
+        cv::extractChannel(input, alpha, 3);
+    }
+
+    cv::Mat srgb;
+    switch (from) {
+        case ColorSpace::Linear: encode(color, srgb); break;
+        case ColorSpace::HSV: cv::cvtColor(toBgr8(color), srgb, cv::COLOR_HSV2BGR); break;
+        case ColorSpace::Lab: cv::cvtColor(toBgr8(color), srgb, cv::COLOR_Lab2BGR); break;
+        case ColorSpace::YCbCr: cv::cvtColor(toBgr8(color), srgb, cv::COLOR_YCrCb2BGR); break;
+        default: srgb = color; break;
+    }
+
+    cv::Mat converted;
+    switch (to) {
+        case ColorSpace::Linear: decode(srgb, converted); break;
+        case ColorSpace::HSV: cv::cvtColor(toBgr8(srgb), converted, cv::COLOR_BGR2HSV); break;
+        case ColorSpace::Lab: cv::cvtColor(toBgr8(srgb), converted, cv::COLOR_BGR2Lab); break;
+        case ColorSpace::YCbCr: cv::cvtColor(toBgr8(srgb), converted, cv::COLOR_BGR2YCrCb); break;
+        default: converted = srgb; break;
+    }
+
+    if (alpha.empty() || converted.channels() != 3) {
+        output = converted;
+        return;
+    }
+    if (alpha.depth() != converted.depth()) {
+        alpha.convertTo(alpha, converted.depth(), rangeScale(alpha.depth(), converted.depth()));
+    }
+    const cv::Mat planes[] = {converted, alpha};
+    cv::Mat merged(converted.size(), CV_MAKETYPE(converted.depth(), 4));
+    const int fromTo[] = {0, 0, 1, 1, 2, 2, 3, 3};
+    cv::mixChannels(planes, 2, &merged, 1, fromTo, 4);
+    output = merged;
+}
+
+void lumaOf(const cv::Mat& image, ColorSpace space, cv::Mat& luma) {
+    if (image.empty() || (image.channels() == 1 && space != ColorSpace::Linear)) {
+        luma = image;
+        return;
+    }
+    switch (space) {
+        case ColorSpace::Lab:
+        case ColorSpace::YCbCr:
+            cv::extractChannel(image, luma, 0);
+            break;
+        case ColorSpace::HSV:
+            cv::extractChannel(image, luma, 2);
+            break;
+        case ColorSpace::Linear: {
+            cv::Mat srgb;
+            convertColorSpace(image, srgb, ColorSpace::Linear, ColorSpace::SRGB);
+            if (srgb.channels() == 1) {
+                luma = srgb;
+            } else {
+                cv::cvtColor(srgb, luma, srgb.channels() == 4 ? cv::COLOR_BGRA2GRAY : cv::COLOR_BGR2GRAY);
+            }
+            break;
+        }
+        default:
+            cv::cvtColor(image, luma, image.channels() == 4 ? cv::COLOR_BGRA2GRAY : cv::COLOR_BGR2GRAY);
+            break;
+    }
+}
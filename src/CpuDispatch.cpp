@@ -0,0 +1,116 @@
+#include "CpuDispatch.h"
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <initializer_list>
+#if defined(NBIP_DISPATCH_X86) && defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace {
+
+CpuLevel probe() {
+#if defined(NBIP_DISPATCH_X86) && (defined(__GNUC__) || defined(__clang__))
+    // These also check that the OS saves the wider registers
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw") && __builtin_cpu_supports("fma")) {
+        return CpuLevel::AVX512;
+    }
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+        return CpuLevel::AVX2;
+    }
+    if (__builtin_cpu_supports("sse4.1")) {
+        return CpuLevel::SSE4;
+    }
+#elif defined(NBIP_DISPATCH_X86) && defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    const int maxLeaf = info[0];
+    __cpuid(info, 1);
+    const bool sse41 = (info[2] & (1 << 19)) != 0;
+    const bool fma = (info[2] & (1 << 12)) != 0;
+    const bool osxsave = (info[2] & (1 << 27)) != 0;
+    // XCR0: the OS must save YMM state for AVX, and opmask and ZMM state for AVX-512
+    const unsigned long long xcr0 = osxsave ? _xgetbv(0) : 0;
+    const bool ymm = (xcr0 & 0x6) == 0x6;
+    const bool zmm = (xcr0 & 0xe6) == 0xe6;
+    bool avx2 = false;
+    bool avx512 = false;
+    if (maxLeaf >= 7) {
+        __cpuidex(info, 7, 0);
+        avx2 = (info[1] & (1 << 5)) != 0;
+        avx512 = (info[1] & (1 << 16)) != 0 && (info[1] & (1 << 30)) != 0;
+    }
+    if (avx512 && fma && zmm) {
+        return CpuLevel::AVX512;
+    }
+    if (avx2 && fma && ymm) {
+        return CpuLevel::AVX2;
+    }
+    if (sse41) {
+        return CpuLevel::SSE4;
+    }
+#endif
+    return CpuLevel::Baseline;
+}
+
+CpuLevel initialLevel() {
+    CpuLevel level = detectedCpuLevel();
+    CpuLevel requested;
+    if (parseCpuLevel(std::getenv("NBIP_CPU_LEVEL"), requested) && requested < level) {
+        level = requested;
+    }
+    return level;
+}
+
+std::atomic<int> s_activeLevel{-1};
+
+} // namespace
+
+CpuLevel detectedCpuLevel() {
+    static const CpuLevel level = probe();
+    return level;
+}
+
+CpuLevel activeCpuLevel() {
+    int level = s_activeLevel.load(std::memory_order_relaxed);
+    if (level < 0) {
+        level = static_cast<int>(initialLevel());
+        s_activeLevel.store(level, std::memory_order_relaxed);
+    }
+    return static_cast<CpuLevel>(level);
+}
+
+CpuLevel setCpuLevel(CpuLevel level) {
+    if (level > detectedCpuLevel()) {
+        level = detectedCpuLevel();
+    }
+    s_activeLevel.store(static_cast<int>(level), std::memory_order_relaxed);
+    return level;
+}
+
+const char* cpuLevelName(CpuLevel level) {
+    switch (level) {
+        case CpuLevel::SSE4:
+            return "sse4";
+        case CpuLevel::AVX2:
+            return "avx2";
+        case CpuLevel::AVX512:
+            return "avx512";
+        default:
+            return "baseline";
+    }
+}
+
+bool parseCpuLevel(const char* name, CpuLevel& level) {
+    if (!name) {
+        return false;
+    }
+    for (CpuLevel candidate : {CpuLevel::Baseline, CpuLevel::SSE4, CpuLevel::AVX2, CpuLevel::AVX512}) {
+        if (std::strcmp(name, cpuLevelName(candidate)) == 0) {
+            level = candidate;
+            return true;
+        }
+    }
+    return false;
+}
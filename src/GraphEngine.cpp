@@ -0,0 +1,529 @@
+#include "GraphEngine.h"
+#include "CpuDispatch.h"
+#include "Node.h"
+#include <chrono>
+#include <typeinfo>
+#include <unordered_map>
+
+namespace {
+
+// Cached outputs depend on the code as well as the parameters. Bump this
+// whenever a node's algorithm or output format changes, so that caches shared
+// across builds stop serving results of the old code.
+const uint64_t kAlgorithmVersion = 1;
+
+cv::Rect grow(const cv::Rect& rect, int margin) {
+    return rect.empty() ? rect : cv::Rect(rect.x - margin, rect.y - margin, rect.width + 2 * margin, rect.height + 2 * margin);
+}
+
+cv::Rect unite(const cv::Rect& a, const cv::Rect& b) {
+    return a.empty() ? b : (b.empty() ? a : (a | b));
+}
+
+} // namespace
+
+GraphEngine::GraphEngine()
+    : m_resultCache(ResultCache::fromEnvironment()), m_memoryBudget(MemoryBudget::fromEnvironment()) {}
+
+GraphEngine::~GraphEngine() {
+    if (m_memoryBudget) {
+        m_memoryBudget->forgetOwner(this);
+    }
+}
+
+void GraphEngine::setMemoryBudget(std::shared_ptr<MemoryBudget> budget) {
+    if (m_memoryBudget) {
+        m_memoryBudget->forgetOwner(this);
+    }
+    m_memoryBudget = std::move(budget);
+}
+
+void GraphEngine::addNode(Node* node) {
+    m_nodes.push_back(node);
+    node->setInvalidationCallback([this]() {
+        if (m_onInvalidated) {
+            m_onInvalidated();
+        }
+    });
+}
+
+void GraphEngine::removeNode(Node* node) {
+    m_nodes.erase(std::remove(m_nodes.begin(), m_nodes.end(), node), m_nodes.end());
+    m_stale.erase(node);
+    node->setInvalidationCallback(nullptr);
+    if (m_memoryBudget) {
+        m_memoryBudget->forget(node);
+    }
+    m_lastPlan = ExecutionPlan();
+}
+
+void GraphEngine::invalidateAll() {
+    for (Node* node : m_nodes) {
+        node->markDirty();
+    }
+}
+
+bool GraphEngine::run() {
+    bool expected = false;
+    if (!m_running.compare_exchange_strong(expected, true, std::memory_order_acq_rel)) {
+        m_rerunRequested.store(true, std::memory_order_release);
+        return false;
+    }
+    do {
+        m_rerunRequested.store(false, std::memory_order_release);
+        runPass();
+    } while (m_rerunRequested.load(std::memory_order_acquire));
+    m_running.store(false, std::memory_order_release);
+    return true;
+}
+
+std::vector<ImageBatch> GraphEngine::processBatch(Node* source, const ImageBatch& frames, Node* target) {
+    const std::vector<Node*> order = GraphOptimizer::topologicalOrder(m_nodes);
+
+    // Only nodes downstream of source and upstream of target see the frames
+    std::unordered_set<Node*> downstream = {source};
+    for (Node* node : order) {
+        for (const auto& connection : node->getInputConnections()) {
+            if (downstream.count(connection.first)) {
+                downstream.insert(node);
+                break;
+            }
+        }
+    }
+    std::unordered_set<Node*> upstream = {target};
+    for (auto it = order.rbegin(); it != order.rend(); ++it) {
+        if (upstream.count(*it)) {
+            for (const auto& connection : (*it)->getInputConnections()) {
+                upstream.insert(connection.first);
+            }
+        }
+    }
+    std::vector<Node*> active;
+    for (Node* node : order) {
+        if (node != source && !node->isSink() && downstream.count(node) && upstream.count(node)) {
+            active.push_back(node);
+        }
+    }
+
+    std::unordered_map<Node*, std::vector<ImageBatch>> batches;
+    auto gatherInputs = [&batches](Node* node, size_t count) {
+        const auto connections = node->getInputConnections();
+        std::vector<ImageBatch> inputs(connections.size());
+        for (size_t port = 0; port < connections.size(); ++port) {
+            Node* producer = connections[port].first;
+            if (!producer) {
+                continue;
+            }
+            auto found = batches.find(producer);
+            if (found != batches.end()) {
+                const int slot = producer->outputSlot(connections[port].second);
+                if (slot >= 0 && slot < static_cast<int>(found->second.size())) {
+                    inputs[port] = found->second[slot];
+                }
+            } else {
+                // Outputs outside the batch may be premultiplied; batches are straight
+                auto data = producer->getOutputData(connections[port].second);
+                const int slot = producer->outputSlot(connections[port].second);
+                inputs[port].assign(count, data ? imageAs(*std::static_pointer_cast<cv::Mat>(data),
+                                                          producer->outputInfo(slot), false)
+                                                : cv::Mat());
+            }
+        }
+        return inputs;
+    };
+
+    // A parameter fed from the frames may differ per frame, which rules out
+    // the shared per-batch state of overridden processBatch() implementations
+    auto parametersPerFrame = [&batches](Node* node) {
+        const auto connections = node->getInputConnections();
+        for (size_t port = node->getPorts().size(); port < connections.size(); ++port) {
+            if (connections[port].first && batches.count(connections[port].first)) {
+                return true;
+            }
+        }
+        return false;
+    };
+
+    std::vector<ImageBatch> results;
+    for (size_t begin = 0; begin < frames.size(); begin += m_batchSize) {
+        const size_t count = std::min(m_batchSize, frames.size() - begin);
+        batches.clear();
+        batches[source] = {ImageBatch(frames.begin() + begin, frames.begin() + begin + count)};
+        for (Node* node : active) {
+            if (parametersPerFrame(node)) {
+                node->Node::processBatch(gatherInputs(node, count), batches[node]);
+            } else {
+                node->applyParameterInputs();
+                node->processBatch(gatherInputs(node, count), batches[node]);
+            }
+        }
+
+        const std::vector<ImageBatch> chunk = target->isSink() ? gatherInputs(target, count) : batches[target];
+        results.resize(std::max(results.size(), chunk.size()));
+        for (size_t slot = 0; slot < chunk.size(); ++slot) {
+            results[slot].insert(results[slot].end(), chunk[slot].begin(), chunk[slot].end());
+        }
+    }
+    return results;
+}
+
+std::vector<std::vector<cv::Mat>> GraphEngine::sweep(Node* node, const std::string& parameter,
+                                                     const std::vector<double>& values, Node* target) {
+    const int port = node->parameterPort(parameter);
+    const auto connections = node->getInputConnections();
+    if (port < 0 || (port < static_cast<int>(connections.size()) && connections[port].first)) {
+        return {};
+    }
+    bool expected = false;
+    if (!m_running.compare_exchange_strong(expected, true, std::memory_order_acq_rel)) {
+        return {};
+    }
+
+    // Each pass re-runs only node and what depends on it; everything upstream
+    // keeps its outputs, and values seen before come back from the result cache
+    std::vector<std::vector<cv::Mat>> results;
+    const double original = node->parameter(parameter);
+    m_observed = {target};
+    for (double value : values) {
+        node->setParameter(parameter, value);
+        runPass();
+        if (target->isSink()) {
+            std::vector<cv::Mat> inputs;
+            for (size_t i = 0; i < target->getPorts().size(); ++i) {
+                auto data = target->getInputData(static_cast<int>(i));
+                if (target->getPorts()[i].type == PortType::Input) {
+                    inputs.push_back(data ? *std::static_pointer_cast<cv::Mat>(data) : cv::Mat());
+                }
+            }
+            results.push_back(inputs);
+        } else {
+            results.push_back(target->outputImages());
+        }
+    }
+    m_observed.clear();
+    node->setParameter(parameter, original);
+    m_running.store(false, std::memory_order_release);
+    return results;
+}
+
+bool GraphEngine::inputsChanged(const Node* node, const std::unordered_set<Node*>& changed) const {
+    const auto connections = node->getInputConnections();
+    for (size_t port = 0; port < connections.size(); ++port) {
+        // A parameter input that settles on the value already applied changes nothing
+        if (connections[port].first && changed.count(connections[port].first) &&
+            !node->isParameterInputApplied(static_cast<int>(port))) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void GraphEngine::runPass() {
+    m_lastPlan = m_optimizer.optimize(m_nodes, m_observed);
+    if (m_resultCache) {
+        updateContentKeys();
+    }
+
+    std::unordered_set<Node*> changed;
+    std::unordered_set<Node*> ran;
+    // Patched outputs count as changed, over the area the patches cover
+    DamageMap damage;
+    for (Node* node : m_nodes) {
+        std::vector<cv::Rect> patches = node->takePatches();
+        if (!patches.empty()) {
+            changed.insert(node);
+            discardInputCaches(node);
+            if (m_damageTracking) {
+                damage[node] = std::move(patches);
+            }
+        }
+    }
+
+    m_profiler.beginPass();
+    for (const auto& step : m_lastPlan.steps) {
+        Node* node = step.node;
+        const bool rerun = node->isDirty() || m_stale.count(node);
+        bool needed = rerun || inputsChanged(node, changed);
+        if (step.aliasOf) {
+            needed = needed || changed.count(step.aliasOf);
+        }
+        if (step.fused) {
+            for (Node* member : step.fused->nodes) {
+                needed = needed || member->isDirty() || inputsChanged(member, changed);
+            }
+        }
+        if (!needed) {
+            continue;
+        }
+
+        // Clear the flags first so an edit made during the step schedules another pass
+        node->takeDirty();
+        m_stale.erase(node);
+        ran.insert(node);
+        if (step.fused) {
+            for (Node* member : step.fused->nodes) {
+                if (member != node) {
+                    member->takeDirty();
+                    m_stale.insert(member);
+                    ran.insert(member);
+                }
+            }
+        }
+        if (m_memoryBudget) {
+            for (const auto& connection : node->getInputConnections()) {
+                if (connection.first) {
+                    m_memoryBudget->touch(connection.first);
+                }
+            }
+        }
+        if (!rerun && !step.fused && !step.aliasOf && m_damageTracking && runDamaged(node, damage, changed)) {
+            changed.insert(node);
+        } else {
+            damage.erase(node);
+            if (execute(step)) {
+                changed.insert(node);
+            }
+            node->clearPatched();
+        }
+        if (m_memoryBudget) {
+            m_memoryBudget->update(node, this);
+        }
+    }
+    m_profiler.endPass();
+
+    // Pruned nodes downstream of a change now hold outdated outputs
+    for (Node* node : GraphOptimizer::topologicalOrder(m_nodes)) {
+        if (ran.count(node)) {
+            continue;
+        }
+        for (const auto& connection : node->getInputConnections()) {
+            if (connection.first && (changed.count(connection.first) || m_stale.count(connection.first))) {
+                m_stale.insert(node);
+                break;
+            }
+        }
+    }
+
+    if (m_onPassFinished) {
+        std::vector<Node*> updated;
+        for (Node* node : m_nodes) {
+            if (changed.count(node)) {
+                updated.push_back(node);
+            }
+        }
+        m_onPassFinished(updated);
+    }
+}
+
+bool GraphEngine::execute(const PlanStep& step) {
+    Node* node = step.node;
+    if (step.aliasOf) {
+        node->copyOutputsFrom(step.aliasOf);
+        node->setResultKey(step.aliasOf->resultKey());
+        return true;
+    }
+
+    node->applyParameterInputs();
+    const uint64_t key = m_resultCache ? node->contentKey() : 0;
+    if (key != 0 && node->resultKey() == key) {
+        return false;
+    }
+    if (key != 0 && restoreOutputs(node)) {
+        return true;
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    if (step.fused) {
+        m_profiler.runNode(node, [this, &step]() { m_optimizer.runFused(*step.fused); });
+    } else {
+        m_profiler.runNode(node);
+    }
+    node->recordOutputInfo();
+    const double elapsedMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    node->setResultKey(key);
+    if (key != 0 && elapsedMs >= m_cacheThresholdMs) {
+        const std::vector<cv::Mat> images = node->outputImages();
+        std::vector<uint32_t> flags;
+        for (size_t slot = 0; slot < images.size(); ++slot) {
+            flags.push_back(node->outputInfo(static_cast<int>(slot)).flags());
+        }
+        m_resultCache->store(key, images, &flags);
+    }
+    return true;
+}
+
+bool GraphEngine::runDamaged(Node* node, DamageMap& damage, const std::unordered_set<Node*>& changed) {
+    const int margin = node->damageMargin();
+    const std::vector<cv::Mat> outputs = node->outputImages();
+    if (margin < 0 || outputs.empty()) {
+        return false;
+    }
+
+    // Changed inputs must be same-sized images with known damage; a changed
+    // parameter affects the whole frame. Alpha is left to full runs, since
+    // its state is tracked per buffer rather than per region.
+    const auto connections = node->getInputConnections();
+    const auto& ports = node->getPorts();
+    std::vector<cv::Mat> images(connections.size());
+    cv::Size frame;
+    cv::Rect region;
+    for (size_t port = 0; port < connections.size(); ++port) {
+        Node* producer = connections[port].first;
+        if (!producer) {
+            continue;
+        }
+        if (port >= ports.size() || ports[port].dataType != DataType::Image) {
+            if (changed.count(producer) && !node->isParameterInputApplied(static_cast<int>(port))) {
+                return false;
+            }
+            continue;
+        }
+        auto data = producer->getOutputData(connections[port].second);
+        images[port] = data ? *std::static_pointer_cast<cv::Mat>(data) : cv::Mat();
+        if (images[port].empty() || images[port].channels() == 4 || (!frame.empty() && images[port].size() != frame)) {
+            return false;
+        }
+        frame = images[port].size();
+        if (changed.count(producer)) {
+            auto found = damage.find(producer);
+            const int slot = producer->outputSlot(connections[port].second);
+            if (found == damage.end() || slot < 0 || slot >= static_cast<int>(found->second.size())) {
+                return false;
+            }
+            region = unite(region, found->second[slot]);
+        }
+    }
+    if (frame.empty()) {
+        return false;
+    }
+    for (const cv::Mat& output : outputs) {
+        if (output.empty() || output.size() != frame || output.channels() == 4) {
+            return false;
+        }
+        for (const cv::Mat& image : images) {
+            if (image.u && image.u == output.u) {
+                return false;   // Pass-through output; writing it would edit the input
+            }
+        }
+    }
+
+    // Past half the frame, tiling saves little over a full run
+    const cv::Rect bounds(cv::Point(), frame);
+    region = grow(region, margin) & bounds;
+    if (static_cast<double>(region.area()) * 2 > bounds.area()) {
+        return false;
+    }
+    if (!region.empty()) {
+        const cv::Rect tile = grow(region, margin) & bounds;
+        std::vector<ImageBatch> inputs(connections.size());
+        for (size_t port = 0; port < connections.size(); ++port) {
+            if (!images[port].empty()) {
+                inputs[port] = {images[port](tile).clone()};
+            } else if (connections[port].first) {
+                auto data = node->getInputData(static_cast<int>(port));
+                inputs[port] = {data ? *std::static_pointer_cast<cv::Mat>(data) : cv::Mat()};
+            }
+        }
+        node->applyParameterInputs();
+        std::vector<ImageBatch> results;
+        m_profiler.runNode(node, [node, &inputs, &results]() { node->processBatch(inputs, results); });
+        if (results.size() != outputs.size()) {
+            return false;
+        }
+        for (size_t slot = 0; slot < outputs.size(); ++slot) {
+            if (results[slot].size() != 1 || results[slot][0].size() != tile.size() ||
+                results[slot][0].type() != outputs[slot].type()) {
+                return false;
+            }
+        }
+        // Same rule as Node::patchOutput: aliases, sinks and caches in this
+        // engine see the update, but a caller's copy, a preview in flight or
+        // an earlier result must keep its pixels, so those buffers are copied.
+        // References held here: outputs, output and the engine's own.
+        for (size_t slot = 0; slot < outputs.size(); ++slot) {
+            cv::Mat output = outputs[slot];
+            if (output.u && output.u->refcount > 2 + engineReferences(output.u)) {
+                const ImageInfo info = node->outputInfo(static_cast<int>(slot));
+                output = output.clone();
+                node->setOutputImage(static_cast<int>(slot), output);
+                node->setOutputInfo(static_cast<int>(slot), info);
+            }
+            cv::Mat target = output(region);
+            results[slot][0](region - tile.tl()).copyTo(target);
+        }
+    }
+
+    damage[node] = std::vector<cv::Rect>(outputs.size(), region);
+    node->setResultKey(0);
+    discardInputCaches(node);
+    return true;
+}
+
+void GraphEngine::discardInputCaches(const Node* updated) {
+    // Aliases share the updated buffers, so match buffers rather than producers
+    std::unordered_set<const cv::UMatData*> buffers;
+    for (const cv::Mat& image : updated->outputImages()) {
+        if (image.u) {
+            buffers.insert(image.u);
+        }
+    }
+    for (Node* node : m_nodes) {
+        for (const auto& connection : node->getInputConnections()) {
+            auto data = connection.first ? connection.first->getOutputData(connection.second) : nullptr;
+            if (data && buffers.count(std::static_pointer_cast<cv::Mat>(data)->u)) {
+                node->discardInputCaches();
+                break;
+            }
+        }
+    }
+}
+
+int GraphEngine::engineReferences(const cv::UMatData* buffer) const {
+    int references = 0;
+    for (const Node* node : m_nodes) {
+        for (const cv::Mat& image : node->retainedImages()) {
+            references += image.u == buffer ? 1 : 0;
+        }
+    }
+    return references;
+}
+
+bool GraphEngine::restoreOutputs(Node* node) {
+    std::vector<cv::Mat> images;
+    std::vector<uint32_t> flags;
+    if (!m_resultCache->load(node->contentKey(), images, &flags) || images.size() != node->outputImages().size()) {
+        return false;
+    }
+    node->setOutputImages(images);
+    for (size_t slot = 0; slot < flags.size(); ++slot) {
+        node->setOutputInfo(static_cast<int>(slot), ImageInfo::fromFlags(flags[slot]));
+    }
+    node->setResultKey(node->contentKey());
+    return true;
+}
+
+void GraphEngine::updateContentKeys() {
+    // Merkle-style: a node's key covers its own parameters and every upstream key,
+    // so a change anywhere upstream changes the keys of everything downstream.
+    // Dispatched kernels may round differently per instruction set.
+    const uint64_t salt = ResultCache::combine(kAlgorithmVersion, ResultCache::hash(cpuLevelName(activeCpuLevel())));
+    for (Node* node : GraphOptimizer::topologicalOrder(m_nodes)) {
+        const std::string parameters = node->cacheKey();
+        uint64_t key = 0;
+        // Patched outputs match no key until the node runs again
+        if (!parameters.empty() && !node->isSink() && !node->isPatched()) {
+            key = ResultCache::combine(salt, ResultCache::hash(typeid(*node).name()));
+            key = ResultCache::combine(key, ResultCache::hash(parameters));
+            for (const auto& connection : node->getInputConnections()) {
+                const uint64_t upstream = connection.first ? connection.first->contentKey() : 1;
+                if (upstream == 0) {
+                    key = 0;
+                    break;
+                }
+                key = ResultCache::combine(key, ResultCache::combine(upstream, connection.second));
+            }
+        }
+        node->setContentKey(key);
+    }
+}
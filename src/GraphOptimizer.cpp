@@ -0,0 +1,457 @@
+#include "GraphOptimizer.h"
+#include "ProcessingNodes.h"
+#include <algorithm>
+#include <cmath>
+#include <typeinfo>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace {
+
+// Parameters fed from other nodes are only known when the node runs
+bool drivenByInputs(Node* node) {
+    const auto& ports = node->ports();
+    const auto connections = node->getInputConnections();
+    for (size_t i = 0; i < connections.size() && i < ports.size(); ++i) {
+        if (connections[i].first && isNumeric(ports[i].dataType)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+int chainFamily(Node* node) {
+    if (drivenByInputs(node)) {
+        return -1;
+    }
+    if (dynamic_cast<BlurNode*>(node)) {
+        return static_cast<int>(FusedChain::Kind::Gaussian);
+    }
+    if (dynamic_cast<ConvolutionFilterNode*>(node)) {
+        return static_cast<int>(FusedChain::Kind::Convolution);
+    }
+    if (dynamic_cast<BrightnessContrastNode*>(node)) {
+        return static_cast<int>(FusedChain::Kind::Affine);
+    }
+    if (dynamic_cast<GeometricNode*>(node)) {
+        return static_cast<int>(FusedChain::Kind::Geometric);
+    }
+    if (dynamic_cast<ColorSpaceNode*>(node)) {
+        return static_cast<int>(FusedChain::Kind::ColorSpace);
+    }
+    return -1;
+}
+
+// Chain members other than the tail must not clip 8-bit data, otherwise the
+// merged operator would see values the unmerged chain had already saturated
+bool preservesRange(Node* node) {
+    if (auto* conv = dynamic_cast<ConvolutionFilterNode*>(node)) {
+        cv::Mat kernel = conv->kernelMatrix();
+        double minValue = 0.0;
+        cv::minMaxLoc(kernel, &minValue);
+        return minValue >= 0.0 && cv::sum(kernel)[0] <= 1.0 + 1e-6;
+    }
+    if (auto* affine = dynamic_cast<BrightnessContrastNode*>(node)) {
+        const double low = affine->brightness();
+        const double high = affine->contrast() * 255.0 + affine->brightness();
+        return std::min(low, high) >= 0.0 && std::max(low, high) <= 255.0;
+    }
+    // Gaussian weights are positive and sum to one; geometric members that
+    // would lose data are resampled on their own inside the fused step
+    return true;
+}
+
+// Full 2-D convolution; correlating with a then b equals correlating with a * b
+cv::Mat convolveKernels(const cv::Mat& a, const cv::Mat& b) {
+    cv::Mat result = cv::Mat::zeros(a.rows + b.rows - 1, a.cols + b.cols - 1, CV_32F);
+    for (int i = 0; i < a.rows; ++i) {
+        for (int j = 0; j < a.cols; ++j) {
+            const float weight = a.at<float>(i, j);
+            if (weight == 0.0f) {
+                continue;
+            }
+            for (int k = 0; k < b.rows; ++k) {
+                for (int l = 0; l < b.cols; ++l) {
+                    result.at<float>(i + k, j + l) += weight * b.at<float>(k, l);
+                }
+            }
+        }
+    }
+    return result;
+}
+
+cv::Mat firstOutputImage(const Node* node) {
+    const auto& ports = node->ports();
+    for (size_t i = 0; i < ports.size(); ++i) {
+        if (ports[i].type == PortType::Output) {
+            auto data = node->getOutputData(i);
+            return data ? *std::static_pointer_cast<cv::Mat>(data) : cv::Mat();
+        }
+    }
+    return cv::Mat();
+}
+
+} // namespace
+
+cv::Mat FusedChain::apply(const cv::Mat& input, ColorSpace inputSpace) const {
+    cv::Mat output;
+    switch (kind) {
+        case Kind::Gaussian:
+            cv::GaussianBlur(input, output, cv::Size(0, 0), sigma);
+            break;
+        case Kind::Convolution:
+            ConvolutionFilterNode::applyKernel(kernel, input, output);
+            break;
+        case Kind::Affine:
+            input.convertTo(output, -1, alpha, beta);
+            if (input.channels() == 4) {
+                // Alpha is coverage, not color
+                const int alphaToAlpha[] = {3, 3};
+                cv::mixChannels(&input, 1, &output, 1, alphaToAlpha, 1);
+            }
+            break;
+        case Kind::Geometric: {
+            // Transforms compose until a member would drop pixels or detail
+            // a later one could bring back; only then is an image produced
+            cv::Mat current = input;
+            cv::Matx33d transform = cv::Matx33d::eye();
+            cv::Size size = input.size();
+            Interpolation interpolation = Interpolation::Nearest;
+            for (size_t i = 0; i < nodes.size(); ++i) {
+                auto* member = static_cast<GeometricNode*>(nodes[i]);
+                const bool lossless = member->isLossless(size);
+                transform = member->transform(size) * transform;
+                size = member->outputSize(size);
+                interpolation = std::max(interpolation, member->interpolation());
+                if (i + 1 == nodes.size() || !lossless) {
+                    // No table: the members' own tables belong to their unfused runs
+                    resample(current, output, transform, size, interpolation);
+                    current = output;
+                    transform = cv::Matx33d::eye();
+                    interpolation = Interpolation::Nearest;
+                }
+            }
+            break;
+        }
+        case Kind::ColorSpace:
+            // Intermediate spaces only lose precision; a round trip shares the input
+            convertColorSpace(input, output, inputSpace, space);
+            break;
+    }
+    return output;
+}
+
+std::vector<Node*> GraphOptimizer::topologicalOrder(const std::vector<Node*>& nodes) {
+    std::unordered_map<Node*, int> pending;
+    std::unordered_map<Node*, std::vector<Node*>> consumers;
+    for (Node* node : nodes) {
+        pending[node] = 0;
+    }
+    for (Node* node : nodes) {
+        for (const auto& connection : node->getInputConnections()) {
+            // Sources outside the list are treated as external inputs
+            if (connection.first && pending.count(connection.first)) {
+                ++pending[node];
+                consumers[connection.first].push_back(node);
+            }
+        }
+    }
+
+    std::vector<Node*> order;
+    order.reserve(nodes.size());
+    for (Node* node : nodes) {
+        if (pending[node] == 0) {
+            order.push_back(node);
+        }
+    }
+    for (size_t i = 0; i < order.size(); ++i) {
+        for (Node* consumer : consumers[order[i]]) {
+            if (--pending[consumer] == 0) {
+                order.push_back(consumer);
+            }
+        }
+    }
+
+    if (order.size() < nodes.size()) {
+        for (Node* node : nodes) {
+            if (pending[node] > 0) {
+                order.push_back(node);
+            }
+        }
+    }
+    return order;
+}
+
+ExecutionPlan GraphOptimizer::optimize(const std::vector<Node*>& nodes, const std::unordered_set<Node*>& observed) const {
+    ExecutionPlan plan;
+    std::vector<Node*> order = topologicalOrder(nodes);
+    auto isObserved = [&observed](Node* node) {
+        return node->isSink() || node->isPreviewEnabled() || observed.count(node) > 0;
+    };
+
+    // Common subexpressions: walking in dependency order, a node's inputs are
+    // already canonical, so equal signatures mean equal outputs
+    std::unordered_map<Node*, Node*> canonical;
+    if (m_options.eliminateCommonSubexpressions) {
+        std::unordered_map<std::string, Node*> signatures;
+        for (Node* node : order) {
+            if (node->isSink()) {
+                continue;
+            }
+            std::string key = node->parameterKey();
+            if (key.empty()) {
+                continue;
+            }
+            std::string signature = typeid(*node).name();
+            signature += '|';
+            signature += key;
+            for (const auto& connection : node->getInputConnections()) {
+                Node* source = connection.first;
+                auto it = canonical.find(source);
+                if (it != canonical.end()) {
+                    source = it->second;
+                }
+                signature += '|' + std::to_string(source ? source->id() : 0) + ':' + std::to_string(connection.second);
+            }
+
+            auto inserted = signatures.emplace(signature, node);
+            if (!inserted.second) {
+                canonical[node] = inserted.first->second;
+            }
+        }
+    }
+    auto resolve = [&canonical](Node* node) {
+        auto it = canonical.find(node);
+        return it != canonical.end() ? it->second : node;
+    };
+
+    // Dead nodes: anything a sink cannot reach through its inputs
+    std::unordered_set<Node*> live;
+    if (m_options.pruneDeadNodes) {
+        std::vector<Node*> stack;
+        for (Node* node : nodes) {
+            if (isObserved(node)) {
+                stack.push_back(node);
+            }
+        }
+        while (!stack.empty()) {
+            Node* node = stack.back();
+            stack.pop_back();
+            if (!live.insert(node).second) {
+                continue;
+            }
+            // An alias is satisfied by copying from its canonical node
+            Node* target = resolve(node);
+            if (target != node) {
+                stack.push_back(target);
+                continue;
+            }
+            for (const auto& connection : node->getInputConnections()) {
+                if (connection.first) {
+                    stack.push_back(connection.first);
+                }
+            }
+        }
+    }
+
+    auto isLive = [&](Node* node) {
+        return !m_options.pruneDeadNodes || live.count(node) > 0;
+    };
+
+    // Linear chains: aliases, their canonical nodes and observed nodes keep
+    // their own outputs, so they may end a chain but never sit inside one
+    std::unordered_map<Node*, std::shared_ptr<FusedChain>> chainByTail;
+    std::unordered_set<Node*> absorbed;
+    if (m_options.fuseLinearChains) {
+        std::vector<Node*> liveOrder;
+        std::set<Node*> pinned;
+        for (Node* node : order) {
+            if (!isLive(node)) {
+                continue;
+            }
+            Node* target = resolve(node);
+            if (target != node) {
+                pinned.insert(node);
+                pinned.insert(target);
+                continue;
+            }
+            if (isObserved(node)) {
+                pinned.insert(node);
+            }
+            liveOrder.push_back(node);
+        }
+
+        std::vector<std::shared_ptr<FusedChain>> chains;
+        fuseChains(order, liveOrder, pinned, chains);
+        for (const auto& chain : chains) {
+            chainByTail[chain->nodes.back()] = chain;
+            absorbed.insert(chain->nodes.begin(), chain->nodes.end() - 1);
+        }
+    }
+
+    for (Node* node : order) {
+        if (!isLive(node)) {
+            plan.pruned.push_back(node);
+            continue;
+        }
+        if (absorbed.count(node)) {
+            plan.absorbed.push_back(node);
+            continue;
+        }
+        Node* target = resolve(node);
+        if (target != node) {
+            plan.steps.push_back({node, target, nullptr});
+            ++plan.mergedCount;
+            continue;
+        }
+        auto chain = chainByTail.find(node);
+        if (chain != chainByTail.end()) {
+            plan.steps.push_back({node, nullptr, chain->second});
+            ++plan.fusedCount;
+        } else {
+            plan.steps.push_back({node, nullptr, nullptr});
+        }
+    }
+    return plan;
+}
+
+void GraphOptimizer::fuseChains(const std::vector<Node*>& order, const std::vector<Node*>& liveOrder,
+                                const std::set<Node*>& pinned,
+                                std::vector<std::shared_ptr<FusedChain>>& chains) const {
+    std::unordered_set<Node*> liveSet(liveOrder.begin(), liveOrder.end());
+    std::unordered_map<Node*, int> consumers;
+    for (Node* node : order) {
+        if (!liveSet.count(node) && !pinned.count(node)) {
+            continue;
+        }
+        for (const auto& connection : node->getInputConnections()) {
+            if (connection.first) {
+                ++consumers[connection.first];
+            }
+        }
+    }
+
+    // Walk tails last-to-first so each chain starts from its furthest member
+    std::unordered_set<Node*> absorbed;
+    for (auto it = liveOrder.rbegin(); it != liveOrder.rend(); ++it) {
+        Node* tail = *it;
+        const int family = chainFamily(tail);
+        if (family < 0 || absorbed.count(tail)) {
+            continue;
+        }
+
+        std::vector<Node*> members{tail};
+        Node* current = tail;
+        while (true) {
+            auto connections = current->getInputConnections();
+            if (connections.empty() || !connections[0].first) {
+                break;
+            }
+            Node* source = connections[0].first;
+            if (chainFamily(source) != family || !liveSet.count(source) || pinned.count(source) ||
+                absorbed.count(source) || consumers[source] != 1 || !preservesRange(source)) {
+                break;
+            }
+            members.insert(members.begin(), source);
+            current = source;
+        }
+        if (members.size() < 2) {
+            continue;
+        }
+
+        auto chain = std::make_shared<FusedChain>();
+        chain->kind = static_cast<FusedChain::Kind>(family);
+        chain->signature = std::to_string(family);
+        double variance = 0.0;
+        for (Node* member : members) {
+            chain->signature += '|' + member->parameterKey();
+            if (auto* blur = dynamic_cast<BlurNode*>(member)) {
+                variance += blur->sigma() * blur->sigma();
+            } else if (auto* conv = dynamic_cast<ConvolutionFilterNode*>(member)) {
+                chain->kernel = chain->kernel.empty() ? conv->kernelMatrix()
+                                                      : convolveKernels(chain->kernel, conv->kernelMatrix());
+            } else if (auto* affine = dynamic_cast<BrightnessContrastNode*>(member)) {
+                chain->alpha *= affine->contrast();
+                chain->beta = chain->beta * affine->contrast() + affine->brightness();
+            } else if (auto* convert = dynamic_cast<ColorSpaceNode*>(member)) {
+                chain->space = convert->space();
+            }
+        }
+        // Gaussians compose by adding variances
+        chain->sigma = std::sqrt(variance);
+
+        if (isRejected(*chain)) {
+            continue;
+        }
+        chain->nodes = members;
+        absorbed.insert(members.begin(), members.end() - 1);
+        chains.push_back(chain);
+    }
+}
+
+bool GraphOptimizer::isRejected(const FusedChain& chain) const {
+    std::lock_guard<std::mutex> lock(m_verifyMutex);
+    return m_rejected.count(chain.signature) > 0;
+}
+
+void GraphOptimizer::runFused(const FusedChain& chain) const {
+    Node* head = chain.nodes.front();
+    Node* tail = chain.nodes.back();
+    // Filters work on premultiplied alpha like the nodes they replace, adjustments on straight color
+    const ImageInfo info = head->inputInfo(0);
+    const bool premultiplied = chain.kind != FusedChain::Kind::Affine && chain.kind != FusedChain::Kind::ColorSpace &&
+                               info.hasAlpha();
+    const cv::Mat input = head->readInput(0, premultiplied);
+    if (input.empty()) {
+        return;
+    }
+    cv::Mat fused = chain.apply(input, info.space);
+
+    // A rewrite that holds for one input form may not for another, e.g. 8-bit
+    // against float or one color space against another
+    std::string form;
+    bool verify = false;
+    if (m_options.verifyRewrites) {
+        form = chain.signature + '|' + std::to_string(input.type()) + ':' + std::to_string(input.cols) + 'x' +
+               std::to_string(input.rows) + ':' + std::to_string(static_cast<int>(info.space)) +
+               (premultiplied ? ":p" : "");
+        std::lock_guard<std::mutex> lock(m_verifyMutex);
+        verify = !m_verified.count(form);
+    }
+    if (verify) {
+        // Reference result from the unmerged chain; it stays as the output
+        for (Node* node : chain.nodes) {
+            node->process();
+            node->recordOutputInfo();
+        }
+        cv::Mat reference = firstOutputImage(tail);
+        bool accepted = false;
+        if (reference.size() == fused.size() && reference.type() == fused.type()) {
+            cv::Mat difference;
+            cv::absdiff(reference, fused, difference);
+            double maxDifference = 0.0;
+            cv::minMaxLoc(difference.reshape(1), nullptr, &maxDifference);
+            cv::Scalar perChannel = cv::mean(difference);
+            double meanDifference = 0.0;
+            for (int c = 0; c < difference.channels(); ++c) {
+                meanDifference += perChannel[c];
+            }
+            meanDifference /= difference.channels();
+            // Bounds are in 8-bit levels; 16-bit and float (0-1) images are scaled to match
+            const double scale = rangeScale(CV_8U, reference.depth());
+            accepted = maxDifference <= m_options.maxAbsDifference * scale &&
+                       meanDifference <= m_options.meanAbsDifference * scale;
+        }
+        std::lock_guard<std::mutex> lock(m_verifyMutex);
+        if (accepted) {
+            m_verified.insert(form);
+        } else {
+            m_rejected.insert(chain.signature);
+        }
+        return;
+    }
+
+    tail->setOutputImage(0, fused);
+    tail->setOutputInfo(0, {info.opaque, premultiplied,
+                            chain.kind == FusedChain::Kind::ColorSpace ? chain.space : ColorSpace::Inherit});
+}
@@ -0,0 +1,357 @@
+#include "GroupNode.h"
+#include "NodeFactory.h"
+#include <QtGlobal>
+#include <algorithm>
+#include <map>
+#include <set>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace {
+
+// Hands the group's inputs to the members that read them
+class GroupInputNode : public Node {
+public:
+    explicit GroupInputNode(const std::vector<Port>& groupPorts) {
+        for (const Port& port : groupPorts) {
+            if (port.type == PortType::Input) {
+                m_ports.push_back({static_cast<int>(m_ports.size()), port.name, PortType::Output, port.dataType});
+                m_outputData.push_back(std::make_shared<cv::Mat>());
+            }
+        }
+    }
+
+    void process() override {}
+    std::string name() const override { return "Group Input"; }
+    const std::vector<Port>& getPorts() const override { return m_ports; }
+
+private:
+    std::vector<Port> m_ports;
+};
+
+} // namespace
+
+std::vector<std::string> GroupDefinition::memberTypes() const {
+    std::vector<std::string> types;
+    for (const Member& member : m_members) {
+        types.push_back(member.type);
+    }
+    return types;
+}
+
+int GroupDefinition::addMember(const std::string& type, std::function<void(Node&)> configure) {
+    if (m_frozen.load(std::memory_order_acquire)) {
+        return -1;
+    }
+    m_members.push_back({type, std::move(configure)});
+    return static_cast<int>(m_members.size()) - 1;
+}
+
+bool GroupDefinition::connect(int sourceMember, int sourcePort, int destMember, int destPort) {
+    const int members = static_cast<int>(m_members.size());
+    if (m_frozen.load(std::memory_order_acquire) || sourceMember < kGroupInput || sourceMember >= members ||
+        destMember < 0 || destMember >= members) {
+        return false;
+    }
+    m_links.push_back({sourceMember, sourcePort, destMember, destPort});
+    return true;
+}
+
+int GroupDefinition::addInput(const std::string& name, DataType type) {
+    if (m_frozen.load(std::memory_order_acquire)) {
+        return -1;
+    }
+    // Inputs come before outputs, so the outputs move up by one
+    m_ports.insert(m_ports.begin() + m_inputCount, {m_inputCount, name, PortType::Input, type});
+    for (size_t i = 0; i < m_ports.size(); ++i) {
+        m_ports[i].id = static_cast<int>(i);
+    }
+    return m_inputCount++;
+}
+
+int GroupDefinition::addOutput(const std::string& name, int member, int port, DataType type) {
+    if (m_frozen.load(std::memory_order_acquire) || member < 0 || member >= static_cast<int>(m_members.size())) {
+        return -1;
+    }
+    m_outputs.push_back({member, port});
+    m_ports.push_back({static_cast<int>(m_ports.size()), name, PortType::Output, type});
+    return static_cast<int>(m_outputs.size()) - 1;
+}
+
+std::vector<std::unique_ptr<Node>> GroupDefinition::createNodes() const {
+    std::vector<std::unique_ptr<Node>> nodes;
+    nodes.reserve(m_members.size() + 1);
+    nodes.push_back(std::make_unique<GroupInputNode>(m_ports));
+    for (const Member& member : m_members) {
+        std::unique_ptr<Node> node = NodeFactory::instance().createNode(member.type);
+        if (!node) {
+            qWarning("Group %s uses unknown node type %s", m_name.c_str(), member.type.c_str());
+        } else if (member.configure) {
+            member.configure(*node);
+        }
+        nodes.push_back(std::move(node));
+    }
+    for (const Link& link : m_links) {
+        Node* source = nodes[link.sourceMember + 1].get();
+        Node* dest = nodes[link.destMember + 1].get();
+        if (source && dest) {
+            dest->addInputConnection(source, link.sourcePort, link.destPort);
+        }
+    }
+    return nodes;
+}
+
+const GroupDefinition::Compiled& GroupDefinition::compiled() const {
+    std::call_once(m_compileOnce, [this]() {
+        m_frozen.store(true, std::memory_order_release);
+
+        // Plan a prototype once; instances replay the plan on their own nodes
+        std::vector<std::unique_ptr<Node>> prototype = createNodes();
+        std::vector<Node*> members;
+        std::unordered_map<Node*, int> index;
+        for (size_t i = 1; i < prototype.size(); ++i) {
+            if (prototype[i]) {
+                members.push_back(prototype[i].get());
+                index[prototype[i].get()] = static_cast<int>(i);
+                m_compiled.sink = m_compiled.sink || prototype[i]->isSink();
+            }
+        }
+        std::unordered_set<Node*> observed;
+        for (const Output& output : m_outputs) {
+            if (Node* node = prototype[output.member + 1].get()) {
+                observed.insert(node);
+            }
+        }
+
+        const ExecutionPlan plan = m_optimizer.optimize(members, observed);
+        for (const PlanStep& planStep : plan.steps) {
+            Step step;
+            step.node = index[planStep.node];
+            step.aliasOf = planStep.aliasOf ? index[planStep.aliasOf] : -1;
+            if (planStep.fused) {
+                auto fused = std::make_shared<FusedChain>(*planStep.fused);
+                for (Node* node : fused->nodes) {
+                    step.chain.push_back(index[node]);
+                }
+                fused->nodes.clear();
+                step.fused = fused;
+            }
+            m_compiled.steps.push_back(std::move(step));
+        }
+    });
+    return m_compiled;
+}
+
+std::shared_ptr<GroupDefinition> GroupDefinition::capture(const std::string& name, const std::vector<Node*>& nodes,
+                                                          const std::vector<Node*>& graphNodes,
+                                                          std::vector<std::pair<Node*, int>>* inputSources) {
+    auto definition = std::make_shared<GroupDefinition>(name);
+    std::unordered_map<const Node*, int> members;
+    for (Node* node : nodes) {
+        std::vector<std::pair<std::string, double>> values;
+        for (const auto& parameter : node->parameters()) {
+            values.emplace_back(parameter.name, parameter.get());
+        }
+        // State first: a composite's layer count decides which parameters exist
+        std::function<void(Node&)> state = node->captureState();
+        members[node] = definition->addMember(node->name(), [state, values](Node& member) {
+            if (state) {
+                state(member);
+            }
+            for (const auto& value : values) {
+                member.setParameter(value.first, value.second);
+            }
+        });
+    }
+
+    std::map<std::pair<Node*, int>, int> inputs;
+    for (Node* node : nodes) {
+        const auto connections = node->getInputConnections();
+        const auto& ports = node->ports();
+        for (size_t port = 0; port < connections.size(); ++port) {
+            const auto& connection = connections[port];
+            if (!connection.first) {
+                continue;
+            }
+            auto member = members.find(connection.first);
+            if (member != members.end()) {
+                definition->connect(member->second, connection.second, members[node], static_cast<int>(port));
+                continue;
+            }
+            auto input = inputs.find(connection);
+            if (input == inputs.end()) {
+                const DataType type = port < ports.size() ? ports[port].dataType : DataType::Image;
+                const std::string label = port < ports.size() ? ports[port].name : "Input";
+                input = inputs.emplace(connection, definition->addInput(label, type)).first;
+                if (inputSources) {
+                    inputSources->push_back(connection);
+                }
+            }
+            definition->connect(kGroupInput, input->second, members[node], static_cast<int>(port));
+        }
+    }
+
+    // Outputs in node and port order, whoever reads them first
+    std::set<std::pair<int, int>> read;
+    for (Node* node : graphNodes) {
+        if (members.count(node)) {
+            continue;
+        }
+        for (const auto& connection : node->getInputConnections()) {
+            auto member = members.find(connection.first);
+            if (member != members.end()) {
+                read.insert({member->second, connection.second});
+            }
+        }
+    }
+    for (const auto& output : read) {
+        const Port& port = nodes[output.first]->ports()[output.second];
+        definition->addOutput(port.name, output.first, output.second, port.dataType);
+    }
+    return definition;
+}
+
+GroupNode::GroupNode(std::shared_ptr<const GroupDefinition> definition) : m_definition(std::move(definition)) {
+    const GroupDefinition::Compiled& compiled = m_definition->compiled();
+    m_nodes = m_definition->createNodes();
+    for (size_t i = 0; i < m_definition->outputs().size(); ++i) {
+        m_outputData.push_back(std::make_shared<cv::Mat>());
+    }
+    m_steps.reserve(compiled.steps.size());
+    for (const auto& step : compiled.steps) {
+        PlanStep planStep;
+        planStep.node = m_nodes[step.node].get();
+        planStep.aliasOf = step.aliasOf >= 0 ? m_nodes[step.aliasOf].get() : nullptr;
+        if (step.fused) {
+            auto fused = std::make_shared<FusedChain>(*step.fused);
+            for (int member : step.chain) {
+                fused->nodes.push_back(m_nodes[member].get());
+            }
+            planStep.fused = fused;
+        }
+        m_steps.push_back(planStep);
+    }
+}
+
+void GroupNode::process() {
+    Node* input = m_nodes[0].get();
+    for (int port = 0; port < m_definition->inputCount(); ++port) {
+        auto data = getInputData(port);
+        input->setOutputImage(port, data ? *std::static_pointer_cast<cv::Mat>(data) : cv::Mat());
+        input->setOutputInfo(port, inputInfo(port));
+    }
+
+    // Same rules as GraphEngine::runPass, over the shared plan
+    std::unordered_set<Node*> changed = {input};
+    auto inputsChanged = [&changed](Node* node) {
+        const auto connections = node->getInputConnections();
+        for (size_t port = 0; port < connections.size(); ++port) {
+            if (connections[port].first && changed.count(connections[port].first) &&
+                !node->isParameterInputApplied(static_cast<int>(port))) {
+                return true;
+            }
+        }
+        return false;
+    };
+    auto run = [](Node* node) {
+        node->applyParameterInputs();
+        node->process();
+        node->recordOutputInfo();
+    };
+    for (const PlanStep& step : m_steps) {
+        Node* node = step.node;
+        bool needed = node->takeDirty() || inputsChanged(node) || (step.aliasOf && changed.count(step.aliasOf));
+        if (step.fused) {
+            for (Node* member : step.fused->nodes) {
+                needed = member->takeDirty() || needed || inputsChanged(member);
+            }
+        }
+        if (!needed) {
+            continue;
+        }
+        if (step.aliasOf) {
+            node->copyOutputsFrom(step.aliasOf);
+        } else if (step.fused && m_definition->m_optimizer.isRejected(*step.fused)) {
+            // The plan is fixed, so a rewrite that failed verification runs unfused
+            for (Node* member : step.fused->nodes) {
+                run(member);
+            }
+        } else if (step.fused) {
+            m_definition->m_optimizer.runFused(*step.fused);
+        } else {
+            run(node);
+        }
+        changed.insert(node);
+    }
+
+    const auto& outputs = m_definition->outputs();
+    for (size_t slot = 0; slot < outputs.size(); ++slot) {
+        Node* member = m_nodes[outputs[slot].member + 1].get();
+        if (!member) {
+            continue;
+        }
+        auto data = member->getOutputData(outputs[slot].port);
+        setOutputImage(static_cast<int>(slot), data ? *std::static_pointer_cast<cv::Mat>(data) : cv::Mat());
+        setOutputInfo(static_cast<int>(slot), member->outputInfo(member->outputSlot(outputs[slot].port)));
+    }
+}
+
+std::string GroupNode::parameterKey() const {
+    // Members are configured identically in every instance, so their keys
+    // identify the outputs together with the group's inputs
+    std::string key = m_definition->name();
+    for (size_t i = 1; i < m_nodes.size(); ++i) {
+        const std::string memberKey = m_nodes[i] ? m_nodes[i]->parameterKey() : std::string();
+        if (memberKey.empty()) {
+            return std::string();
+        }
+        key += '|' + memberKey;
+    }
+    return key;
+}
+
+std::string GroupNode::cacheKey() const {
+    std::string key = m_definition->name();
+    for (size_t i = 1; i < m_nodes.size(); ++i) {
+        const std::string memberKey = m_nodes[i] ? m_nodes[i]->cacheKey() : std::string();
+        if (memberKey.empty()) {
+            return std::string();
+        }
+        key += '|' + memberKey;
+    }
+    return key;
+}
+
+std::vector<cv::Mat> GroupNode::retainedImages() const {
+    std::vector<cv::Mat> images = outputImages();
+    for (const auto& member : m_nodes) {
+        if (member) {
+            const std::vector<cv::Mat> held = member->retainedImages();
+            images.insert(images.end(), held.begin(), held.end());
+        }
+    }
+    return images;
+}
+
+void GroupNode::discardInputCaches() {
+    for (const auto& member : m_nodes) {
+        if (member) {
+            member->discardInputCaches();
+        }
+    }
+}
+
+bool registerGroup(std::shared_ptr<const GroupDefinition> definition) {
+    // Members may only use types registered before the group, so no group
+    // can end up containing itself
+    const auto& available = NodeFactory::instance().getAvailableNodes();
+    for (const std::string& type : definition->memberTypes()) {
+        if (!std::binary_search(available.begin(), available.end(), type)) {
+            qWarning("Group %s uses unregistered node type %s", definition->name().c_str(), type.c_str());
+            return false;
+        }
+    }
+    return NodeFactory::instance().registerNodeType(definition->name(), [definition]() {
+        return std::unique_ptr<Node>(new GroupNode(definition));
+    });
+}
@@ -0,0 +1,82 @@
+#include "ImageInfo.h"
+#include <opencv2/core/utility.hpp>
+
+ImageInfo ImageInfo::describe(const cv::Mat& image) {
+    ImageInfo info;
+    info.opaque = image.channels() != 4;
+    return info;
+}
+
+void premultiplyAlpha(const cv::Mat& straight, cv::Mat& premultiplied) {
+    if (straight.type() != CV_8UC4) {
+        premultiplied = straight;
+        return;
+    }
+    cv::Mat result(straight.size(), straight.type());
+    cv::parallel_for_(cv::Range(0, straight.rows), [&](const cv::Range& range) {
+        for (int y = range.start; y < range.end; ++y) {
+            const uchar* in = straight.ptr<uchar>(y);
+            uchar* out = result.ptr<uchar>(y);
+            for (int x = 0; x < straight.cols * 4; x += 4) {
+                const int a = in[x + 3];
+                // Rounded c * a / 255 without a division
+                for (int c = 0; c < 3; ++c) {
+                    const int t = in[x + c] * a + 128;
+                    out[x + c] = static_cast<uchar>((t + (t >> 8)) >> 8);
+                }
+                out[x + 3] = static_cast<uchar>(a);
+            }
+        }
+    });
+    premultiplied = result;
+}
+
+void unpremultiplyAlpha(const cv::Mat& premultiplied, cv::Mat& straight) {
+    if (premultiplied.type() != CV_8UC4) {
+        straight = premultiplied;
+        return;
+    }
+    cv::Mat result(premultiplied.size(), premultiplied.type());
+    cv::parallel_for_(cv::Range(0, premultiplied.rows), [&](const cv::Range& range) {
+        for (int y = range.start; y < range.end; ++y) {
+            const uchar* in = premultiplied.ptr<uchar>(y);
+            uchar* out = result.ptr<uchar>(y);
+            for (int x = 0; x < premultiplied.cols * 4; x += 4) {
+                const int a = in[x + 3];
+                for (int c = 0; c < 3; ++c) {
+                    out[x + c] = a == 0 ? 0 : cv::saturate_cast<uchar>((in[x + c] * 255 + a / 2) / a);
+                }
+                out[x + 3] = static_cast<uchar>(a);
+            }
+        }
+    });
+    straight = result;
+}
+
+bool hasTransparency(const cv::Mat& image) {
+    if (image.type() != CV_8UC4) {
+        return false;
+    }
+    for (int y = 0; y < image.rows; ++y) {
+        const uchar* row = image.ptr<uchar>(y);
+        for (int x = 3; x < image.cols * 4; x += 4) {
+            if (row[x] != 255) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+cv::Mat imageAs(const cv::Mat& image, const ImageInfo& info, bool premultiplied) {
+    if (info.opaque || info.premultiplied == premultiplied || image.type() != CV_8UC4) {
+        return image;
+    }
+    cv::Mat converted;
+    if (premultiplied) {
+        premultiplyAlpha(image, converted);
+    } else {
+        unpremultiplyAlpha(image, converted);
+    }
+    return converted;
+}
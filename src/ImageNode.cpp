@@ -1,36 +1,91 @@
 #include "ImageNode.h"
 #include <QFileDialog>
 #include <QMessageBox>
+#include <filesystem>
 
 ImageInputNode::ImageInputNode() {
     m_outputData.push_back(std::make_shared<cv::Mat>());
 }
 
 void ImageInputNode::process() {
-    if (!m_imagePath.empty()) {
-        cv::Mat image = cv::imread(m_imagePath, cv::IMREAD_COLOR);
-        if (!image.empty()) {
-            m_image = image;
-            auto output = std::static_pointer_cast<cv::Mat>(m_outputData[0]);
-            *output = m_image.clone();
-            emit dataUpdated();
+    if (m_imagePath.empty()) {
+        return;
+    }
+    cv::Mat image = cv::imread(m_imagePath, m_loadAlpha ? cv::IMREAD_UNCHANGED : cv::IMREAD_COLOR);
+    if (image.empty()) {
+        return;
+    }
+
+    ImageInfo info;
+    if (m_loadAlpha) {
+        // The pipeline is 8-bit with 1, 3 or 4 channels
+        if (image.depth() == CV_16U) {
+            image.convertTo(image, CV_8U, 1.0 / 257.0);
+        } else if (image.depth() != CV_8U) {
+            image.convertTo(image, CV_8U);
+        }
+        if (image.channels() == 2) {
+            cv::Mat planes[2];
+            cv::split(image, planes);
+            cv::merge(std::vector<cv::Mat>{planes[0], planes[0], planes[0], planes[1]}, image);
+        }
+        if (image.channels() == 4) {
+            info.opaque = !hasTransparency(image);
+            if (info.opaque) {
+                // Nothing downstream should pay for an alpha channel that says nothing
+                cv::cvtColor(image, image, cv::COLOR_BGRA2BGR);
+            }
         }
     }
+
+    *std::static_pointer_cast<cv::Mat>(m_outputData[0]) = image;
+    setOutputInfo(0, info);
 }
 
-std::vector<Port> ImageInputNode::getPorts() const {
-    return {
+const std::vector<Port>& ImageInputNode::getPorts() const {
+    static const std::vector<Port> ports = {
         {0, "Output", PortType::Output, DataType::Image}
     };
+    return ports;
+}
+
+std::string ImageInputNode::cacheKey() const {
+    // The file can change between sessions, so key on its size and timestamp too
+    std::error_code error;
+    const auto size = std::filesystem::file_size(m_imagePath, error);
+    if (error) {
+        return std::string();
+    }
+    const auto modified = std::filesystem::last_write_time(m_imagePath, error);
+    if (error) {
+        return std::string();
+    }
+    return parameterKey() + '|' + std::to_string(size) + '|' + std::to_string(modified.time_since_epoch().count());
 }
 
 void ImageInputNode::setImagePath(const std::string& path) {
     m_imagePath = path;
-    process();
+    invalidate();
+}
+
+void ImageInputNode::setLoadAlpha(bool loadAlpha) {
+    m_loadAlpha = loadAlpha;
+    invalidate();
+}
+
+std::function<void(Node&)> ImageInputNode::captureState() const {
+    const std::string path = m_imagePath;
+    const bool loadAlpha = m_loadAlpha;
+    return [path, loadAlpha](Node& node) {
+        auto& input = static_cast<ImageInputNode&>(node);
+        input.setImagePath(path);
+        input.setLoadAlpha(loadAlpha);
+    };
 }
 
 cv::Mat ImageInputNode::getImage() const {
-    return m_image;
+    // The output may have been restored from the result cache without a decode
+    return *std::static_pointer_cast<cv::Mat>(m_outputData[0]);
 }
 
 ImageOutputNode::ImageOutputNode() {
@@ -38,27 +93,31 @@ ImageOutputNode::ImageOutputNode() {
 }
 
 void ImageOutputNode::process() {
-    auto inputData = getInputData(0);
-    if (inputData) {
-        auto inputImage = *std::static_pointer_cast<cv::Mat>(inputData);
-        if (!inputImage.empty()) {
-            m_outputImage = inputImage.clone();
-            if (!m_outputPath.empty()) {
-                cv::imwrite(m_outputPath, m_outputImage);
-            }
+    // Files and previews store straight alpha
+    cv::Mat inputImage = readInput(0);
+    if (!inputImage.empty()) {
+        m_outputImage = inputImage;
+        if (!m_outputPath.empty()) {
+            cv::imwrite(m_outputPath, m_outputImage);
         }
     }
 }
 
-std::vector<Port> ImageOutputNode::getPorts() const {
-    return {
+const std::vector<Port>& ImageOutputNode::getPorts() const {
+    static const std::vector<Port> ports = {
         {0, "Input", PortType::Input, DataType::Image}
     };
+    return ports;
 }
 
 void ImageOutputNode::setOutputPath(const std::string& path) {
     m_outputPath = path;
-    process();
+    invalidate();
+}
+
+std::function<void(Node&)> ImageOutputNode::captureState() const {
+    const std::string path = m_outputPath;
+    return [path](Node& node) { static_cast<ImageOutputNode&>(node).setOutputPath(path); };
 }
 
 cv::Mat ImageOutputNode::getOutputImage() const {
@@ -0,0 +1,108 @@
+#include "ImageStatistics.h"
+#include <algorithm>
+#include <cmath>
+#include <mutex>
+
+double Histogram256::min() const {
+    for (int i = 0; i < 256; ++i) {
+        if (counts[i]) {
+            return i;
+        }
+    }
+    return 0.0;
+}
+
+double Histogram256::max() const {
+    for (int i = 255; i >= 0; --i) {
+        if (counts[i]) {
+            return i;
+        }
+    }
+    return 0.0;
+}
+
+double Histogram256::mean() const {
+    if (total == 0) {
+        return 0.0;
+    }
+    double sum = 0.0;
+    for (int i = 0; i < 256; ++i) {
+        sum += static_cast<double>(i) * counts[i];
+    }
+    return sum / total;
+}
+
+double Histogram256::standardDeviation() const {
+    if (total == 0) {
+        return 0.0;
+    }
+    const double average = mean();
+    double sum = 0.0;
+    for (int i = 0; i < 256; ++i) {
+        sum += (i - average) * (i - average) * counts[i];
+    }
+    return std::sqrt(sum / total);
+}
+
+double Histogram256::percentile(double fraction) const {
+    if (total == 0) {
+        return 0.0;
+    }
+    const double target = std::clamp(fraction, 0.0, 1.0) * total;
+    uint64_t below = 0;
+    for (int i = 0; i < 256; ++i) {
+        below += counts[i];
+        if (below >= target && below > 0) {
+            return i;
+        }
+    }
+    return 255.0;
+}
+
+void accumulateHistogram(const cv::Mat& image, int channel, Histogram256& histogram) {
+    histogram = Histogram256();
+    if (image.empty() || image.depth() != CV_8U) {
+        return;
+    }
+    const int channels = image.channels();
+    const bool luma = channel == static_cast<int>(StatisticsChannel::Luma) && channels >= 3;
+    const bool all = channel == static_cast<int>(StatisticsChannel::AllChannels) || (channel < 0 && !luma);
+    const int offset = std::clamp(channel, 0, channels - 1);
+    const int step = all ? 1 : channels;
+    const int values = luma ? image.cols : (all ? image.cols * channels : image.cols);
+
+    std::mutex mutex;
+    const int bands = std::max(1, std::min(image.rows, cv::getNumThreads() * 4));
+    cv::parallel_for_(cv::Range(0, bands), [&](const cv::Range& range) {
+        // Four interleaved tables so runs of equal values do not serialize on one counter
+        uint32_t local[4][256] = {};
+        const int y0 = range.start * image.rows / bands;
+        const int y1 = range.end * image.rows / bands;
+        for (int y = y0; y < y1; ++y) {
+            const uchar* row = image.ptr<uchar>(y);
+            if (luma) {
+                for (int x = 0; x < image.cols; ++x) {
+                    const uchar* p = row + x * channels;
+                    ++local[x & 3][(29 * p[0] + 150 * p[1] + 77 * p[2] + 128) >> 8];
+                }
+                continue;
+            }
+            const uchar* p = row + (all ? 0 : offset);
+            int x = 0;
+            for (; x + 4 <= values; x += 4) {
+                ++local[0][p[x * step]];
+                ++local[1][p[(x + 1) * step]];
+                ++local[2][p[(x + 2) * step]];
+                ++local[3][p[(x + 3) * step]];
+            }
+            for (; x < values; ++x) {
+                ++local[0][p[x * step]];
+            }
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        for (int i = 0; i < 256; ++i) {
+            histogram.counts[i] += static_cast<uint64_t>(local[0][i]) + local[1][i] + local[2][i] + local[3][i];
+        }
+    });
+    histogram.total = static_cast<uint64_t>(image.rows) * values;
+}
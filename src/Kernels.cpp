@@ -0,0 +1,39 @@
+#include "Kernels.h"
+
+// The portable variant, built with the project's default flags
+namespace kernels_baseline {
+
+#define NBIP_KERNEL_LEVEL CpuLevel::Baseline
+#include "KernelsImpl.inl"
+#undef NBIP_KERNEL_LEVEL
+
+} // namespace kernels_baseline
+
+#ifdef NBIP_DISPATCH_X86
+const KernelTable& sse4Kernels();
+const KernelTable& avx2Kernels();
+const KernelTable& avx512Kernels();
+#endif
+
+const KernelTable& kernels() {
+    return kernelsFor(activeCpuLevel());
+}
+
+const KernelTable& kernelsFor(CpuLevel level) {
+    if (level > detectedCpuLevel()) {
+        level = detectedCpuLevel();
+    }
+#ifdef NBIP_DISPATCH_X86
+    switch (level) {
+        case CpuLevel::AVX512:
+            return avx512Kernels();
+        case CpuLevel::AVX2:
+            return avx2Kernels();
+        case CpuLevel::SSE4:
+            return sse4Kernels();
+        default:
+            break;
+    }
+#endif
+    return kernels_baseline::table;
+}
@@ -0,0 +1,18 @@
+// Kernels built with AVX2 and FMA enabled; see KernelsImpl.inl
+#include "Kernels.h"
+
+#ifdef NBIP_DISPATCH_X86
+
+namespace kernels_avx2 {
+
+#define NBIP_KERNEL_LEVEL CpuLevel::AVX2
+#include "KernelsImpl.inl"
+#undef NBIP_KERNEL_LEVEL
+
+} // namespace kernels_avx2
+
+const KernelTable& avx2Kernels() {
+    return kernels_avx2::table;
+}
+
+#endif // NBIP_DISPATCH_X86
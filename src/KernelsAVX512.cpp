@@ -0,0 +1,18 @@
+// Kernels built with AVX-512 (F and BW) enabled; see KernelsImpl.inl
+#include "Kernels.h"
+
+#ifdef NBIP_DISPATCH_X86
+
+namespace kernels_avx512 {
+
+#define NBIP_KERNEL_LEVEL CpuLevel::AVX512
+#include "KernelsImpl.inl"
+#undef NBIP_KERNEL_LEVEL
+
+} // namespace kernels_avx512
+
+const KernelTable& avx512Kernels() {
+    return kernels_avx512::table;
+}
+
+#endif // NBIP_DISPATCH_X86
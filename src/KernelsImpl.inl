@@ -0,0 +1,183 @@
+// Kernel bodies, included once per instruction set inside that set's
+// namespace from a source compiled with its flags. Loops are kept branch-free
+// so the compiler vectorizes them for the target. Nothing here may call inline
+// functions from shared headers: the linker keeps one copy of each, and it
+// could be the AVX-512 one.
+
+// Written as two selects; the nested form defeats if-conversion
+static inline float clampValue(float value, float low, float high) {
+    const float raised = value < low ? low : value;
+    return raised > high ? high : raised;
+}
+
+// Exact below 2^23 in magnitude; beyond that, where floats have no fraction
+// left, it saturates rather than overflow the int conversion
+static inline float floorValue(float value) {
+    const float limited = clampValue(value, -8388608.0f, 8388608.0f);
+    const float truncated = static_cast<float>(static_cast<int>(limited));
+    return truncated > value ? truncated - 1.0f : truncated;
+}
+
+// Sine accurate to about 4e-6: reduce to [-pi, pi], reflect into
+// [-pi/2, pi/2], then a degree-9 odd polynomial
+static inline float sine(float t) {
+    const float turns = floorValue(t * 0.159154943f + 0.5f);
+    float r = t - turns * 6.28318531f;
+    r = r > 1.57079633f ? 3.14159265f - r : r;
+    r = r < -1.57079633f ? -3.14159265f - r : r;
+    const float r2 = r * r;
+    return r * (1.0f + r2 * (-1.66666667e-1f + r2 * (8.33333333e-3f + r2 * (-1.98412698e-4f + r2 * 2.75573192e-6f))));
+}
+
+static inline uint8_t roundToByte(float value) {
+    return static_cast<uint8_t>(static_cast<int>(clampValue(value, 0.0f, 255.0f) + 0.5f));
+}
+
+static void overlayRow(float* dst, const uint8_t* src, int count, float opacity) {
+    const float scale = 1.0f / 255.0f;
+    for (int i = 0; i < count; ++i) {
+        const float a = dst[i];
+        const float b = src[i] * scale;
+        const float low = 2.0f * a * b;
+        const float high = 1.0f - 2.0f * (1.0f - a) * (1.0f - b);
+        dst[i] = a + ((a < 0.5f ? low : high) - a) * opacity;
+    }
+}
+
+static void lutRow(const uint8_t* src, uint8_t* dst, int width, int channels, const uint8_t* table) {
+    if (channels != 4) {
+        const int count = width * channels;
+        int i = 0;
+        for (; i + 4 <= count; i += 4) {
+            dst[i] = table[src[i]];
+            dst[i + 1] = table[src[i + 1]];
+            dst[i + 2] = table[src[i + 2]];
+            dst[i + 3] = table[src[i + 3]];
+        }
+        for (; i < count; ++i) {
+            dst[i] = table[src[i]];
+        }
+        return;
+    }
+    for (int i = 0; i < width * 4; i += 4) {
+        dst[i] = table[src[i]];
+        dst[i + 1] = table[src[i + 1]];
+        dst[i + 2] = table[src[i + 2]];
+        dst[i + 3] = src[i + 3];
+    }
+}
+
+static void noiseRow(float* dst, int width, int y, const NoiseRowParameters& parameters) {
+    for (int x = 0; x < width; ++x) {
+        dst[x] = 0.0f;
+    }
+    float amplitude = 1.0f;
+    float frequency = 1.0f;
+    for (int octave = 0; octave < parameters.octaves; ++octave) {
+        const float step = frequency * parameters.scale;
+        const float ny = y * step;
+        switch (parameters.type) {
+            case 0: // Perlin
+                for (int x = 0; x < width; ++x) {
+                    const float n = (x * step) * 0.1f + ny * 0.1f;
+                    dst[x] += (sine(n * 10.0f) * 0.5f + 0.5f) * amplitude;
+                }
+                break;
+            case 1: // Simplex, the same pattern at half the frequency
+                for (int x = 0; x < width; ++x) {
+                    const float n = (x * step * 0.5f) * 0.1f + ny * 0.5f * 0.1f;
+                    dst[x] += (sine(n * 10.0f) * 0.5f + 0.5f) * amplitude;
+                }
+                break;
+            default: // Worley placeholder: a repeating ramp
+                for (int x = 0; x < width; ++x) {
+                    const float n = (x * step) * 0.1f + ny * 0.1f;
+                    dst[x] += (n - floorValue(n)) * amplitude;
+                }
+                break;
+        }
+        amplitude *= parameters.persistence;
+        frequency *= 2.0f;
+    }
+}
+
+static void convolveRow(const uint8_t* const* rows, uint8_t* dst, int width, int channels,
+                        const float* kernel, int ksize) {
+    // Blocks small enough for the accumulators to stay in L1 across all taps
+    const int kBlock = 512;
+    float sums[kBlock];
+    const int count = width * channels;
+    for (int begin = 0; begin < count; begin += kBlock) {
+        const int n = count - begin < kBlock ? count - begin : kBlock;
+        for (int i = 0; i < n; ++i) {
+            sums[i] = 0.0f;
+        }
+        for (int ky = 0; ky < ksize; ++ky) {
+            for (int kx = 0; kx < ksize; ++kx) {
+                const float weight = kernel[ky * ksize + kx];
+                if (weight == 0.0f) {
+                    continue;
+                }
+                const uint8_t* in = rows[ky] + begin + kx * channels;
+                for (int i = 0; i < n; ++i) {
+                    sums[i] += weight * in[i];
+                }
+            }
+        }
+        for (int i = 0; i < n; ++i) {
+            dst[begin + i] = roundToByte(sums[i]);
+        }
+    }
+}
+
+static void splitRow(const uint8_t* src, uint8_t* const* planes, int width, int channels) {
+    // Plane pointers in locals, or every store could alias the pointer array
+    uint8_t* p0 = planes[0];
+    uint8_t* p1 = channels > 1 ? planes[1] : nullptr;
+    uint8_t* p2 = channels > 2 ? planes[2] : nullptr;
+    uint8_t* p3 = channels > 3 ? planes[3] : nullptr;
+    switch (channels) {
+        case 1:
+            for (int x = 0; x < width; ++x) {
+                p0[x] = src[x];
+            }
+            break;
+        case 2:
+            for (int x = 0; x < width; ++x) {
+                p0[x] = src[x * 2];
+                p1[x] = src[x * 2 + 1];
+            }
+            break;
+        case 3:
+            for (int x = 0; x < width; ++x) {
+                p0[x] = src[x * 3];
+                p1[x] = src[x * 3 + 1];
+                p2[x] = src[x * 3 + 2];
+            }
+            break;
+        default:
+            for (int x = 0; x < width; ++x) {
+                p0[x] = src[x * 4];
+                p1[x] = src[x * 4 + 1];
+                p2[x] = src[x * 4 + 2];
+                p3[x] = src[x * 4 + 3];
+            }
+            break;
+    }
+}
+
+static void isolateRow(const uint8_t* src, uint8_t* dst, int width, int channels, int channel, int slot) {
+    const uint8_t keep0 = slot == 0 ? 0xff : 0;
+    const uint8_t keep1 = slot == 1 ? 0xff : 0;
+    const uint8_t keep2 = slot == 2 ? 0xff : 0;
+    for (int x = 0; x < width; ++x) {
+        const uint8_t value = src[x * channels + channel];
+        dst[x * 3] = value & keep0;
+        dst[x * 3 + 1] = value & keep1;
+        dst[x * 3 + 2] = value & keep2;
+    }
+}
+
+static const KernelTable table = {
+    NBIP_KERNEL_LEVEL, overlayRow, lutRow, noiseRow, convolveRow, splitRow, isolateRow
+};
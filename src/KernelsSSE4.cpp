@@ -0,0 +1,18 @@
+// Kernels built with SSE4.1 enabled; see KernelsImpl.inl
+#include "Kernels.h"
+
+#ifdef NBIP_DISPATCH_X86
+
+namespace kernels_sse4 {
+
+#define NBIP_KERNEL_LEVEL CpuLevel::SSE4
+#include "KernelsImpl.inl"
+#undef NBIP_KERNEL_LEVEL
+
+} // namespace kernels_sse4
+
+const KernelTable& sse4Kernels() {
+    return kernels_sse4::table;
+}
+
+#endif // NBIP_DISPATCH_X86
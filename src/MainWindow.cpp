@@ -1,14 +1,30 @@
 void MainWindow::setupNodeFactory() {
-    // Node types are already registered via the REGISTER_NODE macros
-    // This function is kept for potential future extensions
+    // Built-in types are registered by the factory; plugin libraries are only
+    // opened when one of their node types is first added
+    NodeFactory& factory = NodeFactory::instance();
+    factory.loadPlugins(QCoreApplication::applicationDirPath().toStdString() + "/plugins");
+    factory.loadPluginsFromEnvironment();
+    for (const auto& name : factory.getAvailableNodes()) {
+        m_nodeList->addItem(QString::fromStdString(name));
+    }
+}
+
+QComboBox* MainWindow::createBlendModeCombo() {
+    QComboBox* combo = new QComboBox(m_propertiesPanel);
+    for (const char* mode : {"Normal", "Multiply", "Screen", "Overlay", "Difference",
+                             "Add", "Subtract", "Darken", "Lighten", "Soft Light", "Hard Light"}) {
+        combo->addItem(mode);
+    }
+    return combo;
 }
 
 void MainWindow::addNode() {
     if (m_nodeList->currentItem()) {
-        Node* node = NodeFactory::instance().createNode(m_nodeList->currentItem()->text().toStdString());
+        std::unique_ptr<Node> node = NodeFactory::instance().createNode(m_nodeList->currentItem()->text().toStdString());
         if (node) {
             node->setPos(m_view->mapToScene(m_view->viewport()->rect().center()));
-            m_graph->addNode(node);
+            // The graph owns its nodes
+            m_graph->addNode(node.release());
         }
     }
 }
@@ -70,6 +86,15 @@ void MainWindow::saveImage() {
     }
 }
 
+QSlider* MainWindow::createParameterSlider(int minimum, int maximum, int value) {
+    QSlider* slider = new QSlider(Qt::Horizontal, m_propertiesPanel);
+    slider->setRange(minimum, maximum);
+    slider->setValue(value);
+    // Without tracking, valueChanged only fires when the handle is released
+    slider->setTracking(!(m_selectedNode && m_selectedNode->updatesOnRelease()));
+    return slider;
+}
+
 void MainWindow::showNodeProperties() {
     updatePropertiesPanel();
 }
@@ -108,6 +133,23 @@ void MainWindow::updatePropertiesPanel() {
     font.setBold(true);
     nameLabel->setFont(font);
     formLayout->addRow(nameLabel);
+
+    QCheckBox* previewCheck = new QCheckBox("Show preview", m_propertiesPanel);
+    previewCheck->setChecked(m_selectedNode->isPreviewEnabled());
+    connect(previewCheck, &QCheckBox::toggled, m_selectedNode, &Node::setPreviewEnabled);
+    formLayout->addRow(previewCheck);
+
+    // Slider edits are coalesced by the graph; expensive nodes can wait for release instead
+    QCheckBox* releaseCheck = new QCheckBox("Update on release", m_propertiesPanel);
+    releaseCheck->setChecked(m_selectedNode->updatesOnRelease());
+    Node* selectedNode = m_selectedNode;
+    connect(releaseCheck, &QCheckBox::toggled, this, [this, selectedNode](bool onRelease) {
+        selectedNode->setUpdateOnRelease(onRelease);
+        for (QSlider* slider : m_propertiesPanel->findChildren<QSlider*>()) {
+            slider->setTracking(!onRelease);
+        }
+    });
+    formLayout->addRow(releaseCheck);
     
     // Add properties based on node type
     if (ImageInputNode* node = dynamic_cast<ImageInputNode*>(m_selectedNode)) {
@@ -115,13 +157,18 @@ void MainWindow::updatePropertiesPanel() {
         connect(loadButton, &QPushButton::clicked, this, &MainWindow::openImage);
         formLayout->addRow(loadButton);
         
+        QCheckBox* alphaCheck = new QCheckBox("Load alpha", m_propertiesPanel);
+        alphaCheck->setChecked(node->loadsAlpha());
+        connect(alphaCheck, &QCheckBox::toggled, node, &ImageInputNode::setLoadAlpha);
+        formLayout->addRow(alphaCheck);
+        
         // Display image info if loaded
         cv::Mat image = node->getImage();
         if (!image.empty()) {
             formLayout->addRow(new QLabel("Dimensions:", m_propertiesPanel));
             formLayout->addRow(new QLabel(QString("%1 x %2").arg(image.cols).arg(image.rows), m_propertiesPanel));
             formLayout->addRow(new QLabel("Channels:", m_propertiesPanel));
-            formLayout->addRow(new QLabel(QString::number(image.channels())), m_propertiesPanel));
+            formLayout->addRow(new QLabel(QString::number(image.channels()), m_propertiesPanel));
         }
     }
     else if (ImageOutputNode* node = dynamic_cast<ImageOutputNode*>(m_selectedNode)) {
@@ -130,33 +177,45 @@ void MainWindow::updatePropertiesPanel() {
         formLayout->addRow(saveButton);
     }
     else if (BrightnessContrastNode* node = dynamic_cast<BrightnessContrastNode*>(m_selectedNode)) {
-        QSlider* brightnessSlider = new QSlider(Qt::Horizontal, m_propertiesPanel);
-        brightnessSlider->setRange(-100, 100);
-        brightnessSlider->setValue(0);
+        QSlider* brightnessSlider = createParameterSlider(-100, 100, 0);
         connect(brightnessSlider, &QSlider::valueChanged, node, &BrightnessContrastNode::setBrightness);
         formLayout->addRow("Brightness:", brightnessSlider);
         
-        QSlider* contrastSlider = new QSlider(Qt::Horizontal, m_propertiesPanel);
-        contrastSlider->setRange(0, 300); // 0.0 to 3.0 in steps of 0.01
-        contrastSlider->setValue(100); // 1.0
+        QSlider* contrastSlider = createParameterSlider(0, 300, 100); // 0.0 to 3.0 in steps of 0.01, starting at 1.0
         connect(contrastSlider, &QSlider::valueChanged, [node](int value) {
             node->setContrast(value / 100.0f);
         });
         formLayout->addRow("Contrast:", contrastSlider);
     }
     else if (BlurNode* node = dynamic_cast<BlurNode*>(m_selectedNode)) {
-        QSlider* radiusSlider = new QSlider(Qt::Horizontal, m_propertiesPanel);
-        radiusSlider->setRange(1, 20);
-        radiusSlider->setValue(5);
+        QSlider* radiusSlider = createParameterSlider(1, 20, 5);
         connect(radiusSlider, &QSlider::valueChanged, node, &BlurNode::setRadius);
         formLayout->addRow("Blur Radius:", radiusSlider);
     }
     else if (ThresholdNode* node = dynamic_cast<ThresholdNode*>(m_selectedNode)) {
-        QSlider* thresholdSlider = new QSlider(Qt::Horizontal, m_propertiesPanel);
-        thresholdSlider->setRange(0, 255);
-        thresholdSlider->setValue(127);
+        QComboBox* modeCombo = new QComboBox(m_propertiesPanel);
+        modeCombo->addItems({"Fixed", "Otsu", "Triangle", "Adaptive Mean", "Sauvola"});
+        modeCombo->setCurrentIndex(node->mode());
+        connect(modeCombo, QOverload<int>::of(&QComboBox::currentIndexChanged), node, &ThresholdNode::setMode);
+        formLayout->addRow("Mode:", modeCombo);
+        
+        QSlider* thresholdSlider = createParameterSlider(0, 255, node->threshold());
         connect(thresholdSlider, &QSlider::valueChanged, node, &ThresholdNode::setThreshold);
         formLayout->addRow("Threshold:", thresholdSlider);
+        
+        QSlider* radiusSlider = createParameterSlider(1, 200, node->radius());
+        connect(radiusSlider, &QSlider::valueChanged, node, &ThresholdNode::setRadius);
+        formLayout->addRow("Window Radius:", radiusSlider);
+        
+        QSlider* offsetSlider = createParameterSlider(-50, 50, node->offset());
+        connect(offsetSlider, &QSlider::valueChanged, node, &ThresholdNode::setOffset);
+        formLayout->addRow("Mean Offset:", offsetSlider);
+        
+        QSlider* kSlider = createParameterSlider(0, 100, qRound(node->sauvolaK() * 100)); // 0.0 to 1.0
+        connect(kSlider, &QSlider::valueChanged, [node](int value) {
+            node->setSauvolaK(value / 100.0f);
+        });
+        formLayout->addRow("Sauvola k:", kSlider);
     }
     else if (EdgeDetectionNode* node = dynamic_cast<EdgeDetectionNode*>(m_selectedNode)) {
         QComboBox* methodCombo = new QComboBox(m_propertiesPanel);
@@ -167,24 +226,167 @@ void MainWindow::updatePropertiesPanel() {
         formLayout->addRow("Method:", methodCombo);
     }
     else if (BlendNode* node = dynamic_cast<BlendNode*>(m_selectedNode)) {
-        QComboBox* modeCombo = new QComboBox(m_propertiesPanel);
-        modeCombo->addItem("Normal");
-        modeCombo->addItem("Multiply");
-        modeCombo->addItem("Screen");
-        modeCombo->addItem("Overlay");
-        modeCombo->addItem("Difference");
+        QComboBox* modeCombo = createBlendModeCombo();
         connect(modeCombo, QOverload<int>::of(&QComboBox::currentIndexChanged), 
                 node, &BlendNode::setBlendMode);
         formLayout->addRow("Blend Mode:", modeCombo);
         
-        QSlider* opacitySlider = new QSlider(Qt::Horizontal, m_propertiesPanel);
-        opacitySlider->setRange(0, 100);
-        opacitySlider->setValue(50);
+        QSlider* opacitySlider = createParameterSlider(0, 100, 50);
         connect(opacitySlider, &QSlider::valueChanged, [node](int value) {
             node->setOpacity(value / 100.0f);
         });
         formLayout->addRow("Opacity:", opacitySlider);
     }
+    else if (CompositeNode* node = dynamic_cast<CompositeNode*>(m_selectedNode)) {
+        QSpinBox* countSpin = new QSpinBox(m_propertiesPanel);
+        countSpin->setRange(1, 32);
+        countSpin->setValue(node->layerCount());
+        connect(countSpin, QOverload<int>::of(&QSpinBox::valueChanged), this, [this, node](int count) {
+            node->setLayerCount(count);
+            // The per-layer controls depend on the count
+            QTimer::singleShot(0, this, &MainWindow::updatePropertiesPanel);
+        });
+        formLayout->addRow("Layers:", countSpin);
+
+        QSlider* baseOpacitySlider = createParameterSlider(0, 100, qRound(node->layerOpacity(0) * 100));
+        connect(baseOpacitySlider, &QSlider::valueChanged, [node](int value) {
+            node->setLayerOpacity(0, value / 100.0f);
+        });
+        formLayout->addRow("Base Opacity:", baseOpacitySlider);
+
+        for (int i = 1; i < node->layerCount(); ++i) {
+            QComboBox* modeCombo = createBlendModeCombo();
+            modeCombo->setCurrentIndex(static_cast<int>(node->layerMode(i)));
+            connect(modeCombo, QOverload<int>::of(&QComboBox::currentIndexChanged), [node, i](int mode) {
+                node->setLayerMode(i, static_cast<BlendMode>(mode));
+            });
+            formLayout->addRow(QString("Layer %1 Mode:").arg(i), modeCombo);
+
+            QSlider* opacitySlider = createParameterSlider(0, 100, qRound(node->layerOpacity(i) * 100));
+            connect(opacitySlider, &QSlider::valueChanged, [node, i](int value) {
+                node->setLayerOpacity(i, value / 100.0f);
+            });
+            formLayout->addRow(QString("Layer %1 Opacity:").arg(i), opacitySlider);
+        }
+    }
+    else if (MorphologyNode* node = dynamic_cast<MorphologyNode*>(m_selectedNode)) {
+        QComboBox* operationCombo = new QComboBox(m_propertiesPanel);
+        operationCombo->addItems({"Erode", "Dilate", "Open", "Close", "Gradient"});
+        operationCombo->setCurrentIndex(node->operation());
+        connect(operationCombo, QOverload<int>::of(&QComboBox::currentIndexChanged),
+                node, &MorphologyNode::setOperation);
+        formLayout->addRow("Operation:", operationCombo);
+        
+        QComboBox* shapeCombo = new QComboBox(m_propertiesPanel);
+        shapeCombo->addItems({"Rectangle", "Horizontal Line", "Vertical Line", "Ellipse"});
+        shapeCombo->setCurrentIndex(node->shape());
+        connect(shapeCombo, QOverload<int>::of(&QComboBox::currentIndexChanged),
+                node, &MorphologyNode::setShape);
+        formLayout->addRow("Shape:", shapeCombo);
+        
+        QSlider* radiusSlider = createParameterSlider(0, 100, node->radius());
+        connect(radiusSlider, &QSlider::valueChanged, node, &MorphologyNode::setRadius);
+        formLayout->addRow("Radius:", radiusSlider);
+    }
+    else if (MedianNode* node = dynamic_cast<MedianNode*>(m_selectedNode)) {
+        QSlider* radiusSlider = createParameterSlider(0, 50, node->radius());
+        connect(radiusSlider, &QSlider::valueChanged, node, &MedianNode::setRadius);
+        formLayout->addRow("Radius:", radiusSlider);
+    }
+    else if (ColorSpaceNode* node = dynamic_cast<ColorSpaceNode*>(m_selectedNode)) {
+        QComboBox* spaceCombo = new QComboBox(m_propertiesPanel);
+        for (int space = 0; space < kColorSpaceCount; ++space) {
+            spaceCombo->addItem(colorSpaceName(static_cast<ColorSpace>(space)));
+        }
+        spaceCombo->setCurrentIndex(static_cast<int>(node->space()));
+        connect(spaceCombo, QOverload<int>::of(&QComboBox::currentIndexChanged), node, &ColorSpaceNode::setSpace);
+        formLayout->addRow("Convert To:", spaceCombo);
+    }
+    else if (StatisticsNode* node = dynamic_cast<StatisticsNode*>(m_selectedNode)) {
+        QComboBox* channelCombo = new QComboBox(m_propertiesPanel);
+        channelCombo->addItems({"Luma", "All Channels", "Blue", "Green", "Red", "Alpha"});
+        channelCombo->setCurrentIndex(node->channel());
+        connect(channelCombo, QOverload<int>::of(&QComboBox::currentIndexChanged), node, &StatisticsNode::setChannel);
+        formLayout->addRow("Channel:", channelCombo);
+        
+        QSlider* lowSlider = createParameterSlider(0, 500, qRound(node->lowPercentile() * 10)); // 0.0 to 50.0 %
+        QSlider* highSlider = createParameterSlider(500, 1000, qRound(node->highPercentile() * 10));
+        auto updatePercentiles = [node, lowSlider, highSlider]() {
+            node->setPercentiles(lowSlider->value() / 10.0f, highSlider->value() / 10.0f);
+        };
+        connect(lowSlider, &QSlider::valueChanged, updatePercentiles);
+        connect(highSlider, &QSlider::valueChanged, updatePercentiles);
+        formLayout->addRow("Low Percentile:", lowSlider);
+        formLayout->addRow("High Percentile:", highSlider);
+    }
+    else if (DisplacementNode* node = dynamic_cast<DisplacementNode*>(m_selectedNode)) {
+        QSlider* strengthSlider = createParameterSlider(0, 200, qRound(node->strength()));
+        connect(strengthSlider, &QSlider::valueChanged, [node](int value) {
+            node->setStrength(static_cast<float>(value));
+        });
+        formLayout->addRow("Strength (px):", strengthSlider);
+    }
+    
+    if (GeometricNode* node = dynamic_cast<GeometricNode*>(m_selectedNode)) {
+        if (ResizeNode* resize = dynamic_cast<ResizeNode*>(node)) {
+            QSlider* scaleSlider = createParameterSlider(1, 400, qRound(resize->scale() * 100)); // percent
+            connect(scaleSlider, &QSlider::valueChanged, [resize](int value) {
+                resize->setScale(value / 100.0f);
+            });
+            formLayout->addRow("Scale (%):", scaleSlider);
+        }
+        else if (WarpNode* warp = dynamic_cast<WarpNode*>(node)) {
+            QSlider* angleSlider = createParameterSlider(-180, 180, qRound(warp->angle()));
+            connect(angleSlider, &QSlider::valueChanged, [warp](int value) {
+                warp->setAngle(static_cast<float>(value));
+            });
+            formLayout->addRow("Angle:", angleSlider);
+            
+            QSlider* scaleSlider = createParameterSlider(10, 400, qRound(warp->scale() * 100));
+            connect(scaleSlider, &QSlider::valueChanged, [warp](int value) {
+                warp->setScale(value / 100.0f);
+            });
+            formLayout->addRow("Scale (%):", scaleSlider);
+            
+            // Tilt in units of 1e-5 per pixel keeps the slider range useful
+            QSlider* tiltSlider = createParameterSlider(-100, 100, 0);
+            connect(tiltSlider, &QSlider::valueChanged, [warp](int value) {
+                warp->setTilt(0.0f, value * 1e-5f);
+            });
+            formLayout->addRow("Tilt:", tiltSlider);
+        }
+        else if (CropNode* crop = dynamic_cast<CropNode*>(node)) {
+            QSpinBox* xSpin = new QSpinBox(m_propertiesPanel);
+            QSpinBox* ySpin = new QSpinBox(m_propertiesPanel);
+            QSpinBox* widthSpin = new QSpinBox(m_propertiesPanel);
+            QSpinBox* heightSpin = new QSpinBox(m_propertiesPanel);
+            const cv::Rect rect = crop->rect();
+            const int values[] = {rect.x, rect.y, rect.width, rect.height};
+            int index = 0;
+            for (QSpinBox* spin : {xSpin, ySpin, widthSpin, heightSpin}) {
+                spin->setRange(0, 65535);
+                spin->setValue(values[index++]);
+                connect(spin, QOverload<int>::of(&QSpinBox::valueChanged), [=](int) {
+                    crop->setRect(xSpin->value(), ySpin->value(), widthSpin->value(), heightSpin->value());
+                });
+            }
+            widthSpin->setSpecialValueText("To edge");
+            heightSpin->setSpecialValueText("To edge");
+            formLayout->addRow("X:", xSpin);
+            formLayout->addRow("Y:", ySpin);
+            formLayout->addRow("Width:", widthSpin);
+            formLayout->addRow("Height:", heightSpin);
+        }
+        
+        if (!dynamic_cast<CropNode*>(node)) {
+            QComboBox* interpolationCombo = new QComboBox(m_propertiesPanel);
+            interpolationCombo->addItems({"Nearest", "Bilinear", "Bicubic"});
+            interpolationCombo->setCurrentIndex(static_cast<int>(node->interpolation()));
+            connect(interpolationCombo, QOverload<int>::of(&QComboBox::currentIndexChanged),
+                    node, &GeometricNode::setInterpolation);
+            formLayout->addRow("Interpolation:", interpolationCombo);
+        }
+    }
     
     // Add a spacer to push everything up
     formLayout->addItem(new QSpacerItem(0, 0, QSizePolicy::Minimum, QSizePolicy::Expanding));
@@ -0,0 +1,347 @@
+#include "MemoryBudget.h"
+#include "Node.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <set>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// Smaller buffers are not worth a file of their own
+const uint64_t kMinSpillBytes = 64 << 10;
+
+// Backs Mats with unlinked files in one directory. Instances live as long as
+// the process, since spilled Mats may outlive the budget that made them.
+class ScratchAllocator : public cv::MatAllocator {
+public:
+    explicit ScratchAllocator(const std::string& directory) : m_directory(directory) {}
+
+    cv::UMatData* allocate(int dims, const int* sizes, int type, void* data, size_t* step,
+                           cv::AccessFlag flags, cv::UMatUsageFlags usageFlags) const override {
+        if (data) {
+            return cv::Mat::getStdAllocator()->allocate(dims, sizes, type, data, step, flags, usageFlags);
+        }
+        size_t total = CV_ELEM_SIZE(type);
+        for (int i = dims - 1; i >= 0; --i) {
+            if (step) {
+                step[i] = total;
+            }
+            total *= sizes[i];
+        }
+        // Returning null makes cv::Mat::create() fall back to the default allocator
+        void* mapped = mapFile(total);
+        if (!mapped) {
+            return nullptr;
+        }
+        cv::UMatData* u = new cv::UMatData(this);
+        u->data = u->origdata = static_cast<uchar*>(mapped);
+        u->size = total;
+        return u;
+    }
+
+    bool allocate(cv::UMatData* data, cv::AccessFlag, cv::UMatUsageFlags) const override {
+        return data != nullptr;
+    }
+
+    void deallocate(cv::UMatData* data) const override {
+        if (!data) {
+            return;
+        }
+        munmap(data->origdata, data->size);
+        delete data;
+    }
+
+private:
+    void* mapFile(size_t size) const {
+        if (size == 0) {
+            return nullptr;
+        }
+        int fd = -1;
+#ifdef O_TMPFILE
+        fd = ::open(m_directory.c_str(), O_TMPFILE | O_RDWR | O_CLOEXEC, 0600);
+#endif
+        if (fd < 0) {
+            std::string path = m_directory + "/nbip-spill-XXXXXX";
+            fd = mkstemp(&path[0]);
+            if (fd >= 0) {
+                ::unlink(path.c_str());
+            }
+        }
+        if (fd < 0) {
+            return nullptr;
+        }
+        // Reserve the blocks now: a full disk must fail here, not fault later
+#ifdef __linux__
+        const bool sized = posix_fallocate(fd, 0, static_cast<off_t>(size)) == 0;
+#else
+        const bool sized = ftruncate(fd, static_cast<off_t>(size)) == 0;
+#endif
+        void* mapped = sized ? mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+        ::close(fd);
+        return mapped == MAP_FAILED ? nullptr : mapped;
+    }
+
+    std::string m_directory;
+};
+
+const cv::MatAllocator* scratchAllocator(const std::string& directory) {
+    static std::mutex mutex;
+    static auto* allocators = new std::map<std::string, ScratchAllocator*>();
+    std::lock_guard<std::mutex> lock(mutex);
+    ScratchAllocator*& allocator = (*allocators)[directory];
+    if (!allocator) {
+        allocator = new ScratchAllocator(directory);
+    }
+    return allocator;
+}
+
+} // namespace
+
+MemoryBudget::MemoryBudget(uint64_t maxBytes, const std::string& scratchDirectory)
+    : m_maxBytes(maxBytes), m_scratchDirectory(scratchDirectory) {
+    std::error_code error;
+    if (m_scratchDirectory.empty()) {
+        m_scratchDirectory = fs::temp_directory_path(error).string();
+    }
+    fs::create_directories(m_scratchDirectory, error);
+}
+
+std::shared_ptr<MemoryBudget> MemoryBudget::fromEnvironment() {
+    static const std::shared_ptr<MemoryBudget> shared = []() -> std::shared_ptr<MemoryBudget> {
+        const char* megabytes = std::getenv("NBIP_MEMORY_BUDGET_MB");
+        if (!megabytes || !*megabytes) {
+            return nullptr;
+        }
+        const char* directory = std::getenv("NBIP_SCRATCH_DIR");
+        return std::make_shared<MemoryBudget>(std::strtoull(megabytes, nullptr, 10) << 20,
+                                              directory ? directory : "");
+    }();
+    return shared;
+}
+
+void MemoryBudget::touch(Node* node) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto found = m_entries.find(node);
+    if (found != m_entries.end()) {
+        found->second.lastUse = ++m_clock;
+    }
+}
+
+void MemoryBudget::update(Node* node, const void* owner) {
+    std::vector<std::pair<uint64_t, Node*>> candidates;
+    uint64_t target = 0;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto inserted = m_entries.emplace(node, Entry());
+        Entry& entry = inserted.first->second;
+        if (inserted.second) {
+            entry.order = m_nextOrder++;
+        }
+        entry.owner = owner;
+        entry.node = node->id();
+        entry.name = node->name();
+        entry.lastUse = ++m_clock;
+        entry.buffers = buffersOf(node);
+
+        uint64_t resident = 0;
+        uint64_t spilled = 0;
+        totals(resident, spilled);
+        if (resident <= m_maxBytes) {
+            return;
+        }
+
+        // Only the owner's nodes: it is the one thread that may touch their
+        // outputs now. It frees its share of the excess, so one engine does
+        // not spill everything it holds for memory other engines use.
+        uint64_t ownerResident = 0;
+        std::set<const void*> seen;
+        for (const auto& item : m_entries) {
+            if (item.second.owner != owner) {
+                continue;
+            }
+            if (item.first != node) {
+                candidates.emplace_back(item.second.lastUse, item.first);
+            }
+            for (const Buffer& buffer : item.second.buffers) {
+                if (!buffer.spilled && seen.insert(buffer.key).second) {
+                    ownerResident += buffer.bytes;
+                }
+            }
+        }
+        std::sort(candidates.begin(), candidates.end());
+        candidates.emplace_back(entry.lastUse, node);
+        const double share = static_cast<double>(ownerResident) / static_cast<double>(resident);
+        target = static_cast<uint64_t>(std::ceil(static_cast<double>(resident - m_maxBytes) * share));
+    }
+
+    // Copying and writing back happen unlocked; other engines keep reporting meanwhile
+    uint64_t freed = 0;
+    for (const auto& candidate : candidates) {
+        if (freed >= target) {
+            break;
+        }
+        const uint64_t moved = spillOutputs(candidate.second);
+        if (moved > 0) {
+            freed += moved;
+            std::lock_guard<std::mutex> lock(m_mutex);
+            auto found = m_entries.find(candidate.second);
+            if (found != m_entries.end()) {
+                found->second.buffers = buffersOf(candidate.second);
+            }
+        }
+    }
+}
+
+void MemoryBudget::forget(Node* node) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_entries.erase(node);
+}
+
+void MemoryBudget::forgetOwner(const void* owner) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (auto it = m_entries.begin(); it != m_entries.end();) {
+        if (it->second.owner == owner) {
+            it = m_entries.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+uint64_t MemoryBudget::residentBytes() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    uint64_t resident = 0;
+    uint64_t spilled = 0;
+    totals(resident, spilled);
+    return resident;
+}
+
+uint64_t MemoryBudget::spilledBytes() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    uint64_t resident = 0;
+    uint64_t spilled = 0;
+    totals(resident, spilled);
+    return spilled;
+}
+
+void MemoryBudget::totals(uint64_t& resident, uint64_t& spilled) const {
+    resident = 0;
+    spilled = 0;
+    std::set<const void*> seen;
+    for (const auto& item : m_entries) {
+        for (const Buffer& buffer : item.second.buffers) {
+            if (seen.insert(buffer.key).second) {
+                (buffer.spilled ? spilled : resident) += buffer.bytes;
+            }
+        }
+    }
+}
+
+std::vector<MemoryBudget::NodeUsage> MemoryBudget::report() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::vector<const Entry*> entries;
+    for (const auto& item : m_entries) {
+        entries.push_back(&item.second);
+    }
+    std::sort(entries.begin(), entries.end(), [](const Entry* a, const Entry* b) { return a->order < b->order; });
+
+    std::vector<NodeUsage> usage;
+    std::set<const void*> seen;
+    for (const Entry* entry : entries) {
+        NodeUsage node;
+        node.node = entry->node;
+        node.name = entry->name;
+        for (const Buffer& buffer : entry->buffers) {
+            if (seen.insert(buffer.key).second) {
+                (buffer.spilled ? node.spilledBytes : node.residentBytes) += buffer.bytes;
+            }
+        }
+        usage.push_back(node);
+    }
+    std::stable_sort(usage.begin(), usage.end(),
+                     [](const NodeUsage& a, const NodeUsage& b) { return a.residentBytes > b.residentBytes; });
+    return usage;
+}
+
+bool MemoryBudget::writeReport(const std::string& path) const {
+    std::ofstream out(path);
+    if (!out) {
+        return false;
+    }
+    out << "node,name,resident_bytes,spilled_bytes\n";
+    for (const NodeUsage& node : report()) {
+        out << node.node << ",\"" << node.name << "\"," << node.residentBytes << ',' << node.spilledBytes << '\n';
+    }
+    return static_cast<bool>(out);
+}
+
+cv::Mat MemoryBudget::spill(const cv::Mat& image) const {
+    if (image.empty() || isSpilled(image)) {
+        return image;
+    }
+    cv::Mat spilled;
+    spilled.allocator = const_cast<cv::MatAllocator*>(scratchAllocator(m_scratchDirectory));
+    spilled.create(image.dims, image.size.p, image.type());
+    // Later reallocations of this header go back to the default allocator
+    spilled.allocator = nullptr;
+    if (!isSpilled(spilled)) {
+        return cv::Mat();
+    }
+    image.copyTo(spilled);
+
+    // Write back now and unmap the pages, so the memory is released at once;
+    // the next read faults them in from the file
+    msync(spilled.u->origdata, spilled.u->size, MS_SYNC);
+    madvise(spilled.u->origdata, spilled.u->size, MADV_DONTNEED);
+    return spilled;
+}
+
+bool MemoryBudget::isSpilled(const cv::Mat& image) {
+    return image.u && dynamic_cast<const ScratchAllocator*>(image.u->currAllocator) != nullptr;
+}
+
+std::vector<MemoryBudget::Buffer> MemoryBudget::buffersOf(const Node* node) {
+    std::vector<Buffer> buffers;
+    for (const cv::Mat& image : node->retainedImages()) {
+        if (image.empty()) {
+            continue;
+        }
+        Buffer buffer;
+        buffer.key = image.u ? static_cast<const void*>(image.u) : static_cast<const void*>(image.data);
+        buffer.bytes = image.u ? image.u->size : image.total() * image.elemSize();
+        buffer.spilled = isSpilled(image);
+        if (std::none_of(buffers.begin(), buffers.end(), [&buffer](const Buffer& b) { return b.key == buffer.key; })) {
+            buffers.push_back(buffer);
+        }
+    }
+    return buffers;
+}
+
+uint64_t MemoryBudget::spillOutputs(Node* node) const {
+    uint64_t moved = 0;
+    const std::vector<cv::Mat> images = node->outputImages();
+    for (size_t slot = 0; slot < images.size(); ++slot) {
+        const cv::Mat& image = images[slot];
+        // Held by the node and by images only; another holder keeps the heap copy alive
+        if (image.empty() || !image.u || isSpilled(image) || image.u->refcount > 2 || image.u->size < kMinSpillBytes) {
+            continue;
+        }
+        const cv::Mat spilled = spill(image);
+        if (spilled.empty()) {
+            continue;
+        }
+        const ImageInfo info = node->outputInfo(static_cast<int>(slot));
+        node->setOutputImage(static_cast<int>(slot), spilled);
+        node->setOutputInfo(static_cast<int>(slot), info);
+        moved += image.u->size;
+    }
+    return moved;
+}
@@ -0,0 +1,404 @@
+#include "Morphology.h"
+#include <opencv2/imgproc.hpp>
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+// Below this window OpenCV's vectorized O(k) kernels win
+static const int kMinVanHerkWindow = 7;
+// Columns per vertical-pass strip, sized to keep a block of rows in L1
+static const int kStripBytes = 256;
+// Rows per median band; each band pays 2 * radius rows of apron to start up
+static const int kMedianBandRows = 64;
+
+template <bool Maximum>
+static inline uchar pick(uchar a, uchar b) {
+    return Maximum ? std::max(a, b) : std::min(a, b);
+}
+
+// One line of n pixels, cn interleaved channels. p is the line padded by r
+// pixels on each side and rounded up to whole k-pixel blocks; g holds running
+// extrema from each block start, h from each block end, and the window
+// [x - r, x + r] is always h at its left edge against g at its right.
+template <bool Maximum>
+static void vanHerkLine(const uchar* src, uchar* dst, int n, int cn, int r,
+                        std::vector<uchar>& p, std::vector<uchar>& g, std::vector<uchar>& h) {
+    const int k = 2 * r + 1;
+    const int blocks = (n + 2 * r + k - 1) / k;
+    const int length = blocks * k * cn;
+    const uchar border = Maximum ? 0 : 255;
+    p.assign(length, border);
+    g.resize(length);
+    h.resize(length);
+    std::memcpy(&p[r * cn], src, static_cast<size_t>(n) * cn);
+
+    const int blockBytes = k * cn;
+    for (int start = 0; start < length; start += blockBytes) {
+        const int end = start + blockBytes;
+        std::memcpy(&g[start], &p[start], cn);
+        for (int i = start + cn; i < end; ++i) {
+            g[i] = pick<Maximum>(g[i - cn], p[i]);
+        }
+        std::memcpy(&h[end - cn], &p[end - cn], cn);
+        for (int i = end - cn - 1; i >= start; --i) {
+            h[i] = pick<Maximum>(h[i + cn], p[i]);
+        }
+    }
+    const int span = 2 * r * cn;
+    for (int i = 0; i < n * cn; ++i) {
+        dst[i] = pick<Maximum>(h[i], g[i + span]);
+    }
+}
+
+template <bool Maximum>
+static void vanHerkRows(const cv::Mat& src, cv::Mat& dst, int r) {
+    const int cn = src.channels();
+    cv::parallel_for_(cv::Range(0, src.rows), [&](const cv::Range& range) {
+        std::vector<uchar> p, g, h;
+        for (int y = range.start; y < range.end; ++y) {
+            vanHerkLine<Maximum>(src.ptr<uchar>(y), dst.ptr<uchar>(y), src.cols, cn, r, p, g, h);
+        }
+    });
+}
+
+// The same recurrences down the columns, run on strips of whole rows so every
+// step is a contiguous, vectorizable pass over kStripBytes
+template <bool Maximum>
+static void vanHerkColumns(const cv::Mat& src, cv::Mat& dst, int r) {
+    const int k = 2 * r + 1;
+    const int n = src.rows;
+    const int blocks = (n + 2 * r + k - 1) / k;
+    const int length = blocks * k;
+    const int rowBytes = src.cols * src.channels();
+    const int strips = (rowBytes + kStripBytes - 1) / kStripBytes;
+    const uchar border = Maximum ? 0 : 255;
+
+    cv::parallel_for_(cv::Range(0, strips), [&](const cv::Range& range) {
+        std::vector<uchar> g(static_cast<size_t>(length) * kStripBytes);
+        std::vector<uchar> h(g.size());
+        const std::vector<uchar> borderRow(kStripBytes, border);
+        for (int strip = range.start; strip < range.end; ++strip) {
+            const int x0 = strip * kStripBytes;
+            const int w = std::min(kStripBytes, rowBytes - x0);
+            auto row = [&](int j) -> const uchar* {
+                const int y = j - r;
+                return y >= 0 && y < n ? src.ptr<uchar>(y) + x0 : borderRow.data();
+            };
+            for (int start = 0; start < length; start += k) {
+                const int end = start + k;
+                for (int j = start; j < end; ++j) {
+                    uchar* gj = &g[static_cast<size_t>(j) * kStripBytes];
+                    const uchar* in = row(j);
+                    if (j == start) {
+                        std::memcpy(gj, in, w);
+                        continue;
+                    }
+                    const uchar* prev = gj - kStripBytes;
+                    for (int x = 0; x < w; ++x) {
+                        gj[x] = pick<Maximum>(prev[x], in[x]);
+                    }
+                }
+                for (int j = end - 1; j >= start; --j) {
+                    uchar* hj = &h[static_cast<size_t>(j) * kStripBytes];
+                    const uchar* in = row(j);
+                    if (j == end - 1) {
+                        std::memcpy(hj, in, w);
+                        continue;
+                    }
+                    const uchar* next = hj + kStripBytes;
+                    for (int x = 0; x < w; ++x) {
+                        hj[x] = pick<Maximum>(next[x], in[x]);
+                    }
+                }
+            }
+            for (int y = 0; y < n; ++y) {
+                const uchar* left = &h[static_cast<size_t>(y) * kStripBytes];
+                const uchar* right = &g[static_cast<size_t>(y + 2 * r) * kStripBytes];
+                uchar* out = dst.ptr<uchar>(y) + x0;
+                for (int x = 0; x < w; ++x) {
+                    out[x] = pick<Maximum>(left[x], right[x]);
+                }
+            }
+        }
+    });
+}
+
+template <bool Maximum>
+static void vanHerk(const cv::Mat& src, cv::Mat& dst, cv::Size window) {
+    // Windows are odd and centred, like the node's radius parameters
+    const int rx = window.width / 2;
+    const int ry = window.height / 2;
+    cv::Mat source = src;
+    if (rx > 0) {
+        cv::Mat rows(src.size(), src.type());
+        vanHerkRows<Maximum>(source, rows, rx);
+        source = rows;
+    }
+    if (ry > 0) {
+        cv::Mat columns(src.size(), src.type());
+        vanHerkColumns<Maximum>(source, columns, ry);
+        source = columns;
+    }
+    dst = rx > 0 || ry > 0 ? source : src.clone();
+}
+
+void minMaxFilter(const cv::Mat& src, cv::Mat& dst, cv::Size window, bool maximum) {
+    if (src.empty()) {
+        dst = cv::Mat();
+        return;
+    }
+    if (src.depth() != CV_8U || std::max(window.width, window.height) < kMinVanHerkWindow) {
+        cv::Mat element = cv::getStructuringElement(cv::MORPH_RECT, window);
+        if (maximum) {
+            cv::dilate(src, dst, element);
+        } else {
+            cv::erode(src, dst, element);
+        }
+        return;
+    }
+    if (maximum) {
+        vanHerk<true>(src, dst, window);
+    } else {
+        vanHerk<false>(src, dst, window);
+    }
+}
+
+// Coarse histograms count the top four bits, fine ones all eight. The kernel's
+// fine histogram for a coarse bin is only brought up to date when the median
+// lands in that bin, which is what keeps the work per pixel constant.
+static void medianPlane(const cv::Mat& src, cv::Mat& dst, int r) {
+    const int width = src.cols;
+    const int height = src.rows;
+    const int columns = width + 2 * r;
+    const int area = (2 * r + 1) * (2 * r + 1);
+    const int bands = (height + kMedianBandRows - 1) / kMedianBandRows;
+
+    cv::parallel_for_(cv::Range(0, bands), [&](const cv::Range& range) {
+        std::vector<uint16_t> columnCoarse(static_cast<size_t>(columns) * 16);
+        std::vector<uint16_t> columnFine(static_cast<size_t>(columns) * 256);
+        auto sourceColumn = [&](int c) { return std::clamp(c - r, 0, width - 1); };
+        auto update = [&](int y, int delta) {
+            const uchar* in = src.ptr<uchar>(std::clamp(y, 0, height - 1));
+            for (int c = 0; c < columns; ++c) {
+                const uchar v = in[sourceColumn(c)];
+                columnCoarse[c * 16 + (v >> 4)] += delta;
+                columnFine[c * 256 + v] += delta;
+            }
+        };
+
+        for (int band = range.start; band < range.end; ++band) {
+            const int y0 = band * kMedianBandRows;
+            const int y1 = std::min(y0 + kMedianBandRows, height);
+            std::fill(columnCoarse.begin(), columnCoarse.end(), 0);
+            std::fill(columnFine.begin(), columnFine.end(), 0);
+            for (int y = y0 - r; y < y0 + r; ++y) {
+                update(y, 1);
+            }
+
+            for (int y = y0; y < y1; ++y) {
+                update(y + r, 1);
+                if (y > y0) {
+                    update(y - r - 1, -1);
+                }
+
+                uint16_t coarse[16] = {};
+                uint16_t fine[16][16];
+                int lastUpdated[16];
+                std::fill(lastUpdated, lastUpdated + 16, -(2 * r + 2));
+                for (int c = 0; c < 2 * r + 1; ++c) {
+                    for (int b = 0; b < 16; ++b) {
+                        coarse[b] += columnCoarse[c * 16 + b];
+                    }
+                }
+
+                uchar* out = dst.ptr<uchar>(y);
+                for (int x = 0; x < width; ++x) {
+                    // Padded columns x .. x + 2r are under the kernel
+                    if (x > 0) {
+                        const uint16_t* add = &columnCoarse[(x + 2 * r) * 16];
+                        const uint16_t* sub = &columnCoarse[(x - 1) * 16];
+                        for (int b = 0; b < 16; ++b) {
+                            coarse[b] += add[b] - sub[b];
+                        }
+                    }
+                    int bin = 0;
+                    int below = 0;
+                    while (below + coarse[bin] <= area / 2) {
+                        below += coarse[bin++];
+                    }
+
+                    uint16_t* f = fine[bin];
+                    // Rebuild when that is cheaper than catching up
+                    if (x - lastUpdated[bin] > r) {
+                        std::fill(f, f + 16, 0);
+                        for (int c = x; c <= x + 2 * r; ++c) {
+                            const uint16_t* column = &columnFine[c * 256 + bin * 16];
+                            for (int i = 0; i < 16; ++i) {
+                                f[i] += column[i];
+                            }
+                        }
+                    } else {
+                        for (int c = lastUpdated[bin] + 1; c <= x; ++c) {
+                            const uint16_t* add = &columnFine[(c + 2 * r) * 256 + bin * 16];
+                            const uint16_t* sub = &columnFine[(c - 1) * 256 + bin * 16];
+                            for (int i = 0; i < 16; ++i) {
+                                f[i] += add[i] - sub[i];
+                            }
+                        }
+                    }
+                    lastUpdated[bin] = x;
+
+                    int value = 0;
+                    while (below + f[value] <= area / 2) {
+                        below += f[value++];
+                    }
+                    out[x] = static_cast<uchar>(bin * 16 + value);
+                }
+            }
+        }
+    });
+}
+
+// 16-bit planes: 65536 fine bins per column would not fit in cache, so each
+// row slides one window (Huang) over a high-byte and a full-value histogram.
+// A step right swaps one column of 2r + 1 pixels.
+static void medianPlane16(const cv::Mat& src, cv::Mat& dst, int r) {
+    const int width = src.cols;
+    const int height = src.rows;
+    const int half = (2 * r + 1) * (2 * r + 1) / 2;
+
+    cv::parallel_for_(cv::Range(0, height), [&](const cv::Range& range) {
+        std::vector<int> coarse(256, 0);
+        std::vector<int> fine(65536, 0);
+        std::vector<const ushort*> rows(2 * r + 1);
+        auto update = [&](int x, int delta) {
+            const int c = std::clamp(x, 0, width - 1);
+            for (const ushort* row : rows) {
+                const ushort v = row[c];
+                coarse[v >> 8] += delta;
+                fine[v] += delta;
+            }
+        };
+
+        for (int y = range.start; y < range.end; ++y) {
+            for (int i = 0; i < 2 * r + 1; ++i) {
+                rows[i] = src.ptr<ushort>(std::clamp(y - r + i, 0, height - 1));
+            }
+            for (int x = -r; x <= r; ++x) {
+                update(x, 1);
+            }
+            ushort* out = dst.ptr<ushort>(y);
+            for (int x = 0; x < width; ++x) {
+                if (x > 0) {
+                    update(x + r, 1);
+                    update(x - r - 1, -1);
+                }
+                int bin = 0;
+                int below = 0;
+                while (below + coarse[bin] <= half) {
+                    below += coarse[bin++];
+                }
+                int value = bin << 8;
+                while (below + fine[value] <= half) {
+                    below += fine[value++];
+                }
+                out[x] = static_cast<ushort>(value);
+            }
+            // Empty the histograms by removing the last window
+            for (int x = width - 1 - r; x <= width - 1 + r; ++x) {
+                update(x, -1);
+            }
+        }
+    });
+}
+
+// Float and 32-bit planes have no histogram form; exact, but O(r^2) per pixel
+static void medianPlaneSorted(const cv::Mat& src, cv::Mat& dst, int r) {
+    const int width = src.cols;
+    const int height = src.rows;
+    const size_t half = static_cast<size_t>((2 * r + 1) * (2 * r + 1) / 2);
+
+    cv::parallel_for_(cv::Range(0, height), [&](const cv::Range& range) {
+        std::vector<double> window;
+        for (int y = range.start; y < range.end; ++y) {
+            double* out = dst.ptr<double>(y);
+            for (int x = 0; x < width; ++x) {
+                window.clear();
+                for (int dy = -r; dy <= r; ++dy) {
+                    const double* in = src.ptr<double>(std::clamp(y + dy, 0, height - 1));
+                    for (int dx = -r; dx <= r; ++dx) {
+                        window.push_back(in[std::clamp(x + dx, 0, width - 1)]);
+                    }
+                }
+                std::nth_element(window.begin(), window.begin() + half, window.end());
+                out[x] = window[half];
+            }
+        }
+    });
+}
+
+static void medianOfPlane(const cv::Mat& src, cv::Mat& dst, int radius) {
+    switch (src.depth()) {
+        case CV_8U:
+            if (radius <= 127) {
+                dst.create(src.size(), src.type());
+                medianPlane(src, dst, radius);
+            } else {
+                // Column counts are 16-bit and hold a 255 x 255 window at most
+                cv::Mat wide;
+                cv::Mat result(src.size(), CV_16U);
+                src.convertTo(wide, CV_16U);
+                medianPlane16(wide, result, radius);
+                result.convertTo(dst, CV_8U);
+            }
+            break;
+        case CV_16U:
+            dst.create(src.size(), src.type());
+            medianPlane16(src, dst, radius);
+            break;
+        case CV_16S: {
+            // Offset to unsigned, which keeps the order
+            cv::Mat shifted;
+            cv::Mat result(src.size(), CV_16U);
+            src.convertTo(shifted, CV_16U, 1.0, 32768.0);
+            medianPlane16(shifted, result, radius);
+            result.convertTo(dst, CV_16S, 1.0, -32768.0);
+            break;
+        }
+        default: {
+            cv::Mat wide;
+            cv::Mat result(src.size(), CV_64F);
+            src.convertTo(wide, CV_64F);
+            medianPlaneSorted(wide, result, radius);
+            result.convertTo(dst, src.depth());
+            break;
+        }
+    }
+}
+
+void medianFilter(const cv::Mat& src, cv::Mat& dst, int radius) {
+    if (src.empty() || radius <= 0) {
+        dst = src;
+        return;
+    }
+    const int depth = src.depth();
+    if (radius <= 2 && (depth == CV_8U || depth == CV_16U || depth == CV_32F)) {
+        // OpenCV's sorting networks are faster for 3x3 and 5x5
+        cv::medianBlur(src, dst, 2 * radius + 1);
+        return;
+    }
+    if (src.channels() == 1) {
+        cv::Mat result;
+        medianOfPlane(src, result, radius);
+        dst = result;
+        return;
+    }
+    std::vector<cv::Mat> planes;
+    cv::split(src, planes);
+    for (auto& plane : planes) {
+        cv::Mat result;
+        medianOfPlane(plane, result, radius);
+        plane = result;
+    }
+    cv::merge(planes, dst);
+}
@@ -1,84 +1,449 @@
 #include "Node.h"
+#include <QCoreApplication>
+#include <QGraphicsScene>
 #include <QGraphicsSceneMouseEvent>
+#include <QGraphicsView>
 #include <QPainter>
+#include <QPointer>
+#include <QRunnable>
 #include <QStyleOption>
+#include <QThreadPool>
+#include <QTimer>
+#include <algorithm>
+#include <atomic>
+#include <limits>
+#include <sstream>
 
-static NodeID nextNodeID = 1;
+// Nodes are created on service worker threads as well as the GUI thread
+static std::atomic<NodeID> nextNodeID{1};
 
-Node::Node(QGraphicsItem* parent) : QGraphicsItem(parent), m_id(nextNodeID++) {
+static const int kPreviewWidth = 140;
+static const int kPreviewHeight = 96;
+static const qint64 kPreviewIntervalMs = 150;
+
+// Area-averages an output down to thumbnail size on a pool thread and hands
+// the QImage back to the GUI thread
+class PreviewTask : public QRunnable {
+public:
+    PreviewTask(Node* node, const cv::Mat& source, const ImageInfo& info)
+        : m_node(node), m_source(source), m_info(info) {}
+
+    void run() override {
+        QImage image = makeThumbnail(m_source, m_info);
+        QPointer<Node> node = m_node;
+        QMetaObject::invokeMethod(QCoreApplication::instance(), [node, image]() {
+            if (node) {
+                node->applyPreview(image);
+            }
+        }, Qt::QueuedConnection);
+    }
+
+private:
+    static QImage makeThumbnail(const cv::Mat& source, const ImageInfo& info) {
+        double scale = std::min({1.0, static_cast<double>(kPreviewWidth) / source.cols,
+                                 static_cast<double>(kPreviewHeight) / source.rows});
+        cv::Size size(std::max(1, cvRound(source.cols * scale)), std::max(1, cvRound(source.rows * scale)));
+        cv::Mat small;
+        cv::resize(source, small, size, 0, 0, cv::INTER_AREA);
+        // Shown as sRGB; converting after the downsample keeps it cheap
+        convertColorSpace(small, small, info.space, ColorSpace::SRGB);
+
+        if (small.depth() != CV_8U) {
+            cv::normalize(small, small, 0, 255, cv::NORM_MINMAX, CV_8U);
+        }
+
+        cv::Mat rgb;
+        switch (small.channels()) {
+            case 1:
+                return QImage(small.data, small.cols, small.rows, small.step, QImage::Format_Grayscale8).copy();
+            case 3:
+                cv::cvtColor(small, rgb, cv::COLOR_BGR2RGB);
+                return QImage(rgb.data, rgb.cols, rgb.rows, rgb.step, QImage::Format_RGB888).copy();
+            case 4:
+                // BGRA byte order is ARGB32 on little-endian hosts
+                return QImage(small.data, small.cols, small.rows, small.step,
+                              info.premultiplied ? QImage::Format_ARGB32_Premultiplied : QImage::Format_ARGB32).copy();
+            default:
+                cv::extractChannel(small, rgb, 0);
+                return QImage(rgb.data, rgb.cols, rgb.rows, rgb.step, QImage::Format_Grayscale8).copy();
+        }
+    }
+
+    QPointer<Node> m_node;
+    cv::Mat m_source;
+    ImageInfo m_info;
+};
+
+Node::Node(QGraphicsItem* parent) : QGraphicsItem(parent), m_id(nextNodeID.fetch_add(1, std::memory_order_relaxed)) {
     setFlag(QGraphicsItem::ItemIsMovable);
     setFlag(QGraphicsItem::ItemIsSelectable);
     setFlag(QGraphicsItem::ItemSendsGeometryChanges);
+    // Node bodies only change on selection or new data, so repaint from a cached pixmap
+    setCacheMode(QGraphicsItem::DeviceCoordinateCache);
 }
 
 Node::~Node() {}
 
+const Node::Layout& Node::layout() const {
+    if (!m_layout) {
+        auto layout = std::make_unique<Layout>();
+        layout->ports = getPorts();
+        for (const auto& parameter : m_parameters) {
+            layout->ports.push_back({static_cast<int>(layout->ports.size()), parameter.name, PortType::Input, parameter.type});
+        }
+        const auto& ports = layout->ports;
+        const int previewSpace = m_previewEnabled ? kPreviewHeight + 4 : 0;
+        layout->bounds = QRectF(0, 0, 150, 100 + ports.size() * 20 + previewSpace);
+        layout->title = QString::fromStdString(name());
+        int outputSlot = 0;
+        for (size_t i = 0; i < ports.size(); ++i) {
+            const auto& port = ports[i];
+            layout->portLabels.push_back(QString::fromStdString(port.name));
+            if (port.type == PortType::Input) {
+                layout->portHitRects.emplace_back(5, 25 + i * 20, 10, 10);
+                layout->outputSlots.push_back(-1);
+            } else {
+                layout->portHitRects.emplace_back(layout->bounds.width() - 15, 25 + i * 20, 10, 10);
+                layout->outputSlots.push_back(outputSlot++);
+            }
+        }
+        m_layout = std::move(layout);
+    }
+    return *m_layout;
+}
+
+void Node::invalidateLayout() {
+    prepareGeometryChange();
+    m_layout.reset();
+}
+
+const std::vector<Port>& Node::ports() const {
+    return layout().ports;
+}
+
+void Node::addParameter(const std::string& name, DataType type, std::function<double()> get,
+                        std::function<void(double)> set) {
+    m_parameters.push_back({name, type, std::move(get), std::move(set)});
+    m_appliedInputs.push_back(std::numeric_limits<double>::quiet_NaN());
+    m_layout.reset();
+}
+
+void Node::clearParameters() {
+    m_parameters.clear();
+    m_appliedInputs.clear();
+    m_layout.reset();
+}
+
+int Node::parameterPort(const std::string& name) const {
+    for (size_t i = 0; i < m_parameters.size(); ++i) {
+        if (m_parameters[i].name == name) {
+            return static_cast<int>(getPorts().size() + i);
+        }
+    }
+    return -1;
+}
+
+double Node::parameter(const std::string& name) const {
+    const int port = parameterPort(name);
+    return port < 0 ? 0.0 : m_parameters[port - getPorts().size()].get();
+}
+
+bool Node::setParameter(const std::string& name, double value) {
+    const int port = parameterPort(name);
+    if (port < 0) {
+        return false;
+    }
+    const size_t index = port - getPorts().size();
+    m_appliedInputs[index] = std::numeric_limits<double>::quiet_NaN();
+    m_parameters[index].set(value);
+    return true;
+}
+
+void Node::applyParameterInputs() {
+    const int first = static_cast<int>(getPorts().size());
+    m_applyingParameters = true;
+    for (size_t i = 0; i < m_parameters.size(); ++i) {
+        const int port = first + static_cast<int>(i);
+        if (!getInputData(port)) {
+            continue;
+        }
+        const double value = inputScalar(port, m_parameters[i].get());
+        m_parameters[i].set(value);
+        m_appliedInputs[i] = value;
+    }
+    m_applyingParameters = false;
+}
+
+bool Node::isParameterInputApplied(int portIndex) const {
+    const int index = portIndex - static_cast<int>(getPorts().size());
+    if (index < 0 || index >= static_cast<int>(m_parameters.size())) {
+        return false;
+    }
+    // NaN never compares equal, so a parameter set by hand since is re-applied
+    return inputScalar(portIndex, std::numeric_limits<double>::quiet_NaN()) == m_appliedInputs[index];
+}
+
 QRectF Node::boundingRect() const {
-    return QRectF(0, 0, 150, 100 + getPorts().size() * 20);
+    return layout().bounds;
+}
+
+int Node::portAt(const QPointF& pos) const {
+    const auto& rects = layout().portHitRects;
+    for (size_t i = 0; i < rects.size(); ++i) {
+        if (rects[i].contains(pos)) {
+            return static_cast<int>(i);
+        }
+    }
+    return -1;
 }
 
 void Node::paint(QPainter* painter, const QStyleOptionGraphicsItem* option, QWidget* widget) {
+    Q_UNUSED(option);
     Q_UNUSED(widget);
 
+    const Layout& geometry = layout();
+    const QRectF& bounds = geometry.bounds;
+
     // Draw node background
     QColor fillColor = isSelected() ? QColor(100, 100, 150) : QColor(80, 80, 120);
     painter->setBrush(fillColor);
     painter->setPen(QPen(Qt::black, 1));
-    painter->drawRoundedRect(boundingRect(), 5, 5);
+    painter->drawRoundedRect(bounds, 5, 5);
 
     // Draw node title
     painter->setPen(Qt::white);
     QFont font = painter->font();
     font.setBold(true);
     painter->setFont(font);
-    painter->drawText(QRectF(0, 0, boundingRect().width(), 20), Qt::AlignCenter, QString::fromStdString(name()));
+    painter->drawText(QRectF(0, 0, bounds.width(), 20), Qt::AlignCenter, geometry.title);
 
     // Draw ports
-    auto ports = getPorts();
+    const auto& ports = geometry.ports;
     for (size_t i = 0; i < ports.size(); ++i) {
-        const auto& port = ports[i];
         QRectF portRect(5, 25 + i * 20, 140, 20);
 
-        if (port.type == PortType::Input) {
-            painter->setBrush(Qt::darkGreen);
+        if (ports[i].type == PortType::Input) {
+            painter->setBrush(isNumeric(ports[i].dataType) ? Qt::darkCyan : Qt::darkGreen);
             painter->drawEllipse(portRect.left(), portRect.top() + 5, 10, 10);
             painter->drawText(portRect.adjusted(15, 0, 0, 0), Qt::AlignLeft | Qt::AlignVCenter, 
-                            QString::fromStdString(port.name));
+                            geometry.portLabels[i]);
         } else {
-            painter->setBrush(Qt::darkRed);
+            painter->setBrush(isNumeric(ports[i].dataType) ? Qt::darkMagenta : Qt::darkRed);
             painter->drawEllipse(portRect.right() - 10, portRect.top() + 5, 10, 10);
             painter->drawText(portRect.adjusted(0, 0, -15, 0), Qt::AlignRight | Qt::AlignVCenter, 
-                            QString::fromStdString(port.name));
+                            geometry.portLabels[i]);
+        }
+    }
+
+    // Draw the cached thumbnail; paint() only runs for exposed items, so an
+    // update skipped while off-screen is picked up here
+    if (m_previewEnabled) {
+        QRectF previewRect(5, 30 + ports.size() * 20, kPreviewWidth, kPreviewHeight);
+        painter->setPen(Qt::NoPen);
+        painter->setBrush(QColor(40, 40, 60));
+        painter->drawRect(previewRect);
+        if (!m_preview.isNull()) {
+            QPointF topLeft(previewRect.center().x() - m_preview.width() / 2.0,
+                            previewRect.center().y() - m_preview.height() / 2.0);
+            painter->drawImage(topLeft, m_preview);
+        }
+        if (m_previewStale && !m_previewInFlight && !m_previewScheduled) {
+            m_previewScheduled = true;
+            QTimer::singleShot(0, this, [this]() {
+                m_previewScheduled = false;
+                updatePreview(true);
+            });
         }
     }
+
+    // Draw the timing badge from the last profiled pass
+    if (m_lastRunMs >= 0.0) {
+        QRectF badgeRect(5, bounds.height() - 22, bounds.width() - 10, 17);
+        painter->setPen(Qt::NoPen);
+        painter->setBrush(QColor::fromHsvF((1.0 - m_heat) * 0.33, 0.8, 0.85));
+        painter->drawRoundedRect(badgeRect, 4, 4);
+        painter->setPen(Qt::black);
+        painter->drawText(badgeRect, Qt::AlignCenter, QString("%1 ms").arg(m_lastRunMs, 0, 'f', 2));
+    }
+}
+
+void Node::setTimingBadge(double milliseconds, double heat) {
+    m_lastRunMs = milliseconds;
+    m_heat = std::min(std::max(heat, 0.0), 1.0);
+    update();
+}
+
+void Node::clearTimingBadge() {
+    m_lastRunMs = -1.0;
+    update();
+}
+
+std::string Node::makeParameterKey(std::initializer_list<double> values) {
+    std::ostringstream key;
+    key.precision(17);
+    for (double value : values) {
+        key << value << ';';
+    }
+    return key.str();
+}
+
+void Node::copyOutputsFrom(const Node* other) {
+    const size_t count = std::min(m_outputData.size(), other->m_outputData.size());
+    for (size_t i = 0; i < count; ++i) {
+        // Copy the Mat header, not the pointer, so later writes stay independent
+        *std::static_pointer_cast<cv::Mat>(m_outputData[i]) = *std::static_pointer_cast<cv::Mat>(other->m_outputData[i]);
+    }
+    m_outputInfo = other->m_outputInfo;
 }
 
-void Node::mousePressEvent(QGraphicsSceneMouseEvent* event) {
-    m_oldPos = pos();
-    QGraphicsItem::mousePressEvent(event);
+void Node::setOutputImage(int slot, const cv::Mat& image) {
+    if (slot >= 0 && slot < static_cast<int>(m_outputData.size())) {
+        *std::static_pointer_cast<cv::Mat>(m_outputData[slot]) = image;
+    }
+}
+
+std::vector<cv::Mat> Node::outputImages() const {
+    std::vector<cv::Mat> images;
+    images.reserve(m_outputData.size());
+    for (const auto& data : m_outputData) {
+        images.push_back(*std::static_pointer_cast<cv::Mat>(data));
+    }
+    return images;
+}
+
+void Node::setOutputImages(const std::vector<cv::Mat>& images) {
+    for (size_t i = 0; i < images.size(); ++i) {
+        setOutputImage(static_cast<int>(i), images[i]);
+    }
+}
+
+void Node::invalidate() {
+    if (m_applyingParameters) {
+        return;
+    }
+    markDirty();
+    if (m_onInvalidated) {
+        m_onInvalidated();
+    }
+}
+
+void Node::setPreviewEnabled(bool enabled) {
+    if (m_previewEnabled == enabled) {
+        return;
+    }
+    m_previewEnabled = enabled;
+    if (!enabled) {
+        m_preview = QImage();
+        m_previewStale = false;
+    }
+    invalidateLayout();
+    if (enabled) {
+        requestPreview();
+    }
 }
 
-void Node::mouseMoveEvent(QGraphicsSceneMouseEvent* event) {
-    QGraphicsItem::mouseMoveEvent(event);
+void Node::requestPreview() {
+    if (!m_previewEnabled) {
+        return;
+    }
+    m_previewStale = true;
+    updatePreview(isOnScreen());
 }
 
-void Node::mouseReleaseEvent(QGraphicsSceneMouseEvent* event) {
-    if (pos() != m_oldPos) {
-        // Position changed - notify connections
-        emit dataUpdated();
+ImageInfo Node::previewInfo() const {
+    const auto& ports = this->ports();
+    for (size_t i = 0; i < ports.size(); ++i) {
+        if (ports[i].type == PortType::Output && ports[i].dataType == DataType::Image) {
+            return outputInfo(outputSlot(static_cast<int>(i)));
+        }
+    }
+    // Sinks preview what they receive
+    ImageInfo info;
+    info.space = inputSpace();
+    return info;
+}
+
+cv::Mat Node::previewSource() const {
+    const auto& ports = this->ports();
+    for (size_t i = 0; i < ports.size(); ++i) {
+        if (ports[i].type == PortType::Output && ports[i].dataType == DataType::Image) {
+            auto data = getOutputData(i);
+            return data ? *std::static_pointer_cast<cv::Mat>(data) : cv::Mat();
+        }
+    }
+    return cv::Mat();
+}
+
+bool Node::isOnScreen() const {
+    if (!scene()) {
+        return false;
+    }
+    const QRectF bounds = sceneBoundingRect();
+    for (QGraphicsView* view : scene()->views()) {
+        if (view->isVisible() && view->mapToScene(view->viewport()->rect()).boundingRect().intersects(bounds)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void Node::updatePreview(bool visible) {
+    if (!m_previewEnabled || !m_previewStale || m_previewInFlight || m_previewScheduled) {
+        return;
+    }
+    if (!visible) {
+        // Drop the cached pixmap so the next exposure repaints and refreshes
+        update();
+        return;
+    }
+
+    // Rate-limit to one thumbnail per interval, trailing updates win
+    if (m_previewClock.isValid() && m_previewClock.elapsed() < kPreviewIntervalMs) {
+        m_previewScheduled = true;
+        QTimer::singleShot(kPreviewIntervalMs - m_previewClock.elapsed(), this, [this]() {
+            m_previewScheduled = false;
+            updatePreview(isOnScreen());
+        });
+        return;
+    }
+
+    cv::Mat source = previewSource();
+    m_previewStale = false;
+    if (source.empty()) {
+        return;
+    }
+    m_previewInFlight = true;
+    m_previewClock.start();
+    QThreadPool::globalInstance()->start(new PreviewTask(this, source, previewInfo()));
+}
+
+void Node::applyPreview(const QImage& image) {
+    m_previewInFlight = false;
+    if (!m_previewEnabled) {
+        return;
+    }
+    m_preview = image;
+    update();
+    if (m_previewStale) {
+        updatePreview(isOnScreen());
     }
-    QGraphicsItem::mouseReleaseEvent(event);
 }
 
 void Node::addInputConnection(Node* sourceNode, int sourcePort, int destPort) {
-    if (destPort < static_cast<int>(m_inputConnections.size())) {
-        m_inputConnections[destPort] = {sourceNode, sourcePort};
+    if (destPort < 0) {
+        return;
+    }
+    if (destPort >= static_cast<int>(m_inputConnections.size())) {
+        m_inputConnections.resize(destPort + 1, {nullptr, -1});
     }
+    m_inputConnections[destPort] = {sourceNode, sourcePort};
+    markDirty();
 }
 
 void Node::removeInputConnection(int port) {
     if (port < static_cast<int>(m_inputConnections.size())) {
         m_inputConnections[port] = {nullptr, -1};
+        markDirty();
     }
 }
 
@@ -92,7 +457,152 @@ void Node::setOutputData(int portIndex, std::shared_ptr<void> data) {
     }
 }
 
+int Node::outputSlot(int portIndex) const {
+    // Port indices cover inputs and outputs; m_outputData only holds outputs
+    const auto& slots = layout().outputSlots;
+    if (portIndex < 0 || portIndex >= static_cast<int>(slots.size())) {
+        return -1;
+    }
+    return slots[portIndex];
+}
+
+ImageInfo Node::outputInfo(int slot) const {
+    if (slot < 0 || slot >= static_cast<int>(m_outputData.size())) {
+        return ImageInfo();
+    }
+    const cv::Mat& image = *std::static_pointer_cast<cv::Mat>(m_outputData[slot]);
+    const bool recorded = slot < static_cast<int>(m_outputInfo.size()) && m_outputInfo[slot].data == image.data && image.data;
+    if (!recorded) {
+        ImageInfo info = ImageInfo::describe(image);
+        info.space = ColorSpace::SRGB;
+        return info;
+    }
+    return m_outputInfo[slot].info;
+}
+
+ColorSpace Node::inputSpace() const {
+    // Recorded spaces are never Inherit, so one step upstream is enough
+    const auto& ports = getPorts();
+    for (size_t i = 0; i < ports.size() && i < m_inputConnections.size(); ++i) {
+        const auto& connection = m_inputConnections[i];
+        if (ports[i].type == PortType::Input && ports[i].dataType == DataType::Image && connection.first) {
+            return connection.first->outputInfo(connection.first->outputSlot(connection.second)).space;
+        }
+    }
+    return ColorSpace::SRGB;
+}
+
+void Node::setOutputInfo(int slot, const ImageInfo& info) {
+    if (slot < 0 || slot >= static_cast<int>(m_outputData.size())) {
+        return;
+    }
+    if (slot >= static_cast<int>(m_outputInfo.size())) {
+        m_outputInfo.resize(slot + 1);
+    }
+    ImageInfo resolved = info;
+    if (resolved.space == ColorSpace::Inherit) {
+        resolved.space = inputSpace();
+    }
+    m_outputInfo[slot] = {std::static_pointer_cast<cv::Mat>(m_outputData[slot])->data, resolved};
+}
+
+void Node::recordOutputInfo() {
+    for (size_t slot = 0; slot < m_outputData.size(); ++slot) {
+        const cv::Mat& image = *std::static_pointer_cast<cv::Mat>(m_outputData[slot]);
+        if (slot >= m_outputInfo.size() || m_outputInfo[slot].data != image.data || !image.data) {
+            setOutputInfo(static_cast<int>(slot), ImageInfo::describe(image));
+        }
+    }
+}
+
+ImageInfo Node::inputInfo(int portIndex) const {
+    const bool connected = portIndex >= 0 && portIndex < static_cast<int>(m_inputConnections.size()) &&
+                           m_inputConnections[portIndex].first;
+    if (!m_batchInputs.empty() || !connected) {
+        auto data = getInputData(portIndex);
+        ImageInfo info = data ? ImageInfo::describe(*std::static_pointer_cast<cv::Mat>(data)) : ImageInfo();
+        // The space follows from the graph rather than the pixels, so batch
+        // frames are in the producer's
+        info.space = ColorSpace::SRGB;
+        if (connected) {
+            const auto& connection = m_inputConnections[portIndex];
+            info.space = connection.first->outputInfo(connection.first->outputSlot(connection.second)).space;
+        }
+        return info;
+    }
+    const auto& connection = m_inputConnections[portIndex];
+    return connection.first->outputInfo(connection.first->outputSlot(connection.second));
+}
+
+cv::Mat Node::readInput(int portIndex, bool premultiplied) const {
+    auto data = getInputData(portIndex);
+    if (!data) {
+        return cv::Mat();
+    }
+    return imageAs(*std::static_pointer_cast<cv::Mat>(data), inputInfo(portIndex), premultiplied);
+}
+
+double Node::inputScalar(int portIndex, double fallback) const {
+    auto data = getInputData(portIndex);
+    if (!data) {
+        return fallback;
+    }
+    const cv::Mat& value = *std::static_pointer_cast<cv::Mat>(data);
+    return value.empty() ? fallback : cv::mean(value)[0];
+}
+
+void Node::setOutputScalar(int slot, double value) {
+    setOutputImage(slot, cv::Mat(1, 1, CV_64F, cv::Scalar(value)));
+}
+
+bool Node::patchOutput(int slot, const cv::Rect& rect, const cv::Mat& pixels) {
+    if (slot < 0 || slot >= static_cast<int>(m_outputData.size())) {
+        return false;
+    }
+    cv::Mat& output = *std::static_pointer_cast<cv::Mat>(m_outputData[slot]);
+    if (output.empty() || rect.empty() || pixels.type() != output.type() || pixels.size() != rect.size() ||
+        (rect & cv::Rect(0, 0, output.cols, output.rows)) != rect) {
+        return false;
+    }
+    ImageInfo info = outputInfo(slot);
+    info.opaque = info.opaque && !hasTransparency(pixels);
+    // Other holders (an alias, a caller's copy) keep the unpatched image
+    if (output.u && output.u->refcount > 1) {
+        output = output.clone();
+    }
+    pixels.copyTo(output(rect));
+    setOutputInfo(slot, info);
+
+    if (m_patches.size() < m_outputData.size()) {
+        m_patches.resize(m_outputData.size());
+    }
+    m_patches[slot] = m_patches[slot].empty() ? rect : (m_patches[slot] | rect);
+    m_patched = true;
+    m_resultKey = 0;
+    if (m_onInvalidated) {
+        m_onInvalidated();
+    }
+    return true;
+}
+
+std::vector<cv::Rect> Node::takePatches() {
+    std::vector<cv::Rect> patches;
+    patches.swap(m_patches);
+    return patches;
+}
+
+std::shared_ptr<void> Node::getOutputData(int portIndex) const {
+    int slot = outputSlot(portIndex);
+    if (slot >= 0 && slot < static_cast<int>(m_outputData.size())) {
+        return m_outputData[slot];
+    }
+    return nullptr;
+}
+
 std::shared_ptr<void> Node::getInputData(int portIndex) const {
+    if (!m_batchInputs.empty()) {
+        return portIndex >= 0 && portIndex < static_cast<int>(m_batchInputs.size()) ? m_batchInputs[portIndex] : nullptr;
+    }
     if (portIndex >= 0 && portIndex < static_cast<int>(m_inputConnections.size())) {
         const auto& connection = m_inputConnections[portIndex];
         if (connection.first) {
@@ -100,4 +610,47 @@ std::shared_ptr<void> Node::getInputData(int portIndex) const {
         }
     }
     return nullptr;
-}
\ No newline at end of file
+}
+
+void Node::processBatch(const std::vector<ImageBatch>& inputs, std::vector<ImageBatch>& outputs) {
+    size_t frames = 0;
+    for (const auto& batch : inputs) {
+        frames = std::max(frames, batch.size());
+    }
+    outputs.assign(m_outputData.size(), ImageBatch(frames));
+
+    // Run process() against each frame in turn, keeping the interactive outputs
+    // and parameters intact; parameter inputs may differ from frame to frame
+    const std::vector<cv::Mat> saved = outputImages();
+    const std::vector<OutputInfo> savedInfo = m_outputInfo;
+    std::vector<double> savedParameters;
+    for (const auto& parameter : m_parameters) {
+        savedParameters.push_back(parameter.get());
+    }
+    const std::vector<double> savedApplied = m_appliedInputs;
+    m_batchInputs.assign(inputs.size(), nullptr);
+    for (size_t frame = 0; frame < frames; ++frame) {
+        for (size_t port = 0; port < inputs.size(); ++port) {
+            m_batchInputs[port] = frame < inputs[port].size() ? std::make_shared<cv::Mat>(inputs[port][frame]) : nullptr;
+        }
+        for (auto& data : m_outputData) {
+            *std::static_pointer_cast<cv::Mat>(data) = cv::Mat();
+        }
+        applyParameterInputs();
+        process();
+        // Batches exchange straight alpha, whatever form process() left
+        for (size_t slot = 0; slot < m_outputData.size(); ++slot) {
+            outputs[slot][frame] = imageAs(*std::static_pointer_cast<cv::Mat>(m_outputData[slot]),
+                                           outputInfo(static_cast<int>(slot)), false);
+        }
+    }
+    m_batchInputs.clear();
+    setOutputImages(saved);
+    m_outputInfo = savedInfo;
+    m_applyingParameters = true;
+    for (size_t i = 0; i < m_parameters.size(); ++i) {
+        m_parameters[i].set(savedParameters[i]);
+    }
+    m_applyingParameters = false;
+    m_appliedInputs = savedApplied;
+}
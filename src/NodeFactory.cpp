@@ -0,0 +1,177 @@
+#include "NodeFactory.h"
+#include "ImageNode.h"
+#include "ProcessingNodes.h"
+#include <QtGlobal>
+#include <algorithm>
+#include <cstdlib>
+#include <dlfcn.h>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+namespace fs = std::filesystem;
+
+using PluginEntry = bool (*)(NodeFactory*, int);
+
+// The plugin whose library this thread is loading, so its lazy entries can be filled in
+static thread_local const void* loadingPlugin = nullptr;
+
+template<typename T>
+static NodeFactory::CreatorFunc creatorFor() {
+    return []() { return std::unique_ptr<Node>(new T()); };
+}
+
+NodeFactory& NodeFactory::instance() {
+    static NodeFactory instance;
+    return instance;
+}
+
+NodeFactory::NodeFactory() {
+    auto builtins = std::make_unique<Registry>();
+    builtins->entries["Image Input"] = {creatorFor<ImageInputNode>(), nullptr};
+    builtins->entries["Image Output"] = {creatorFor<ImageOutputNode>(), nullptr};
+    builtins->entries["Brightness/Contrast"] = {creatorFor<BrightnessContrastNode>(), nullptr};
+    builtins->entries["Blur"] = {creatorFor<BlurNode>(), nullptr};
+    builtins->entries["Threshold"] = {creatorFor<ThresholdNode>(), nullptr};
+    builtins->entries["Edge Detection"] = {creatorFor<EdgeDetectionNode>(), nullptr};
+    builtins->entries["Blend"] = {creatorFor<BlendNode>(), nullptr};
+    builtins->entries["Composite"] = {creatorFor<CompositeNode>(), nullptr};
+    builtins->entries["Channel Splitter"] = {creatorFor<ColorChannelSplitterNode>(), nullptr};
+    builtins->entries["Color Space"] = {creatorFor<ColorSpaceNode>(), nullptr};
+    builtins->entries["Noise Generator"] = {creatorFor<NoiseGenerationNode>(), nullptr};
+    builtins->entries["Convolution Filter"] = {creatorFor<ConvolutionFilterNode>(), nullptr};
+    builtins->entries["Morphology"] = {creatorFor<MorphologyNode>(), nullptr};
+    builtins->entries["Median"] = {creatorFor<MedianNode>(), nullptr};
+    builtins->entries["Resize"] = {creatorFor<ResizeNode>(), nullptr};
+    builtins->entries["Warp"] = {creatorFor<WarpNode>(), nullptr};
+    builtins->entries["Crop"] = {creatorFor<CropNode>(), nullptr};
+    builtins->entries["Displace"] = {creatorFor<DisplacementNode>(), nullptr};
+    builtins->entries["Statistics"] = {creatorFor<StatisticsNode>(), nullptr};
+    std::lock_guard<std::mutex> lock(m_writeMutex);
+    publish(std::move(builtins));
+}
+
+void NodeFactory::publish(std::unique_ptr<Registry> next) {
+    next->names.clear();
+    for (const auto& pair : next->entries) {
+        next->names.push_back(pair.first);
+    }
+    m_registry.store(next.get(), std::memory_order_release);
+    m_snapshots.push_back(std::move(next));
+}
+
+bool NodeFactory::registerNodeType(const std::string& name, CreatorFunc creator) {
+    std::lock_guard<std::mutex> lock(m_writeMutex);
+    auto existing = registry().entries.find(name);
+    if (existing != registry().entries.end() &&
+        (existing->second.creator || existing->second.plugin.get() != loadingPlugin)) {
+        qWarning("Node type %s is already registered", name.c_str());
+        return false;
+    }
+    auto next = std::make_unique<Registry>(registry());
+    next->entries[name] = {std::move(creator), nullptr};
+    publish(std::move(next));
+    return true;
+}
+
+std::unique_ptr<Node> NodeFactory::createNode(const std::string& name) {
+    const Registry* current = &registry();
+    auto it = current->entries.find(name);
+    if (it == current->entries.end()) {
+        return nullptr;
+    }
+    if (!it->second.creator && it->second.plugin) {
+        // The library replaces its lazy entries with real creators while loading
+        Plugin& plugin = *it->second.plugin;
+        std::call_once(plugin.loadOnce, [this, &plugin]() { plugin.loaded = loadLibrary(plugin); });
+        current = &registry();
+        it = current->entries.find(name);
+    }
+    if (it == current->entries.end() || !it->second.creator) {
+        return nullptr;
+    }
+    return it->second.creator();
+}
+
+const std::vector<std::string>& NodeFactory::getAvailableNodes() const {
+    return registry().names;
+}
+
+bool NodeFactory::loadLibrary(Plugin& plugin) {
+    // Static REGISTER_NODE registrars run inside dlopen, so the plugin counts
+    // as loading from before it until the entry point returns
+    loadingPlugin = &plugin;
+    void* handle = dlopen(plugin.libraryPath.c_str(), RTLD_NOW | RTLD_LOCAL);
+    if (!handle) {
+        loadingPlugin = nullptr;
+        qWarning("Cannot load node plugin %s: %s", plugin.libraryPath.c_str(), dlerror());
+        return false;
+    }
+    auto entry = reinterpret_cast<PluginEntry>(dlsym(handle, NBIP_PLUGIN_ENTRY));
+    const bool registered = entry && entry(this, NBIP_PLUGIN_ABI_VERSION);
+    loadingPlugin = nullptr;
+    if (!registered) {
+        qWarning("Node plugin %s has no compatible %s entry point", plugin.libraryPath.c_str(), NBIP_PLUGIN_ENTRY);
+        dlclose(handle);
+        return false;
+    }
+    // Node types from the library stay in use, so the handle is never closed
+    return true;
+}
+
+int NodeFactory::loadPlugins(const std::string& directory) {
+    std::error_code error;
+    if (!fs::is_directory(directory, error)) {
+        return 0;
+    }
+
+    std::lock_guard<std::mutex> lock(m_writeMutex);
+    auto next = std::make_unique<Registry>(registry());
+    int announced = 0;
+    for (const auto& item : fs::directory_iterator(directory, error)) {
+        if (item.path().extension() != ".nodes") {
+            continue;
+        }
+        fs::path library = item.path();
+        library.replace_extension(".so");
+        if (!fs::exists(library, error)) {
+            qWarning("Node manifest %s has no matching library", item.path().c_str());
+            continue;
+        }
+
+        auto plugin = std::make_shared<Plugin>();
+        plugin->libraryPath = library.string();
+        std::ifstream manifest(item.path());
+        std::string line;
+        while (std::getline(manifest, line)) {
+            line.erase(0, line.find_first_not_of(" \t"));
+            line.erase(line.find_last_not_of(" \t\r") + 1);
+            // Built-in and already registered types take precedence
+            if (line.empty() || line[0] == '#' || next->entries.count(line)) {
+                continue;
+            }
+            next->entries[line] = {CreatorFunc(), plugin};
+            ++announced;
+        }
+    }
+    if (announced > 0) {
+        publish(std::move(next));
+    }
+    return announced;
+}
+
+int NodeFactory::loadPluginsFromEnvironment() {
+    const char* paths = std::getenv("NBIP_PLUGIN_PATH");
+    if (!paths) {
+        return 0;
+    }
+    int announced = 0;
+    std::istringstream list(paths);
+    std::string directory;
+    while (std::getline(list, directory, ':')) {
+        if (!directory.empty()) {
+            announced += loadPlugins(directory);
+        }
+    }
+    return announced;
+}
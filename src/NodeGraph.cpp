@@ -1,29 +1,44 @@
 #include "NodeGraph.h"
+#include "GroupNode.h"
 #include "Node.h"
 #include <QGraphicsLineItem>
 #include <QPen>
+#include <QThread>
+#include <QTimer>
+#include <algorithm>
 
-NodeGraph::NodeGraph(QObject* parent) : QGraphicsScene(parent) {}
+static const int kFrameIntervalMs = 16;
+
+NodeGraph::NodeGraph(QObject* parent) : QGraphicsScene(parent) {
+    m_engine.setInvalidationCallback([this]() {
+        // Edits may come from worker threads; passes always start on the GUI thread
+        if (QThread::currentThread() == thread()) {
+            scheduleProcessing();
+        } else {
+            QMetaObject::invokeMethod(this, [this]() { scheduleProcessing(); }, Qt::QueuedConnection);
+        }
+    });
+    m_engine.setPassCallback([this](const std::vector<Node*>& updated) { passFinished(updated); });
+}
 
 NodeGraph::~NodeGraph() {
-    for (auto node : m_nodes) {
+    for (auto node : m_engine.nodes()) {
         removeItem(node);
         delete node;
     }
 }
 
 void NodeGraph::addNode(Node* node) {
-    m_nodes.push_back(node);
+    m_engine.addNode(node);
     addItem(node);
-    connect(node, &Node::dataUpdated, this, [this]() { processGraph(); });
     emit nodeAdded(node);
 }
 
 void NodeGraph::removeNode(Node* node) {
-    auto it = std::find(m_nodes.begin(), m_nodes.end(), node);
-    if (it != m_nodes.end()) {
+    const auto& nodes = m_engine.nodes();
+    if (std::find(nodes.begin(), nodes.end(), node) != nodes.end()) {
         // Remove all connections to this node
-        for (auto otherNode : m_nodes) {
+        for (auto otherNode : nodes) {
             auto connections = otherNode->getInputConnections();
             for (size_t i = 0; i < connections.size(); ++i) {
                 if (connections[i].first == node) {
@@ -33,61 +48,155 @@ void NodeGraph::removeNode(Node* node) {
             }
         }
 
-        m_nodes.erase(it);
+        m_engine.removeNode(node);
         removeItem(node);
         emit nodeRemoved(node);
         delete node;
+        processPending();
     }
 }
 
 void NodeGraph::connectNodes(Node* sourceNode, int sourcePort, Node* destNode, int destPort) {
     destNode->addInputConnection(sourceNode, sourcePort, destPort);
     emit connectionMade(sourceNode, sourcePort, destNode, destPort);
-    processGraph();
+    processPending();
 }
 
 void NodeGraph::disconnectNodes(Node* destNode, int destPort) {
     destNode->removeInputConnection(destPort);
     emit connectionRemoved(destNode, destPort);
-    processGraph();
+    processPending();
+}
+
+Node* NodeGraph::groupNodes(const std::vector<Node*>& nodes, const std::string& name) {
+    if (nodes.empty()) {
+        return nullptr;
+    }
+    std::vector<std::pair<Node*, int>> sources;
+    auto definition = GroupDefinition::capture(name, nodes, m_engine.nodes(), &sources);
+    // Leaves the graph as it was when a member could not be recreated or the name is taken
+    if (!registerGroup(definition)) {
+        return nullptr;
+    }
+    auto* group = new GroupNode(definition);
+    group->setPos(nodes.front()->pos());
+
+    // Readers outside the selection switch to the matching group output
+    struct Reader {
+        Node* node;
+        int port;
+        int output;
+    };
+    std::vector<Reader> readers;
+    const auto& outputs = definition->outputs();
+    for (Node* node : m_engine.nodes()) {
+        if (std::find(nodes.begin(), nodes.end(), node) != nodes.end()) {
+            continue;
+        }
+        const auto connections = node->getInputConnections();
+        for (size_t port = 0; port < connections.size(); ++port) {
+            for (size_t output = 0; output < outputs.size(); ++output) {
+                if (connections[port].first == nodes[outputs[output].member] &&
+                    connections[port].second == outputs[output].port) {
+                    readers.push_back({node, static_cast<int>(port), static_cast<int>(output)});
+                }
+            }
+        }
+    }
+
+    addNode(group);
+    for (size_t input = 0; input < sources.size(); ++input) {
+        connectNodes(sources[input].first, sources[input].second, group, static_cast<int>(input));
+    }
+    for (const Reader& reader : readers) {
+        connectNodes(group, definition->inputCount() + reader.output, reader.node, reader.port);
+    }
+    for (Node* node : nodes) {
+        removeNode(node);
+    }
+    return group;
 }
 
 void NodeGraph::processGraph() {
-    // Simple processing - just process all nodes in order
-    // A more sophisticated implementation would topologically sort the graph
-    for (auto node : m_nodes) {
-        node->process();
+    m_engine.invalidateAll();
+    m_engine.run();
+}
+
+void NodeGraph::processPending() {
+    m_engine.run();
+}
+
+void NodeGraph::passFinished(const std::vector<Node*>& updated) {
+    updateTimingBadges();
+    for (auto node : updated) {
+        node->requestPreview();
     }
     emit graphProcessed();
 }
 
+void NodeGraph::scheduleProcessing() {
+    if (m_flushScheduled.exchange(true)) {
+        return;
+    }
+    QTimer::singleShot(kFrameIntervalMs, this, [this]() {
+        m_flushScheduled = false;
+        processPending();
+    });
+}
+
+void NodeGraph::setProfilingEnabled(bool enabled) {
+    m_engine.profiler().setEnabled(enabled);
+    if (!enabled) {
+        for (auto node : m_engine.nodes()) {
+            node->clearTimingBadge();
+        }
+    }
+}
+
+void NodeGraph::updateTimingBadges() {
+    const NodeProfiler& profiler = m_engine.profiler();
+    const PassProfile* pass = profiler.isEnabled() ? profiler.lastPass() : nullptr;
+    if (!pass) {
+        return;
+    }
+
+    // Heat is relative to the slowest node of the pass
+    int64_t slowest = 1;
+    for (const auto& timing : pass->nodes) {
+        slowest = std::max(slowest, timing.wallNs);
+    }
+    for (auto node : m_engine.nodes()) {
+        for (const auto& timing : pass->nodes) {
+            if (timing.nodeId == node->id()) {
+                node->setTimingBadge(timing.wallNs / 1e6, static_cast<double>(timing.wallNs) / slowest);
+                break;
+            }
+        }
+    }
+}
+
+Node* NodeGraph::nodeAt(const QPointF& scenePos) const {
+    // The temporary connection line sits on top while dragging, so skip non-node items
+    for (QGraphicsItem* item : items(scenePos)) {
+        if (Node* node = dynamic_cast<Node*>(item)) {
+            return node;
+        }
+    }
+    return nullptr;
+}
+
 void NodeGraph::mousePressEvent(QGraphicsSceneMouseEvent* event) {
     if (event->button() == Qt::LeftButton) {
-        QGraphicsItem* item = itemAt(event->scenePos(), QTransform());
-        if (item && dynamic_cast<Node*>(item))) {
-            Node* node = dynamic_cast<Node*>(item);
-            QPointF pos = node->mapFromScene(event->scenePos());
-            QRectF bounds = node->boundingRect();
-            
+        if (Node* node = nodeAt(event->scenePos())) {
             // Check if click was on a port
-            auto ports = node->getPorts();
-            for (size_t i = 0; i < ports.size(); ++i) {
-                const auto& port = ports[i];
-                QRectF portRect;
-                if (port.type == PortType::Input) {
-                    portRect = QRectF(5, 25 + i * 20, 10, 10);
-                } else {
-                    portRect = QRectF(bounds.width() - 15, 25 + i * 20, 10, 10);
-                }
-                
-                if (portRect.contains(pos)) {
-                    m_connectionStartNode = node;
-                    m_connectionStartPort = i;
-                    m_tempConnection = new QGraphicsLineItem(QLineF(event->scenePos(), event->scenePos()));
-                    m_tempConnection->setPen(QPen(Qt::black, 2));
-                    addItem(m_tempConnection);
-                    return;
-                }
+            int port = node->portAt(node->mapFromScene(event->scenePos()));
+            if (port >= 0) {
+                m_connectionStartNode = node;
+                m_connectionStartPort = port;
+                m_tempConnection = new QGraphicsLineItem(QLineF(event->scenePos(), event->scenePos()));
+                m_tempConnection->setPen(QPen(Qt::black, 2));
+                addItem(m_tempConnection);
+                return;
             }
         }
     }
@@ -105,36 +214,21 @@ void NodeGraph::mouseMoveEvent(QGraphicsSceneMouseEvent* event) {
 
 void NodeGraph::mouseReleaseEvent(QGraphicsSceneMouseEvent* event) {
     if (m_tempConnection && event->button() == Qt::LeftButton) {
-        QGraphicsItem* item = itemAt(event->scenePos(), QTransform());
-        if (item && dynamic_cast<Node*>(item))) {
-            Node* endNode = dynamic_cast<Node*>(item);
-            QPointF pos = endNode->mapFromScene(event->scenePos());
-            QRectF bounds = endNode->boundingRect();
-            
-            auto ports = endNode->getPorts();
-            for (size_t i = 0; i < ports.size(); ++i) {
-                const auto& port = ports[i];
-                QRectF portRect;
-                if (port.type == PortType::Input) {
-                    portRect = QRectF(5, 25 + i * 20, 10, 10);
-                } else {
-                    portRect = QRectF(bounds.width() - 15, 25 + i * 20, 10, 10);
-                }
+        if (Node* endNode = nodeAt(event->scenePos())) {
+            int i = endNode->portAt(endNode->mapFromScene(event->scenePos()));
+            if (i >= 0) {
+                // Check if connection is valid
+                const Port& startPort = m_connectionStartNode->ports()[m_connectionStartPort];
+                const Port& endPort = endNode->ports()[i];
                 
-                if (portRect.contains(pos)) {
-                    // Check if connection is valid
-                    auto startPort = m_connectionStartNode->getPorts()[m_connectionStartPort];
-                    auto endPort = port;
-                    
-                    if (startPort.type != endPort.type && 
-                        startPort.dataType == endPort.dataType) {
-                        if (startPort.type == PortType::Output) {
-                            connectNodes(m_connectionStartNode, m_connectionStartPort, endNode, i);
-                        } else {
-                            connectNodes(endNode, i, m_connectionStartNode, m_connectionStartPort);
-                        }
+                if (startPort.type != endPort.type &&
+                    (startPort.dataType == endPort.dataType ||
+                     (isNumeric(startPort.dataType) && isNumeric(endPort.dataType)))) {
+                    if (startPort.type == PortType::Output) {
+                        connectNodes(m_connectionStartNode, m_connectionStartPort, endNode, i);
+                    } else {
+                        connectNodes(endNode, i, m_connectionStartNode, m_connectionStartPort);
                     }
-                    break;
                 }
             }
         }
@@ -146,4 +240,4 @@ void NodeGraph::mouseReleaseEvent(QGraphicsSceneMouseEvent* event) {
         m_connectionStartPort = -1;
     }
     QGraphicsScene::mouseReleaseEvent(event);
-}
\ No newline at end of file
+}
@@ -0,0 +1,195 @@
+#include "NodeProfiler.h"
+#include "AllocationTracker.h"
+#include "Node.h"
+#include <chrono>
+#include <ctime>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+
+static int64_t steadyNowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static int64_t processCpuNs() {
+    timespec ts{};
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+static std::vector<ImageDims> imageDims(const Node* node, PortType type) {
+    std::vector<ImageDims> dims;
+    const auto& ports = node->ports();
+    for (size_t i = 0; i < ports.size(); ++i) {
+        if (ports[i].type != type || ports[i].dataType != DataType::Image) {
+            continue;
+        }
+        auto data = type == PortType::Input ? node->getInputData(i) : node->getOutputData(i);
+        if (!data) {
+            continue;
+        }
+        const cv::Mat& image = *std::static_pointer_cast<cv::Mat>(data);
+        dims.push_back({static_cast<int>(i), image.cols, image.rows, image.channels()});
+    }
+    return dims;
+}
+
+static std::string jsonEscape(const std::string& text) {
+    std::string escaped;
+    escaped.reserve(text.size());
+    for (char c : text) {
+        switch (c) {
+            case '"': escaped += "\\\""; break;
+            case '\\': escaped += "\\\\"; break;
+            case '\n': escaped += "\\n"; break;
+            case '\r': escaped += "\\r"; break;
+            case '\t': escaped += "\\t"; break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20) {
+                    char code[8];
+                    std::snprintf(code, sizeof(code), "\\u%04x", static_cast<unsigned char>(c));
+                    escaped += code;
+                } else {
+                    escaped += c;
+                }
+                break;
+        }
+    }
+    return escaped;
+}
+
+static void writeDims(std::ofstream& out, const std::vector<ImageDims>& dims) {
+    out << "[";
+    for (size_t i = 0; i < dims.size(); ++i) {
+        if (i > 0) {
+            out << ",";
+        }
+        out << "\"" << dims[i].width << "x" << dims[i].height << "x" << dims[i].channels << "\"";
+    }
+    out << "]";
+}
+
+NodeProfiler::NodeProfiler(size_t maxPasses) : m_maxPasses(maxPasses) {}
+
+void NodeProfiler::setEnabled(bool enabled) {
+    m_enabled = enabled;
+    if (enabled) {
+        AllocationTracker::instance().install();
+    }
+}
+
+void NodeProfiler::beginPass() {
+    if (!m_enabled) {
+        return;
+    }
+    m_current = PassProfile();
+    m_current.passIndex = m_nextPassIndex++;
+    m_current.startNs = steadyNowNs();
+    m_inPass = true;
+}
+
+void NodeProfiler::runNode(Node* node) {
+    runNode(node, [node]() { node->process(); });
+}
+
+void NodeProfiler::runNode(Node* node, const std::function<void()>& work) {
+    if (!m_inPass) {
+        work();
+        return;
+    }
+
+    NodeTiming timing;
+    timing.nodeId = node->id();
+    timing.nodeName = node->name();
+    timing.inputs = imageDims(node, PortType::Input);
+
+    const size_t bytesBefore = AllocationTracker::instance().snapshot().bytesAllocated;
+    const int64_t cpuBefore = processCpuNs();
+    const int64_t wallBefore = steadyNowNs();
+    work();
+    const int64_t wallAfter = steadyNowNs();
+    const int64_t cpuAfter = processCpuNs();
+
+    timing.startNs = wallBefore - m_current.startNs;
+    timing.wallNs = wallAfter - wallBefore;
+    timing.cpuNs = cpuAfter - cpuBefore;
+    timing.bytesAllocated = AllocationTracker::instance().snapshot().bytesAllocated - bytesBefore;
+    timing.outputs = imageDims(node, PortType::Output);
+    m_current.nodes.push_back(std::move(timing));
+}
+
+void NodeProfiler::endPass() {
+    if (!m_inPass) {
+        return;
+    }
+    m_inPass = false;
+    m_current.wallNs = steadyNowNs() - m_current.startNs;
+    m_passes.push_back(std::move(m_current));
+    while (m_passes.size() > m_maxPasses) {
+        m_passes.pop_front();
+    }
+}
+
+const PassProfile* NodeProfiler::lastPass() const {
+    return m_passes.empty() ? nullptr : &m_passes.back();
+}
+
+const NodeTiming* NodeProfiler::lastTiming(NodeID id) const {
+    for (auto pass = m_passes.rbegin(); pass != m_passes.rend(); ++pass) {
+        for (const auto& timing : pass->nodes) {
+            if (timing.nodeId == id) {
+                return &timing;
+            }
+        }
+    }
+    return nullptr;
+}
+
+void NodeProfiler::clear() {
+    m_passes.clear();
+}
+
+bool NodeProfiler::exportChromeTrace(const std::string& path) const {
+    std::ofstream out(path);
+    if (!out) {
+        return false;
+    }
+    // Fixed notation keeps sub-microsecond digits in traces longer than a second
+    out << std::fixed << std::setprecision(3);
+
+    // Timestamps are microseconds relative to the first retained pass
+    const int64_t origin = m_passes.empty() ? 0 : m_passes.front().startNs;
+    bool first = true;
+    auto separator = [&]() {
+        if (!first) {
+            out << ",\n";
+        }
+        first = false;
+    };
+
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    for (const auto& pass : m_passes) {
+        const double passStartUs = (pass.startNs - origin) / 1000.0;
+        separator();
+        out << "{\"name\":\"Pass " << pass.passIndex << "\",\"cat\":\"pass\",\"ph\":\"X\",\"pid\":1,\"tid\":1"
+            << ",\"ts\":" << passStartUs << ",\"dur\":" << pass.wallNs / 1000.0 << "}";
+
+        for (const auto& timing : pass.nodes) {
+            separator();
+            out << "{\"name\":\"" << jsonEscape(timing.nodeName) << "\",\"cat\":\"node\",\"ph\":\"X\",\"pid\":1,\"tid\":1"
+                << ",\"ts\":" << passStartUs + timing.startNs / 1000.0
+                << ",\"dur\":" << timing.wallNs / 1000.0
+                << ",\"args\":{\"nodeId\":" << timing.nodeId
+                << ",\"cpuMs\":" << timing.cpuNs / 1e6
+                << ",\"bytesAllocated\":" << timing.bytesAllocated
+                << ",\"inputs\":";
+            writeDims(out, timing.inputs);
+            out << ",\"outputs\":";
+            writeDims(out, timing.outputs);
+            out << "}}";
+        }
+    }
+    out << "\n]}\n";
+    return static_cast<bool>(out);
+}
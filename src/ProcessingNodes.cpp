@@ -1,325 +1,795 @@
 #include "ProcessingNodes.h"
+#include "Binarize.h"
+#include "ColorSpace.h"
+#include "ImageStatistics.h"
+#include "Kernels.h"
+#include "Morphology.h"
+#include <algorithm>
+#include <cmath>
+
+// Frames arriving on the first input port, empty when it is unconnected
+static const ImageBatch& firstInput(const std::vector<ImageBatch>& inputs) {
+    static const ImageBatch none;
+    return inputs.empty() ? none : inputs[0];
+}
+
+// 8-bit copy of an image at full scale: 16-bit (linear light) and float (0-1)
+// white maps to 255, other depths convert as they are
+static void toFullRange8U(const cv::Mat& image, cv::Mat& converted) {
+    const int depth = image.depth();
+    const bool ranged = depth == CV_16U || depth == CV_32F || depth == CV_64F;
+    image.convertTo(converted, CV_8U, ranged ? rangeScale(depth, CV_8U) : 1.0);
+}
 
 BrightnessContrastNode::BrightnessContrastNode() : m_brightness(0), m_contrast(1.0f) {
     m_outputData.push_back(std::make_shared<cv::Mat>());
+    addParameter("Brightness", DataType::Scalar, [this]() { return m_brightness; },
+                 [this](double value) { setBrightness(cvRound(value)); });
+    addParameter("Contrast", DataType::Scalar, [this]() { return m_contrast; },
+                 [this](double value) { setContrast(static_cast<float>(value)); });
 }
 
 void BrightnessContrastNode::process() {
-    auto inputData = getInputData(0);
-    if (inputData) {
-        auto inputImage = *std::static_pointer_cast<cv::Mat>(inputData);
-        if (!inputImage.empty()) {
-            cv::Mat output;
-            inputImage.convertTo(output, -1, m_contrast, m_brightness);
-            *std::static_pointer_cast<cv::Mat>(m_outputData[0]) = output;
-            emit dataUpdated();
+    cv::Mat inputImage = readInput(0);
+    if (!inputImage.empty()) {
+        cv::Mat output;
+        adjust(lookupTable(), inputImage, output);
+        *std::static_pointer_cast<cv::Mat>(m_outputData[0]) = output;
+        setOutputInfo(0, {inputInfo(0).opaque, false});
+    }
+}
+
+void BrightnessContrastNode::processBatch(const std::vector<ImageBatch>& inputs, std::vector<ImageBatch>& outputs) {
+    const ImageBatch& frames = firstInput(inputs);
+    const cv::Mat lut = lookupTable();
+    outputs.assign(1, ImageBatch(frames.size()));
+    for (size_t i = 0; i < frames.size(); ++i) {
+        if (!frames[i].empty()) {
+            adjust(lut, frames[i], outputs[0][i]);
         }
     }
 }
 
-std::vector<Port> BrightnessContrastNode::getPorts() const {
-    return {
+cv::Mat BrightnessContrastNode::lookupTable() const {
+    // Tabulate with convertTo itself so the result matches the direct path exactly
+    cv::Mat levels(1, 256, CV_8U);
+    for (int i = 0; i < 256; ++i) {
+        levels.at<uchar>(i) = static_cast<uchar>(i);
+    }
+    cv::Mat lut;
+    levels.convertTo(lut, -1, m_contrast, m_brightness);
+    return lut;
+}
+
+void BrightnessContrastNode::adjust(const cv::Mat& lut, const cv::Mat& input, cv::Mat& output) const {
+    if (input.depth() != CV_8U) {
+        // Brightness is in 8-bit levels; alpha is copied as in the table path
+        input.convertTo(output, -1, m_contrast, m_brightness * rangeScale(CV_8U, input.depth()));
+        if (input.channels() == 4) {
+            const int alpha[] = {3, 3};
+            cv::mixChannels(&input, 1, &output, 1, alpha, 1);
+        }
+    } else {
+        // Alpha is coverage, not color, so the kernel copies it unchanged
+        output.create(input.size(), input.type());
+        const KernelTable& table = kernels();
+        const uchar* levels = lut.ptr<uchar>();
+        cv::parallel_for_(cv::Range(0, input.rows), [&](const cv::Range& range) {
+            for (int y = range.start; y < range.end; ++y) {
+                table.lutRow(input.ptr<uchar>(y), output.ptr<uchar>(y), input.cols, input.channels(), levels);
+            }
+        });
+    }
+}
+
+const std::vector<Port>& BrightnessContrastNode::getPorts() const {
+    static const std::vector<Port> ports = {
         {0, "Input", PortType::Input, DataType::Image},
         {1, "Output", PortType::Output, DataType::Image}
     };
+    return ports;
+}
+
+std::string BrightnessContrastNode::parameterKey() const {
+    return makeParameterKey({static_cast<double>(m_brightness), m_contrast});
 }
 
 void BrightnessContrastNode::setBrightness(int value) {
     m_brightness = value;
-    process();
+    invalidate();
 }
 
 void BrightnessContrastNode::setContrast(float value) {
     m_contrast = value;
-    process();
+    invalidate();
 }
 
 BlurNode::BlurNode() : m_radius(5) {
     m_outputData.push_back(std::make_shared<cv::Mat>());
+    addParameter("Radius", DataType::Integer, [this]() { return m_radius; },
+                 [this](double value) { setRadius(std::max(cvRound(value), 1)); });
 }
 
 void BlurNode::process() {
-    auto inputData = getInputData(0);
-    if (inputData) {
-        auto inputImage = *std::static_pointer_cast<cv::Mat>(inputData);
-        if (!inputImage.empty()) {
-            cv::Mat output;
-            cv::GaussianBlur(inputImage, output, cv::Size(m_radius, m_radius), 0);
-            *std::static_pointer_cast<cv::Mat>(m_outputData[0]) = output;
-            emit dataUpdated();
+    // Blurring straight alpha bleeds the color of transparent pixels into edges
+    const ImageInfo info = inputInfo(0);
+    cv::Mat inputImage = readInput(0, info.hasAlpha());
+    if (!inputImage.empty()) {
+        cv::Mat output;
+        cv::GaussianBlur(inputImage, output, cv::Size(kernelSize(), kernelSize()), 0);
+        *std::static_pointer_cast<cv::Mat>(m_outputData[0]) = output;
+        setOutputInfo(0, {info.opaque, info.hasAlpha()});
+    }
+}
+
+void BlurNode::processBatch(const std::vector<ImageBatch>& inputs, std::vector<ImageBatch>& outputs) {
+    const ImageBatch& frames = firstInput(inputs);
+    const cv::Size aperture(kernelSize(), kernelSize());
+    outputs.assign(1, ImageBatch(frames.size()));
+    for (size_t i = 0; i < frames.size(); ++i) {
+        if (frames[i].type() == CV_8UC4) {
+            // Batches exchange straight alpha
+            cv::Mat premultiplied;
+            premultiplyAlpha(frames[i], premultiplied);
+            cv::GaussianBlur(premultiplied, premultiplied, aperture, 0);
+            unpremultiplyAlpha(premultiplied, outputs[0][i]);
+        } else if (!frames[i].empty()) {
+            cv::GaussianBlur(frames[i], outputs[0][i], aperture, 0);
         }
     }
 }
 
-std::vector<Port> BlurNode::getPorts() const {
-    return {
+const std::vector<Port>& BlurNode::getPorts() const {
+    static const std::vector<Port> ports = {
         {0, "Input", PortType::Input, DataType::Image},
         {1, "Output", PortType::Output, DataType::Image}
     };
+    return ports;
+}
+
+std::string BlurNode::parameterKey() const {
+    return makeParameterKey({static_cast<double>(m_radius)});
 }
 
 void BlurNode::setRadius(int radius) {
     m_radius = radius;
-    process();
+    invalidate();
 }
 
-ThresholdNode::ThresholdNode() : m_threshold(127) {
+ThresholdNode::ThresholdNode() : m_threshold(127), m_mode(Fixed), m_radius(15), m_offset(10), m_sauvolaK(0.2f) {
     m_outputData.push_back(std::make_shared<cv::Mat>());
+    addParameter("Threshold", DataType::Scalar, [this]() { return m_threshold; },
+                 [this](double value) { setThreshold(cvRound(value)); });
+    addParameter("Mode", DataType::Integer, [this]() { return m_mode; },
+                 [this](double value) { setMode(std::clamp(cvRound(value), 0, static_cast<int>(Sauvola))); });
+    addParameter("Radius", DataType::Integer, [this]() { return m_radius; },
+                 [this](double value) { setRadius(cvRound(value)); });
+    addParameter("Offset", DataType::Integer, [this]() { return m_offset; },
+                 [this](double value) { setOffset(cvRound(value)); });
+    addParameter("Sauvola K", DataType::Scalar, [this]() { return m_sauvolaK; },
+                 [this](double value) { setSauvolaK(static_cast<float>(value)); });
 }
 
 void ThresholdNode::process() {
-    auto inputData = getInputData(0);
-    if (inputData) {
-        auto inputImage = *std::static_pointer_cast<cv::Mat>(inputData);
-        if (!inputImage.empty()) {
-            cv::Mat gray, output;
-            if (inputImage.channels() > 1) {
-                cv::cvtColor(inputImage, gray, cv::COLOR_BGR2GRAY);
-            } else {
-                gray = inputImage.clone();
-            }
+    cv::Mat inputImage = readInput(0);
+    if (!inputImage.empty()) {
+        cv::Mat gray;
+        lumaOf(inputImage, inputInfo(0).space, gray);
+        cv::Mat output;
+        binarize(gray, output);
+        *std::static_pointer_cast<cv::Mat>(m_outputData[0]) = output;
+    }
+}
+
+void ThresholdNode::binarize(const cv::Mat& gray, cv::Mat& output) const {
+    if (gray.depth() != CV_8U) {
+        // The level is in 8-bit steps, and the automatic and adaptive modes are
+        // 8-bit only, so 16-bit and float (0-1) luma is scaled down first
+        cv::Mat scaled;
+        toFullRange8U(gray, scaled);
+        binarize(scaled, output);
+        return;
+    }
+    switch (m_mode) {
+        case Otsu:
+        case Triangle: {
+            int histogram[256];
+            grayHistogram(gray, histogram);
+            const int level = m_mode == Otsu ? otsuThreshold(histogram) : triangleThreshold(histogram);
+            cv::threshold(gray, output, level, 255, cv::THRESH_BINARY);
+            break;
+        }
+        case AdaptiveMean:
+            adaptiveThreshold(gray, output, m_radius, AdaptiveMethod::Mean, m_offset);
+            break;
+        case Sauvola:
+            adaptiveThreshold(gray, output, m_radius, AdaptiveMethod::Sauvola, m_sauvolaK);
+            break;
+        default:
             cv::threshold(gray, output, m_threshold, 255, cv::THRESH_BINARY);
-            *std::static_pointer_cast<cv::Mat>(m_outputData[0]) = output;
-            emit dataUpdated();
+            break;
+    }
+}
+
+void ThresholdNode::processBatch(const std::vector<ImageBatch>& inputs, std::vector<ImageBatch>& outputs) {
+    const ImageBatch& frames = firstInput(inputs);
+    outputs.assign(1, ImageBatch(frames.size()));
+    const ColorSpace space = inputInfo(0).space;
+    cv::Mat gray; // Reused across frames of the same size
+    for (size_t i = 0; i < frames.size(); ++i) {
+        if (frames[i].empty()) {
+            continue;
         }
+        lumaOf(frames[i], space, gray);
+        binarize(gray, outputs[0][i]);
     }
 }
 
-std::vector<Port> ThresholdNode::getPorts() const {
-    return {
+const std::vector<Port>& ThresholdNode::getPorts() const {
+    static const std::vector<Port> ports = {
         {0, "Input", PortType::Input, DataType::Image},
         {1, "Output", PortType::Output, DataType::Image}
     };
+    return ports;
+}
+
+std::string ThresholdNode::parameterKey() const {
+    return makeParameterKey({static_cast<double>(m_threshold), static_cast<double>(m_mode),
+                             static_cast<double>(m_radius), static_cast<double>(m_offset), m_sauvolaK});
+}
+
+int ThresholdNode::damageMargin() const {
+    switch (m_mode) {
+        case Otsu:
+        case Triangle:
+            return -1;  // The level comes from the whole histogram
+        case AdaptiveMean:
+        case Sauvola:
+            return m_radius;
+        default:
+            return 0;
+    }
 }
 
 void ThresholdNode::setThreshold(int value) {
     m_threshold = value;
-    process();
+    invalidate();
+}
+
+void ThresholdNode::setMode(int mode) {
+    m_mode = mode;
+    invalidate();
+}
+
+void ThresholdNode::setRadius(int radius) {
+    m_radius = std::max(radius, 1);
+    invalidate();
+}
+
+void ThresholdNode::setOffset(int offset) {
+    m_offset = offset;
+    invalidate();
+}
+
+void ThresholdNode::setSauvolaK(float k) {
+    m_sauvolaK = k;
+    invalidate();
 }
 
 EdgeDetectionNode::EdgeDetectionNode() : m_method(0) {
     m_outputData.push_back(std::make_shared<cv::Mat>());
+    addParameter("Method", DataType::Integer, [this]() { return m_method; },
+                 [this](double value) { setMethod(std::clamp(cvRound(value), 0, 1)); });
 }
 
 void EdgeDetectionNode::process() {
-    auto inputData = getInputData(0);
-    if (inputData) {
-        auto inputImage = *std::static_pointer_cast<cv::Mat>(inputData);
-        if (!inputImage.empty()) {
-            cv::Mat gray, output;
-            if (inputImage.channels() > 1) {
-                cv::cvtColor(inputImage, gray, cv::COLOR_BGR2GRAY);
-            } else {
-                gray = inputImage.clone();
-            }
+    cv::Mat inputImage = readInput(0);
+    if (!inputImage.empty()) {
+        cv::Mat gray, output;
+        lumaOf(inputImage, inputInfo(0).space, gray);
+        
+        if (m_method == 0) { // Sobel
+            cv::Mat grad_x, grad_y;
+            cv::Sobel(gray, grad_x, CV_16S, 1, 0);
+            cv::Sobel(gray, grad_y, CV_16S, 0, 1);
             
-            if (m_method == 0) { // Sobel
-                cv::Mat grad_x, grad_y;
-                cv::Sobel(gray, grad_x, CV_16S, 1, 0);
-                cv::Sobel(gray, grad_y, CV_16S, 0, 1);
-                
-                cv::Mat abs_grad_x, abs_grad_y;
-                cv::convertScaleAbs(grad_x, abs_grad_x);
-                cv::convertScaleAbs(grad_y, abs_grad_y);
-                
-                cv::addWeighted(abs_grad_x, 0.5, abs_grad_y, 0.5, 0, output);
-            } else { // Canny
-                cv::Canny(gray, output, 50, 150);
-            }
+            cv::Mat abs_grad_x, abs_grad_y;
+            cv::convertScaleAbs(grad_x, abs_grad_x);
+            cv::convertScaleAbs(grad_y, abs_grad_y);
             
-            *std::static_pointer_cast<cv::Mat>(m_outputData[0]) = output;
-            emit dataUpdated();
+            cv::addWeighted(abs_grad_x, 0.5, abs_grad_y, 0.5, 0, output);
+        } else { // Canny
+            cv::Canny(gray, output, 50, 150);
         }
+        
+        *std::static_pointer_cast<cv::Mat>(m_outputData[0]) = output;
     }
 }
 
-std::vector<Port> EdgeDetectionNode::getPorts() const {
-    return {
+const std::vector<Port>& EdgeDetectionNode::getPorts() const {
+    static const std::vector<Port> ports = {
         {0, "Input", PortType::Input, DataType::Image},
         {1, "Output", PortType::Output, DataType::Image}
     };
+    return ports;
+}
+
+std::string EdgeDetectionNode::parameterKey() const {
+    return makeParameterKey({static_cast<double>(m_method)});
 }
 
 void EdgeDetectionNode::setMethod(int method) {
     m_method = method;
-    process();
+    invalidate();
+}
+
+const cv::Mat& PreparedInput::prepare(const cv::Mat& input, cv::Size targetSize, int targetType,
+                                      ColorSpace fromSpace, ColorSpace toSpace) {
+    if (input.data == source.data && input.size() == source.size() && input.type() == source.type() &&
+        targetSize == size && targetType == type && fromSpace == from && toSpace == to) {
+        return prepared;
+    }
+    source = input;
+    size = targetSize;
+    type = targetType;
+    from = fromSpace;
+    to = toSpace;
+
+    cv::Mat converted;
+    convertColorSpace(input, converted, fromSpace, toSpace);
+    if (converted.depth() != CV_8U) {
+        toFullRange8U(converted, converted);
+    }
+    const int from = converted.channels();
+    const int to = CV_MAT_CN(targetType);
+    if (from != to) {
+        static const int codes[5][5] = {
+            {-1, -1, -1, -1, -1},
+            {-1, -1, -1, cv::COLOR_GRAY2BGR, cv::COLOR_GRAY2BGRA},
+            {-1, -1, -1, -1, -1},
+            {-1, cv::COLOR_BGR2GRAY, -1, -1, cv::COLOR_BGR2BGRA},
+            {-1, cv::COLOR_BGRA2GRAY, -1, cv::COLOR_BGRA2BGR, -1}
+        };
+        int code = from <= 4 && to <= 4 ? codes[from][to] : -1;
+        if (code < 0) {
+            // Two-channel and other unusual inputs: treat the first channel as gray
+            cv::extractChannel(converted, converted, 0);
+            code = to == 3 ? cv::COLOR_GRAY2BGR : (to == 4 ? cv::COLOR_GRAY2BGRA : -1);
+        }
+        if (code >= 0) {
+            cv::cvtColor(converted, converted, code);
+        }
+    }
+    if (converted.size() != targetSize) {
+        cv::resize(converted, converted, targetSize, 0, 0, cv::INTER_LINEAR);
+    }
+    prepared = converted;
+    return prepared;
+}
+
+namespace {
+
+struct CompositeLayer {
+    const cv::Mat* image;   // Base size, working channel count
+    const cv::Mat* mask;    // CV_8UC1 or null
+    BlendMode mode;
+    float opacity;
+    bool hasAlpha;          // Channel 3 of image is straight alpha
+};
+
+// Four working channels when the base or any layer carries real alpha
+int workingChannels(const cv::Mat& base, bool baseAlpha, bool anyLayerAlpha) {
+    return baseAlpha || anyLayerAlpha ? 4 : base.channels();
+}
+
+// dst holds the composite so far in 0-1; the layer row is blended in place.
+// Over an opaque base only the colour channels change and the layer's alpha
+// just scales its weight. Over a transparent base dst is premultiplied and the
+// general source-over with blend function B is used:
+//   co = cs*as*(1-ab) + cb*(1-as) + as*ab*B(Cb, Cs),  ao = as + ab*(1-as)
+template <typename Blend>
+void blendRow(float* dst, const uchar* src, const uchar* mask, int width, int channels,
+              float opacity, bool layerAlpha, bool baseAlpha, Blend blend) {
+    const float scale = 1.0f / 255.0f;
+    const int colors = channels == 4 ? 3 : channels;
+    if (!baseAlpha) {
+        for (int x = 0; x < width; ++x) {
+            float weight = mask ? opacity * mask[x] * scale : opacity;
+            if (layerAlpha) {
+                weight *= src[x * 4 + 3] * scale;
+            }
+            for (int c = 0; c < colors; ++c) {
+                const int i = x * channels + c;
+                const float a = dst[i];
+                dst[i] = a + (blend(a, src[i] * scale) - a) * weight;
+            }
+        }
+        return;
+    }
+    for (int x = 0; x < width; ++x) {
+        float* d = dst + x * 4;
+        const uchar* s = src + x * 4;
+        float as = mask ? opacity * mask[x] * scale : opacity;
+        if (layerAlpha) {
+            as *= s[3] * scale;
+        }
+        const float ab = d[3];
+        const float inverse = ab > 0.0f ? 1.0f / ab : 0.0f;
+        for (int c = 0; c < 3; ++c) {
+            const float cs = s[c] * scale;
+            d[c] = cs * as * (1.0f - ab) + d[c] * (1.0f - as) + as * ab * blend(d[c] * inverse, cs);
+        }
+        d[3] = as + ab * (1.0f - as);
+    }
+}
+
+void blendLayerRow(const CompositeLayer& layer, float* dst, const uchar* src, const uchar* mask, int width, int channels,
+                   bool baseAlpha) {
+    const float o = layer.opacity;
+    const bool alpha = layer.hasAlpha;
+    switch (layer.mode) {
+        case BlendMode::Normal:
+            blendRow(dst, src, mask, width, channels, o, alpha, baseAlpha, [](float, float b) { return b; });
+            break;
+        case BlendMode::Multiply:
+            blendRow(dst, src, mask, width, channels, o, alpha, baseAlpha, [](float a, float b) { return a * b; });
+            break;
+        case BlendMode::Screen:
+            blendRow(dst, src, mask, width, channels, o, alpha, baseAlpha, [](float a, float b) { return a + b - a * b; });
+            break;
+        case BlendMode::Overlay:
+            if (!baseAlpha && !alpha && !mask && channels != 4) {
+                kernels().overlayRow(dst, src, width * channels, o);
+                break;
+            }
+            blendRow(dst, src, mask, width, channels, o, alpha, baseAlpha, [](float a, float b) {
+                return a < 0.5f ? 2.0f * a * b : 1.0f - 2.0f * (1.0f - a) * (1.0f - b);
+            });
+            break;
+        case BlendMode::Difference:
+            blendRow(dst, src, mask, width, channels, o, alpha, baseAlpha, [](float a, float b) { return std::abs(a - b); });
+            break;
+        case BlendMode::Add:
+            blendRow(dst, src, mask, width, channels, o, alpha, baseAlpha, [](float a, float b) { return std::min(a + b, 1.0f); });
+            break;
+        case BlendMode::Subtract:
+            blendRow(dst, src, mask, width, channels, o, alpha, baseAlpha, [](float a, float b) { return std::max(a - b, 0.0f); });
+            break;
+        case BlendMode::Darken:
+            blendRow(dst, src, mask, width, channels, o, alpha, baseAlpha, [](float a, float b) { return std::min(a, b); });
+            break;
+        case BlendMode::Lighten:
+            blendRow(dst, src, mask, width, channels, o, alpha, baseAlpha, [](float a, float b) { return std::max(a, b); });
+            break;
+        case BlendMode::SoftLight:
+            // Pegtop's formula, continuous unlike the Photoshop variant
+            blendRow(dst, src, mask, width, channels, o, alpha, baseAlpha, [](float a, float b) {
+                return (1.0f - 2.0f * b) * a * a + 2.0f * b * a;
+            });
+            break;
+        case BlendMode::HardLight:
+            blendRow(dst, src, mask, width, channels, o, alpha, baseAlpha, [](float a, float b) {
+                return b < 0.5f ? 2.0f * a * b : 1.0f - 2.0f * (1.0f - a) * (1.0f - b);
+            });
+            break;
+    }
+}
+
+// One pass over memory: each row is accumulated in a small float buffer that
+// stays in cache while every layer is applied, then written out once. The
+// output has outChannels channels of straight alpha; an opaque base gives
+// alpha 255 when four are asked for. The base's own mask and opacity scale its
+// alpha, so a partly covered base needs baseAlpha and four channels.
+void compositeLayers(const cv::Mat& base, bool baseAlpha, const cv::Mat* baseMask, float baseOpacity,
+                     const std::vector<CompositeLayer>& layers, int outChannels, cv::Mat& output) {
+    output.create(base.size(), CV_8UC(outChannels));
+    const int channels = base.channels();
+    const int colors = channels == 4 ? 3 : channels;
+    const int width = base.cols;
+    cv::parallel_for_(cv::Range(0, base.rows), [&](const cv::Range& range) {
+        std::vector<float> row(static_cast<size_t>(width) * channels);
+        const float scale = 1.0f / 255.0f;
+        for (int y = range.start; y < range.end; ++y) {
+            const uchar* in = base.ptr<uchar>(y);
+            for (size_t i = 0; i < row.size(); ++i) {
+                row[i] = in[i] * scale;
+            }
+            if (baseAlpha) {
+                const uchar* mask = baseMask ? baseMask->ptr<uchar>(y) : nullptr;
+                for (int x = 0; x < width; ++x) {
+                    float* p = &row[x * 4];
+                    p[3] *= mask ? baseOpacity * mask[x] * scale : baseOpacity;
+                    p[0] *= p[3];
+                    p[1] *= p[3];
+                    p[2] *= p[3];
+                }
+            }
+            for (const auto& layer : layers) {
+                blendLayerRow(layer, row.data(), layer.image->ptr<uchar>(y),
+                              layer.mask ? layer.mask->ptr<uchar>(y) : nullptr, width, channels, baseAlpha);
+            }
+            uchar* out = output.ptr<uchar>(y);
+            for (int x = 0; x < width; ++x) {
+                const float* p = &row[x * channels];
+                uchar* o = out + x * outChannels;
+                const float inverse = baseAlpha ? (p[3] > 0.0f ? 1.0f / p[3] : 0.0f) : 1.0f;
+                for (int c = 0; c < colors && c < outChannels; ++c) {
+                    o[c] = cv::saturate_cast<uchar>(p[c] * inverse * 255.0f);
+                }
+                if (outChannels == 4) {
+                    o[3] = baseAlpha ? cv::saturate_cast<uchar>(p[3] * 255.0f) : 255;
+                }
+            }
+        }
+    });
 }
 
+} // namespace
+
 BlendNode::BlendNode() : m_blendMode(0), m_opacity(0.5f) {
     m_outputData.push_back(std::make_shared<cv::Mat>());
+    addParameter("Mode", DataType::Integer, [this]() { return m_blendMode; },
+                 [this](double value) { setBlendMode(std::clamp(cvRound(value), 0, static_cast<int>(BlendMode::HardLight))); });
+    addParameter("Opacity", DataType::Scalar, [this]() { return m_opacity; },
+                 [this](double value) { setOpacity(static_cast<float>(value)); });
 }
 
 void BlendNode::process() {
-    auto input1 = getInputData(0);
-    auto input2 = getInputData(1);
+    const cv::Mat image1 = readInput(0);
+    const cv::Mat image2 = readInput(1);
     
-    if (input1 && input2) {
-        auto image1 = *std::static_pointer_cast<cv::Mat>(input1);
-        auto image2 = *std::static_pointer_cast<cv::Mat>(input2);
+    if (!image1.empty() && !image2.empty()) {
+        const bool baseAlpha = image1.channels() == 4 && !inputInfo(0).opaque;
+        const bool layerAlpha = image2.channels() == 4 && !inputInfo(1).opaque;
+        const int channels = workingChannels(image1, baseAlpha, layerAlpha);
+        const int outChannels = image1.channels() == 4 || channels != 4 ? image1.channels() : 3;
         
-        if (!image1.empty() && !image2.empty()) {
-            cv::Mat output;
-            
-            // Resize images to match if needed
-            if (image1.size() != image2.size()) {
-                cv::resize(image2, image2, image1.size());
-            }
-            
-            switch (m_blendMode) {
-                case 0: // Normal
-                    cv::addWeighted(image1, 1.0 - m_opacity, image2, m_opacity, 0, output);
-                    break;
-                case 1: // Multiply
-                    cv::multiply(image1, image2, output, 1.0/255.0);
-                    break;
-                case 2: // Screen
-                    cv::Mat temp1, temp2;
-                    cv::subtract(cv::Scalar::all(255), image1, temp1);
-                    cv::subtract(cv::Scalar::all(255), image2, temp2);
-                    cv::multiply(temp1, temp2, output, 1.0/255.0);
-                    cv::subtract(cv::Scalar::all(255), output, output);
-                    break;
-                case 3: // Overlay
-                    // Implementation of overlay blend mode
-                    output = cv::Mat::zeros(image1.size(), image1.type());
-                    for (int y = 0; y < image1.rows; y++) {
-                        for (int x = 0; x < image1.cols; x++) {
-                            for (int c = 0; c < image1.channels(); c++) {
-                                double a = image1.at<cv::Vec3b>(y, x)[c] / 255.0;
-                                double b = image2.at<cv::Vec3b>(y, x)[c] / 255.0;
-                                double r = (a < 0.5) ? (2 * a * b) : (1 - 2 * (1 - a) * (1 - b));
-                                output.at<cv::Vec3b>(y, x)[c] = cv::saturate_cast<uchar>(
-                                    (1 - m_opacity) * a * 255 + m_opacity * r * 255);
-                            }
-                        }
-                    }
-                    break;
-                case 4: // Difference
-                    cv::absdiff(image1, image2, output);
-                    break;
-                default:
-                    output = image1.clone();
-            }
-            
-            *std::static_pointer_cast<cv::Mat>(m_outputData[0]) = output;
-            emit dataUpdated();
+        cv::Mat output;
+        if (m_blendMode < 0 || m_blendMode > static_cast<int>(BlendMode::HardLight)) {
+            output = image1;
+        } else {
+            // Input 2 is matched to input 1, color space included, once and
+            // reused until either changes
+            const int type = CV_8UC(channels);
+            const ColorSpace space = inputInfo(0).space;
+            const cv::Mat& base = m_base.prepare(image1, image1.size(), type);
+            const cv::Mat& layer = m_layer.prepare(image2, image1.size(), type, inputInfo(1).space, space);
+            compositeLayers(base, baseAlpha, nullptr, 1.0f,
+                            {{&layer, nullptr, static_cast<BlendMode>(m_blendMode), m_opacity, layerAlpha}},
+                            outChannels, output);
         }
+        
+        *std::static_pointer_cast<cv::Mat>(m_outputData[0]) = output;
+        setOutputInfo(0, {!baseAlpha, false});
     }
 }
 
-std::vector<Port> BlendNode::getPorts() const {
-    return {
+const std::vector<Port>& BlendNode::getPorts() const {
+    static const std::vector<Port> ports = {
         {0, "Input 1", PortType::Input, DataType::Image},
         {1, "Input 2", PortType::Input, DataType::Image},
         {2, "Output", PortType::Output, DataType::Image}
     };
+    return ports;
+}
+
+std::string BlendNode::parameterKey() const {
+    return makeParameterKey({static_cast<double>(m_blendMode), m_opacity});
+}
+
+void BlendNode::discardInputCaches() {
+    m_base = PreparedInput();
+    m_layer = PreparedInput();
 }
 
 void BlendNode::setBlendMode(int mode) {
     m_blendMode = mode;
-    process();
+    invalidate();
 }
 
 void BlendNode::setOpacity(float opacity) {
     m_opacity = opacity;
-    process();
+    invalidate();
 }
-// Add these implementations to ProcessingNodes.cpp
-
 ColorChannelSplitterNode::ColorChannelSplitterNode() : m_outputGrayscale(true) {
     // Output ports for each channel (R, G, B, A)
     m_outputData.push_back(std::make_shared<cv::Mat>());
     m_outputData.push_back(std::make_shared<cv::Mat>());
     m_outputData.push_back(std::make_shared<cv::Mat>());
     m_outputData.push_back(std::make_shared<cv::Mat>());
+    addParameter("Grayscale", DataType::Boolean, [this]() { return m_outputGrayscale; },
+                 [this](double value) { setOutputGrayscale(value != 0.0); });
 }
 
-void ColorChannelSplitterNode::process() {
-    auto inputData = getInputData(0);
-    if (inputData) {
-        auto inputImage = *std::static_pointer_cast<cv::Mat>(inputData);
-        if (!inputImage.empty()) {
-            std::vector<cv::Mat> channels;
-            cv::split(inputImage, channels);
-            
-            // If input is grayscale, just duplicate it for all channels
-            if (channels.size() == 1) {
-                channels.push_back(channels[0].clone());
-                channels.push_back(channels[0].clone());
-            }
-            
-            // Ensure we have at least 3 channels
-            while (channels.size() < 3) {
-                channels.push_back(cv::Mat::zeros(inputImage.size(), CV_8UC1));
+namespace {
+
+void splitChannels(const cv::Mat& input, std::vector<cv::Mat>& planes) {
+    if (input.depth() != CV_8U || input.channels() > 4) {
+        cv::split(input, planes);
+        return;
+    }
+    planes.resize(input.channels());
+    for (auto& plane : planes) {
+        plane.create(input.size(), CV_8UC1);
+    }
+    const KernelTable& table = kernels();
+    cv::parallel_for_(cv::Range(0, input.rows), [&](const cv::Range& range) {
+        uchar* rows[4];
+        for (int y = range.start; y < range.end; ++y) {
+            for (size_t c = 0; c < planes.size(); ++c) {
+                rows[c] = planes[c].ptr<uchar>(y);
             }
-            
-            // Alpha channel if available
+            table.splitRow(input.ptr<uchar>(y), rows, input.cols, input.channels());
+        }
+    });
+}
+
+// A BGR image holding one input channel in slot and zeros elsewhere
+cv::Mat isolateChannel(const cv::Mat& input, int channel, int slot) {
+    cv::Mat output(input.size(), CV_8UC3);
+    const KernelTable& table = kernels();
+    cv::parallel_for_(cv::Range(0, input.rows), [&](const cv::Range& range) {
+        for (int y = range.start; y < range.end; ++y) {
+            table.isolateRow(input.ptr<uchar>(y), output.ptr<uchar>(y), input.cols, input.channels(), channel, slot);
+        }
+    });
+    return output;
+}
+
+} // namespace
+
+void ColorChannelSplitterNode::process() {
+    cv::Mat inputImage = readInput(0);
+    if (!inputImage.empty()) {
+        const int count = inputImage.channels();
+        if (!m_outputGrayscale && inputImage.depth() == CV_8U && (count == 1 || count == 3 || count == 4)) {
+            // Tinted outputs come straight from the input, one pass each
+            const int green = count == 1 ? 0 : 1;
+            const int red = count == 1 ? 0 : 2;
             cv::Mat alpha;
-            if (channels.size() > 3) {
-                alpha = channels[3];
+            if (count == 4) {
+                cv::extractChannel(inputImage, alpha, 3);
             } else {
-                alpha = cv::Mat(inputImage.size(), CV_8UC1, cv::Scalar(255));
+                if (m_opaqueAlpha.size() != inputImage.size()) {
+                    m_opaqueAlpha = cv::Mat(inputImage.size(), CV_8UC1, cv::Scalar(255));
+                }
+                alpha = m_opaqueAlpha;
             }
-            
-            if (m_outputGrayscale) {
-                *std::static_pointer_cast<cv::Mat>(m_outputData[0]) = channels[2]; // R
-                *std::static_pointer_cast<cv::Mat>(m_outputData[1]) = channels[1]; // G
-                *std::static_pointer_cast<cv::Mat>(m_outputData[2]) = channels[0]; // B
-                *std::static_pointer_cast<cv::Mat>(m_outputData[3]) = alpha;       // A
-            } else {
-                cv::Mat red, green, blue;
-                cv::Mat zeros = cv::Mat::zeros(inputImage.size(), CV_8UC1);
-                
-                // Red channel
-                std::vector<cv::Mat> redChannels = {zeros, zeros, channels[2]};
-                cv::merge(redChannels, red);
-                
-                // Green channel
-                std::vector<cv::Mat> greenChannels = {zeros, channels[1], zeros};
-                cv::merge(greenChannels, green);
-                
-                // Blue channel
-                std::vector<cv::Mat> blueChannels = {channels[0], zeros, zeros};
-                cv::merge(blueChannels, blue);
-                
-                *std::static_pointer_cast<cv::Mat>(m_outputData[0]) = red;
-                *std::static_pointer_cast<cv::Mat>(m_outputData[1]) = green;
-                *std::static_pointer_cast<cv::Mat>(m_outputData[2]) = blue;
-                *std::static_pointer_cast<cv::Mat>(m_outputData[3]) = alpha;
+            *std::static_pointer_cast<cv::Mat>(m_outputData[0]) = isolateChannel(inputImage, red, 2);
+            *std::static_pointer_cast<cv::Mat>(m_outputData[1]) = isolateChannel(inputImage, green, 1);
+            *std::static_pointer_cast<cv::Mat>(m_outputData[2]) = isolateChannel(inputImage, 0, 0);
+            *std::static_pointer_cast<cv::Mat>(m_outputData[3]) = alpha;
+            return;
+        }
+
+        std::vector<cv::Mat> channels;
+        splitChannels(inputImage, channels);
+        
+        // If input is grayscale, share it for all channels
+        if (channels.size() == 1) {
+            channels.push_back(channels[0]);
+            channels.push_back(channels[0]);
+        }
+        
+        // Ensure we have at least 3 channels
+        while (channels.size() < 3) {
+            channels.push_back(cv::Mat::zeros(inputImage.size(), CV_8UC1));
+        }
+        
+        // Alpha channel if available; opaque images share one constant plane across passes
+        cv::Mat alpha;
+        if (channels.size() > 3) {
+            alpha = channels[3];
+        } else {
+            if (m_opaqueAlpha.size() != inputImage.size()) {
+                m_opaqueAlpha = cv::Mat(inputImage.size(), CV_8UC1, cv::Scalar(255));
             }
+            alpha = m_opaqueAlpha;
+        }
+        
+        if (m_outputGrayscale) {
+            *std::static_pointer_cast<cv::Mat>(m_outputData[0]) = channels[2]; // R
+            *std::static_pointer_cast<cv::Mat>(m_outputData[1]) = channels[1]; // G
+            *std::static_pointer_cast<cv::Mat>(m_outputData[2]) = channels[0]; // B
+            *std::static_pointer_cast<cv::Mat>(m_outputData[3]) = alpha;       // A
+        } else {
+            cv::Mat red, green, blue;
+            cv::Mat zeros = cv::Mat::zeros(inputImage.size(), CV_8UC1);
+            
+            // Red channel
+            std::vector<cv::Mat> redChannels = {zeros, zeros, channels[2]};
+            cv::merge(redChannels, red);
             
-            emit dataUpdated();
+            // Green channel
+            std::vector<cv::Mat> greenChannels = {zeros, channels[1], zeros};
+            cv::merge(greenChannels, green);
+            
+            // Blue channel
+            std::vector<cv::Mat> blueChannels = {channels[0], zeros, zeros};
+            cv::merge(blueChannels, blue);
+            
+            *std::static_pointer_cast<cv::Mat>(m_outputData[0]) = red;
+            *std::static_pointer_cast<cv::Mat>(m_outputData[1]) = green;
+            *std::static_pointer_cast<cv::Mat>(m_outputData[2]) = blue;
+            *std::static_pointer_cast<cv::Mat>(m_outputData[3]) = alpha;
         }
     }
 }
 
-std::vector<Port> ColorChannelSplitterNode::getPorts() const {
-    return {
+const std::vector<Port>& ColorChannelSplitterNode::getPorts() const {
+    static const std::vector<Port> ports = {
         {0, "Input", PortType::Input, DataType::Image},
         {1, "Red", PortType::Output, DataType::Image},
         {2, "Green", PortType::Output, DataType::Image},
         {3, "Blue", PortType::Output, DataType::Image},
         {4, "Alpha", PortType::Output, DataType::Image}
     };
+    return ports;
+}
+
+std::string ColorChannelSplitterNode::parameterKey() const {
+    return makeParameterKey({m_outputGrayscale ? 1.0 : 0.0});
+}
+
+std::vector<cv::Mat> ColorChannelSplitterNode::retainedImages() const {
+    std::vector<cv::Mat> images = outputImages();
+    images.push_back(m_opaqueAlpha);
+    return images;
 }
 
 void ColorChannelSplitterNode::setOutputGrayscale(bool grayscale) {
     m_outputGrayscale = grayscale;
-    process();
+    invalidate();
+}
+
+ColorSpaceNode::ColorSpaceNode() : m_space(ColorSpace::Linear) {
+    m_outputData.push_back(std::make_shared<cv::Mat>());
+    addParameter("Space", DataType::Integer, [this]() { return static_cast<int>(m_space); },
+                 [this](double value) { setSpace(cvRound(value)); });
+}
+
+void ColorSpaceNode::process() {
+    const ImageInfo info = inputInfo(0);
+    cv::Mat inputImage = readInput(0);
+    if (!inputImage.empty()) {
+        cv::Mat output;
+        convertColorSpace(inputImage, output, info.space, m_space);
+        *std::static_pointer_cast<cv::Mat>(m_outputData[0]) = output;
+        setOutputInfo(0, {info.opaque, false, m_space});
+    }
+}
+
+const std::vector<Port>& ColorSpaceNode::getPorts() const {
+    static const std::vector<Port> ports = {
+        {0, "Input", PortType::Input, DataType::Image},
+        {1, "Output", PortType::Output, DataType::Image}
+    };
+    return ports;
+}
+
+std::string ColorSpaceNode::parameterKey() const {
+    return makeParameterKey({static_cast<double>(m_space)});
+}
+
+void ColorSpaceNode::setSpace(int space) {
+    m_space = static_cast<ColorSpace>(std::max(0, std::min(space, kColorSpaceCount - 1)));
+    invalidate();
 }
 
 NoiseGenerationNode::NoiseGenerationNode() : 
     m_type(Perlin), m_scale(0.1f), m_octaves(4), 
     m_persistence(0.5f), m_useAsDisplacement(false) {
     m_outputData.push_back(std::make_shared<cv::Mat>());
-}
-
-// Simple Perlin noise implementation (simplified for this example)
-float NoiseGenerationNode::perlinNoise(float x, float y, float z) {
-    // This is a very basic implementation - a real implementation would be more complex
-    // and might use a proper noise library like FastNoise or similar
-    float n = x * 0.1f + y * 0.1f + z * 0.1f;
-    return std::sin(n * 10.0f) * 0.5f + 0.5f;
+    addParameter("Type", DataType::Integer, [this]() { return m_type; },
+                 [this](double value) { setNoiseType(static_cast<NoiseType>(std::clamp(cvRound(value), 0, 2))); });
+    addParameter("Scale", DataType::Scalar, [this]() { return m_scale; },
+                 [this](double value) { setScale(static_cast<float>(value)); });
+    addParameter("Octaves", DataType::Integer, [this]() { return m_octaves; },
+                 [this](double value) { setOctaves(std::max(cvRound(value), 1)); });
+    addParameter("Persistence", DataType::Scalar, [this]() { return m_persistence; },
+                 [this](double value) { setPersistence(static_cast<float>(value)); });
+    addParameter("Displacement", DataType::Boolean, [this]() { return m_useAsDisplacement; },
+                 [this](double value) { setUseAsDisplacement(value != 0.0); });
 }
 
 void NoiseGenerationNode::process() {
@@ -328,39 +798,14 @@ void NoiseGenerationNode::process() {
     const int height = 512;
     cv::Mat noise(height, width, CV_32FC1);
     
-    for (int y = 0; y < height; ++y) {
-        for (int x = 0; x < width; ++x) {
-            float value = 0.0f;
-            float amplitude = 1.0f;
-            float frequency = 1.0f;
-            
-            for (int o = 0; o < m_octaves; ++o) {
-                float nx = x * frequency * m_scale;
-                float ny = y * frequency * m_scale;
-                
-                float noiseValue = 0.0f;
-                switch (m_type) {
-                    case Perlin:
-                        noiseValue = perlinNoise(nx, ny);
-                        break;
-                    case Simplex:
-                        // Simplex would be similar but with different coordinates
-                        noiseValue = perlinNoise(nx * 0.5f, ny * 0.5f);
-                        break;
-                    case Worley:
-                        // Worley noise would need a different implementation
-                        noiseValue = std::fmod(nx * 0.1f + ny * 0.1f, 1.0f);
-                        break;
-                }
-                
-                value += noiseValue * amplitude;
-                amplitude *= m_persistence;
-                frequency *= 2.0f;
-            }
-            
-            noise.at<float>(y, x) = value;
+    // The pattern is evaluated a row at a time by the dispatched kernel
+    const NoiseRowParameters parameters = {static_cast<int>(m_type), m_scale, m_octaves, m_persistence};
+    const KernelTable& table = kernels();
+    cv::parallel_for_(cv::Range(0, height), [&](const cv::Range& range) {
+        for (int y = range.start; y < range.end; ++y) {
+            table.noiseRow(noise.ptr<float>(y), width, y, parameters);
         }
-    }
+    });
     
     // Normalize to 0-1 range
     cv::normalize(noise, noise, 0.0f, 1.0f, cv::NORM_MINMAX);
@@ -376,39 +821,43 @@ void NoiseGenerationNode::process() {
         noise.convertTo(output, CV_8UC1, 255.0f);
         *std::static_pointer_cast<cv::Mat>(m_outputData[0]) = output;
     }
-    
-    emit dataUpdated();
 }
 
-std::vector<Port> NoiseGenerationNode::getPorts() const {
-    return {
+const std::vector<Port>& NoiseGenerationNode::getPorts() const {
+    static const std::vector<Port> ports = {
         {0, "Output", PortType::Output, DataType::Image}
     };
+    return ports;
+}
+
+std::string NoiseGenerationNode::parameterKey() const {
+    return makeParameterKey({static_cast<double>(m_type), m_scale, static_cast<double>(m_octaves),
+                             m_persistence, m_useAsDisplacement ? 1.0 : 0.0});
 }
 
 void NoiseGenerationNode::setNoiseType(NoiseType type) {
     m_type = type;
-    process();
+    invalidate();
 }
 
 void NoiseGenerationNode::setScale(float scale) {
     m_scale = scale;
-    process();
+    invalidate();
 }
 
 void NoiseGenerationNode::setOctaves(int octaves) {
     m_octaves = octaves;
-    process();
+    invalidate();
 }
 
 void NoiseGenerationNode::setPersistence(float persistence) {
     m_persistence = persistence;
-    process();
+    invalidate();
 }
 
 void NoiseGenerationNode::setUseAsDisplacement(bool useAsDisplacement) {
     m_useAsDisplacement = useAsDisplacement;
-    process();
+    invalidate();
 }
 
 ConvolutionFilterNode::ConvolutionFilterNode() : m_kernelSize(3) {
@@ -419,50 +868,114 @@ ConvolutionFilterNode::ConvolutionFilterNode() : m_kernelSize(3) {
     m_outputData.push_back(std::make_shared<cv::Mat>());
 }
 
-void ConvolutionFilterNode::applyKernel(const cv::Mat& input, cv::Mat& output) {
+cv::Mat ConvolutionFilterNode::kernelMatrix() const {
     cv::Mat kernel(m_kernelSize, m_kernelSize, CV_32F);
     for (int i = 0; i < m_kernelSize; ++i) {
         for (int j = 0; j < m_kernelSize; ++j) {
             kernel.at<float>(i, j) = m_kernel[i][j];
         }
     }
-    
-    cv::filter2D(input, output, -1, kernel, cv::Point(-1, -1), 0, cv::BORDER_DEFAULT);
+    return kernel;
+}
+
+void ConvolutionFilterNode::applyKernel(const cv::Mat& kernel, const cv::Mat& input, cv::Mat& output) {
+    // Larger kernels, as fused chains can produce, are faster through the DFT
+    if (input.depth() != CV_8U || kernel.rows > 9 || kernel.rows != kernel.cols) {
+        cv::filter2D(input, output, -1, kernel, cv::Point(-1, -1), 0, cv::BORDER_DEFAULT);
+        return;
+    }
+    const int radius = kernel.rows / 2;
+    cv::Mat weights;
+    kernel.convertTo(weights, CV_32F);
+    cv::Mat padded;
+    cv::copyMakeBorder(input, padded, radius, radius, radius, radius, cv::BORDER_DEFAULT);
+    output.create(input.size(), input.type());
+    const KernelTable& table = kernels();
+    cv::parallel_for_(cv::Range(0, output.rows), [&](const cv::Range& range) {
+        std::vector<const uchar*> rows(kernel.rows);
+        for (int y = range.start; y < range.end; ++y) {
+            for (int ky = 0; ky < kernel.rows; ++ky) {
+                rows[ky] = padded.ptr<uchar>(y + ky);
+            }
+            table.convolveRow(rows.data(), output.ptr<uchar>(y), output.cols, output.channels(),
+                              weights.ptr<float>(), kernel.rows);
+        }
+    });
 }
 
 void ConvolutionFilterNode::process() {
-    auto inputData = getInputData(0);
-    if (inputData) {
-        auto inputImage = *std::static_pointer_cast<cv::Mat>(inputData);
-        if (!inputImage.empty()) {
-            cv::Mat output;
-            applyKernel(inputImage, output);
-            *std::static_pointer_cast<cv::Mat>(m_outputData[0]) = output;
-            emit dataUpdated();
+    // A linear filter, so like blur it runs on premultiplied alpha
+    const ImageInfo info = inputInfo(0);
+    cv::Mat inputImage = readInput(0, info.hasAlpha());
+    if (!inputImage.empty()) {
+        cv::Mat output;
+        applyKernel(kernelMatrix(), inputImage, output);
+        *std::static_pointer_cast<cv::Mat>(m_outputData[0]) = output;
+        setOutputInfo(0, {info.opaque, info.hasAlpha()});
+    }
+}
+
+void ConvolutionFilterNode::processBatch(const std::vector<ImageBatch>& inputs, std::vector<ImageBatch>& outputs) {
+    const ImageBatch& frames = firstInput(inputs);
+    const cv::Mat kernel = kernelMatrix();
+    outputs.assign(1, ImageBatch(frames.size()));
+    for (size_t i = 0; i < frames.size(); ++i) {
+        if (frames[i].type() == CV_8UC4) {
+            cv::Mat premultiplied;
+            premultiplyAlpha(frames[i], premultiplied);
+            applyKernel(kernel, premultiplied, premultiplied);
+            unpremultiplyAlpha(premultiplied, outputs[0][i]);
+        } else if (!frames[i].empty()) {
+            applyKernel(kernel, frames[i], outputs[0][i]);
         }
     }
 }
 
-std::vector<Port> ConvolutionFilterNode::getPorts() const {
-    return {
+const std::vector<Port>& ConvolutionFilterNode::getPorts() const {
+    static const std::vector<Port> ports = {
         {0, "Input", PortType::Input, DataType::Image},
         {1, "Output", PortType::Output, DataType::Image}
     };
+    return ports;
+}
+
+std::string ConvolutionFilterNode::parameterKey() const {
+    std::string key = makeParameterKey({static_cast<double>(m_kernelSize)});
+    for (const auto& row : m_kernel) {
+        for (float value : row) {
+            key += makeParameterKey({value});
+        }
+    }
+    return key;
+}
+
+std::function<void(Node&)> ConvolutionFilterNode::captureState() const {
+    const int size = m_kernelSize;
+    const std::vector<std::vector<float>> kernel = m_kernel;
+    return [size, kernel](Node& node) {
+        auto& filter = static_cast<ConvolutionFilterNode&>(node);
+        filter.setKernelSize(size);
+        for (int row = 0; row < size; ++row) {
+            for (int col = 0; col < size; ++col) {
+                filter.setKernelValue(row, col, kernel[row][col]);
+            }
+        }
+    };
 }
 
 void ConvolutionFilterNode::setKernelSize(int size) {
     if (size % 2 == 1 && size >= 3 && size <= 5) { // Only odd sizes 3x3 or 5x5
         m_kernelSize = size;
-        m_kernel.resize(m_kernelSize, std::vector<float>(m_kernelSize, 0.0f));
+        m_kernel.assign(m_kernelSize, std::vector<float>(m_kernelSize, 0.0f));
         m_kernel[m_kernelSize/2][m_kernelSize/2] = 1.0f; // Reset to identity
-        process();
+        invalidate();
     }
 }
 
 void ConvolutionFilterNode::setKernelValue(int row, int col, float value) {
     if (row >= 0 && row < m_kernelSize && col >= 0 && col < m_kernelSize) {
         m_kernel[row][col] = value;
-        process();
+        invalidate();
     }
 }
 
@@ -533,5 +1046,695 @@ void ConvolutionFilterNode::setPreset(int preset) {
             break;
     }
     
-    process();
-}
\ No newline at end of file
+    invalidate();
+}
+
+CompositeNode::CompositeNode() {
+    m_outputData.push_back(std::make_shared<cv::Mat>());
+    m_layers.resize(2);
+    rebuildPorts();
+}
+
+void CompositeNode::rebuildPorts() {
+    m_ports.clear();
+    m_ports.push_back({0, "Output", PortType::Output, DataType::Image});
+    for (size_t i = 0; i < m_layers.size(); ++i) {
+        const std::string label = i == 0 ? std::string("Base") : "Layer " + std::to_string(i);
+        m_ports.push_back({static_cast<int>(m_ports.size()), label, PortType::Input, DataType::Image});
+        m_ports.push_back({static_cast<int>(m_ports.size()), label + " Mask", PortType::Input, DataType::Image});
+    }
+    clearParameters();
+    addParameter("Base Opacity", DataType::Scalar, [this]() { return m_layers[0].opacity; },
+                 [this](double value) { setLayerOpacity(0, static_cast<float>(value)); });
+    for (int i = 1; i < layerCount(); ++i) {
+        const std::string label = "Layer " + std::to_string(i);
+        addParameter(label + " Mode", DataType::Integer, [this, i]() { return static_cast<int>(m_layers[i].mode); },
+                     [this, i](double value) {
+                         setLayerMode(i, static_cast<BlendMode>(std::clamp(cvRound(value), 0, static_cast<int>(BlendMode::HardLight))));
+                     });
+        addParameter(label + " Opacity", DataType::Scalar, [this, i]() { return m_layers[i].opacity; },
+                     [this, i](double value) { setLayerOpacity(i, static_cast<float>(value)); });
+    }
+    invalidateLayout();
+}
+
+void CompositeNode::process() {
+    const cv::Mat baseImage = readInput(1);
+    if (baseImage.empty()) {
+        return;
+    }
+
+    // Gather the visible layers first; their alpha decides the working channel count
+    std::vector<cv::Mat> images(m_layers.size());
+    bool anyLayerAlpha = false;
+    for (size_t i = 1; i < m_layers.size(); ++i) {
+        const int port = 1 + 2 * static_cast<int>(i);
+        if (m_layers[i].opacity > 0.0f) {
+            images[i] = readInput(port);
+            anyLayerAlpha |= images[i].channels() == 4 && !inputInfo(port).opaque;
+        }
+    }
+
+    // The base is drawn over nothing, so only its mask and opacity apply
+    const cv::Size size = baseImage.size();
+    const float baseOpacity = std::clamp(m_layers[0].opacity, 0.0f, 1.0f);
+    const cv::Mat* baseMask = nullptr;
+    if (auto maskData = getInputData(2)) {
+        const cv::Mat& maskImage = *std::static_pointer_cast<cv::Mat>(maskData);
+        if (!maskImage.empty()) {
+            baseMask = &m_layers[0].mask.prepare(maskImage, size, CV_8UC1);
+        }
+    }
+    const bool baseCovered = baseMask || baseOpacity < 1.0f;
+    const bool baseAlpha = (baseImage.channels() == 4 && !inputInfo(1).opaque) || baseCovered;
+    const int channels = workingChannels(baseImage, baseAlpha, anyLayerAlpha);
+    const int outChannels = baseImage.channels() == 4 || baseCovered ? 4 : (channels != 4 ? baseImage.channels() : 3);
+    const int type = CV_8UC(channels);
+    const cv::Mat& base = m_layers[0].image.prepare(baseImage, size, type);
+
+    std::vector<CompositeLayer> layers;
+    for (size_t i = 1; i < m_layers.size(); ++i) {
+        Layer& layer = m_layers[i];
+        if (images[i].empty()) {
+            continue;
+        }
+        const cv::Mat* mask = nullptr;
+        if (auto maskData = getInputData(2 + 2 * static_cast<int>(i))) {
+            const cv::Mat& maskImage = *std::static_pointer_cast<cv::Mat>(maskData);
+            if (!maskImage.empty()) {
+                mask = &layer.mask.prepare(maskImage, size, CV_8UC1);
+            }
+        }
+        // Layers blend in the base's color space, which the output keeps
+        const ImageInfo info = inputInfo(1 + 2 * static_cast<int>(i));
+        const bool layerAlpha = images[i].channels() == 4 && !info.opaque;
+        layers.push_back({&layer.image.prepare(images[i], size, type, info.space, inputInfo(1).space), mask,
+                          layer.mode, std::min(layer.opacity, 1.0f), layerAlpha});
+    }
+
+    cv::Mat output;
+    compositeLayers(base, baseAlpha, baseMask, baseOpacity, layers, outChannels, output);
+    *std::static_pointer_cast<cv::Mat>(m_outputData[0]) = output;
+    setOutputInfo(0, {!baseAlpha, false});
+}
+
+std::string CompositeNode::parameterKey() const {
+    std::string key = std::to_string(m_layers.size()) + ';';
+    for (const auto& layer : m_layers) {
+        key += makeParameterKey({static_cast<double>(layer.mode), layer.opacity});
+    }
+    return key;
+}
+
+void CompositeNode::discardInputCaches() {
+    for (auto& layer : m_layers) {
+        layer.image = PreparedInput();
+        layer.mask = PreparedInput();
+    }
+}
+
+std::function<void(Node&)> CompositeNode::captureState() const {
+    const int count = layerCount();
+    return [count](Node& node) { static_cast<CompositeNode&>(node).setLayerCount(count); };
+}
+
+void CompositeNode::setLayerCount(int count) {
+    count = std::max(count, 1);
+    if (count == layerCount()) {
+        return;
+    }
+    // Drop connections to ports that no longer exist or change meaning; the
+    // parameter ports follow the layer ports and move with them
+    for (int port = 1 + 2 * std::min(count, layerCount()); port < static_cast<int>(m_inputConnections.size()); ++port) {
+        removeInputConnection(port);
+    }
+    m_layers.resize(count);
+    rebuildPorts();
+    invalidate();
+}
+
+void CompositeNode::setLayerMode(int layer, BlendMode mode) {
+    // The base has nothing beneath it to blend with
+    if (layer > 0 && layer < layerCount()) {
+        m_layers[layer].mode = mode;
+        invalidate();
+    }
+}
+
+void CompositeNode::setLayerOpacity(int layer, float opacity) {
+    if (layer >= 0 && layer < layerCount()) {
+        m_layers[layer].opacity = opacity;
+        invalidate();
+    }
+}
+
+MorphologyNode::MorphologyNode() : m_operation(Open), m_shape(Rectangle), m_radius(2) {
+    m_outputData.push_back(std::make_shared<cv::Mat>());
+    addParameter("Operation", DataType::Integer, [this]() { return m_operation; },
+                 [this](double value) { setOperation(std::clamp(cvRound(value), 0, static_cast<int>(Gradient))); });
+    addParameter("Shape", DataType::Integer, [this]() { return m_shape; },
+                 [this](double value) { setShape(std::clamp(cvRound(value), 0, static_cast<int>(Ellipse))); });
+    addParameter("Radius", DataType::Integer, [this]() { return m_radius; },
+                 [this](double value) { setRadius(cvRound(value)); });
+}
+
+void MorphologyNode::process() {
+    cv::Mat inputImage = readInput(0);
+    if (inputImage.empty()) {
+        return;
+    }
+    cv::Mat output, other;
+    switch (m_operation) {
+        case Erode:
+            minMax(inputImage, output, false);
+            break;
+        case Dilate:
+            minMax(inputImage, output, true);
+            break;
+        case Open:
+            minMax(inputImage, other, false);
+            minMax(other, output, true);
+            break;
+        case Close:
+            minMax(inputImage, other, true);
+            minMax(other, output, false);
+            break;
+        case Gradient:
+            minMax(inputImage, other, true);
+            minMax(inputImage, output, false);
+            cv::subtract(other, output, output);
+            break;
+        default:
+            output = inputImage;
+            break;
+    }
+    *std::static_pointer_cast<cv::Mat>(m_outputData[0]) = output;
+    setOutputInfo(0, {inputInfo(0).opaque, false});
+}
+
+void MorphologyNode::minMax(const cv::Mat& input, cv::Mat& output, bool maximum) const {
+    const int size = 2 * m_radius + 1;
+    switch (m_shape) {
+        case HorizontalLine:
+            minMaxFilter(input, output, cv::Size(size, 1), maximum);
+            break;
+        case VerticalLine:
+            minMaxFilter(input, output, cv::Size(1, size), maximum);
+            break;
+        case Ellipse: {
+            cv::Mat element = cv::getStructuringElement(cv::MORPH_ELLIPSE, cv::Size(size, size));
+            if (maximum) {
+                cv::dilate(input, output, element);
+            } else {
+                cv::erode(input, output, element);
+            }
+            break;
+        }
+        default:
+            minMaxFilter(input, output, cv::Size(size, size), maximum);
+            break;
+    }
+}
+
+const std::vector<Port>& MorphologyNode::getPorts() const {
+    static const std::vector<Port> ports = {
+        {0, "Input", PortType::Input, DataType::Image},
+        {1, "Output", PortType::Output, DataType::Image}
+    };
+    return ports;
+}
+
+std::string MorphologyNode::parameterKey() const {
+    return makeParameterKey({static_cast<double>(m_operation), static_cast<double>(m_shape),
+                             static_cast<double>(m_radius)});
+}
+
+int MorphologyNode::damageMargin() const {
+    // Opening and closing apply the structuring element twice
+    return m_operation == Open || m_operation == Close ? 2 * m_radius : m_radius;
+}
+
+void MorphologyNode::setOperation(int operation) {
+    m_operation = operation;
+    invalidate();
+}
+
+void MorphologyNode::setShape(int shape) {
+    m_shape = shape;
+    invalidate();
+}
+
+void MorphologyNode::setRadius(int radius) {
+    m_radius = std::max(radius, 0);
+    invalidate();
+}
+
+MedianNode::MedianNode() : m_radius(2) {
+    m_outputData.push_back(std::make_shared<cv::Mat>());
+    addParameter("Radius", DataType::Integer, [this]() { return m_radius; },
+                 [this](double value) { setRadius(cvRound(value)); });
+}
+
+void MedianNode::process() {
+    cv::Mat inputImage = readInput(0);
+    if (!inputImage.empty()) {
+        cv::Mat output;
+        medianFilter(inputImage, output, m_radius);
+        *std::static_pointer_cast<cv::Mat>(m_outputData[0]) = output;
+        setOutputInfo(0, {inputInfo(0).opaque, false});
+    }
+}
+
+const std::vector<Port>& MedianNode::getPorts() const {
+    static const std::vector<Port> ports = {
+        {0, "Input", PortType::Input, DataType::Image},
+        {1, "Output", PortType::Output, DataType::Image}
+    };
+    return ports;
+}
+
+std::string MedianNode::parameterKey() const {
+    return makeParameterKey({static_cast<double>(m_radius)});
+}
+
+void MedianNode::setRadius(int radius) {
+    m_radius = std::max(radius, 0);
+    invalidate();
+}
+
+GeometricNode::GeometricNode() : m_interpolation(Interpolation::Linear) {
+    m_outputData.push_back(std::make_shared<cv::Mat>());
+    addParameter("Interpolation", DataType::Integer, [this]() { return static_cast<int>(m_interpolation); },
+                 [this](double value) { setInterpolation(cvRound(value)); });
+}
+
+void GeometricNode::process() {
+    // Resampling is filtering, so it runs on premultiplied alpha
+    const ImageInfo info = inputInfo(0);
+    cv::Mat inputImage = readInput(0, info.hasAlpha());
+    if (!inputImage.empty()) {
+        cv::Mat output;
+        resample(inputImage, output, transform(inputImage.size()), outputSize(inputImage.size()),
+                 m_interpolation, &m_remapTable);
+        *std::static_pointer_cast<cv::Mat>(m_outputData[0]) = output;
+        setOutputInfo(0, {info.opaque, info.hasAlpha()});
+    }
+}
+
+const std::vector<Port>& GeometricNode::getPorts() const {
+    static const std::vector<Port> ports = {
+        {0, "Input", PortType::Input, DataType::Image},
+        {1, "Output", PortType::Output, DataType::Image}
+    };
+    return ports;
+}
+
+std::vector<cv::Mat> GeometricNode::retainedImages() const {
+    std::vector<cv::Mat> images = outputImages();
+    for (const cv::Mat& table : m_remapTable.buffers()) {
+        images.push_back(table);
+    }
+    return images;
+}
+
+bool GeometricNode::isLossless(cv::Size inputSize) const {
+    // Only flips, quarter turns and whole-pixel shifts: anything that
+    // interpolates, even a scale a later member undoes, changes the pixels
+    const cv::Matx33d m = transform(inputSize);
+    if (std::abs(m(2, 0)) > 1e-12 || std::abs(m(2, 1)) > 1e-12 || std::abs(m(2, 2) - 1.0) > 1e-12) {
+        return false;
+    }
+    int a[2][2];
+    for (int row = 0; row < 2; ++row) {
+        for (int col = 0; col < 3; ++col) {
+            if (std::abs(m(row, col) - std::round(m(row, col))) > 1e-9) {
+                return false;
+            }
+            if (col < 2) {
+                a[row][col] = cvRound(m(row, col));
+            }
+        }
+    }
+    if (std::abs(a[0][0]) + std::abs(a[0][1]) != 1 || std::abs(a[1][0]) + std::abs(a[1][1]) != 1 ||
+        a[0][0] * a[1][1] - a[0][1] * a[1][0] == 0) {
+        return false;
+    }
+    // Every input corner must land in the output
+    const cv::Size size = outputSize(inputSize);
+    const double corners[4][2] = {{0.0, 0.0}, {inputSize.width - 1.0, 0.0},
+                                  {0.0, inputSize.height - 1.0}, {inputSize.width - 1.0, inputSize.height - 1.0}};
+    for (const auto& corner : corners) {
+        const double x = m(0, 0) * corner[0] + m(0, 1) * corner[1] + m(0, 2);
+        const double y = m(1, 0) * corner[0] + m(1, 1) * corner[1] + m(1, 2);
+        if (x < -0.5 || y < -0.5 || x > size.width - 0.5 || y > size.height - 0.5) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void GeometricNode::setInterpolation(int interpolation) {
+    m_interpolation = static_cast<Interpolation>(std::clamp(interpolation, 0, 2));
+    invalidate();
+}
+
+ResizeNode::ResizeNode() : m_scale(0.5f), m_width(0), m_height(0) {
+    addParameter("Scale", DataType::Scalar, [this]() { return m_scale; },
+                 [this](double value) { setScale(static_cast<float>(value)); });
+    addParameter("Width", DataType::Integer, [this]() { return m_width; },
+                 [this](double value) { setSize(cvRound(value), m_height); });
+    addParameter("Height", DataType::Integer, [this]() { return m_height; },
+                 [this](double value) { setSize(m_width, cvRound(value)); });
+}
+
+std::string ResizeNode::parameterKey() const {
+    return makeParameterKey({m_scale, static_cast<double>(m_width), static_cast<double>(m_height),
+                             static_cast<double>(m_interpolation)});
+}
+
+cv::Matx33d ResizeNode::transform(cv::Size inputSize) const {
+    const cv::Size size = outputSize(inputSize);
+    const double sx = static_cast<double>(size.width) / inputSize.width;
+    const double sy = static_cast<double>(size.height) / inputSize.height;
+    // Pixel centres: x maps to sx * (x + 0.5) - 0.5
+    return cv::Matx33d(sx, 0.0, 0.5 * (sx - 1.0),
+                       0.0, sy, 0.5 * (sy - 1.0),
+                       0.0, 0.0, 1.0);
+}
+
+cv::Size ResizeNode::outputSize(cv::Size inputSize) const {
+    int width = m_width;
+    int height = m_height;
+    if (width <= 0 && height <= 0) {
+        width = cvRound(inputSize.width * m_scale);
+        height = cvRound(inputSize.height * m_scale);
+    } else if (width <= 0) {
+        width = cvRound(static_cast<double>(inputSize.width) * height / inputSize.height);
+    } else if (height <= 0) {
+        height = cvRound(static_cast<double>(inputSize.height) * width / inputSize.width);
+    }
+    return cv::Size(std::max(width, 1), std::max(height, 1));
+}
+
+void ResizeNode::setScale(float scale) {
+    m_scale = std::max(scale, 1e-3f);
+    invalidate();
+}
+
+void ResizeNode::setSize(int width, int height) {
+    m_width = std::max(width, 0);
+    m_height = std::max(height, 0);
+    invalidate();
+}
+
+WarpNode::WarpNode() : m_angle(0.0f), m_scale(1.0f), m_translateX(0.0f), m_translateY(0.0f), m_tiltX(0.0f), m_tiltY(0.0f) {
+    addParameter("Angle", DataType::Scalar, [this]() { return m_angle; },
+                 [this](double value) { setAngle(static_cast<float>(value)); });
+    addParameter("Scale", DataType::Scalar, [this]() { return m_scale; },
+                 [this](double value) { setScale(static_cast<float>(value)); });
+    addParameter("Translate X", DataType::Scalar, [this]() { return m_translateX; },
+                 [this](double value) { setTranslation(static_cast<float>(value), m_translateY); });
+    addParameter("Translate Y", DataType::Scalar, [this]() { return m_translateY; },
+                 [this](double value) { setTranslation(m_translateX, static_cast<float>(value)); });
+    addParameter("Tilt X", DataType::Scalar, [this]() { return m_tiltX; },
+                 [this](double value) { setTilt(static_cast<float>(value), m_tiltY); });
+    addParameter("Tilt Y", DataType::Scalar, [this]() { return m_tiltY; },
+                 [this](double value) { setTilt(m_tiltX, static_cast<float>(value)); });
+}
+
+std::string WarpNode::parameterKey() const {
+    return makeParameterKey({m_angle, m_scale, m_translateX, m_translateY, m_tiltX, m_tiltY,
+                             static_cast<double>(m_interpolation)});
+}
+
+cv::Matx33d WarpNode::transform(cv::Size inputSize) const {
+    const double cx = (inputSize.width - 1) * 0.5;
+    const double cy = (inputSize.height - 1) * 0.5;
+    const double radians = m_angle * CV_PI / 180.0;
+    const double a = m_scale * std::cos(radians);
+    const double b = m_scale * std::sin(radians);
+    // Same rotation sense as cv::getRotationMatrix2D: positive is counter-clockwise
+    const cv::Matx33d centred(a, b, 0.0,
+                              -b, a, 0.0,
+                              m_tiltX, m_tiltY, 1.0);
+    const cv::Matx33d toCentre(1.0, 0.0, -cx, 0.0, 1.0, -cy, 0.0, 0.0, 1.0);
+    const cv::Matx33d back(1.0, 0.0, cx + m_translateX, 0.0, 1.0, cy + m_translateY, 0.0, 0.0, 1.0);
+    return back * centred * toCentre;
+}
+
+void WarpNode::setAngle(float degrees) {
+    m_angle = degrees;
+    invalidate();
+}
+
+void WarpNode::setScale(float scale) {
+    m_scale = std::max(scale, 1e-3f);
+    invalidate();
+}
+
+void WarpNode::setTranslation(float x, float y) {
+    m_translateX = x;
+    m_translateY = y;
+    invalidate();
+}
+
+void WarpNode::setTilt(float x, float y) {
+    m_tiltX = x;
+    m_tiltY = y;
+    invalidate();
+}
+
+CropNode::CropNode() : m_rect(0, 0, 0, 0) {
+    addParameter("X", DataType::Integer, [this]() { return m_rect.x; },
+                 [this](double value) { setRect(cvRound(value), m_rect.y, m_rect.width, m_rect.height); });
+    addParameter("Y", DataType::Integer, [this]() { return m_rect.y; },
+                 [this](double value) { setRect(m_rect.x, cvRound(value), m_rect.width, m_rect.height); });
+    addParameter("Width", DataType::Integer, [this]() { return m_rect.width; },
+                 [this](double value) { setRect(m_rect.x, m_rect.y, cvRound(value), m_rect.height); });
+    addParameter("Height", DataType::Integer, [this]() { return m_rect.height; },
+                 [this](double value) { setRect(m_rect.x, m_rect.y, m_rect.width, cvRound(value)); });
+}
+
+void CropNode::process() {
+    // Passes the input through as is, premultiplied or not
+    auto data = getInputData(0);
+    if (!data) {
+        return;
+    }
+    const cv::Mat& inputImage = *std::static_pointer_cast<cv::Mat>(data);
+    if (inputImage.empty()) {
+        return;
+    }
+    const cv::Rect rect = clippedRect(inputImage.size());
+    *std::static_pointer_cast<cv::Mat>(m_outputData[0]) = rect.empty() ? cv::Mat() : inputImage(rect);
+    setOutputInfo(0, inputInfo(0));
+}
+
+std::string CropNode::parameterKey() const {
+    return makeParameterKey({static_cast<double>(m_rect.x), static_cast<double>(m_rect.y),
+                             static_cast<double>(m_rect.width), static_cast<double>(m_rect.height)});
+}
+
+cv::Matx33d CropNode::transform(cv::Size inputSize) const {
+    const cv::Rect rect = clippedRect(inputSize);
+    return cv::Matx33d(1.0, 0.0, -rect.x, 0.0, 1.0, -rect.y, 0.0, 0.0, 1.0);
+}
+
+cv::Size CropNode::outputSize(cv::Size inputSize) const {
+    return clippedRect(inputSize).size();
+}
+
+cv::Rect CropNode::clippedRect(cv::Size inputSize) const {
+    // Zero width or height reaches the input's far edge
+    cv::Rect rect = m_rect;
+    if (rect.width <= 0) {
+        rect.width = inputSize.width - rect.x;
+    }
+    if (rect.height <= 0) {
+        rect.height = inputSize.height - rect.y;
+    }
+    return rect & cv::Rect(cv::Point(0, 0), inputSize);
+}
+
+void CropNode::setRect(int x, int y, int width, int height) {
+    m_rect = cv::Rect(x, y, width, height);
+    invalidate();
+}
+
+DisplacementNode::DisplacementNode() : m_strength(10.0f), m_interpolation(Interpolation::Linear) {
+    m_outputData.push_back(std::make_shared<cv::Mat>());
+    addParameter("Strength", DataType::Scalar, [this]() { return m_strength; },
+                 [this](double value) { setStrength(static_cast<float>(value)); });
+    addParameter("Interpolation", DataType::Integer, [this]() { return static_cast<int>(m_interpolation); },
+                 [this](double value) { setInterpolation(cvRound(value)); });
+}
+
+void DisplacementNode::process() {
+    const ImageInfo info = inputInfo(0);
+    cv::Mat inputImage = readInput(0, info.hasAlpha());
+    if (inputImage.empty()) {
+        return;
+    }
+    cv::Mat map = readInput(1);
+    if (map.empty()) {
+        *std::static_pointer_cast<cv::Mat>(m_outputData[0]) = inputImage;
+        setOutputInfo(0, {info.opaque, info.hasAlpha()});
+        return;
+    }
+
+    // Holding the map header keeps its buffer alive, so an equal pointer means an equal map
+    if (map.data != m_mapSource.data || map.size() != m_mapSource.size() || map.type() != m_mapSource.type() ||
+        inputImage.size() != m_tableSize || m_strength != m_tableStrength || m_interpolation != m_tableInterpolation) {
+        const double range = map.depth() == CV_8U ? 255.0 : (map.depth() == CV_16U ? 65535.0 : 1.0);
+        cv::Mat values;
+        map.convertTo(values, CV_32F, 1.0 / range);
+        if (values.size() != inputImage.size()) {
+            cv::resize(values, values, inputImage.size(), 0, 0, cv::INTER_LINEAR);
+        }
+        std::vector<cv::Mat> planes;
+        cv::split(values, planes);
+        const cv::Mat& dx = planes.size() >= 3 ? planes[2] : planes[0];
+        const cv::Mat& dy = planes.size() >= 2 ? planes[1] : planes[0];
+
+        const float gain = 2.0f * m_strength;
+        cv::Mat coordinates(inputImage.size(), CV_32FC2);
+        cv::parallel_for_(cv::Range(0, coordinates.rows), [&](const cv::Range& range) {
+            for (int y = range.start; y < range.end; ++y) {
+                const float* sx = dx.ptr<float>(y);
+                const float* sy = dy.ptr<float>(y);
+                cv::Vec2f* row = coordinates.ptr<cv::Vec2f>(y);
+                for (int x = 0; x < coordinates.cols; ++x) {
+                    row[x] = cv::Vec2f(x + (sx[x] - 0.5f) * gain, y + (sy[x] - 0.5f) * gain);
+                }
+            }
+        });
+        m_remapTable.assign(coordinates, m_interpolation);
+        m_mapSource = map;
+        m_tableSize = inputImage.size();
+        m_tableStrength = m_strength;
+        m_tableInterpolation = m_interpolation;
+    }
+
+    cv::Mat output;
+    m_remapTable.apply(inputImage, output, cv::BORDER_REPLICATE);
+    *std::static_pointer_cast<cv::Mat>(m_outputData[0]) = output;
+    setOutputInfo(0, {info.opaque, info.hasAlpha()});
+}
+
+const std::vector<Port>& DisplacementNode::getPorts() const {
+    static const std::vector<Port> ports = {
+        {0, "Image", PortType::Input, DataType::Image},
+        {1, "Map", PortType::Input, DataType::Image},
+        {2, "Output", PortType::Output, DataType::Image}
+    };
+    return ports;
+}
+
+std::string DisplacementNode::parameterKey() const {
+    return makeParameterKey({m_strength, static_cast<double>(m_interpolation)});
+}
+
+std::vector<cv::Mat> DisplacementNode::retainedImages() const {
+    std::vector<cv::Mat> images = outputImages();
+    images.push_back(m_mapSource);
+    for (const cv::Mat& table : m_remapTable.buffers()) {
+        images.push_back(table);
+    }
+    return images;
+}
+
+void DisplacementNode::setStrength(float pixels) {
+    m_strength = pixels;
+    invalidate();
+}
+
+void DisplacementNode::setInterpolation(int interpolation) {
+    m_interpolation = static_cast<Interpolation>(std::clamp(interpolation, 0, 2));
+    invalidate();
+}
+
+StatisticsNode::StatisticsNode() : m_channel(Luma), m_lowPercentile(1.0f), m_highPercentile(99.0f) {
+    for (int i = 0; i < 10; ++i) {
+        m_outputData.push_back(std::make_shared<cv::Mat>());
+    }
+    addParameter("Channel", DataType::Integer, [this]() { return m_channel; },
+                 [this](double value) { setChannel(std::clamp(cvRound(value), 0, static_cast<int>(Alpha))); });
+    addParameter("Low Percentile", DataType::Scalar, [this]() { return m_lowPercentile; },
+                 [this](double value) { setPercentiles(static_cast<float>(value), m_highPercentile); });
+    addParameter("High Percentile", DataType::Scalar, [this]() { return m_highPercentile; },
+                 [this](double value) { setPercentiles(m_lowPercentile, static_cast<float>(value)); });
+}
+
+void StatisticsNode::process() {
+    cv::Mat inputImage = readInput(0);
+    if (inputImage.empty()) {
+        return;
+    }
+    if (inputImage.depth() != CV_8U) {
+        toFullRange8U(inputImage, inputImage);
+    }
+
+    // Everything below comes from this one histogram
+    static const int channels[] = {static_cast<int>(StatisticsChannel::Luma),
+                                   static_cast<int>(StatisticsChannel::AllChannels), 0, 1, 2, 3};
+    Histogram256 histogram;
+    accumulateHistogram(inputImage, channels[std::clamp(m_channel, 0, 5)], histogram);
+
+    // A 256 x 128 plot, each bar scaled to the fullest bin
+    cv::Mat plot = cv::Mat::zeros(128, 256, CV_8UC1);
+    const uint64_t peak = *std::max_element(histogram.counts.begin(), histogram.counts.end());
+    if (peak > 0) {
+        for (int i = 0; i < 256; ++i) {
+            const int height = static_cast<int>(histogram.counts[i] * 128 / peak);
+            if (height > 0) {
+                plot(cv::Rect(i, 128 - height, 1, height)).setTo(255);
+            }
+        }
+    }
+    *std::static_pointer_cast<cv::Mat>(m_outputData[0]) = plot;
+
+    const double low = histogram.percentile(m_lowPercentile / 100.0);
+    const double high = histogram.percentile(m_highPercentile / 100.0);
+    const double gain = high > low ? 255.0 / (high - low) : 1.0;
+    setOutputScalar(1, histogram.min());
+    setOutputScalar(2, histogram.max());
+    setOutputScalar(3, histogram.mean());
+    setOutputScalar(4, histogram.standardDeviation());
+    setOutputScalar(5, histogram.percentile(0.5));
+    setOutputScalar(6, low);
+    setOutputScalar(7, high);
+    setOutputScalar(8, gain);
+    setOutputScalar(9, high > low ? -low * gain : 0.0);
+}
+
+const std::vector<Port>& StatisticsNode::getPorts() const {
+    static const std::vector<Port> ports = {
+        {0, "Input", PortType::Input, DataType::Image},
+        {1, "Histogram", PortType::Output, DataType::Image},
+        {2, "Min", PortType::Output, DataType::Scalar},
+        {3, "Max", PortType::Output, DataType::Scalar},
+        {4, "Mean", PortType::Output, DataType::Scalar},
+        {5, "StdDev", PortType::Output, DataType::Scalar},
+        {6, "Median", PortType::Output, DataType::Scalar},
+        {7, "Low", PortType::Output, DataType::Scalar},
+        {8, "High", PortType::Output, DataType::Scalar},
+        {9, "Levels Gain", PortType::Output, DataType::Scalar},
+        {10, "Levels Offset", PortType::Output, DataType::Scalar}
+    };
+    return ports;
+}
+
+std::string StatisticsNode::parameterKey() const {
+    return makeParameterKey({static_cast<double>(m_channel), m_lowPercentile, m_highPercentile});
+}
+
+void StatisticsNode::setChannel(int channel) {
+    m_channel = channel;
+    invalidate();
+}
+
+void StatisticsNode::setPercentiles(float low, float high) {
+    m_lowPercentile = std::clamp(low, 0.0f, 100.0f);
+    m_highPercentile = std::clamp(high, m_lowPercentile, 100.0f);
+    invalidate();
+}
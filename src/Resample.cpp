@@ -0,0 +1,124 @@
+#include "Resample.h"
+#include <opencv2/imgproc.hpp>
+#include <cmath>
+
+// Two map planes cost 6 bytes per output pixel; beyond this, warp directly
+static const double kMaxTablePixels = 16e6;
+static const double kEpsilon = 1e-9;
+
+int cvInterpolation(Interpolation interpolation) {
+    switch (interpolation) {
+        case Interpolation::Nearest:
+            return cv::INTER_NEAREST;
+        case Interpolation::Cubic:
+            return cv::INTER_CUBIC;
+        default:
+            return cv::INTER_LINEAR;
+    }
+}
+
+static bool isAffine(const cv::Matx33d& m) {
+    return std::abs(m(2, 0)) < kEpsilon && std::abs(m(2, 1)) < kEpsilon && std::abs(m(2, 2) - 1.0) < kEpsilon;
+}
+
+bool RemapTable::prepare(const cv::Matx33d& transform, cv::Size inputSize, cv::Size outputSize,
+                         Interpolation interpolation) {
+    if (static_cast<double>(outputSize.area()) > kMaxTablePixels) {
+        clear();
+        return false;
+    }
+    if (!m_map1.empty() && transform == m_transform && inputSize == m_inputSize && outputSize == m_outputSize &&
+        interpolation == m_interpolation) {
+        return true;
+    }
+
+    const cv::Matx33d inverse = transform.inv();
+    cv::Mat coordinates(outputSize, CV_32FC2);
+    cv::parallel_for_(cv::Range(0, outputSize.height), [&](const cv::Range& range) {
+        for (int y = range.start; y < range.end; ++y) {
+            cv::Vec2f* row = coordinates.ptr<cv::Vec2f>(y);
+            for (int x = 0; x < outputSize.width; ++x) {
+                const double u = inverse(0, 0) * x + inverse(0, 1) * y + inverse(0, 2);
+                const double v = inverse(1, 0) * x + inverse(1, 1) * y + inverse(1, 2);
+                const double w = inverse(2, 0) * x + inverse(2, 1) * y + inverse(2, 2);
+                const double scale = std::abs(w) > kEpsilon ? 1.0 / w : 0.0;
+                // Points at or behind the horizon fall outside the input
+                row[x] = scale > 0.0 ? cv::Vec2f(static_cast<float>(u * scale), static_cast<float>(v * scale))
+                                     : cv::Vec2f(-1e6f, -1e6f);
+            }
+        }
+    });
+    assign(coordinates, interpolation);
+    m_transform = transform;
+    m_inputSize = inputSize;
+    m_outputSize = outputSize;
+    return true;
+}
+
+void RemapTable::assign(const cv::Mat& coordinates, Interpolation interpolation) {
+    cv::convertMaps(coordinates, cv::noArray(), m_map1, m_map2, CV_16SC2, interpolation == Interpolation::Nearest);
+    m_interpolation = interpolation;
+    m_inputSize = cv::Size();
+}
+
+void RemapTable::apply(const cv::Mat& input, cv::Mat& output, int border) const {
+    cv::remap(input, output, m_map1, m_map2, cvInterpolation(m_interpolation), border);
+}
+
+void RemapTable::clear() {
+    m_map1.release();
+    m_map2.release();
+}
+
+void resample(const cv::Mat& input, cv::Mat& output, const cv::Matx33d& transform, cv::Size size,
+              Interpolation interpolation, RemapTable* table) {
+    if (input.empty() || size.area() <= 0) {
+        output = cv::Mat();
+        return;
+    }
+    const cv::Matx33d& m = transform;
+    const bool affine = isAffine(m);
+    const bool axisAligned = affine && std::abs(m(0, 1)) < kEpsilon && std::abs(m(1, 0)) < kEpsilon;
+
+    if (axisAligned && std::abs(m(0, 0) - 1.0) < kEpsilon && std::abs(m(1, 1) - 1.0) < kEpsilon &&
+        std::abs(m(0, 2) - std::round(m(0, 2))) < kEpsilon && std::abs(m(1, 2) - std::round(m(1, 2))) < kEpsilon) {
+        // A crop: share the input's buffer when the window lies inside it
+        const cv::Rect window(static_cast<int>(-std::round(m(0, 2))), static_cast<int>(-std::round(m(1, 2))),
+                              size.width, size.height);
+        const cv::Rect inside = window & cv::Rect(0, 0, input.cols, input.rows);
+        if (inside == window) {
+            output = input(window);
+            return;
+        }
+        output = cv::Mat::zeros(size, input.type());
+        if (!inside.empty()) {
+            input(inside).copyTo(output(inside - window.tl()));
+        }
+        return;
+    }
+
+    if (axisAligned) {
+        // cv::resize maps x to sx * (x + 0.5) - 0.5
+        const double sx = static_cast<double>(size.width) / input.cols;
+        const double sy = static_cast<double>(size.height) / input.rows;
+        if (std::abs(m(0, 0) - sx) < 1e-6 && std::abs(m(1, 1) - sy) < 1e-6 &&
+            std::abs(m(0, 2) - 0.5 * (sx - 1.0)) < 1e-6 && std::abs(m(1, 2) - 0.5 * (sy - 1.0)) < 1e-6) {
+            // Area averaging avoids aliasing when a linear resize shrinks
+            const int flag = interpolation == Interpolation::Linear && sx < 1.0 && sy < 1.0
+                                 ? cv::INTER_AREA : cvInterpolation(interpolation);
+            cv::resize(input, output, size, 0, 0, flag);
+            return;
+        }
+    }
+
+    if (table && table->prepare(transform, input.size(), size, interpolation)) {
+        table->apply(input, output);
+        return;
+    }
+    if (affine) {
+        const cv::Matx23d forward(m(0, 0), m(0, 1), m(0, 2), m(1, 0), m(1, 1), m(1, 2));
+        cv::warpAffine(input, output, forward, size, cvInterpolation(interpolation), cv::BORDER_CONSTANT);
+    } else {
+        cv::warpPerspective(input, output, m, size, cvInterpolation(interpolation), cv::BORDER_CONSTANT);
+    }
+}
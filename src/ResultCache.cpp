@@ -0,0 +1,299 @@
+#include "ResultCache.h"
+#include <QStandardPaths>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <new>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+const char kMagic[4] = {'N', 'B', 'R', 'C'};
+const uint32_t kVersion = 2;
+const char* kEntrySuffix = ".nbrc";
+// Nodes have a handful of outputs; anything larger is a damaged header
+const uint32_t kMaxImages = 256;
+
+struct FileHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t imageCount;
+    uint32_t reserved;
+};
+
+struct ImageHeader {
+    int32_t rows;
+    int32_t cols;
+    int32_t type;
+    uint32_t flags;
+    uint64_t bytes;
+};
+
+// Releases the advisory lock on scope exit
+class DirectoryLock {
+public:
+    explicit DirectoryLock(const std::string& path) {
+        m_fd = ::open(path.c_str(), O_CREAT | O_RDWR, 0644);
+        m_locked = m_fd >= 0 && ::flock(m_fd, LOCK_EX | LOCK_NB) == 0;
+    }
+    ~DirectoryLock() {
+        if (m_fd >= 0) {
+            if (m_locked) {
+                ::flock(m_fd, LOCK_UN);
+            }
+            ::close(m_fd);
+        }
+    }
+    bool locked() const { return m_locked; }
+
+private:
+    int m_fd = -1;
+    bool m_locked = false;
+};
+
+} // namespace
+
+ResultCache::ResultCache(const std::string& directory, uint64_t maxBytes)
+    : m_directory(directory), m_maxBytes(maxBytes) {
+    std::error_code error;
+    fs::create_directories(m_directory, error);
+}
+
+std::shared_ptr<ResultCache> ResultCache::fromEnvironment() {
+    const char* directory = std::getenv("NBIP_CACHE_DIR");
+    if (!directory || !*directory) {
+        return nullptr;
+    }
+    std::string path = directory;
+    if (path == "default") {
+        path = QStandardPaths::writableLocation(QStandardPaths::CacheLocation).toStdString() + "/results";
+    }
+    uint64_t maxBytes = 2ull << 30;
+    if (const char* megabytes = std::getenv("NBIP_CACHE_MAX_MB")) {
+        maxBytes = std::strtoull(megabytes, nullptr, 10) << 20;
+    }
+    return std::make_shared<ResultCache>(path, maxBytes);
+}
+
+uint64_t ResultCache::hash(const void* data, size_t size, uint64_t seed) {
+    // FNV-1a
+    const auto* bytes = static_cast<const unsigned char*>(data);
+    uint64_t h = seed;
+    for (size_t i = 0; i < size; ++i) {
+        h ^= bytes[i];
+        h *= 0x100000001b3ull;
+    }
+    return h;
+}
+
+uint64_t ResultCache::combine(uint64_t seed, uint64_t value) {
+    // splitmix64 finalizer over the pair
+    uint64_t z = seed ^ (value + 0x9e3779b97f4a7c15ull + (seed << 6) + (seed >> 2));
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+std::string ResultCache::pathFor(uint64_t key) const {
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx", static_cast<unsigned long long>(key));
+    return m_directory + "/" + name + kEntrySuffix;
+}
+
+bool ResultCache::load(uint64_t key, std::vector<cv::Mat>& images, std::vector<uint32_t>* flags) {
+    const std::string path = pathFor(key);
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        return false;
+    }
+    // Entries may be truncated or corrupt; everything read is checked against
+    // the file size before anything is allocated
+    std::error_code error;
+    const uint64_t fileSize = fs::file_size(path, error);
+    if (error) {
+        return false;
+    }
+
+    FileHeader header{};
+    if (!in.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+        !std::equal(kMagic, kMagic + 4, header.magic) || header.version != kVersion ||
+        header.imageCount > kMaxImages) {
+        return false;
+    }
+    uint64_t remaining = fileSize - std::min<uint64_t>(fileSize, sizeof(header));
+    if (static_cast<uint64_t>(header.imageCount) * sizeof(ImageHeader) > remaining) {
+        return false;
+    }
+    remaining -= header.imageCount * sizeof(ImageHeader);
+
+    std::vector<ImageHeader> layouts(header.imageCount);
+    if (!in.read(reinterpret_cast<char*>(layouts.data()), layouts.size() * sizeof(ImageHeader))) {
+        return false;
+    }
+
+    std::vector<cv::Mat> loaded;
+    loaded.reserve(layouts.size());
+    try {
+        for (const auto& layout : layouts) {
+            cv::Mat image;
+            if (layout.rows != 0 || layout.cols != 0) {
+                if (layout.rows <= 0 || layout.cols <= 0 || layout.type < 0 || CV_MAT_TYPE(layout.type) != layout.type) {
+                    return false;
+                }
+                const uint64_t bytes = static_cast<uint64_t>(layout.rows) * static_cast<uint64_t>(layout.cols) *
+                                       CV_ELEM_SIZE(layout.type);
+                if (bytes != layout.bytes || bytes > remaining) {
+                    return false;
+                }
+                remaining -= bytes;
+                image.create(layout.rows, layout.cols, layout.type);
+                if (!in.read(reinterpret_cast<char*>(image.data), layout.bytes)) {
+                    return false;
+                }
+            }
+            loaded.push_back(image);
+        }
+    } catch (const cv::Exception&) {
+        return false;
+    } catch (const std::bad_alloc&) {
+        return false;
+    }
+
+    // Refresh the timestamp so eviction sees this entry as recently used
+    fs::last_write_time(path, fs::file_time_type::clock::now(), error);
+    images = std::move(loaded);
+    if (flags) {
+        flags->clear();
+        for (const auto& layout : layouts) {
+            flags->push_back(layout.flags);
+        }
+    }
+    return true;
+}
+
+bool ResultCache::store(uint64_t key, const std::vector<cv::Mat>& images, const std::vector<uint32_t>* flags) {
+    static std::atomic<uint64_t> counter{0};
+    const std::string path = pathFor(key);
+    const std::string temporary = path + ".tmp." + std::to_string(::getpid()) + "." + std::to_string(counter++);
+
+    uint64_t written = 0;
+    {
+        std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+        if (!out) {
+            return false;
+        }
+
+        FileHeader header{};
+        std::copy(kMagic, kMagic + 4, header.magic);
+        header.version = kVersion;
+        header.imageCount = static_cast<uint32_t>(images.size());
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+        for (size_t i = 0; i < images.size(); ++i) {
+            const cv::Mat& image = images[i];
+            ImageHeader layout{};
+            layout.flags = flags && i < flags->size() ? (*flags)[i] : 0;
+            layout.rows = image.rows;
+            layout.cols = image.cols;
+            layout.type = image.type();
+            layout.bytes = image.total() * image.elemSize();
+            out.write(reinterpret_cast<const char*>(&layout), sizeof(layout));
+        }
+        for (const auto& image : images) {
+            const size_t rowBytes = image.cols * image.elemSize();
+            for (int y = 0; y < image.rows; ++y) {
+                out.write(reinterpret_cast<const char*>(image.ptr(y)), rowBytes);
+            }
+            written += rowBytes * image.rows;
+        }
+        if (!out) {
+            out.close();
+            std::remove(temporary.c_str());
+            return false;
+        }
+    }
+
+    // rename() is atomic, so readers see either no entry or a complete one
+    if (std::rename(temporary.c_str(), path.c_str()) != 0) {
+        std::remove(temporary.c_str());
+        return false;
+    }
+
+    bool shouldEvict = false;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_bytesSinceEviction += written;
+        if (m_bytesSinceEviction > m_maxBytes / 16) {
+            m_bytesSinceEviction = 0;
+            shouldEvict = true;
+        }
+    }
+    if (shouldEvict) {
+        evict();
+    }
+    return true;
+}
+
+void ResultCache::evict() {
+    // One evicting process at a time; the others simply skip this round
+    DirectoryLock lock(m_directory + "/.lock");
+    if (!lock.locked()) {
+        return;
+    }
+
+    struct Entry {
+        fs::path path;
+        uint64_t size;
+        fs::file_time_type time;
+    };
+    std::vector<Entry> entries;
+    uint64_t total = 0;
+    const auto now = fs::file_time_type::clock::now();
+
+    std::error_code error;
+    for (const auto& item : fs::directory_iterator(m_directory, error)) {
+        std::error_code itemError;
+        if (!item.is_regular_file(itemError)) {
+            continue;
+        }
+        const std::string name = item.path().filename().string();
+        const auto time = item.last_write_time(itemError);
+        if (name.find(".tmp.") != std::string::npos) {
+            // Left behind by a writer that died mid-store
+            if (now - time > std::chrono::hours(1)) {
+                fs::remove(item.path(), itemError);
+            }
+            continue;
+        }
+        if (item.path().extension() != kEntrySuffix) {
+            continue;
+        }
+        const uint64_t size = item.file_size(itemError);
+        entries.push_back({item.path(), size, time});
+        total += size;
+    }
+
+    if (total <= m_maxBytes) {
+        return;
+    }
+    std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) { return a.time < b.time; });
+    // Trim below the budget so every store does not trigger another scan
+    const uint64_t target = m_maxBytes - m_maxBytes / 8;
+    for (const auto& entry : entries) {
+        if (total <= target) {
+            break;
+        }
+        std::error_code removeError;
+        if (fs::remove(entry.path, removeError)) {
+            total -= entry.size;
+        }
+    }
+}
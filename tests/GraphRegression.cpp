@@ -0,0 +1,1133 @@
+// Regression harness for graph outputs. Every node type in NodeFactory runs
+// over fixed inputs in each of its modes and is compared with a golden file;
+// cross-checks compare optimized paths (fusion, batches, groups, sweeps,
+// constant-time kernels) with independent references in the same run.
+//
+//   GraphRegression [--golden DIR] [--update] [--require-golden] [--report FILE] [--filter TEXT]
+//
+// Goldens are read from DIR, by default tests/golden in the source tree.
+// --update records every golden instead of comparing, into DIR when it is
+// given and into the build tree otherwise. A missing golden is reported and
+// fails the run with --require-golden, which ctest passes. While DIR holds no
+// goldens at all, the golden cases are skipped instead, the cross-checks still
+// have to pass, and the run exits with 77 so ctest lists it as skipped.
+// The report is CSV with the status, differences and timing of every case.
+
+#include "CpuDispatch.h"
+#include "GroupNode.h"
+#include "ImageNode.h"
+#include "MemoryBudget.h"
+#include "NodeFactory.h"
+#include "NodeGraph.h"
+#include "ProcessingNodes.h"
+#include "ResultCache.h"
+#include <QApplication>
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <limits>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace {
+
+// Largest per-element difference allowed and smallest PSNR in dB; an
+// infinite PSNR bound with maxAbs 0 means bit-exact
+struct Tolerance {
+    double maxAbs = 0.0;
+    double minPsnr = std::numeric_limits<double>::infinity();
+};
+
+// Integer kernels must stay exact; float paths may round differently
+const std::map<std::string, Tolerance> kNodeTolerances = {
+    {"Blur", {1.0, 50.0}},
+    {"Brightness/Contrast", {1.0, 50.0}},
+    {"Blend", {1.0, 50.0}},
+    {"Color Space", {1.0, 50.0}},
+    {"Composite", {1.0, 50.0}},
+    {"Convolution Filter", {1.0, 50.0}},
+    {"Displace", {1.0, 45.0}},
+    {"Noise Generator", {1.0, 50.0}},
+    {"Resize", {1.0, 45.0}},
+    {"Statistics", {1e-6, 0.0}},
+    {"Warp", {1.0, 45.0}},
+};
+
+// Parameters that select a code path; each of their values is a case
+const char* const kModeParameters[] = {"Mode", "Method", "Operation", "Shape", "Type", "Channel", "Interpolation", "Space"};
+
+const cv::Size kInputSize(253, 187);
+
+// Exit code ctest reports as skipped, while no goldens are recorded
+const int kSkipped = 77;
+
+// Feeds a fixed image into the graph
+class MatSourceNode : public Node {
+public:
+    explicit MatSourceNode(const cv::Mat& image) {
+        m_outputData.push_back(std::make_shared<cv::Mat>(image));
+    }
+
+    void process() override {}
+    std::string name() const override { return "Test Source"; }
+    const std::vector<Port>& getPorts() const override {
+        static const std::vector<Port> ports = {
+            {0, "Output", PortType::Output, DataType::Image}
+        };
+        return ports;
+    }
+};
+
+// Gradient plus noise, so thresholds, edges and histograms all have work;
+// odd dimensions exercise row tails. BGRA alpha ramps from 0 to 255.
+cv::Mat testInput(int channels, int seed = 0) {
+    cv::Mat image(kInputSize, CV_8UC(channels));
+    cv::RNG rng(0x5eed + seed);
+    for (int y = 0; y < image.rows; ++y) {
+        uchar* row = image.ptr<uchar>(y);
+        for (int x = 0; x < image.cols; ++x) {
+            for (int c = 0; c < channels; ++c) {
+                const int gradient = (x * 255 / image.cols + y * 128 / image.rows + c * 60) % 256;
+                row[x * channels + c] = cv::saturate_cast<uchar>(gradient + rng.uniform(-24, 25));
+            }
+            if (channels == 4) {
+                row[x * 4 + 3] = static_cast<uchar>(x * 255 / (image.cols - 1));
+            }
+        }
+    }
+    return image;
+}
+
+struct Comparison {
+    bool passed = true;
+    double maxAbs = 0.0;
+    double psnr = std::numeric_limits<double>::infinity();
+    std::string message;
+};
+
+Comparison compare(const std::vector<cv::Mat>& actual, const std::vector<cv::Mat>& expected, const Tolerance& tolerance) {
+    Comparison result;
+    if (actual.size() != expected.size()) {
+        result.passed = false;
+        result.message = "output count " + std::to_string(actual.size()) + " != " + std::to_string(expected.size());
+        return result;
+    }
+    for (size_t i = 0; i < actual.size(); ++i) {
+        const cv::Mat& a = actual[i];
+        const cv::Mat& b = expected[i];
+        if (a.empty() && b.empty()) {
+            continue;
+        }
+        if (a.size() != b.size() || a.type() != b.type()) {
+            result.passed = false;
+            result.message = "output " + std::to_string(i) + " size or type differs";
+            return result;
+        }
+        const double maxAbs = cv::norm(a, b, cv::NORM_INF);
+        const double mse = cv::norm(a, b, cv::NORM_L2SQR) / (static_cast<double>(a.total()) * a.channels());
+        double range = 255.0;
+        if (a.depth() == CV_16U) {
+            range = 65535.0;
+        } else if (a.depth() != CV_8U) {
+            double low = 0.0, high = 0.0;
+            cv::minMaxLoc(b.reshape(1), &low, &high);
+            range = std::max({std::abs(low), std::abs(high), 1.0});
+        }
+        const double psnr = mse > 0.0 ? 10.0 * std::log10(range * range / mse) : std::numeric_limits<double>::infinity();
+        result.maxAbs = std::max(result.maxAbs, maxAbs);
+        result.psnr = std::min(result.psnr, psnr);
+    }
+    if (result.maxAbs > tolerance.maxAbs || result.psnr < tolerance.minPsnr) {
+        result.passed = false;
+        result.message = "outside tolerance";
+    }
+    return result;
+}
+
+std::string checksum(const std::vector<cv::Mat>& images) {
+    uint64_t hash = ResultCache::hash(std::string("outputs"));
+    for (const cv::Mat& image : images) {
+        const int header[] = {image.rows, image.cols, image.type()};
+        hash = ResultCache::combine(hash, ResultCache::hash(header, sizeof(header)));
+        for (int y = 0; y < image.rows; ++y) {
+            hash = ResultCache::combine(hash, ResultCache::hash(image.ptr(y), image.cols * image.elemSize()));
+        }
+    }
+    char text[17];
+    std::snprintf(text, sizeof(text), "%016llx", static_cast<unsigned long long>(hash));
+    return text;
+}
+
+// Outputs as a sink would see them: straight alpha
+std::vector<cv::Mat> straightOutputs(const Node* node) {
+    std::vector<cv::Mat> outputs = node->outputImages();
+    for (size_t slot = 0; slot < outputs.size(); ++slot) {
+        outputs[slot] = imageAs(outputs[slot], node->outputInfo(static_cast<int>(slot)), false);
+    }
+    return outputs;
+}
+
+class Harness {
+public:
+    std::string goldenDirectory = NBIP_GOLDEN_DIR;
+    std::string updateDirectory = NBIP_GOLDEN_UPDATE_DIR;
+    bool update = false;
+    bool requireGolden = false;
+    std::string filter;
+
+    // Compares a case's outputs with its golden file, or records it with --update
+    void checkGolden(const std::string& name, const Tolerance& tolerance, const std::function<std::vector<cv::Mat>()>& run) {
+        if (skipped(name)) {
+            return;
+        }
+        double milliseconds = 0.0;
+        const std::vector<cv::Mat> outputs = timed(run, milliseconds);
+        const std::string sum = checksum(outputs);
+
+        if (update) {
+            const std::string path = updateDirectory + "/" + fileName(name) + ".yml.gz";
+            std::error_code error;
+            std::filesystem::create_directories(updateDirectory, error);
+            const bool written = writeGolden(path, outputs, sum);
+            Comparison result;
+            result.passed = written;
+            result.message = written ? "recorded" : "cannot write " + path;
+            record(name, result, milliseconds);
+            return;
+        }
+        const std::string path = goldenDirectory + "/" + fileName(name) + ".yml.gz";
+        cv::FileStorage stored(path, cv::FileStorage::READ);
+        if (!stored.isOpened()) {
+            Comparison result;
+            result.passed = !requireGolden;
+            result.message = "missing";
+            record(name, result, milliseconds);
+            return;
+        }
+        std::string storedSum;
+        stored["checksum"] >> storedSum;
+        if (storedSum == sum) {
+            record(name, Comparison(), milliseconds);
+            return;
+        }
+        int count = 0;
+        stored["outputs"] >> count;
+        std::vector<cv::Mat> expected(count);
+        for (int i = 0; i < count; ++i) {
+            stored["output" + std::to_string(i)] >> expected[i];
+        }
+        record(name, compare(outputs, expected, tolerance), milliseconds);
+    }
+
+    // Runs an optimized path and its reference and compares them
+    void crossCheck(const std::string& name, const Tolerance& tolerance, const std::function<std::vector<cv::Mat>()>& optimized,
+                    const std::function<std::vector<cv::Mat>()>& reference) {
+        if (skipped(name)) {
+            return;
+        }
+        double milliseconds = 0.0;
+        const std::vector<cv::Mat> actual = timed(optimized, milliseconds);
+        const std::vector<cv::Mat> expected = reference();
+        record(name, compare(actual, expected, tolerance), milliseconds);
+    }
+
+    bool writeReport(const std::string& path) const {
+        std::ofstream report(path);
+        if (!report) {
+            return false;
+        }
+        report << "case,status,max_abs_diff,psnr_db,ms\n";
+        for (const auto& row : m_rows) {
+            report << '"' << row.name << "\"," << row.status << ',' << row.maxAbs << ',' << row.psnr << ',' << row.ms << '\n';
+        }
+        return true;
+    }
+
+    int failures() const { return m_failures; }
+    size_t caseCount() const { return m_rows.size(); }
+
+    // Whether the golden directory holds at least one recorded golden
+    bool hasGoldens() const {
+        std::error_code error;
+        for (const auto& entry : std::filesystem::directory_iterator(goldenDirectory, error)) {
+            const std::string file = entry.path().filename().string();
+            if (file.size() > 7 && file.compare(file.size() - 7, 7, ".yml.gz") == 0) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+private:
+    struct Row {
+        std::string name;
+        std::string status;
+        double maxAbs;
+        double psnr;
+        double ms;
+    };
+
+    bool skipped(const std::string& name) const {
+        return !filter.empty() && name.find(filter) == std::string::npos;
+    }
+
+    static std::vector<cv::Mat> timed(const std::function<std::vector<cv::Mat>()>& run, double& milliseconds) {
+        const auto start = std::chrono::steady_clock::now();
+        std::vector<cv::Mat> outputs = run();
+        milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        return outputs;
+    }
+
+    static std::string fileName(const std::string& name) {
+        std::string file = name;
+        for (char& c : file) {
+            if (!std::isalnum(static_cast<unsigned char>(c)) && c != '-' && c != '.') {
+                c = '_';
+            }
+        }
+        return file;
+    }
+
+    static bool writeGolden(const std::string& path, const std::vector<cv::Mat>& outputs, const std::string& sum) {
+        cv::FileStorage file(path, cv::FileStorage::WRITE);
+        if (!file.isOpened()) {
+            return false;
+        }
+        file << "checksum" << sum;
+        file << "outputs" << static_cast<int>(outputs.size());
+        for (size_t i = 0; i < outputs.size(); ++i) {
+            file << "output" + std::to_string(i) << outputs[i];
+        }
+        return true;
+    }
+
+    void record(const std::string& name, const Comparison& result, double milliseconds) {
+        const std::string status = result.passed ? (result.message.empty() ? "pass" : result.message) : "FAIL";
+        std::printf("%-48s %-9s max|d|=%-8g psnr=%-8g %8.2f ms%s%s\n", name.c_str(), status.c_str(), result.maxAbs,
+                    result.psnr, milliseconds, result.passed ? "" : "  ", result.passed ? "" : result.message.c_str());
+        m_rows.push_back({name, status, result.maxAbs, result.psnr, milliseconds});
+        m_failures += result.passed ? 0 : 1;
+    }
+
+    std::vector<Row> m_rows;
+    int m_failures = 0;
+};
+
+// source -> node -> output, with the source on every image input
+std::vector<cv::Mat> runNode(const std::string& type, const cv::Mat& input,
+                             const std::function<void(Node&)>& configure = nullptr) {
+    NodeGraph graph;
+    graph.setResultCache(nullptr);
+    auto* source = new MatSourceNode(input);
+    std::unique_ptr<Node> created = NodeFactory::instance().createNode(type);
+    if (!created) {
+        return {};
+    }
+    Node* node = created.release();
+    auto* output = new ImageOutputNode();
+    graph.addNode(source);
+    graph.addNode(node);
+    graph.addNode(output);
+    if (configure) {
+        configure(*node);
+    }
+    const auto& ports = node->ports();
+    const size_t ownPorts = node->getPorts().size();
+    int firstOutput = -1;
+    for (size_t i = 0; i < ownPorts; ++i) {
+        if (ports[i].type == PortType::Input && ports[i].dataType == DataType::Image) {
+            graph.connectNodes(source, 0, node, static_cast<int>(i));
+        } else if (ports[i].type == PortType::Output && ports[i].dataType == DataType::Image && firstOutput < 0) {
+            firstOutput = static_cast<int>(i);
+        }
+    }
+    if (firstOutput >= 0) {
+        graph.connectNodes(node, firstOutput, output, 0);
+    }
+    graph.processGraph();
+    return straightOutputs(node);
+}
+
+// Every factory type in each mode over gray, BGR and BGRA input
+void goldenCases(Harness& harness) {
+    const std::pair<const char*, int> variants[] = {{"gray", 1}, {"bgr", 3}, {"bgra", 4}};
+    for (const std::string& type : NodeFactory::instance().getAvailableNodes()) {
+        std::unique_ptr<Node> probe = NodeFactory::instance().createNode(type);
+        if (!probe || probe->isSink() || dynamic_cast<ImageInputNode*>(probe.get())) {
+            continue;
+        }
+        auto found = kNodeTolerances.find(type);
+        const Tolerance tolerance = found != kNodeTolerances.end() ? found->second : Tolerance();
+
+        // Modes: every value the node accepts unchanged, stopping where its setter clamps
+        std::vector<std::pair<std::string, int>> modes = {{"", 0}};
+        for (const char* parameter : kModeParameters) {
+            if (probe->parameterPort(parameter) < 0) {
+                continue;
+            }
+            for (int value = 0; value < 16; ++value) {
+                probe->setParameter(parameter, value);
+                if (probe->parameter(parameter) != value) {
+                    break;
+                }
+                modes.push_back({parameter, value});
+            }
+        }
+
+        for (const auto& variant : variants) {
+            const cv::Mat input = testInput(variant.second);
+            for (const auto& mode : modes) {
+                std::string name = type + "/" + variant.first;
+                if (!mode.first.empty()) {
+                    name += "/" + mode.first + "=" + std::to_string(mode.second);
+                }
+                harness.checkGolden(name, tolerance, [&]() {
+                    return runNode(type, input, [&mode](Node& node) {
+                        if (!mode.first.empty()) {
+                            node.setParameter(mode.first, mode.second);
+                        }
+                    });
+                });
+            }
+        }
+    }
+}
+
+// Scalar per-pixel Overlay at the node's default opacity, opaque inputs
+std::vector<cv::Mat> referenceOverlay(const cv::Mat& base, const cv::Mat& layer, float opacity) {
+    cv::Mat output(base.size(), base.type());
+    for (int y = 0; y < base.rows; ++y) {
+        for (int x = 0; x < base.cols * base.channels(); ++x) {
+            const float a = base.ptr<uchar>(y)[x] / 255.0f;
+            const float b = layer.ptr<uchar>(y)[x] / 255.0f;
+            const float blended = a < 0.5f ? 2.0f * a * b : 1.0f - 2.0f * (1.0f - a) * (1.0f - b);
+            output.ptr<uchar>(y)[x] = cv::saturate_cast<uchar>((a + (blended - a) * opacity) * 255.0f);
+        }
+    }
+    return {output};
+}
+
+// Scalar Sobel magnitude as EdgeDetectionNode defines it: (|gx| + |gy|) / 2
+std::vector<cv::Mat> referenceSobel(const cv::Mat& gray) {
+    cv::Mat output(gray.size(), CV_8U);
+    auto at = [&gray](int y, int x) {
+        // BORDER_REFLECT_101
+        y = y < 0 ? -y : (y >= gray.rows ? 2 * gray.rows - y - 2 : y);
+        x = x < 0 ? -x : (x >= gray.cols ? 2 * gray.cols - x - 2 : x);
+        return static_cast<int>(gray.at<uchar>(y, x));
+    };
+    for (int y = 0; y < gray.rows; ++y) {
+        for (int x = 0; x < gray.cols; ++x) {
+            const int gx = at(y - 1, x + 1) + 2 * at(y, x + 1) + at(y + 1, x + 1)
+                         - at(y - 1, x - 1) - 2 * at(y, x - 1) - at(y + 1, x - 1);
+            const int gy = at(y + 1, x - 1) + 2 * at(y + 1, x) + at(y + 1, x + 1)
+                         - at(y - 1, x - 1) - 2 * at(y - 1, x) - at(y - 1, x + 1);
+            const int ax = std::min(std::abs(gx), 255);
+            const int ay = std::min(std::abs(gy), 255);
+            output.at<uchar>(y, x) = cv::saturate_cast<uchar>(0.5 * ax + 0.5 * ay);
+        }
+    }
+    return {output};
+}
+
+// Brightness/contrast as it ran before the dispatched kernel: cv::LUT over a
+// convertTo-built table, alpha through the identity
+std::vector<cv::Mat> referenceBrightnessContrast(const cv::Mat& input, int brightness, double contrast) {
+    cv::Mat levels(1, 256, CV_8U);
+    for (int i = 0; i < 256; ++i) {
+        levels.at<uchar>(i) = static_cast<uchar>(i);
+    }
+    cv::Mat lut;
+    levels.convertTo(lut, -1, contrast, brightness);
+    cv::Mat output;
+    if (input.channels() == 4) {
+        cv::Mat lut4;
+        cv::merge(std::vector<cv::Mat>{lut, lut, lut, levels}, lut4);
+        cv::LUT(input, lut4, output);
+    } else {
+        cv::LUT(input, lut, output);
+    }
+    return {output};
+}
+
+// The noise pattern as it ran before the dispatched kernel, with std::sin
+std::vector<cv::Mat> referenceNoise(int type, float scale, int octaves, float persistence) {
+    cv::Mat noise(512, 512, CV_32F);
+    for (int y = 0; y < noise.rows; ++y) {
+        for (int x = 0; x < noise.cols; ++x) {
+            float value = 0.0f;
+            float amplitude = 1.0f;
+            float frequency = 1.0f;
+            for (int octave = 0; octave < octaves; ++octave) {
+                const float nx = x * frequency * scale;
+                const float ny = y * frequency * scale;
+                if (type == NoiseGenerationNode::Worley) {
+                    value += std::fmod(nx * 0.1f + ny * 0.1f, 1.0f) * amplitude;
+                } else {
+                    const float half = type == NoiseGenerationNode::Simplex ? 0.5f : 1.0f;
+                    value += (std::sin((nx * half * 0.1f + ny * half * 0.1f) * 10.0f) * 0.5f + 0.5f) * amplitude;
+                }
+                amplitude *= persistence;
+                frequency *= 2.0f;
+            }
+            noise.at<float>(y, x) = value;
+        }
+    }
+    cv::normalize(noise, noise, 0.0f, 1.0f, cv::NORM_MINMAX);
+    cv::Mat output;
+    noise.convertTo(output, CV_8UC1, 255.0f);
+    return {output};
+}
+
+// Blur -> Blur -> Convolution -> Adjust -> Adjust from one source, tail returned
+Node* buildChain(NodeGraph& graph, const cv::Mat& input) {
+    auto* source = new MatSourceNode(input);
+    graph.addNode(source);
+    auto* sharpen = new ConvolutionFilterNode();
+    auto* adjustA = new BrightnessContrastNode();
+    auto* adjustB = new BrightnessContrastNode();
+    sharpen->setPreset(4);
+    adjustA->setContrast(0.8f);
+    adjustA->setBrightness(10);
+    adjustB->setContrast(1.2f);
+    Node* previous = source;
+    int previousPort = 0;
+    for (Node* node : std::initializer_list<Node*>{new BlurNode(), new BlurNode(), sharpen, adjustA, adjustB}) {
+        graph.addNode(node);
+        graph.connectNodes(previous, previousPort, node, 0);
+        previous = node;
+        previousPort = 1;
+    }
+    auto* output = new ImageOutputNode();
+    graph.addNode(output);
+    graph.connectNodes(previous, 1, output, 0);
+    return output;
+}
+
+void crossChecks(Harness& harness) {
+    const cv::Mat gray = testInput(1);
+    const cv::Mat bgr = testInput(3);
+    const cv::Mat bgrOther = testInput(3, 1);
+
+    harness.crossCheck("cross/fusion", {8.0, 35.0}, [&]() {
+        NodeGraph graph;
+        graph.setResultCache(nullptr);
+        auto* output = static_cast<ImageOutputNode*>(buildChain(graph, bgr));
+        graph.processGraph();
+        return std::vector<cv::Mat>{output->getOutputImage()};
+    }, [&]() {
+        NodeGraph graph;
+        graph.setResultCache(nullptr);
+        GraphOptimizer::Options options;
+        options.fuseLinearChains = false;
+        graph.setOptimizerOptions(options);
+        auto* output = static_cast<ImageOutputNode*>(buildChain(graph, bgr));
+        graph.processGraph();
+        return std::vector<cv::Mat>{output->getOutputImage()};
+    });
+
+    // A budget too small for anything: every intermediate lives in a scratch
+    // file and is paged back in when the next pass reads it. Unfused, so
+    // the intermediates exist.
+    GraphOptimizer::Options unfused;
+    unfused.fuseLinearChains = false;
+    harness.crossCheck("cross/spill", Tolerance(), [&]() {
+        NodeGraph graph;
+        graph.setResultCache(nullptr);
+        graph.setOptimizerOptions(unfused);
+        auto budget = std::make_shared<MemoryBudget>(1);
+        graph.setMemoryBudget(budget);
+        auto* output = static_cast<ImageOutputNode*>(buildChain(graph, bgr));
+        graph.processGraph();
+        graph.processGraph();
+        const bool spilled = budget->spilledBytes() > 0;
+        return std::vector<cv::Mat>{output->getOutputImage().clone(), cv::Mat(1, 1, CV_64F, cv::Scalar(spilled ? 1.0 : 0.0))};
+    }, [&]() {
+        NodeGraph graph;
+        graph.setResultCache(nullptr);
+        graph.setMemoryBudget(nullptr);
+        graph.setOptimizerOptions(unfused);
+        auto* output = static_cast<ImageOutputNode*>(buildChain(graph, bgr));
+        graph.processGraph();
+        return std::vector<cv::Mat>{output->getOutputImage().clone(), cv::Mat(1, 1, CV_64F, cv::Scalar(1.0))};
+    });
+
+    // A patched source recomputes only the region it reaches, in place,
+    // against a full pass over the patched image
+    const cv::Rect patch(40, 30, 24, 24);
+    cv::Mat patched = bgr.clone();
+    bgrOther(patch).copyTo(patched(patch));
+    harness.crossCheck("cross/damage", Tolerance(), [&]() {
+        NodeGraph graph;
+        graph.setResultCache(nullptr);
+        graph.setOptimizerOptions(unfused);
+        auto* output = static_cast<ImageOutputNode*>(buildChain(graph, bgr));
+        graph.processGraph();
+        const uchar* before = output->getOutputImage().data;
+        graph.getNodes().front()->patchOutput(0, patch, bgrOther(patch));
+        graph.processPending();
+        const bool inPlace = output->getOutputImage().data == before;
+        return std::vector<cv::Mat>{output->getOutputImage().clone(), cv::Mat(1, 1, CV_64F, cv::Scalar(inPlace ? 1.0 : 0.0))};
+    }, [&]() {
+        NodeGraph graph;
+        graph.setResultCache(nullptr);
+        graph.setOptimizerOptions(unfused);
+        auto* output = static_cast<ImageOutputNode*>(buildChain(graph, patched));
+        graph.processGraph();
+        return std::vector<cv::Mat>{output->getOutputImage().clone(), cv::Mat(1, 1, CV_64F, cv::Scalar(1.0))};
+    });
+
+    // sRGB -> Linear -> sRGB fuses into no conversion at all; the 16-bit
+    // linear step makes the unfused round trip exact too
+    auto roundTrip = [](NodeGraph& graph, const cv::Mat& input) {
+        graph.setResultCache(nullptr);
+        auto* source = new MatSourceNode(input);
+        auto* toLinear = new ColorSpaceNode();
+        auto* toSrgb = new ColorSpaceNode();
+        auto* output = new ImageOutputNode();
+        toSrgb->setSpace(static_cast<int>(ColorSpace::SRGB));
+        for (Node* node : std::initializer_list<Node*>{source, toLinear, toSrgb, output}) {
+            graph.addNode(node);
+        }
+        graph.connectNodes(source, 0, toLinear, 0);
+        graph.connectNodes(toLinear, 1, toSrgb, 0);
+        graph.connectNodes(toSrgb, 1, output, 0);
+        graph.processGraph();
+        return output;
+    };
+    harness.crossCheck("cross/color-roundtrip", Tolerance(), [&]() {
+        NodeGraph graph;
+        GraphOptimizer::Options options;
+        options.verifyRewrites = false;
+        graph.setOptimizerOptions(options);
+        auto* output = roundTrip(graph, bgr);
+        return std::vector<cv::Mat>{output->getOutputImage(), cv::Mat(1, 1, CV_64F, cv::Scalar(graph.lastPlan().fusedCount))};
+    }, [&]() {
+        NodeGraph graph;
+        graph.setOptimizerOptions(unfused);
+        auto* output = roundTrip(graph, bgr);
+        return std::vector<cv::Mat>{output->getOutputImage(), cv::Mat(1, 1, CV_64F, cv::Scalar(1.0))};
+    });
+
+    // Upscaling interpolates, so a 2x then 0.5x chain must not fuse to the
+    // identity; verification is off so a wrong fusion cannot hide behind it
+    auto upDown = [](NodeGraph& graph, const cv::Mat& input) {
+        graph.setResultCache(nullptr);
+        auto* source = new MatSourceNode(input);
+        auto* up = new ResizeNode();
+        auto* down = new ResizeNode();
+        auto* output = new ImageOutputNode();
+        up->setScale(2.0f);
+        down->setScale(0.5f);
+        for (Node* node : std::initializer_list<Node*>{source, up, down, output}) {
+            graph.addNode(node);
+        }
+        graph.connectNodes(source, 0, up, 0);
+        graph.connectNodes(up, 1, down, 0);
+        graph.connectNodes(down, 1, output, 0);
+        graph.processGraph();
+        return output;
+    };
+    harness.crossCheck("cross/geometric-updown", Tolerance(), [&]() {
+        NodeGraph graph;
+        GraphOptimizer::Options options;
+        options.verifyRewrites = false;
+        graph.setOptimizerOptions(options);
+        return std::vector<cv::Mat>{upDown(graph, bgr)->getOutputImage()};
+    }, [&]() {
+        NodeGraph graph;
+        graph.setOptimizerOptions(unfused);
+        return std::vector<cv::Mat>{upDown(graph, bgr)->getOutputImage()};
+    });
+
+    // Batched frames against one pass per frame
+    const ImageBatch frames = {bgr, bgrOther, testInput(3, 2)};
+    auto batchGraph = [](NodeGraph& graph, const cv::Mat& first, Node*& source, Node*& threshold) {
+        graph.setResultCache(nullptr);
+        source = new MatSourceNode(first);
+        auto* adjust = new BrightnessContrastNode();
+        auto* blur = new BlurNode();
+        threshold = new ThresholdNode();
+        auto* output = new ImageOutputNode();
+        adjust->setContrast(1.1f);
+        for (Node* node : std::initializer_list<Node*>{source, adjust, blur, threshold, output}) {
+            graph.addNode(node);
+        }
+        graph.connectNodes(source, 0, adjust, 0);
+        graph.connectNodes(adjust, 1, blur, 0);
+        graph.connectNodes(blur, 1, threshold, 0);
+        graph.connectNodes(threshold, 1, output, 0);
+    };
+    harness.crossCheck("cross/batch", Tolerance(), [&]() {
+        NodeGraph graph;
+        Node* source = nullptr;
+        Node* threshold = nullptr;
+        batchGraph(graph, frames[0], source, threshold);
+        graph.setBatchSize(2);
+        return graph.processBatch(source, frames, threshold)[0];
+    }, [&]() {
+        NodeGraph graph;
+        Node* source = nullptr;
+        Node* threshold = nullptr;
+        batchGraph(graph, frames[0], source, threshold);
+        std::vector<cv::Mat> outputs;
+        for (const cv::Mat& frame : frames) {
+            source->setOutputImage(0, frame);
+            graph.processGraph();
+            outputs.push_back(threshold->outputImages()[0].clone());
+        }
+        return outputs;
+    });
+
+    // Transparent frames through a node without a batch override (Warp) into
+    // one with (Blur). Compared premultiplied, where the two paths' alpha
+    // round trips differ by rounding only.
+    const ImageBatch alphaFrames = {testInput(4), testInput(4, 1), testInput(4, 2)};
+    auto alphaGraph = [](NodeGraph& graph, const cv::Mat& first, Node*& source, Node*& blur, Node*& output) {
+        graph.setResultCache(nullptr);
+        source = new MatSourceNode(first);
+        auto* warp = new WarpNode();
+        blur = new BlurNode();
+        output = new ImageOutputNode();
+        warp->setAngle(10.0f);
+        for (Node* node : std::initializer_list<Node*>{source, warp, blur, output}) {
+            graph.addNode(node);
+        }
+        graph.connectNodes(source, 0, warp, 0);
+        graph.connectNodes(warp, 1, blur, 0);
+        graph.connectNodes(blur, 1, output, 0);
+    };
+    auto premultiplied = [](const std::vector<cv::Mat>& straight) {
+        std::vector<cv::Mat> images(straight.size());
+        for (size_t i = 0; i < straight.size(); ++i) {
+            premultiplyAlpha(straight[i], images[i]);
+        }
+        return images;
+    };
+    harness.crossCheck("cross/batch-alpha", {2.0, 40.0}, [&]() {
+        NodeGraph graph;
+        Node* source = nullptr;
+        Node* blur = nullptr;
+        Node* output = nullptr;
+        alphaGraph(graph, alphaFrames[0], source, blur, output);
+        return premultiplied(graph.processBatch(source, alphaFrames, blur)[0]);
+    }, [&]() {
+        NodeGraph graph;
+        Node* source = nullptr;
+        Node* blur = nullptr;
+        Node* output = nullptr;
+        alphaGraph(graph, alphaFrames[0], source, blur, output);
+        std::vector<cv::Mat> outputs;
+        for (const cv::Mat& frame : alphaFrames) {
+            source->setOutputImage(0, frame);
+            graph.processGraph();
+            outputs.push_back(static_cast<ImageOutputNode*>(output)->getOutputImage().clone());
+        }
+        return premultiplied(outputs);
+    });
+
+    harness.crossCheck("cross/group", Tolerance(), [&]() {
+        auto definition = std::make_shared<GroupDefinition>("Regression Chain");
+        int previous = GroupDefinition::kGroupInput;
+        int previousPort = definition->addInput("Input");
+        for (const char* type : {"Blur", "Brightness/Contrast", "Threshold"}) {
+            const int member = definition->addMember(type, [](Node& node) {
+                if (node.parameterPort("Contrast") >= 0) {
+                    node.setParameter("Contrast", 1.3);
+                }
+            });
+            definition->connect(previous, previousPort, member, 0);
+            previous = member;
+            previousPort = 1;
+        }
+        definition->addOutput("Output", previous, 1);
+        NodeGraph graph;
+        graph.setResultCache(nullptr);
+        auto* source = new MatSourceNode(bgr);
+        auto* group = new GroupNode(definition);
+        auto* output = new ImageOutputNode();
+        graph.addNode(source);
+        graph.addNode(group);
+        graph.addNode(output);
+        graph.connectNodes(source, 0, group, 0);
+        graph.connectNodes(group, 1, output, 0);
+        graph.processGraph();
+        return std::vector<cv::Mat>{output->getOutputImage()};
+    }, [&]() {
+        NodeGraph graph;
+        graph.setResultCache(nullptr);
+        auto* source = new MatSourceNode(bgr);
+        auto* adjust = new BrightnessContrastNode();
+        auto* blur = new BlurNode();
+        auto* threshold = new ThresholdNode();
+        auto* output = new ImageOutputNode();
+        adjust->setContrast(1.3f);
+        for (Node* node : std::initializer_list<Node*>{source, blur, adjust, threshold, output}) {
+            graph.addNode(node);
+        }
+        graph.connectNodes(source, 0, blur, 0);
+        graph.connectNodes(blur, 1, adjust, 0);
+        graph.connectNodes(adjust, 1, threshold, 0);
+        graph.connectNodes(threshold, 1, output, 0);
+        graph.processGraph();
+        return std::vector<cv::Mat>{output->getOutputImage()};
+    });
+
+    // Grouping existing nodes keeps state that is not a parameter: the
+    // convolution kernel and a third composite layer with its connection
+    auto captureGraph = [](NodeGraph& graph, const cv::Mat& input, std::vector<Node*>& grouped) {
+        graph.setResultCache(nullptr);
+        auto* source = new MatSourceNode(input);
+        auto* sharpen = new ConvolutionFilterNode();
+        auto* composite = new CompositeNode();
+        auto* output = new ImageOutputNode();
+        sharpen->setPreset(1);
+        sharpen->setKernelValue(0, 0, 0.5f);
+        composite->setLayerCount(3);
+        composite->setLayerMode(2, BlendMode::Multiply);
+        for (Node* node : std::initializer_list<Node*>{source, sharpen, composite, output}) {
+            graph.addNode(node);
+        }
+        graph.connectNodes(source, 0, sharpen, 0);
+        graph.connectNodes(sharpen, 1, composite, 1);
+        graph.connectNodes(source, 0, composite, 5);
+        graph.connectNodes(composite, 0, output, 0);
+        grouped = {sharpen, composite};
+        return output;
+    };
+    harness.crossCheck("cross/group-capture", Tolerance(), [&]() {
+        NodeGraph graph;
+        std::vector<Node*> grouped;
+        auto* output = captureGraph(graph, bgr, grouped);
+        const bool created = graph.groupNodes(grouped, "Regression Capture") != nullptr;
+        graph.processGraph();
+        return std::vector<cv::Mat>{output->getOutputImage(), cv::Mat(1, 1, CV_64F, cv::Scalar(created ? 1.0 : 0.0))};
+    }, [&]() {
+        NodeGraph graph;
+        std::vector<Node*> grouped;
+        auto* output = captureGraph(graph, bgr, grouped);
+        graph.processGraph();
+        return std::vector<cv::Mat>{output->getOutputImage(), cv::Mat(1, 1, CV_64F, cv::Scalar(1.0))};
+    });
+
+    harness.crossCheck("cross/sweep", Tolerance(), [&]() {
+        NodeGraph graph;
+        graph.setResultCache(nullptr);
+        auto* source = new MatSourceNode(gray);
+        auto* threshold = new ThresholdNode();
+        graph.addNode(source);
+        graph.addNode(threshold);
+        graph.connectNodes(source, 0, threshold, 0);
+        std::vector<cv::Mat> outputs;
+        for (const auto& result : graph.sweep(threshold, "Threshold", {40, 120, 200}, threshold)) {
+            outputs.push_back(result[0]);
+        }
+        return outputs;
+    }, [&]() {
+        std::vector<cv::Mat> outputs;
+        for (int level : {40, 120, 200}) {
+            cv::Mat output;
+            cv::threshold(gray, output, level, 255, cv::THRESH_BINARY);
+            outputs.push_back(output);
+        }
+        return outputs;
+    });
+
+    harness.crossCheck("cross/overlay", {1.0, 50.0}, [&]() {
+        NodeGraph graph;
+        graph.setResultCache(nullptr);
+        auto* base = new MatSourceNode(bgr);
+        auto* layer = new MatSourceNode(bgrOther);
+        auto* blend = new BlendNode();
+        auto* output = new ImageOutputNode();
+        for (Node* node : std::initializer_list<Node*>{base, layer, blend, output}) {
+            graph.addNode(node);
+        }
+        blend->setBlendMode(static_cast<int>(BlendMode::Overlay));
+        blend->setOpacity(0.75f);
+        graph.connectNodes(base, 0, blend, 0);
+        graph.connectNodes(layer, 0, blend, 1);
+        graph.connectNodes(blend, 2, output, 0);
+        graph.processGraph();
+        return std::vector<cv::Mat>{output->getOutputImage()};
+    }, [&]() { return referenceOverlay(bgr, bgrOther, 0.75f); });
+
+    // 16-bit linear inputs are matched to 8-bit at full scale, not clipped
+    harness.crossCheck("cross/linear-blend", {1.0, 50.0}, [&]() {
+        NodeGraph graph;
+        graph.setResultCache(nullptr);
+        auto* base = new MatSourceNode(bgr);
+        auto* layer = new MatSourceNode(bgrOther);
+        auto* baseLinear = new ColorSpaceNode();
+        auto* layerLinear = new ColorSpaceNode();
+        auto* blend = new BlendNode();
+        auto* output = new ImageOutputNode();
+        for (Node* node : std::initializer_list<Node*>{base, layer, baseLinear, layerLinear, blend, output}) {
+            graph.addNode(node);
+        }
+        blend->setOpacity(0.5f);
+        graph.connectNodes(base, 0, baseLinear, 0);
+        graph.connectNodes(layer, 0, layerLinear, 0);
+        graph.connectNodes(baseLinear, 1, blend, 0);
+        graph.connectNodes(layerLinear, 1, blend, 1);
+        graph.connectNodes(blend, 2, output, 0);
+        graph.processGraph();
+        return std::vector<cv::Mat>{output->getOutputImage()};
+    }, [&]() {
+        cv::Mat baseLinear, layerLinear, blended;
+        convertColorSpace(bgr, baseLinear, ColorSpace::SRGB, ColorSpace::Linear);
+        convertColorSpace(bgrOther, layerLinear, ColorSpace::SRGB, ColorSpace::Linear);
+        baseLinear.convertTo(baseLinear, CV_8U, 1.0 / 257.0);
+        layerLinear.convertTo(layerLinear, CV_8U, 1.0 / 257.0);
+        cv::addWeighted(baseLinear, 0.5, layerLinear, 0.5, 0.0, blended);
+        return std::vector<cv::Mat>{blended};
+    });
+
+    // An sRGB layer is converted to a Linear base's space before blending
+    harness.crossCheck("cross/mixed-space-blend", {1.0, 50.0}, [&]() {
+        NodeGraph graph;
+        graph.setResultCache(nullptr);
+        auto* base = new MatSourceNode(bgr);
+        auto* layer = new MatSourceNode(bgrOther);
+        auto* baseLinear = new ColorSpaceNode();
+        auto* blend = new BlendNode();
+        auto* output = new ImageOutputNode();
+        for (Node* node : std::initializer_list<Node*>{base, layer, baseLinear, blend, output}) {
+            graph.addNode(node);
+        }
+        blend->setOpacity(0.5f);
+        graph.connectNodes(base, 0, baseLinear, 0);
+        graph.connectNodes(baseLinear, 1, blend, 0);
+        graph.connectNodes(layer, 0, blend, 1);
+        graph.connectNodes(blend, 2, output, 0);
+        graph.processGraph();
+        return std::vector<cv::Mat>{output->getOutputImage()};
+    }, [&]() {
+        cv::Mat baseLinear, layerLinear, blended;
+        convertColorSpace(bgr, baseLinear, ColorSpace::SRGB, ColorSpace::Linear);
+        convertColorSpace(bgrOther, layerLinear, ColorSpace::SRGB, ColorSpace::Linear);
+        baseLinear.convertTo(baseLinear, CV_8U, 1.0 / 257.0);
+        layerLinear.convertTo(layerLinear, CV_8U, 1.0 / 257.0);
+        cv::addWeighted(baseLinear, 0.5, layerLinear, 0.5, 0.0, blended);
+        return std::vector<cv::Mat>{blended};
+    });
+
+    // 16-bit images: brightness in 8-bit steps with alpha untouched, and the
+    // threshold level on the 8-bit scale
+    const cv::Mat bgra = testInput(4);
+    cv::Mat bgra16, gray16;
+    bgra.convertTo(bgra16, CV_16U, 257.0);
+    gray.convertTo(gray16, CV_16U, 257.0);
+    harness.crossCheck("cross/16bit-adjust", {1.0, 50.0}, [&]() {
+        std::vector<cv::Mat> outputs = runNode("Brightness/Contrast", bgra16, [](Node& node) {
+            static_cast<BrightnessContrastNode&>(node).setBrightness(20);
+            static_cast<BrightnessContrastNode&>(node).setContrast(1.2f);
+        });
+        for (const cv::Mat& image : runNode("Threshold", gray16)) {
+            outputs.push_back(image);
+        }
+        return outputs;
+    }, [&]() {
+        cv::Mat adjusted;
+        bgra16.convertTo(adjusted, -1, 1.2, 20.0 * 257.0);
+        const int alpha[] = {3, 3};
+        cv::mixChannels(&bgra16, 1, &adjusted, 1, alpha, 1);
+        cv::Mat mask;
+        cv::threshold(gray, mask, 127, 255, cv::THRESH_BINARY);
+        return std::vector<cv::Mat>{adjusted, mask};
+    });
+
+    harness.crossCheck("cross/sobel", {1.0, 50.0}, [&]() { return runNode("Edge Detection", gray); },
+                       [&]() { return referenceSobel(gray); });
+
+    // Constant-time kernels against OpenCV's direct ones
+    harness.crossCheck("cross/erode-rect", Tolerance(), [&]() {
+        return runNode("Morphology", gray, [](Node& node) {
+            node.setParameter("Operation", MorphologyNode::Erode);
+            node.setParameter("Radius", 6);
+        });
+    }, [&]() {
+        cv::Mat output;
+        cv::erode(gray, output, cv::getStructuringElement(cv::MORPH_RECT, cv::Size(13, 13)));
+        return std::vector<cv::Mat>{output};
+    });
+
+    // Every instruction-set variant of the dispatched kernels against the portable one
+    auto dispatchedNodes = [&]() {
+        std::vector<cv::Mat> outputs;
+        auto append = [&outputs](const std::vector<cv::Mat>& images) {
+            outputs.insert(outputs.end(), images.begin(), images.end());
+        };
+        append(runNode("Brightness/Contrast", bgra, [](Node& node) {
+            node.setParameter("Brightness", 12);
+            node.setParameter("Contrast", 1.3);
+        }));
+        append(runNode("Blend", bgr, [](Node& node) { node.setParameter("Mode", static_cast<int>(BlendMode::Overlay)); }));
+        append(runNode("Convolution Filter", bgr, [](Node& node) { static_cast<ConvolutionFilterNode&>(node).setPreset(1); }));
+        append(runNode("Channel Splitter", bgra));
+        append(runNode("Noise Generator", bgr));
+        return outputs;
+    };
+    const CpuLevel active = activeCpuLevel();
+    for (int level = static_cast<int>(CpuLevel::SSE4); level <= static_cast<int>(detectedCpuLevel()); ++level) {
+        harness.crossCheck(std::string("cross/dispatch-") + cpuLevelName(static_cast<CpuLevel>(level)), {1.0, 50.0}, [&]() {
+            setCpuLevel(static_cast<CpuLevel>(level));
+            std::vector<cv::Mat> outputs = dispatchedNodes();
+            setCpuLevel(active);
+            return outputs;
+        }, [&]() {
+            setCpuLevel(CpuLevel::Baseline);
+            std::vector<cv::Mat> outputs = dispatchedNodes();
+            setCpuLevel(active);
+            return outputs;
+        });
+    }
+
+    // Each dispatched kernel at every level against the OpenCV or scalar code
+    // it replaced, so a shared mistake in KernelsImpl.inl cannot pass
+    auto atEveryLevel = [active](const std::function<std::vector<cv::Mat>()>& run) {
+        std::vector<cv::Mat> outputs;
+        for (int level = static_cast<int>(CpuLevel::Baseline); level <= static_cast<int>(detectedCpuLevel()); ++level) {
+            setCpuLevel(static_cast<CpuLevel>(level));
+            const std::vector<cv::Mat> images = run();
+            outputs.insert(outputs.end(), images.begin(), images.end());
+        }
+        setCpuLevel(active);
+        return outputs;
+    };
+    auto repeated = [](const std::vector<cv::Mat>& images) {
+        std::vector<cv::Mat> outputs;
+        for (int level = static_cast<int>(CpuLevel::Baseline); level <= static_cast<int>(detectedCpuLevel()); ++level) {
+            outputs.insert(outputs.end(), images.begin(), images.end());
+        }
+        return outputs;
+    };
+    ConvolutionFilterNode sharpen;
+    sharpen.setPreset(1);
+    const cv::Mat sharpenKernel = sharpen.kernelMatrix();
+    harness.crossCheck("cross/convolve-filter2d", {1.0, 50.0}, [&]() {
+        return atEveryLevel([&]() {
+            return runNode("Convolution Filter", bgr, [](Node& node) { static_cast<ConvolutionFilterNode&>(node).setPreset(1); });
+        });
+    }, [&]() {
+        cv::Mat output;
+        cv::filter2D(bgr, output, -1, sharpenKernel, cv::Point(-1, -1), 0, cv::BORDER_DEFAULT);
+        return repeated({output});
+    });
+    harness.crossCheck("cross/lut-opencv", Tolerance(), [&]() {
+        return atEveryLevel([&]() {
+            std::vector<cv::Mat> outputs;
+            for (const cv::Mat& input : {bgr, bgra}) {
+                const std::vector<cv::Mat> images = runNode("Brightness/Contrast", input, [](Node& node) {
+                    node.setParameter("Brightness", 12);
+                    node.setParameter("Contrast", 1.3);
+                });
+                outputs.insert(outputs.end(), images.begin(), images.end());
+            }
+            return outputs;
+        });
+    }, [&]() {
+        std::vector<cv::Mat> outputs = referenceBrightnessContrast(bgr, 12, 1.3f);
+        outputs.push_back(referenceBrightnessContrast(bgra, 12, 1.3f)[0]);
+        return repeated(outputs);
+    });
+    harness.crossCheck("cross/noise-sin", {1.0, 50.0}, [&]() {
+        return atEveryLevel([&]() {
+            std::vector<cv::Mat> outputs;
+            for (int type = NoiseGenerationNode::Perlin; type <= NoiseGenerationNode::Worley; ++type) {
+                const std::vector<cv::Mat> images = runNode("Noise Generator", bgr, [type](Node& node) {
+                    node.setParameter("Type", type);
+                });
+                outputs.insert(outputs.end(), images.begin(), images.end());
+            }
+            return outputs;
+        });
+    }, [&]() {
+        NoiseGenerationNode defaults;
+        std::vector<cv::Mat> outputs;
+        for (int type = NoiseGenerationNode::Perlin; type <= NoiseGenerationNode::Worley; ++type) {
+            outputs.push_back(referenceNoise(type, static_cast<float>(defaults.parameter("Scale")),
+                                             cvRound(defaults.parameter("Octaves")),
+                                             static_cast<float>(defaults.parameter("Persistence")))[0]);
+        }
+        return repeated(outputs);
+    });
+
+    harness.crossCheck("cross/median", Tolerance(), [&]() {
+        return runNode("Median", bgr, [](Node& node) { node.setParameter("Radius", 4); });
+    }, [&]() {
+        cv::Mat output;
+        cv::medianBlur(bgr, output, 9);
+        return std::vector<cv::Mat>{output};
+    });
+
+    // Scaling by 257 keeps the order, so the 16-bit median is the 8-bit one scaled
+    cv::Mat bgr16;
+    bgr.convertTo(bgr16, CV_16U, 257.0);
+    harness.crossCheck("cross/median-16bit", Tolerance(), [&]() {
+        return runNode("Median", bgr16, [](Node& node) { node.setParameter("Radius", 20); });
+    }, [&]() {
+        cv::Mat output;
+        cv::medianBlur(bgr, output, 41);
+        output.convertTo(output, CV_16U, 257.0);
+        return std::vector<cv::Mat>{output};
+    });
+
+    // 16-bit statistics are reported on the 8-bit scale
+    harness.crossCheck("cross/statistics-16bit", Tolerance(), [&]() { return runNode("Statistics", bgr16); },
+                       [&]() { return runNode("Statistics", bgr); });
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    // NodeGraph is a QGraphicsScene and needs an application object, but no display
+    qputenv("QT_QPA_PLATFORM", "offscreen");
+    QApplication app(argc, argv);
+
+    Harness harness;
+    std::string reportPath;
+    for (int i = 1; i < argc; ++i) {
+        const std::string argument = argv[i];
+        if (argument == "--golden" && i + 1 < argc) {
+            harness.goldenDirectory = argv[++i];
+            harness.updateDirectory = harness.goldenDirectory;
+        } else if (argument == "--report" && i + 1 < argc) {
+            reportPath = argv[++i];
+        } else if (argument == "--filter" && i + 1 < argc) {
+            harness.filter = argv[++i];
+        } else if (argument == "--update") {
+            harness.update = true;
+        } else if (argument == "--require-golden") {
+            harness.requireGolden = true;
+        } else {
+            std::fprintf(stderr, "usage: %s [--golden DIR] [--update] [--require-golden] [--report FILE] [--filter TEXT]\n",
+                         argv[0]);
+            return 2;
+        }
+    }
+
+    const bool unrecorded = !harness.update && !harness.hasGoldens();
+    if (unrecorded) {
+        std::printf("No goldens in %s; build the update_goldens target and copy its output there. "
+                    "Golden cases are skipped.\n", harness.goldenDirectory.c_str());
+        harness.requireGolden = false;
+    }
+    goldenCases(harness);
+    crossChecks(harness);
+    if (!reportPath.empty() && !harness.writeReport(reportPath)) {
+        std::fprintf(stderr, "Cannot write %s\n", reportPath.c_str());
+        return 1;
+    }
+    std::printf("%zu cases, %d failed\n", harness.caseCount(), harness.failures());
+    if (harness.failures() != 0) {
+        return 1;
+    }
+    return unrecorded ? kSkipped : 0;
+}